@@ -44,6 +44,8 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include "aes_ct.h"
+#include "aes_ni.h"
 
 /* define if you have fast 32-bit types on your system */
 #if ( __CORTEX_M != 0 ) // if Cortex is different from M0/M0+
@@ -556,6 +558,9 @@ return_type aes_set_key( const uint8_t key[], length_type keylen, aes_context ct
         ctx->ksch[cc + 2] = ctx->ksch[tt + 2] ^ t2;
         ctx->ksch[cc + 3] = ctx->ksch[tt + 3] ^ t3;
     }
+#if defined( AES_CT )
+    aes_ct_set_key( ctx );
+#endif
     return 0;
 }
 
@@ -566,6 +571,27 @@ return_type aes_set_key( const uint8_t key[], length_type keylen, aes_context ct
 /*  Encrypt a single block of 16 bytes */
 
 return_type aes_encrypt( const uint8_t in[N_BLOCK], uint8_t  out[N_BLOCK], const aes_context ctx[1] )
+{
+#if defined( AES_NI )
+    if( ctx->rnd && aes_ni_available() )
+    {
+        aes_ni_encrypt_blocks( in, out, 1, &ctx, 0 );
+        return 0;
+    }
+#endif
+#if defined( AES_CT )
+    if( ctx->rnd )
+    {
+        aes_ct_encrypt_blocks( in, out, 1, &ctx, 0 );
+        return 0;
+    }
+#endif
+    return aes_encrypt_table( in, out, ctx );
+}
+
+/*  Encrypt a single block of 16 bytes with the byte oriented code */
+
+return_type aes_encrypt_table( const uint8_t in[N_BLOCK], uint8_t  out[N_BLOCK], const aes_context ctx[1] )
 {
     if( ctx->rnd )
     {
@@ -611,6 +637,61 @@ return_type aes_cbc_encrypt( const uint8_t *in, uint8_t *out,
     return EXIT_SUCCESS;
 }
 
+/* Encrypt a number of independent blocks with one key */
+
+return_type aes_encrypt_blocks( const uint8_t *in, uint8_t *out,
+                         uint32_t n_block, const aes_context ctx[1] )
+{
+    if( !ctx->rnd )
+        return ( uint8_t )-1;
+#if defined( AES_NI )
+    if( aes_ni_available() )
+    {
+        aes_ni_encrypt_blocks( in, out, n_block, &ctx, 0 );
+        return 0;
+    }
+#endif
+#if defined( AES_CT )
+    aes_ct_encrypt_blocks( in, out, n_block, &ctx, 0 );
+    return 0;
+#endif
+    while(n_block--)
+    {
+        aes_encrypt(in, out, ctx);
+        in += N_BLOCK;
+        out += N_BLOCK;
+    }
+    return 0;
+}
+
+/* Encrypt a number of independent blocks, block i with the key ctx[i] */
+
+return_type aes_encrypt_blocks_keyed( const uint8_t *in, uint8_t *out,
+                         uint32_t n_block, const aes_context *const ctx[] )
+{
+    uint32_t i;
+
+    /* the AES-NI path needs one key size for all the blocks */
+    for( i = 0; i < n_block; ++i )
+        if( !ctx[i]->rnd || ctx[i]->rnd != ctx[0]->rnd )
+            return ( uint8_t )-1;
+#if defined( AES_NI )
+    if( n_block && aes_ni_available() )
+    {
+        aes_ni_encrypt_blocks( in, out, n_block, ctx, 1 );
+        return 0;
+    }
+#endif
+#if defined( AES_CT )
+    if( n_block )
+        aes_ct_encrypt_blocks( in, out, n_block, ctx, 1 );
+    return 0;
+#endif
+    for( i = 0; i < n_block; ++i )
+        aes_encrypt(in + i * N_BLOCK, out + i * N_BLOCK, ctx[i]);
+    return 0;
+}
+
 #endif
 
 #if defined( AES_DEC_PREKEYED )
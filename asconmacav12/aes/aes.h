@@ -52,6 +52,13 @@
 #  define AES_DEC_256_OTFK  /* AES decryption with 'on the fly' 256 bit keying */
 #endif
 
+#if 1
+#  define AES_CT            /* constant-time bitsliced encryption (aes_ct.c)   */
+#endif
+#if defined( __x86_64__ ) || defined( __i386__ )
+#  define AES_NI            /* AES-NI encryption selected at runtime (aes_ni.c) */
+#endif
+
 #define N_ROW                   4
 #define N_COL                   4
 #define N_BLOCK   (N_ROW * N_COL)
@@ -68,6 +75,9 @@ typedef uint8_t length_type;
 typedef struct
 {   uint8_t ksch[(N_MAX_ROUNDS + 1) * N_BLOCK];
     uint8_t rnd;
+#if defined( AES_CT )
+    uint16_t ct_ksch[(N_MAX_ROUNDS + 1) * 8];   /* bitsliced ksch, see aes_ct.c */
+#endif
 } aes_context;
 
 /*  The following calls are for a precomputed key schedule
@@ -91,11 +101,36 @@ return_type aes_encrypt( const uint8_t in[N_BLOCK],
                          uint8_t out[N_BLOCK],
                          const aes_context ctx[1] );
 
+/*  aes_encrypt without the AES-NI and bitsliced backends, the reference
+    they are checked against (make check)
+*/
+return_type aes_encrypt_table( const uint8_t in[N_BLOCK],
+                         uint8_t out[N_BLOCK],
+                         const aes_context ctx[1] );
+
 return_type aes_cbc_encrypt( const uint8_t *in,
                          uint8_t *out,
                          int32_t n_block,
                          uint8_t iv[N_BLOCK],
                          const aes_context ctx[1] );
+
+/*  Encrypt n_block independent blocks of 16 bytes (e.g the A_i counter
+    blocks of a LoRaWAN FRMPayload), pipelined with AES-NI when available,
+    otherwise 8 blocks at a time with the bitsliced code.
+    aes_encrypt_blocks_keyed encrypts block i with ctx[i] so the blocks of
+    a whole batch of frames can go in one call (all the keys must have
+    the same size)
+*/
+
+return_type aes_encrypt_blocks( const uint8_t *in,
+                         uint8_t *out,
+                         uint32_t n_block,
+                         const aes_context ctx[1] );
+
+return_type aes_encrypt_blocks_keyed( const uint8_t *in,
+                         uint8_t *out,
+                         uint32_t n_block,
+                         const aes_context *const ctx[] );
 #endif
 
 #if defined( AES_DEC_PREKEYED )
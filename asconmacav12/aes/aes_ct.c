@@ -0,0 +1,391 @@
+/*
+ Constant-time bitsliced AES encryption, see aes_ct.h
+
+ Bitsliced layout: a group of 4 blocks is held in q[8], q[b] holds bit b of
+ every byte, bit 16 * k + i of q[b] belongs to byte i of block k. Byte i of a
+ block is the state byte of row i % 4 and column i / 4, as in aes.c.
+ */
+
+#include <string.h>
+
+#include "aes_ct.h"
+
+#if defined( AES_CT )
+
+#define AES_CT_GROUP    4   /* blocks in one bitsliced group */
+#define AES_CT_LANES    8   /* blocks per iteration, 2 groups */
+
+/* masks replicated over the 4 blocks of a group */
+#define REP16(x)        (( uint64_t )( x ) * 0x0001000100010001ULL)
+#define REP4(x)         (( uint64_t )( x ) * 0x1111111111111111ULL)
+
+/*  8x8 bit matrix transpose, byte j bit b <-> byte b bit j */
+
+static inline uint64_t transpose8( uint64_t x )
+{
+    uint64_t t;
+
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+    x ^= t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+    x ^= t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+    x ^= t ^ (t << 28);
+    return x;
+}
+
+static inline uint64_t load64_le( const uint8_t *p )
+{
+    return ( uint64_t )p[0] | (( uint64_t )p[1] << 8) | (( uint64_t )p[2] << 16)
+         | (( uint64_t )p[3] << 24) | (( uint64_t )p[4] << 32) | (( uint64_t )p[5] << 40)
+         | (( uint64_t )p[6] << 48) | (( uint64_t )p[7] << 56);
+}
+
+static inline void store64_le( uint8_t *p, uint64_t x )
+{
+    uint8_t i;
+
+    for( i = 0; i < 8; ++i )
+        p[i] = ( uint8_t )(x >> (8 * i));
+}
+
+/*  Bitslice 4 blocks of 16 bytes */
+
+static void ortho_in( uint64_t q[8], const uint8_t *in )
+{
+    uint8_t k, h, b;
+
+    memset( q, 0, 8 * sizeof( uint64_t ) );
+    for( k = 0; k < AES_CT_GROUP; ++k )
+        for( h = 0; h < 2; ++h )
+        {
+            uint64_t x = transpose8( load64_le( in + k * N_BLOCK + h * 8 ) );
+
+            for( b = 0; b < 8; ++b )
+                q[b] |= ((x >> (8 * b)) & 0xFF) << (16 * k + 8 * h);
+        }
+}
+
+static void ortho_out( uint8_t *out, const uint64_t q[8], uint8_t n )
+{
+    uint8_t k, h, b;
+
+    for( k = 0; k < n; ++k )
+        for( h = 0; h < 2; ++h )
+        {
+            uint64_t x = 0;
+
+            for( b = 0; b < 8; ++b )
+                x |= ((q[b] >> (16 * k + 8 * h)) & 0xFF) << (8 * b);
+            store64_le( out + k * N_BLOCK + h * 8, transpose8( x ) );
+        }
+}
+
+/*  S-box circuit of Boyar and Peralta, q[7] is the most significant bit */
+
+static void sub_bytes( uint64_t q[8] )
+{
+    uint64_t x0, x1, x2, x3, x4, x5, x6, x7;
+    uint64_t y1, y2, y3, y4, y5, y6, y7, y8, y9;
+    uint64_t y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+    uint64_t y20, y21;
+    uint64_t z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+    uint64_t z10, z11, z12, z13, z14, z15, z16, z17;
+    uint64_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+    uint64_t t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+    uint64_t t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+    uint64_t t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+    uint64_t t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+    uint64_t t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+    uint64_t t60, t61, t62, t63, t64, t65, t66, t67;
+    uint64_t s0, s1, s2, s3, s4, s5, s6, s7;
+
+    x0 = q[7];
+    x1 = q[6];
+    x2 = q[5];
+    x3 = q[4];
+    x4 = q[3];
+    x5 = q[2];
+    x6 = q[1];
+    x7 = q[0];
+
+    /* top linear transformation */
+    y14 = x3 ^ x5;
+    y13 = x0 ^ x6;
+    y9 = x0 ^ x3;
+    y8 = x0 ^ x5;
+    t0 = x1 ^ x2;
+    y1 = t0 ^ x7;
+    y4 = y1 ^ x3;
+    y12 = y13 ^ y14;
+    y2 = y1 ^ x0;
+    y5 = y1 ^ x6;
+    y3 = y5 ^ y8;
+    t1 = x4 ^ y12;
+    y15 = t1 ^ x5;
+    y20 = t1 ^ x1;
+    y6 = y15 ^ x7;
+    y10 = y15 ^ t0;
+    y11 = y20 ^ y9;
+    y7 = x7 ^ y11;
+    y17 = y10 ^ y11;
+    y19 = y10 ^ y8;
+    y16 = t0 ^ y11;
+    y21 = y13 ^ y16;
+    y18 = x0 ^ y16;
+
+    /* non-linear section, inversion in GF(2^8) */
+    t2 = y12 & y15;
+    t3 = y3 & y6;
+    t4 = t3 ^ t2;
+    t5 = y4 & x7;
+    t6 = t5 ^ t2;
+    t7 = y13 & y16;
+    t8 = y5 & y1;
+    t9 = t8 ^ t7;
+    t10 = y2 & y7;
+    t11 = t10 ^ t7;
+    t12 = y9 & y11;
+    t13 = y14 & y17;
+    t14 = t13 ^ t12;
+    t15 = y8 & y10;
+    t16 = t15 ^ t12;
+    t17 = t4 ^ t14;
+    t18 = t6 ^ t16;
+    t19 = t9 ^ t14;
+    t20 = t11 ^ t16;
+    t21 = t17 ^ y20;
+    t22 = t18 ^ y19;
+    t23 = t19 ^ y21;
+    t24 = t20 ^ y18;
+
+    t25 = t21 ^ t22;
+    t26 = t21 & t23;
+    t27 = t24 ^ t26;
+    t28 = t25 & t27;
+    t29 = t28 ^ t22;
+    t30 = t23 ^ t24;
+    t31 = t22 ^ t26;
+    t32 = t31 & t30;
+    t33 = t32 ^ t24;
+    t34 = t23 ^ t33;
+    t35 = t27 ^ t33;
+    t36 = t24 & t35;
+    t37 = t36 ^ t34;
+    t38 = t27 ^ t36;
+    t39 = t29 & t38;
+    t40 = t25 ^ t39;
+
+    t41 = t40 ^ t37;
+    t42 = t29 ^ t33;
+    t43 = t29 ^ t40;
+    t44 = t33 ^ t37;
+    t45 = t42 ^ t41;
+    z0 = t44 & y15;
+    z1 = t37 & y6;
+    z2 = t33 & x7;
+    z3 = t43 & y16;
+    z4 = t40 & y1;
+    z5 = t29 & y7;
+    z6 = t42 & y11;
+    z7 = t45 & y17;
+    z8 = t41 & y10;
+    z9 = t44 & y12;
+    z10 = t37 & y3;
+    z11 = t33 & y4;
+    z12 = t43 & y13;
+    z13 = t40 & y5;
+    z14 = t29 & y2;
+    z15 = t42 & y9;
+    z16 = t45 & y14;
+    z17 = t41 & y8;
+
+    /* bottom linear transformation */
+    t46 = z15 ^ z16;
+    t47 = z10 ^ z11;
+    t48 = z5 ^ z13;
+    t49 = z9 ^ z10;
+    t50 = z2 ^ z12;
+    t51 = z2 ^ z5;
+    t52 = z7 ^ z8;
+    t53 = z0 ^ z3;
+    t54 = z6 ^ z7;
+    t55 = z16 ^ z17;
+    t56 = z12 ^ t48;
+    t57 = t50 ^ t53;
+    t58 = z4 ^ t46;
+    t59 = z3 ^ t54;
+    t60 = t46 ^ t57;
+    t61 = z14 ^ t57;
+    t62 = t52 ^ t58;
+    t63 = t49 ^ t58;
+    t64 = z4 ^ t59;
+    t65 = t61 ^ t62;
+    t66 = z1 ^ t63;
+    s0 = t59 ^ t63;
+    s6 = t56 ^ ~t62;
+    s7 = t48 ^ ~t60;
+    t67 = t64 ^ t65;
+    s3 = t53 ^ t66;
+    s4 = t51 ^ t66;
+    s5 = t47 ^ t65;
+    s1 = t64 ^ ~s3;
+    s2 = t55 ^ ~t67;
+
+    q[7] = s0;
+    q[6] = s1;
+    q[5] = s2;
+    q[4] = s3;
+    q[3] = s4;
+    q[2] = s5;
+    q[1] = s6;
+    q[0] = s7;
+}
+
+/*  Row r of the state moves left by r columns, i.e byte 4c + r takes byte
+    4c + r + 4r (mod 16) of the same block
+*/
+
+static void shift_rows( uint64_t q[8] )
+{
+    uint8_t b;
+
+    for( b = 0; b < 8; ++b )
+    {
+        uint64_t x = q[b];
+        uint64_t r1 = x & REP4(0x2), r2 = x & REP4(0x4), r3 = x & REP4(0x8);
+
+        q[b] = (x & REP4(0x1))
+             | ((r1 >> 4) & REP16(0x0FFF)) | ((r1 << 12) & REP16(0xF000))
+             | ((r2 >> 8) & REP16(0x00FF)) | ((r2 << 8) & REP16(0xFF00))
+             | ((r3 >> 12) & REP16(0x000F)) | ((r3 << 4) & REP16(0xFFF0));
+    }
+}
+
+/*  Byte of row r takes the byte of row r + n (mod 4) in the same column */
+
+static inline uint64_t rotate_rows( uint64_t x, uint8_t n )
+{
+    return ((x >> n) & REP4(0xF >> n)) | ((x << (4 - n)) & REP4((0xF << (4 - n)) & 0xF));
+}
+
+/*  b_r = 2 * a_r + 3 * a_r+1 + a_r+2 + a_r+3 = a_r + sum(a) + 2 * (a_r + a_r+1) */
+
+static void mix_columns( uint64_t q[8] )
+{
+    uint64_t t[8], s[8];
+    uint8_t b;
+
+    for( b = 0; b < 8; ++b )
+    {
+        uint64_t r1 = rotate_rows( q[b], 1 );
+
+        t[b] = q[b] ^ r1;
+        s[b] = r1 ^ rotate_rows( q[b], 2 ) ^ rotate_rows( q[b], 3 );
+    }
+    q[0] = s[0] ^ t[7];
+    q[1] = s[1] ^ t[0] ^ t[7];
+    q[2] = s[2] ^ t[1];
+    q[3] = s[3] ^ t[2] ^ t[7];
+    q[4] = s[4] ^ t[3] ^ t[7];
+    q[5] = s[5] ^ t[4];
+    q[6] = s[6] ^ t[5];
+    q[7] = s[7] ^ t[6];
+}
+
+static inline void add_round_key( uint64_t q[8], const uint64_t rk[8] )
+{
+    uint8_t b;
+
+    for( b = 0; b < 8; ++b )
+        q[b] ^= rk[b];
+}
+
+void aes_ct_set_key( aes_context ctx[1] )
+{
+    uint8_t r, b, i;
+
+    for( r = 0; r <= ctx->rnd; ++r )
+        for( b = 0; b < 8; ++b )
+        {
+            uint16_t x = 0;
+
+            for( i = 0; i < N_BLOCK; ++i )
+                x |= ( uint16_t )((ctx->ksch[r * N_BLOCK + i] >> b) & 1) << i;
+            ctx->ct_ksch[r * 8 + b] = x;
+        }
+}
+
+/*  Round keys of a group, block k of the group uses key[k] */
+
+static void group_round_keys( uint64_t rk[][8], const aes_context *const key[AES_CT_GROUP], uint8_t rnd )
+{
+    uint8_t r, b, k;
+
+    for( r = 0; r <= rnd; ++r )
+        for( b = 0; b < 8; ++b )
+        {
+            uint64_t x = 0;
+
+            for( k = 0; k < AES_CT_GROUP; ++k )
+                x |= ( uint64_t )key[k]->ct_ksch[r * 8 + b] << (16 * k);
+            rk[r][b] = x;
+        }
+}
+
+void aes_ct_encrypt_blocks( const uint8_t *in, uint8_t *out, uint32_t n_block,
+                            const aes_context *const ctx[], uint32_t ctx_step )
+{
+    uint64_t rk[2][N_MAX_ROUNDS + 1][8];
+    uint64_t q[2][8];
+    uint8_t rnd = ctx[0]->rnd;
+    uint32_t i;
+    uint8_t r, g;
+
+    for( i = 0; i < n_block; i += AES_CT_LANES )
+    {
+        uint8_t n = n_block - i < AES_CT_LANES ? n_block - i : AES_CT_LANES;
+        uint8_t groups = (n + AES_CT_GROUP - 1) / AES_CT_GROUP;
+        uint8_t buf[AES_CT_LANES * N_BLOCK] = {0};
+
+        /* the round keys only change between iterations with one key per block */
+        if( i == 0 || ctx_step )
+            for( g = 0; g < groups; ++g )
+            {
+                const aes_context *key[AES_CT_GROUP];
+                uint8_t k;
+
+                for( k = 0; k < AES_CT_GROUP; ++k )
+                {
+                    uint8_t lane = g * AES_CT_GROUP + k < n ? g * AES_CT_GROUP + k : 0;
+                    key[k] = ctx[(i + lane) * ctx_step];
+                }
+                group_round_keys( rk[g], key, rnd );
+            }
+
+        memcpy( buf, in + i * N_BLOCK, n * N_BLOCK );
+        for( g = 0; g < groups; ++g )
+        {
+            ortho_in( q[g], buf + g * AES_CT_GROUP * N_BLOCK );
+            add_round_key( q[g], rk[g][0] );
+        }
+        for( r = 1; r < rnd; ++r )
+            for( g = 0; g < groups; ++g )
+            {
+                sub_bytes( q[g] );
+                shift_rows( q[g] );
+                mix_columns( q[g] );
+                add_round_key( q[g], rk[g][r] );
+            }
+        for( g = 0; g < groups; ++g )
+        {
+            sub_bytes( q[g] );
+            shift_rows( q[g] );
+            add_round_key( q[g], rk[g][rnd] );
+            ortho_out( buf + g * AES_CT_GROUP * N_BLOCK, q[g], AES_CT_GROUP );
+        }
+        memcpy( out + i * N_BLOCK, buf, n * N_BLOCK );
+    }
+}
+
+#endif
@@ -0,0 +1,34 @@
+/*
+ Constant-time bitsliced AES encryption for CPUs without AES instructions
+
+ Only 64-bit integer logic is used (no table lookups and no secret dependent
+ branches), so the timing does not depend on the key or the data. Each bit
+ of the state is held in its own 64-bit word for 4 blocks, and two groups of
+ 4 blocks are run side by side, so 8 blocks are encrypted for the price of
+ one S-box circuit per round and group.
+ */
+
+#ifndef AES_CT_H
+#define AES_CT_H
+
+#include <stdint.h>
+
+#include "aes.h"
+
+#if defined( AES_CT )
+
+/*  Bitslice the round keys of ctx->ksch into ctx->ct_ksch, called by
+    aes_set_key
+*/
+void aes_ct_set_key( aes_context ctx[1] );
+
+/*  Encrypt n_block blocks of 16 bytes, block i with the key ctx[i * ctx_step]
+    (a ctx_step of 0 encrypts all blocks with ctx[0]). All the keys must have
+    the same number of rounds
+*/
+void aes_ct_encrypt_blocks( const uint8_t *in, uint8_t *out, uint32_t n_block,
+                            const aes_context *const ctx[], uint32_t ctx_step );
+
+#endif
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ AES-NI backend for the pre-keyed AES encryption in aes.c, see aes_ni.h
+ */
+
+#include "aes_ni.h"
+
+#if defined( AES_NI )
+
+#include <immintrin.h>
+
+#define AESNI __attribute__((target("aes,sse2")))
+
+#define AES_NI_LANES 8
+
+int aes_ni_available( void )
+{
+    static int available = -1;
+
+    if( available < 0 )
+    {
+        __builtin_cpu_init();
+        available = __builtin_cpu_supports("aes") && __builtin_cpu_supports("sse2");
+    }
+    return available;
+}
+
+static inline const __m128i *round_keys( const aes_context *ctx )
+{
+    return ( const __m128i * )ctx->ksch;
+}
+
+/*  Encrypt up to AES_NI_LANES blocks, interleaving the rounds so the AESENC
+    latency of one block is hidden behind the others. All the keys of a call
+    have the same number of rounds (the LoRaWAN keys are all AES-128)
+*/
+AESNI static inline void aes_ni_encrypt_lanes( const uint8_t *in, uint8_t *out, uint32_t n,
+                                        const aes_context *const ctx[], uint32_t ctx_step )
+{
+    const __m128i *k[AES_NI_LANES];
+    __m128i s[AES_NI_LANES];
+    uint8_t rnd = ctx[0]->rnd, r;
+    uint32_t i;
+
+    for( i = 0; i < n; ++i )
+    {
+        k[i] = round_keys( ctx[i * ctx_step] );
+        s[i] = _mm_xor_si128( _mm_loadu_si128( ( const __m128i * )( in + i * N_BLOCK ) ),
+                              _mm_loadu_si128( k[i] ) );
+    }
+    for( r = 1; r < rnd; ++r )
+        for( i = 0; i < n; ++i )
+            s[i] = _mm_aesenc_si128( s[i], _mm_loadu_si128( k[i] + r ) );
+    for( i = 0; i < n; ++i )
+        _mm_storeu_si128( ( __m128i * )( out + i * N_BLOCK ),
+                          _mm_aesenclast_si128( s[i], _mm_loadu_si128( k[i] + rnd ) ) );
+}
+
+AESNI void aes_ni_encrypt_blocks( const uint8_t *in, uint8_t *out, uint32_t n_block,
+                                  const aes_context *const ctx[], uint32_t ctx_step )
+{
+    /* full groups with a constant lane count so the state stays in registers */
+    for( ; n_block >= AES_NI_LANES; n_block -= AES_NI_LANES )
+    {
+        aes_ni_encrypt_lanes( in, out, AES_NI_LANES, ctx, ctx_step );
+        in += AES_NI_LANES * N_BLOCK;
+        out += AES_NI_LANES * N_BLOCK;
+        ctx += AES_NI_LANES * ctx_step;
+    }
+    if( n_block )
+        aes_ni_encrypt_lanes( in, out, n_block, ctx, ctx_step );
+}
+
+#endif
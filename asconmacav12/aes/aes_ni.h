@@ -0,0 +1,29 @@
+/*
+ AES-NI backend for the pre-keyed AES encryption in aes.c
+
+ The round keys are the ones expanded by aes_set_key (aes_context.ksch holds
+ them in the byte order AESENC expects), so a context can be used by either
+ implementation. Only call the encryption when aes_ni_available() is true.
+ */
+
+#ifndef AES_NI_H
+#define AES_NI_H
+
+#include <stdint.h>
+
+#include "aes.h"
+
+#if defined( AES_NI )
+
+int aes_ni_available( void );
+
+/*  Encrypt n_block blocks of 16 bytes, 8 blocks in flight at a time.
+    Block i uses the key ctx[i * ctx_step], a ctx_step of 0 encrypts all
+    blocks with ctx[0]
+*/
+void aes_ni_encrypt_blocks( const uint8_t *in, uint8_t *out, uint32_t n_block,
+                            const aes_context *const ctx[], uint32_t ctx_step );
+
+#endif
+
+#endif
@@ -1,15 +1,26 @@
 #include <inttypes.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#define read _read
+#define write _write
+#else
+#include <unistd.h>
+#endif
+
 #include "api.h"
 #include "crypto_auth.h"
 #include "base64.h"
 #include "loramac.h"
-
-#include <time.h>
+#include "codec.h"
+#include "hist.h"
+#include "udpfe.h"
 
 #define BASE64_INPUT_DATA   argv[1]
 #define APPSKEY_INPUT_DATA  argv[2]
@@ -24,8 +35,63 @@
 
 #define DEVICES_ADDRBYTES 4
 
-static unsigned char nwskey1[CRYPTO_KEYBYTES] = { 0 };
-static unsigned char appskey1[CRYPTO_KEYBYTES] = { 0 };
+/*
+ * Server mode ('./out --serve')
+ *
+ * Request frame:  [LEN (4 bytes, LE)][ARG1 '\0' ARG2 '\0' ...]
+ * Response frame: [LEN (4 bytes, LE)][STATUS (int8)][TEXT]
+ *
+ * The arguments are the same as the one-shot command line (3 arguments for
+ * decryption, 6 for encryption, '--batch' and 3 per frame for batch
+ * decryption) and TEXT is exactly what the one-shot mode prints to stdout.
+ * Requests can be pipelined, they are answered in order.
+ */
+#define SERVE_ARG           "--serve"
+#define SERVE_MAX_ARGS      (2 + 3 * CODEC_BATCH_MAX)
+#define SERVE_FRAME_MAX     (32 * 1024)
+#define SERVE_RESPONSE_MAX  (CODEC_BATCH_MAX * 512 + 64)
+#define SERVE_IN_SIZE       (64 * 1024)
+#define SERVE_OUT_SIZE      (128 * 1024)
+/* set to time the stages of every request, reported on stderr at the end */
+#define SERVE_STAGE_TIMERS_ENV "ASCONMAC_STAGE_TIMERS"
+
+/*
+ * Batch mode ('./out --batch <base64> <appskey> <nwkskey> [...]')
+ *
+ * Decrypts up to CODEC_BATCH_MAX packages in one call and prints one line
+ * per package: <status> <payload> <DevAddr> <FCnt> <FPort> <MHDR>
+ */
+#define BATCH_ARG           "--batch"
+
+/*
+ * UDP front end mode ('./out --udpfe [port] [threads] [uring]')
+ *
+ * Terminates the Semtech packet forwarder protocol on 'port' (1700 by
+ * default) with one thread per core (threads = 0), see udpfe.h for the
+ * frames exchanged with the parent on stdin/stdout. 'uring' selects the
+ * io_uring receive loop.
+ */
+#define UDPFE_ARG           "--udpfe"
+#define UDPFE_URING_ARG     "uring"
+
+struct out_buffer {
+    char *data;
+    size_t size;
+    size_t len;
+};
+
+/*
+ * Sessions are cached by their hex keys, so a long running process (server
+ * mode) parses and expands the keys of a device only once
+ */
+#define SESSION_CACHE_SIZE  256
+
+struct session_cache_entry {
+    char keys[4 * CRYPTO_KEYBYTES + 1]; /* appskey + nwkskey hex strings */
+    struct codec_session session;
+};
+
+static struct session_cache_entry session_cache[SESSION_CACHE_SIZE];
 
 static unsigned char tag[CRYPTO_BYTES] = { 0 };
 
@@ -33,6 +99,17 @@ static unsigned char devices[DEVICES_ADDRBYTES] = { 0 };
 
 void reverse_bytes(uint8_t *bytes, size_t size);
 
+static void out_printf(struct out_buffer *out, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(out->data + out->len, out->size - out->len, format, args);
+    va_end(args);
+    if (n > 0) {
+        out->len += (size_t)n < out->size - out->len ? (size_t)n : out->size - out->len - 1;
+    }
+}
+
 // Function to convert a hex character to its decimal value (0-15)
 uint8_t hex_char_to_value(char c) {
     if (c >= '0' && c <= '9') {
@@ -48,6 +125,9 @@ uint8_t hex_char_to_value(char c) {
 // Function to convert a hex string to a uint8_t array
 int hex_string_to_byte(const char *hexString, uint8_t *byteArray, size_t arraySize) {
     size_t hexLen = strlen(hexString);
+    if (hexLen != 2 * arraySize) {
+        return -1;
+    }
 
     // Convert each pair of hex characters to a byte
     for (size_t i = 0; i < hexLen; i += 2) {
@@ -59,23 +139,48 @@ int hex_string_to_byte(const char *hexString, uint8_t *byteArray, size_t arraySi
     return 0;
 }
 
-static int32_t lora_asconmac_encrypt(char *argv[])
+// Get the session of a device from its hex keys, NULL if the keys are invalid
+static const struct codec_session *lora_asconmac_session(const char *appskey, const char *nwkskey)
 {
-    // Convert hex string to byte array
-    if (hex_string_to_byte(APPSKEY_INPUT_DATA, appskey1, 16) != 0) {
-        printf("\nCan not convert to byte array for appskey");
-        return -1; // Exit on error
+    uint8_t appskey_bytes[CRYPTO_KEYBYTES];
+    uint8_t nwkskey_bytes[CRYPTO_KEYBYTES];
+    uint32_t hash = 2166136261u; /* FNV-1a */
+
+    for (const char *c = appskey; *c; c++) {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    for (const char *c = nwkskey; *c; c++) {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    struct session_cache_entry *entry = &session_cache[hash % SESSION_CACHE_SIZE];
+    size_t appskey_len = strlen(appskey);
+    if (appskey_len == 2 * CRYPTO_KEYBYTES && strncmp(entry->keys, appskey, appskey_len) == 0 &&
+        strcmp(&entry->keys[appskey_len], nwkskey) == 0) {
+        return &entry->session;
     }
 
     // Convert hex string to byte array
-    if (hex_string_to_byte(NWSKEY_INPUT_DATA, nwskey1, 16) != 0) {
-        printf("\nCan not convert to byte array for nwskey");
+    if (hex_string_to_byte(appskey, appskey_bytes, CRYPTO_KEYBYTES) != 0 ||
+        hex_string_to_byte(nwkskey, nwkskey_bytes, CRYPTO_KEYBYTES) != 0) {
+        return NULL;
+    }
+    codec_session_init(&entry->session, appskey_bytes, nwkskey_bytes);
+    memcpy(entry->keys, appskey, 2 * CRYPTO_KEYBYTES);
+    memcpy(&entry->keys[2 * CRYPTO_KEYBYTES], nwkskey, 2 * CRYPTO_KEYBYTES + 1);
+    return &entry->session;
+}
+
+static int32_t lora_asconmac_encrypt(char *argv[], struct out_buffer *out)
+{
+    const struct codec_session *session = lora_asconmac_session(APPSKEY_INPUT_DATA, NWSKEY_INPUT_DATA);
+    if (session == NULL) {
+        out_printf(out, "\nCan not convert to byte array for appskey or nwskey");
         return -1; // Exit on error
     }
 
     // Convert hex string to byte array
     if (hex_string_to_byte(DEV_ADDR_INPUT_DATA, devices, 4) != 0) {
-        printf("\nCan not convert to byte array for device address");
+        out_printf(out, "\nCan not convert to byte array for device address");
         return -1; // Exit on error
     }
 
@@ -83,52 +188,44 @@ static int32_t lora_asconmac_encrypt(char *argv[])
     size_t data_in_size = strlen((const char *)BASE64_INPUT_DATA);
     if (!data_in_size) {
         /* cannot convert to a number */
-        printf("\nCan not get size of data input");
+        out_printf(out, "\nCan not get size of data input");
         return -2;
     }
     /* Base64 decoded package - [MHDR + FHDR + FPORT + FRMPayload + MIC] */
-    unsigned char *decoded = base64_decode(BASE64_INPUT_DATA, data_in_size, &data_out_size);
-    /* Use the LoRaMAC API to calculate the MIC and compare with decoded MIC */
-    struct loramac_phys_payload *loramac_payload = loramac_init();
-
+    unsigned char decoded[CODEC_FRM_PAYLOAD_MAX];
+    int b64 = base64_decode_to(BASE64_INPUT_DATA, data_in_size, decoded, sizeof(decoded), &data_out_size);
+    if (b64 == BASE64_ERR_SIZE) {
+        out_printf(out, "\nData input is too large");
+        return CODEC_ERR_INVALID_INPUT;
+    } else if (b64 != BASE64_OK) {
+        out_printf(out, "\nInvalid base64 data input");
+        return -2;
+    }
     uint8_t f_port = (uint8_t)atoi(FPORT_INPUT_DATA);
-	loramac_fill_mac_payload(loramac_payload, f_port, NULL);
-
-	loramac_fill_phys_payload(loramac_payload, LORAMAC_PHYS_PAYLOAD_MHDR_UNCONFIRM_DATA_DOWN, 0);
-
     uint32_t dev_addr = (devices[0] << 24) | (devices[1] << 16) | (devices[2] << 8) | devices[3];
     uint32_t loramac_f_cnt = (uint32_t)atoi(DOWN_CNT_INPUT_DATA);
-    loramac_fill_fhdr(loramac_payload, dev_addr, 0, loramac_f_cnt, NULL);
-
-    loramac_fill_mac_payload(loramac_payload, f_port, decoded);
 
-    uint32_t loramac_mic = 0;
-    loramac_frm_payload_encryption(loramac_payload, data_out_size, appskey1);
-    loramac_calculate_mic(loramac_payload, data_out_size, nwskey1, 1, &loramac_mic); // FRM_PAYLOAD + 1 MHDR + 7 FHDR + 1 FPORT
-    loramac_fill_phys_payload(loramac_payload, LORAMAC_PHYS_PAYLOAD_MHDR_UNCONFIRM_DATA_DOWN, loramac_mic);
-
-    uint8_t lora_package[data_out_size + 13]; // FRM_PAYLOAD + 13 LoRaWAN protocol excepts FOpts
-    loramac_serialize_data(loramac_payload, lora_package, data_out_size);
-    for (uint8_t i = 0; i < data_out_size + 13; i++) {
-        printf("%.2x", lora_package[i]);
+    uint8_t lora_package[CODEC_FRM_PAYLOAD_MAX + CODEC_FRAME_OVERHEAD]; // FRM_PAYLOAD + 13 LoRaWAN protocol excepts FOpts
+    int32_t rc = codec_encode_frame(decoded, data_out_size, session, dev_addr, loramac_f_cnt, f_port, lora_package);
+    if (rc != CODEC_OK) {
+        out_printf(out, "\nData input is too large");
+        return rc;
+    }
+    for (uint16_t i = 0; i < data_out_size + CODEC_FRAME_OVERHEAD; i++) {
+        out_printf(out, "%.2x", lora_package[i]);
     }
-    printf("\n");
+    out_printf(out, "\n");
     return 0;
 }
 
-static int32_t lora_asconmac_decrypt(char *argv[])
+static int32_t lora_asconmac_decrypt(char *argv[], struct out_buffer *out)
 {
-    clock_t start, end;
-    start = clock();
-    // Convert hex string to byte array
-    if (hex_string_to_byte(APPSKEY_INPUT_DATA, appskey1, 16) != 0) {
-        printf("\nCan not convert to byte array for appskey");
-        return -1; // Exit on error
-    }
-
-    // Convert hex string to byte array
-    if (hex_string_to_byte(NWSKEY_INPUT_DATA, nwskey1, 16) != 0) {
-        printf("\nCan not convert to byte array for nwskey");
+    uint64_t start = hist_now_ns();
+    uint64_t stage = hist_start();
+    const struct codec_session *session = lora_asconmac_session(APPSKEY_INPUT_DATA, NWSKEY_INPUT_DATA);
+    hist_stage_end(HIST_STAGE_SESSION, stage);
+    if (session == NULL) {
+        out_printf(out, "\nCan not convert to byte array for appskey or nwskey");
         return -1; // Exit on error
     }
 
@@ -136,53 +233,45 @@ static int32_t lora_asconmac_decrypt(char *argv[])
     size_t data_in_size = strlen((const char *)BASE64_INPUT_DATA);
     if (!data_in_size) {
         /* cannot convert to a number */
-        printf("\nCan not get size of data input");
+        out_printf(out, "\nCan not get size of data input");
         return -2;
     }
     /* Base64 decoded package - [MHDR + FHDR + FPORT + FRMPayload + MIC] */
-    unsigned char *decoded = base64_decode(BASE64_INPUT_DATA, data_in_size, &data_out_size);
-    /* Use the LoRaMAC API to calculate the MIC and compare with decoded MIC */
-    struct loramac_phys_payload *payload = loramac_init();
-    uint8_t frm_payload_size = data_out_size - (1 + 4 + 1 + 2 + 1 + 4); /* [MHDR + FHDR[DevAddr + ..] + FPORT + MIC] */
-    uint32_t dev_addr = LE_BYTES_TO_UINT32((&decoded[LRMAC_BYTE_OFFSET_DEVADDR]));
-    uint16_t f_cnt = LE_BYTES_TO_UINT16((&decoded[LRMAC_BYTE_OFFSET_FCNT]));
-    uint8_t f_ctrl = decoded[LRMAC_BYTE_OFFSET_FCTRL];
-
-    loramac_fill_fhdr(payload, dev_addr, f_ctrl, f_cnt, NULL);
-
-    uint8_t f_port = decoded[LRMAC_BYTE_OFFSET_FPORT];
-    uint8_t *frm_payload = &decoded[LRMAC_BYTE_OFFSET_FRMPAYLOAD];
-    reverse_bytes(frm_payload, frm_payload_size);
-    loramac_fill_mac_payload(payload, f_port, frm_payload);
-
-    uint8_t m_hdr = decoded[LRMAC_BYTE_OFFSET_MHDR];
-
-    loramac_fill_phys_payload(payload, m_hdr, 0);
-
-    if (f_ctrl & 0xF) {
+    unsigned char decoded[CODEC_FRM_PAYLOAD_MAX + CODEC_FRAME_OVERHEAD];
+    stage = hist_start();
+    int b64 = base64_decode_to(BASE64_INPUT_DATA, data_in_size, decoded, sizeof(decoded), &data_out_size);
+    hist_stage_end(HIST_STAGE_BASE64, stage);
+    if (b64 == BASE64_ERR_SIZE) {
+        out_printf(out, "\nInvalid LoRaWAN package");
+        return CODEC_ERR_INVALID_INPUT;
+    } else if (b64 != BASE64_OK) {
+        out_printf(out, "\nInvalid LoRaWAN package");
+        return -2;
+    }
+    struct codec_uplink uplink;
+    uint8_t frm_payload[CODEC_FRM_PAYLOAD_MAX];
+    int32_t rc = codec_decode_frame(decoded, data_out_size, session, &uplink, frm_payload);
+    if (rc == CODEC_ERR_INVALID_INPUT) {
+        out_printf(out, "\nInvalid LoRaWAN package");
+        return rc;
+    } else if (rc == CODEC_ERR_FOPTS) {
         /* currently not support FOpts */
-        printf("\nFOpts is asserted but we don't support it");
-        return -3;
-    }
-    uint32_t mic = 0;
-    uint32_t decoded_mic = 0;
-    /* Compare MIC */
-    loramac_calculate_mic(payload, frm_payload_size, nwskey1, 1, &mic);
-    decoded_mic = LE_BYTES_TO_UINT32(&decoded[LRMAC_BYTE_OFFSET_FRMPAYLOAD + frm_payload_size]);
-    if (mic != decoded_mic) {
-        printf("\nMIC does not match");
-        return -4;
+        out_printf(out, "\nFOpts is asserted but we don't support it");
+        return rc;
+    } else if (rc == CODEC_ERR_MIC) {
+        out_printf(out, "\nMIC does not match");
+        return rc;
     }
     /*
-     * Decrypt LoRaWAN payload
+     * The payload is decrypted by codec_decode_frame()
      *
-     * Yes I know, the function name is 'encryption' then
-     * how can it decrypt ? The LoRaWAN payload encryption
-     * and decryption is special because the algorithm does
-     * not run with the payload as input but rather a block
-     * called A[16] which is specified in the spec. This get
-     * encrypted and produce S[16] and then it's XOR with the
-     * LoRaWAN payload.
+     * Yes I know, loramac_frm_payload_encryption() is
+     * 'encryption' then how can it decrypt ? The LoRaWAN
+     * payload encryption and decryption is special because
+     * the algorithm does not run with the payload as input
+     * but rather a block called A[16] which is specified in
+     * the spec. This get encrypted and produce S[16] and then
+     * it's XOR with the LoRaWAN payload.
      *
      * So now we can just run the encryption function. Which
      * will produce the same S[16] and XOR with the encrypted
@@ -190,41 +279,219 @@ static int32_t lora_asconmac_decrypt(char *argv[])
      *
      * Check the spec if this is not clear to you.
      */
-    loramac_frm_payload_encryption(payload, frm_payload_size, appskey1);
-    end = clock();
-    double elapsed_time_in_us = (double)(end - start) * 1000000.0 / CLOCKS_PER_SEC;
-    for (uint8_t i = 0; i < frm_payload_size; i++) {
-        printf("%.2x", frm_payload[i]);
-    }
-    printf("\n");
-    printf("%.8u\n", (uint64_t)elapsed_time_in_us);
-    printf("%x\n", dev_addr);
-    printf("%.4x\n", f_cnt);
-    printf("%.2x\n", f_port);
-    printf("%.2x\n", m_hdr);
-    base64_cleanup();
+    /* wall time of the decoding, on the monotonic clock */
+    double elapsed_time_in_us = (hist_now_ns() - start) / 1000.0;
+    stage = hist_start();
+    for (uint16_t i = 0; i < uplink.frm_payload_size; i++) {
+        out_printf(out, "%.2x", frm_payload[i]);
+    }
+    out_printf(out, "\n");
+    out_printf(out, "%.8u\n", (uint32_t)elapsed_time_in_us);
+    out_printf(out, "%x\n", uplink.dev_addr);
+    out_printf(out, "%.4x\n", uplink.f_cnt);
+    out_printf(out, "%.2x\n", uplink.f_port);
+    out_printf(out, "%.2x\n", uplink.m_hdr);
+    hist_stage_end(HIST_STAGE_OUTPUT, stage);
     return 0;
 }
 
-int main(int argc, char *argv[])
+static int32_t lora_asconmac_decrypt_batch(int count, char *argv[], struct out_buffer *out)
 {
-    if (argc == 4) {
-        return lora_asconmac_decrypt(argv);
+    static struct codec_batch batch;
+    static struct codec_session sessions[CODEC_BATCH_MAX];
+    static uint8_t payloads[CODEC_BATCH_MAX][CODEC_FRM_PAYLOAD_MAX];
+    static unsigned char decoded[CODEC_BATCH_MAX][CODEC_FRM_PAYLOAD_MAX + CODEC_FRAME_OVERHEAD];
+
+    if (count > CODEC_BATCH_MAX) {
+        out_printf(out, "\nToo many packages in batch: %d", count);
+        return -1;
+    }
+    static uint8_t known[CODEC_BATCH_MAX];
+
+    batch.count = count;
+    uint64_t stage = hist_start();
+    for (int n = 0; n < count; n++) {
+        char **args = &argv[3 * n];
+
+        /* copied, another package of the batch may evict the cache entry */
+        const struct codec_session *session = lora_asconmac_session(args[1], args[2]);
+        batch.session[n] = &sessions[n];
+        batch.payload[n] = payloads[n];
+        batch.frame[n] = NULL;
+        batch.frame_size[n] = 0;
+        known[n] = session != NULL;
+        if (session != NULL) {
+            sessions[n] = *session;
+        }
+    }
+    hist_stage_end(HIST_STAGE_SESSION, stage);
+
+    stage = hist_start();
+    for (int n = 0; n < count; n++) {
+        char **args = &argv[3 * n];
+        size_t data_out_size = 0;
+
+        /* Base64 decoded package - [MHDR + FHDR + FPORT + FRMPayload + MIC] */
+        if (known[n] &&
+            base64_decode_to(args[0], strlen(args[0]), decoded[n], sizeof(decoded[n]), &data_out_size) == BASE64_OK) {
+            batch.frame[n] = decoded[n];
+            batch.frame_size[n] = data_out_size;
+        }
+    }
+    hist_stage_end(HIST_STAGE_BASE64, stage);
+
+    codec_decode_batch(&batch);
+    stage = hist_start();
+    for (int n = 0; n < count; n++) {
+        out_printf(out, "%d ", batch.status[n]);
+        for (uint16_t i = 0; batch.status[n] == CODEC_OK && i < batch.frm_payload_size[n]; i++) {
+            out_printf(out, "%.2x", payloads[n][i]);
+        }
+        out_printf(out, " %x %.4x %.2x %.2x\n", batch.dev_addr[n], batch.f_cnt[n], batch.f_port[n], batch.m_hdr[n]);
+    }
+    hist_stage_end(HIST_STAGE_OUTPUT, stage);
+    return 0;
+}
+
+static int32_t lora_asconmac_run(int argc, char *argv[], struct out_buffer *out)
+{
+    if (argc >= 2 && strcmp(argv[1], BATCH_ARG) == 0 && (argc - 2) % 3 == 0) {
+        return lora_asconmac_decrypt_batch((argc - 2) / 3, &argv[2], out);
+    } else if (argc == 4) {
+        return lora_asconmac_decrypt(argv, out);
     } else if (argc == 7) {
-        return lora_asconmac_encrypt(argv);
+        return lora_asconmac_encrypt(argv, out);
     }
     /* invalid input parameter size */
-    printf("\nInvalid input parameter size: %d", argc);
+    out_printf(out, "\nInvalid input parameter size: %d", argc);
     return -1;
 }
 
+static int32_t serve_write_all(const uint8_t *data, size_t size)
+{
+    while (size) {
+        int n = write(1, data, size);
+        if (n <= 0) {
+            return -1;
+        }
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/* Answer one request frame, the response is appended to 'out' */
+static void serve_handle_frame(char *frame, uint32_t frame_size, uint8_t *out, size_t *out_len)
+{
+    char *args[SERVE_MAX_ARGS] = {"out"};
+    int argc = 1;
+    for (uint32_t i = 0, start = 0; i < frame_size; i++) {
+        if (frame[i] != '\0') {
+            continue;
+        }
+        if (argc < SERVE_MAX_ARGS) {
+            args[argc] = &frame[start];
+        }
+        argc++;
+        start = i + 1;
+    }
+
+    uint8_t *response = &out[*out_len];
+    struct out_buffer text = {(char *)&response[5], SERVE_RESPONSE_MAX, 0};
+    text.data[0] = '\0';
+    int32_t rc = lora_asconmac_run(argc, args, &text);
+    uint32_t response_size = 1 + text.len;
+    response[0] = response_size & 0xFF;
+    response[1] = (response_size >> 8) & 0xFF;
+    response[2] = (response_size >> 16) & 0xFF;
+    response[3] = (response_size >> 24) & 0xFF;
+    response[4] = (uint8_t)(int8_t)rc;
+    *out_len += 4 + response_size;
+}
+
+/*
+ * Long running mode, requests are read from stdin and answered on stdout.
+ * Every complete frame available after a read is processed and the responses
+ * are written back with a single write, so pipelined requests are batched.
+ */
+static int32_t lora_asconmac_serve(void)
+{
+    static uint8_t in[SERVE_IN_SIZE];
+    static uint8_t out[SERVE_OUT_SIZE];
+    size_t in_len = 0;
+
+#ifdef _WIN32
+    _setmode(0, _O_BINARY);
+    _setmode(1, _O_BINARY);
+#endif
+    if (getenv(SERVE_STAGE_TIMERS_ENV) != NULL) {
+        hist_enable(1);
+    }
+    for (;;) {
+        int n = read(0, &in[in_len], sizeof(in) - in_len);
+        if (n <= 0) {
+            /* EOF, parent has closed the pipe */
+            if (hist_enabled) {
+                hist_report(stderr);
+            }
+            return 0;
+        }
+        in_len += n;
+
+        size_t pos = 0;
+        size_t out_len = 0;
+        while (in_len - pos >= 4) {
+            uint32_t frame_size = LE_BYTES_TO_UINT32(&in[pos]);
+            if (frame_size > SERVE_FRAME_MAX) {
+                /* out of sync, nothing sensible can be answered anymore */
+                return -1;
+            }
+            if (in_len - pos - 4 < frame_size) {
+                break;
+            }
+            if (sizeof(out) - out_len < 5 + SERVE_RESPONSE_MAX) {
+                if (serve_write_all(out, out_len) != 0) {
+                    return -1;
+                }
+                out_len = 0;
+            }
+            char *frame = (char *)&in[pos + 4];
+            serve_handle_frame(frame, frame_size, out, &out_len);
+            pos += 4 + frame_size;
+        }
+        if (out_len && serve_write_all(out, out_len) != 0) {
+            return -1;
+        }
+        memmove(in, &in[pos], in_len - pos);
+        in_len -= pos;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    static char text[SERVE_RESPONSE_MAX];
+    struct out_buffer out = {text, sizeof(text), 0};
+
+    if (argc == 2 && strcmp(argv[1], SERVE_ARG) == 0) {
+        return lora_asconmac_serve();
+    }
+    if (argc >= 2 && argc <= 5 && strcmp(argv[1], UDPFE_ARG) == 0) {
+        uint16_t port = argc >= 3 ? (uint16_t)atoi(argv[2]) : UDPFE_PORT;
+        uint32_t n_thread = argc >= 4 ? (uint32_t)atoi(argv[3]) : 0;
+        enum udpfe_backend backend = argc >= 5 && strcmp(argv[4], UDPFE_URING_ARG) == 0 ? UDPFE_URING : UDPFE_SOCKET;
+        return udpfe_run(port, n_thread, backend);
+    }
+    int32_t rc = lora_asconmac_run(argc, argv, &out);
+    fputs(text, stdout);
+    return rc;
+}
+
 void reverse_bytes(uint8_t *bytes, size_t size)
 {
-    uint8_t limit = 0;
     if (size <= 1) {
         return;
     }
-    for (uint8_t i = 0, j = size - 1; i < size / 2; i++, j--) {
+    for (size_t i = 0, j = size - 1; i < size / 2; i++, j--) {
         uint8_t tmp = bytes[j];
         bytes[j] = bytes[i];
         bytes[i] = tmp;
@@ -0,0 +1,110 @@
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#include "api.h"
+#include "ascon.h"
+#include "prf_lanes.h"
+#include "prf_x4.h"
+#include "word.h"
+
+#define AVX2 __attribute__((target("avx2")))
+
+#define ROR(x, n) \
+  _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - (n)))
+
+AVX2 static inline void ROUND(__m256i* x, uint8_t C) {
+  const __m256i ones = _mm256_set1_epi64x(-1);
+  __m256i t0, t1, t2, t3, t4;
+  /* addition of round constant */
+  x[2] = _mm256_xor_si256(x[2], _mm256_set1_epi64x(C));
+  /* substitution layer */
+  x[0] = _mm256_xor_si256(x[0], x[4]);
+  x[4] = _mm256_xor_si256(x[4], x[3]);
+  x[2] = _mm256_xor_si256(x[2], x[1]);
+  /* start of keccak s-box */
+  t0 = _mm256_xor_si256(x[0], _mm256_andnot_si256(x[1], x[2]));
+  t1 = _mm256_xor_si256(x[1], _mm256_andnot_si256(x[2], x[3]));
+  t2 = _mm256_xor_si256(x[2], _mm256_andnot_si256(x[3], x[4]));
+  t3 = _mm256_xor_si256(x[3], _mm256_andnot_si256(x[4], x[0]));
+  t4 = _mm256_xor_si256(x[4], _mm256_andnot_si256(x[0], x[1]));
+  /* end of keccak s-box */
+  t1 = _mm256_xor_si256(t1, t0);
+  t0 = _mm256_xor_si256(t0, t4);
+  t3 = _mm256_xor_si256(t3, t2);
+  t2 = _mm256_xor_si256(t2, ones);
+  /* linear diffusion layer */
+  x[0] = _mm256_xor_si256(t0, _mm256_xor_si256(ROR(t0, 19), ROR(t0, 28)));
+  x[1] = _mm256_xor_si256(t1, _mm256_xor_si256(ROR(t1, 61), ROR(t1, 39)));
+  x[2] = _mm256_xor_si256(t2, _mm256_xor_si256(ROR(t2, 1), ROR(t2, 6)));
+  x[3] = _mm256_xor_si256(t3, _mm256_xor_si256(ROR(t3, 10), ROR(t3, 17)));
+  x[4] = _mm256_xor_si256(t4, _mm256_xor_si256(ROR(t4, 7), ROR(t4, 41)));
+}
+
+AVX2 static inline void P12(__m256i* x) {
+  ROUND(x, 0xf0);
+  ROUND(x, 0xe1);
+  ROUND(x, 0xd2);
+  ROUND(x, 0xc3);
+  ROUND(x, 0xb4);
+  ROUND(x, 0xa5);
+  ROUND(x, 0x96);
+  ROUND(x, 0x87);
+  ROUND(x, 0x78);
+  ROUND(x, 0x69);
+  ROUND(x, 0x5a);
+  ROUND(x, 0x4b);
+}
+
+AVX2 static inline void P8(__m256i* x) {
+  ROUND(x, 0xb4);
+  ROUND(x, 0xa5);
+  ROUND(x, 0x96);
+  ROUND(x, 0x87);
+  ROUND(x, 0x78);
+  ROUND(x, 0x69);
+  ROUND(x, 0x5a);
+  ROUND(x, 0x4b);
+}
+
+AVX2 void crypto_prf_keyed_x4(unsigned char* const out[4],
+                              const ascon_prf_msg_t* const m[4],
+                              const ascon_state_t* const ks[4]) {
+  unsigned long long blocks[4];
+  unsigned long long max_blocks = 0;
+  uint64_t w[5][4];
+  __m256i x[5];
+  int i, l;
+  /* start from the keyed states */
+  for (i = 0; i < 5; ++i)
+    x[i] = _mm256_set_epi64x(ks[3]->x[i], ks[2]->x[i], ks[1]->x[i],
+                             ks[0]->x[i]);
+  for (l = 0; l < 4; ++l) {
+    blocks[l] = ascon_prf_lane_blocks(m[l]);
+    if (blocks[l] > max_blocks) max_blocks = blocks[l];
+  }
+  /* absorb, the lanes which reached their last block keep their state */
+  for (unsigned long long b = 0; b <= max_blocks; ++b) {
+    for (i = 0; i < 5; ++i)
+      for (l = 0; l < 4; ++l) w[i][l] = ascon_prf_lane_word(m[l], b, i);
+    for (i = 0; i < 5; ++i)
+      x[i] = _mm256_xor_si256(x[i], _mm256_loadu_si256((const __m256i*)w[i]));
+    if (b == max_blocks) break;
+    const __m256i active = _mm256_set_epi64x(
+        -(long long)(b < blocks[3]), -(long long)(b < blocks[2]),
+        -(long long)(b < blocks[1]), -(long long)(b < blocks[0]));
+    __m256i y[5] = {x[0], x[1], x[2], x[3], x[4]};
+    P8(y);
+    for (i = 0; i < 5; ++i) x[i] = _mm256_blendv_epi8(x[i], y[i], active);
+  }
+  /* squeeze */
+  P12(x);
+  _mm256_storeu_si256((__m256i*)w[0], x[0]);
+  _mm256_storeu_si256((__m256i*)w[1], x[1]);
+  for (l = 0; l < 4; ++l) {
+    STOREBYTES(out[l], w[0][l], 8);
+    STOREBYTES(out[l] + 8, w[1][l], 8);
+  }
+}
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef PRF_X4_H_
+#define PRF_X4_H_
+
+#include "ascon.h"
+#include "prf.h"
+
+/* 4 independent Ascon-PRFa MACs (CRYPTO_BYTES each) in the lanes of AVX2
+ * registers, only call it when the CPU supports AVX2 */
+void crypto_prf_keyed_x4(unsigned char* const out[4],
+                         const ascon_prf_msg_t* const m[4],
+                         const ascon_state_t* const ks[4]);
+
+#endif /* PRF_X4_H_ */
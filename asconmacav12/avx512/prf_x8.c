@@ -0,0 +1,107 @@
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+#include "api.h"
+#include "ascon.h"
+#include "prf_lanes.h"
+#include "prf_x8.h"
+#include "word.h"
+
+#define AVX512 __attribute__((target("avx512f")))
+
+AVX512 static inline void ROUND(__m512i* x, uint8_t C) {
+  const __m512i ones = _mm512_set1_epi64(-1);
+  __m512i t0, t1, t2, t3, t4;
+  /* addition of round constant */
+  x[2] = _mm512_xor_si512(x[2], _mm512_set1_epi64(C));
+  /* substitution layer */
+  x[0] = _mm512_xor_si512(x[0], x[4]);
+  x[4] = _mm512_xor_si512(x[4], x[3]);
+  x[2] = _mm512_xor_si512(x[2], x[1]);
+  /* start of keccak s-box */
+  t0 = _mm512_xor_si512(x[0], _mm512_andnot_si512(x[1], x[2]));
+  t1 = _mm512_xor_si512(x[1], _mm512_andnot_si512(x[2], x[3]));
+  t2 = _mm512_xor_si512(x[2], _mm512_andnot_si512(x[3], x[4]));
+  t3 = _mm512_xor_si512(x[3], _mm512_andnot_si512(x[4], x[0]));
+  t4 = _mm512_xor_si512(x[4], _mm512_andnot_si512(x[0], x[1]));
+  /* end of keccak s-box */
+  t1 = _mm512_xor_si512(t1, t0);
+  t0 = _mm512_xor_si512(t0, t4);
+  t3 = _mm512_xor_si512(t3, t2);
+  t2 = _mm512_xor_si512(t2, ones);
+  /* linear diffusion layer */
+  x[0] = _mm512_xor_si512(t0, _mm512_xor_si512(_mm512_ror_epi64(t0, 19), _mm512_ror_epi64(t0, 28)));
+  x[1] = _mm512_xor_si512(t1, _mm512_xor_si512(_mm512_ror_epi64(t1, 61), _mm512_ror_epi64(t1, 39)));
+  x[2] = _mm512_xor_si512(t2, _mm512_xor_si512(_mm512_ror_epi64(t2, 1), _mm512_ror_epi64(t2, 6)));
+  x[3] = _mm512_xor_si512(t3, _mm512_xor_si512(_mm512_ror_epi64(t3, 10), _mm512_ror_epi64(t3, 17)));
+  x[4] = _mm512_xor_si512(t4, _mm512_xor_si512(_mm512_ror_epi64(t4, 7), _mm512_ror_epi64(t4, 41)));
+}
+
+AVX512 static inline void P12(__m512i* x) {
+  ROUND(x, 0xf0);
+  ROUND(x, 0xe1);
+  ROUND(x, 0xd2);
+  ROUND(x, 0xc3);
+  ROUND(x, 0xb4);
+  ROUND(x, 0xa5);
+  ROUND(x, 0x96);
+  ROUND(x, 0x87);
+  ROUND(x, 0x78);
+  ROUND(x, 0x69);
+  ROUND(x, 0x5a);
+  ROUND(x, 0x4b);
+}
+
+AVX512 static inline void P8(__m512i* x) {
+  ROUND(x, 0xb4);
+  ROUND(x, 0xa5);
+  ROUND(x, 0x96);
+  ROUND(x, 0x87);
+  ROUND(x, 0x78);
+  ROUND(x, 0x69);
+  ROUND(x, 0x5a);
+  ROUND(x, 0x4b);
+}
+
+AVX512 void crypto_prf_keyed_x8(unsigned char* const out[8],
+                                const ascon_prf_msg_t* const m[8],
+                                const ascon_state_t* const ks[8]) {
+  unsigned long long blocks[8];
+  unsigned long long max_blocks = 0;
+  uint64_t w[5][8];
+  __m512i x[5];
+  int i, l;
+  /* start from the keyed states */
+  for (i = 0; i < 5; ++i) {
+    for (l = 0; l < 8; ++l) w[i][l] = ks[l]->x[i];
+    x[i] = _mm512_loadu_si512(w[i]);
+  }
+  for (l = 0; l < 8; ++l) {
+    blocks[l] = ascon_prf_lane_blocks(m[l]);
+    if (blocks[l] > max_blocks) max_blocks = blocks[l];
+  }
+  /* absorb, the lanes which reached their last block keep their state */
+  for (unsigned long long b = 0; b <= max_blocks; ++b) {
+    for (i = 0; i < 5; ++i)
+      for (l = 0; l < 8; ++l) w[i][l] = ascon_prf_lane_word(m[l], b, i);
+    for (i = 0; i < 5; ++i)
+      x[i] = _mm512_xor_si512(x[i], _mm512_loadu_si512(w[i]));
+    if (b == max_blocks) break;
+    __mmask8 active = 0;
+    for (l = 0; l < 8; ++l) active |= (__mmask8)((b < blocks[l]) << l);
+    __m512i y[5] = {x[0], x[1], x[2], x[3], x[4]};
+    P8(y);
+    for (i = 0; i < 5; ++i) x[i] = _mm512_mask_mov_epi64(x[i], active, y[i]);
+  }
+  /* squeeze */
+  P12(x);
+  _mm512_storeu_si512(w[0], x[0]);
+  _mm512_storeu_si512(w[1], x[1]);
+  for (l = 0; l < 8; ++l) {
+    STOREBYTES(out[l], w[0][l], 8);
+    STOREBYTES(out[l] + 8, w[1][l], 8);
+  }
+}
+
+#endif
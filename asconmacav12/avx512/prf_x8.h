@@ -0,0 +1,13 @@
+#ifndef PRF_X8_H_
+#define PRF_X8_H_
+
+#include "ascon.h"
+#include "prf.h"
+
+/* 8 independent Ascon-PRFa MACs (CRYPTO_BYTES each) in the lanes of
+ * AVX-512 registers, only call it when the CPU supports AVX-512F */
+void crypto_prf_keyed_x8(unsigned char* const out[8],
+                         const ascon_prf_msg_t* const m[8],
+                         const ascon_state_t* const ks[8]);
+
+#endif /* PRF_X8_H_ */
@@ -7,40 +7,76 @@
 #include <stdint.h>
 #include <stdlib.h>
 
-
-static char encoding_table[] = {'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H',
-                                'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
-                                'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X',
-                                'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f',
-                                'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n',
-                                'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
-                                'w', 'x', 'y', 'z', '0', '1', '2', '3',
-                                '4', '5', '6', '7', '8', '9', '+', '/'};
-static char *decoding_table = NULL;
-static int mod_table[] = {0, 2, 1};
-
-void base64_cleanup() {
-    free(decoding_table);
-}
-
-void build_decoding_table() {
-
-    decoding_table = malloc(256);
-
-    for (int i = 0; i < 64; i++)
-        decoding_table[(unsigned char) encoding_table[i]] = i;
+#include "base64.h"
+#include "base64_simd.h"
+
+
+static const char encoding_table[] = {'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H',
+                                      'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
+                                      'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X',
+                                      'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f',
+                                      'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n',
+                                      'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
+                                      'w', 'x', 'y', 'z', '0', '1', '2', '3',
+                                      '4', '5', '6', '7', '8', '9', '+', '/'};
+/* 0xFF for the characters outside of the alphabet, '=' included */
+static const uint8_t decoding_table[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+static const int mod_table[] = {0, 2, 1};
+
+#ifdef BASE64_SIMD_X86
+enum { SIMD_UNKNOWN, SIMD_NONE, SIMD_SSE41, SIMD_AVX2 };
+
+static int simd_supported(void) {
+    static int simd = SIMD_UNKNOWN;
+
+    if (simd == SIMD_UNKNOWN) {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            simd = SIMD_AVX2;
+        else if (__builtin_cpu_supports("sse4.1"))
+            simd = SIMD_SSE41;
+        else
+            simd = SIMD_NONE;
+    }
+    return simd;
 }
+#endif
 
-char *base64_encode(const unsigned char *data,
-                    size_t input_length,
-                    size_t *output_length) {
+int base64_encode_to(const unsigned char *data,
+                     size_t input_length,
+                     char *out,
+                     size_t out_size,
+                     size_t *output_length) {
 
-    *output_length = 4 * ((input_length + 2) / 3);
+    size_t i = 0, j = 0;
 
-    char *encoded_data = malloc(*output_length);
-    if (encoded_data == NULL) return NULL;
+    *output_length = BASE64_ENCODED_SIZE(input_length);
+    if (*output_length > out_size) return BASE64_ERR_SIZE;
 
-    for (int i = 0, j = 0; i < input_length;) {
+#ifdef BASE64_SIMD_X86
+    if (simd_supported() != SIMD_NONE) {
+        i = base64_encode_ssse3(data, input_length, out);
+        j = i / 3 * 4;
+    }
+#endif
+    while (i < input_length) {
 
         uint32_t octet_a = i < input_length ? (unsigned char)data[i++] : 0;
         uint32_t octet_b = i < input_length ? (unsigned char)data[i++] : 0;
@@ -48,50 +84,92 @@ char *base64_encode(const unsigned char *data,
 
         uint32_t triple = (octet_a << 0x10) + (octet_b << 0x08) + octet_c;
 
-        encoded_data[j++] = encoding_table[(triple >> 3 * 6) & 0x3F];
-        encoded_data[j++] = encoding_table[(triple >> 2 * 6) & 0x3F];
-        encoded_data[j++] = encoding_table[(triple >> 1 * 6) & 0x3F];
-        encoded_data[j++] = encoding_table[(triple >> 0 * 6) & 0x3F];
+        out[j++] = encoding_table[(triple >> 3 * 6) & 0x3F];
+        out[j++] = encoding_table[(triple >> 2 * 6) & 0x3F];
+        out[j++] = encoding_table[(triple >> 1 * 6) & 0x3F];
+        out[j++] = encoding_table[(triple >> 0 * 6) & 0x3F];
     }
 
-    for (int i = 0; i < mod_table[input_length % 3]; i++)
-        encoded_data[*output_length - 1 - i] = '=';
+    for (int k = 0; k < mod_table[input_length % 3]; k++)
+        out[*output_length - 1 - k] = '=';
 
-    return encoded_data;
+    return BASE64_OK;
 }
 
+int base64_decode_to(const char *data,
+                     size_t input_length,
+                     unsigned char *out,
+                     size_t out_size,
+                     size_t *output_length) {
+
+    size_t i = 0, j = 0, padding = 0;
+
+    if (input_length % 4 != 0) return BASE64_ERR_INVALID;
+
+    if (input_length && data[input_length - 1] == '=') padding++;
+    if (input_length && data[input_length - 2] == '=') padding++;
+    *output_length = input_length / 4 * 3 - padding;
+    if (*output_length > out_size) return BASE64_ERR_SIZE;
+
+#ifdef BASE64_SIMD_X86
+    /* never the last quartet, it may be padded, and keep room for the
+     * bytes the vector loops write past their output */
+    int simd = simd_supported();
+    if (simd != SIMD_NONE && input_length > 4 && out_size >= 8) {
+        size_t limit = (out_size - 8) / 3 * 4;
+        if (limit > input_length - 4) limit = input_length - 4;
+        if (simd == SIMD_AVX2)
+            i = base64_decode_avx2(data, limit, out);
+        i += base64_decode_sse41(data + i, limit - i, out + i / 4 * 3);
+        j = i / 4 * 3;
+    }
+#endif
+    for (; i < input_length; i += 4) {
 
-unsigned char *base64_decode(const char *data,
-                             size_t input_length,
-                             size_t *output_length) {
-
-    if (decoding_table == NULL) build_decoding_table();
-
-    if (input_length % 4 != 0) return NULL;
-
-    *output_length = input_length / 4 * 3;
-    if (data[input_length - 1] == '=') (*output_length)--;
-    if (data[input_length - 2] == '=') (*output_length)--;
-
-    unsigned char *decoded_data = malloc(*output_length);
-    if (decoded_data == NULL) return NULL;
-
-    for (int i = 0, j = 0; i < input_length;) {
+        int last = i + 4 == input_length;
+        uint32_t sextet_a = decoding_table[(unsigned char)data[i]];
+        uint32_t sextet_b = decoding_table[(unsigned char)data[i + 1]];
+        uint32_t sextet_c = last && padding == 2 ? 0 : decoding_table[(unsigned char)data[i + 2]];
+        uint32_t sextet_d = last && padding ? 0 : decoding_table[(unsigned char)data[i + 3]];
 
-        uint32_t sextet_a = data[i] == '=' ? 0 & i++ : decoding_table[data[i++]];
-        uint32_t sextet_b = data[i] == '=' ? 0 & i++ : decoding_table[data[i++]];
-        uint32_t sextet_c = data[i] == '=' ? 0 & i++ : decoding_table[data[i++]];
-        uint32_t sextet_d = data[i] == '=' ? 0 & i++ : decoding_table[data[i++]];
+        if ((sextet_a | sextet_b | sextet_c | sextet_d) & 0x80) return BASE64_ERR_INVALID;
 
         uint32_t triple = (sextet_a << 3 * 6)
         + (sextet_b << 2 * 6)
         + (sextet_c << 1 * 6)
         + (sextet_d << 0 * 6);
 
-        if (j < *output_length) decoded_data[j++] = (triple >> 2 * 8) & 0xFF;
-        if (j < *output_length) decoded_data[j++] = (triple >> 1 * 8) & 0xFF;
-        if (j < *output_length) decoded_data[j++] = (triple >> 0 * 8) & 0xFF;
+        if (j < *output_length) out[j++] = (triple >> 2 * 8) & 0xFF;
+        if (j < *output_length) out[j++] = (triple >> 1 * 8) & 0xFF;
+        if (j < *output_length) out[j++] = (triple >> 0 * 8) & 0xFF;
     }
 
+    return BASE64_OK;
+}
+
+char *base64_encode(const unsigned char *data,
+                    size_t input_length,
+                    size_t *output_length) {
+
+    size_t size = BASE64_ENCODED_SIZE(input_length);
+    char *encoded_data = malloc(size ? size : 1);
+    if (encoded_data == NULL) return NULL;
+
+    base64_encode_to(data, input_length, encoded_data, size, output_length);
+    return encoded_data;
+}
+
+unsigned char *base64_decode(const char *data,
+                             size_t input_length,
+                             size_t *output_length) {
+
+    size_t size = BASE64_DECODED_SIZE_MAX(input_length);
+    unsigned char *decoded_data = malloc(size ? size : 1);
+    if (decoded_data == NULL) return NULL;
+
+    if (base64_decode_to(data, input_length, decoded_data, size, output_length) != BASE64_OK) {
+        free(decoded_data);
+        return NULL;
+    }
     return decoded_data;
 }
@@ -7,6 +7,34 @@
 #ifndef BASE64_H
 #define BASE64_H
 
+#include <stddef.h>
+
+/* output sizes, the decoded size is smaller by the number of '=' */
+#define BASE64_ENCODED_SIZE(input_length) (4 * (((input_length) + 2) / 3))
+#define BASE64_DECODED_SIZE_MAX(input_length) ((input_length) / 4 * 3)
+
+enum base64_status {
+    BASE64_OK = 0,
+    BASE64_ERR_INVALID = -1,   /* bad length, character or padding */
+    BASE64_ERR_SIZE = -2,      /* the output buffer is too small */
+};
+
+/*
+ * Encode/decode into a buffer owned by the caller, nothing is allocated.
+ * Use SSSE3/SSE4.1/AVX2 when the CPU supports them.
+ */
+int base64_encode_to(const unsigned char *data,
+                     size_t input_length,
+                     char *out,
+                     size_t out_size,
+                     size_t *output_length);
+int base64_decode_to(const char *data,
+                     size_t input_length,
+                     unsigned char *out,
+                     size_t out_size,
+                     size_t *output_length);
+
+/* Same as above into a malloc'ed buffer, NULL on error */
 char *base64_encode(const unsigned char *data,
                     size_t input_length,
                     size_t *output_length);
@@ -14,6 +42,4 @@ unsigned char *base64_decode(const char *data,
                              size_t input_length,
                              size_t *output_length);
 
-void base64_cleanup();
-
 #endif /* BASE64_H */
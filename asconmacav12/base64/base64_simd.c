@@ -0,0 +1,132 @@
+/*
+ * Vectorized base64 loops, see base64_simd.h
+ *
+ * The decoding validates and translates 16 characters at once with two
+ * nibble lookups (pshufb), the encoding splits 12 bytes into 16 sextets with
+ * multiplies and translates them with one lookup.
+ */
+
+#include "base64_simd.h"
+
+#ifdef BASE64_SIMD_X86
+
+#include <immintrin.h>
+
+#define SSSE3 __attribute__((target("ssse3")))
+#define SSE41 __attribute__((target("sse4.1")))
+#define AVX2 __attribute__((target("avx2")))
+
+/* 12 bytes (and 4 ignored) into 16 sextets, one per byte */
+SSSE3 static inline __m128i enc_reshuffle(__m128i in)
+{
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7,
+                                           4, 5, 3, 4, 1, 2, 0, 1));
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003F03F0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+/* sextets to characters, by adding the offset of the range of each value:
+ * [0..25] +65, [26..51] +71, [52..61] -4, 62 -19, 63 -16 */
+SSSE3 static inline __m128i enc_translate(__m128i in)
+{
+    const __m128i lut = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4,
+                                      -4, -4, -4, -4, -19, -16, 0, 0);
+    __m128i indices = _mm_subs_epu8(in, _mm_set1_epi8(51));
+    const __m128i mask = _mm_cmpgt_epi8(in, _mm_set1_epi8(25));
+    indices = _mm_sub_epi8(indices, mask);
+    return _mm_add_epi8(in, _mm_shuffle_epi8(lut, indices));
+}
+
+SSSE3 size_t base64_encode_ssse3(const unsigned char *in, size_t len, char *out)
+{
+    size_t i = 0;
+
+    /* 16 bytes are loaded for 12 */
+    for (; len - i >= 16; i += 12, out += 16) {
+        __m128i str = _mm_loadu_si128((const __m128i *)(in + i));
+        _mm_storeu_si128((__m128i *)out, enc_translate(enc_reshuffle(str)));
+    }
+    return i;
+}
+
+/* merge the sextets of each 4 characters into 3 bytes, at byte 0..2 of each
+ * 32-bit word in reverse order */
+#define DEC_MERGE(v, maddubs, madd, set1)                       \
+    madd(maddubs(v, set1(0x01400140)), set1(0x00011000))
+
+SSE41 size_t base64_decode_sse41(const char *in, size_t len, unsigned char *out)
+{
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                           0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                                       -1, -1, -1, -1);
+    const __m128i mask_2f = _mm_set1_epi8(0x2F);
+    size_t i = 0;
+
+    for (; len - i >= 16; i += 16, out += 12) {
+        __m128i str = _mm_loadu_si128((const __m128i *)(in + i));
+        const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+        const __m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+        const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+
+        /* a character outside of the alphabet has a common bit in lo and hi */
+        if (!_mm_testz_si128(lo, hi)) {
+            break;
+        }
+        const __m128i eq_2f = _mm_cmpeq_epi8(str, mask_2f);
+        const __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+        str = DEC_MERGE(_mm_add_epi8(str, roll), _mm_maddubs_epi16, _mm_madd_epi16, _mm_set1_epi32);
+        _mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(str, pack));
+    }
+    return i;
+}
+
+AVX2 size_t base64_decode_avx2(const char *in, size_t len, unsigned char *out)
+{
+    const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                              0, 0, 0, 0, 0, 0, 0, 0,
+                                              0, 16, 19, 4, -65, -65, -71, -71,
+                                              0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+    size_t i = 0;
+
+    for (; len - i >= 32; i += 32, out += 24) {
+        __m256i str = _mm256_loadu_si256((const __m256i *)(in + i));
+        const __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2f);
+        const __m256i lo_nibbles = _mm256_and_si256(str, mask_2f);
+        const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        const __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+
+        if (!_mm256_testz_si256(lo, hi)) {
+            break;
+        }
+        const __m256i eq_2f = _mm256_cmpeq_epi8(str, mask_2f);
+        const __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+        str = DEC_MERGE(_mm256_add_epi8(str, roll), _mm256_maddubs_epi16, _mm256_madd_epi16, _mm256_set1_epi32);
+        /* 12 bytes in each 128-bit lane, moved next to each other */
+        str = _mm256_shuffle_epi8(str, pack);
+        str = _mm256_permutevar8x32_epi32(str, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm256_storeu_si256((__m256i *)out, str);
+    }
+    return i;
+}
+
+#endif
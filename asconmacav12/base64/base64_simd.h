@@ -0,0 +1,25 @@
+/*
+ * Vectorized base64 loops, they only handle whole blocks and stop at the
+ * first invalid character so the scalar code can finish and report it.
+ * Only call them when the CPU supports the instruction set of the loop.
+ */
+
+#ifndef BASE64_SIMD_H
+#define BASE64_SIMD_H
+
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BASE64_SIMD_X86
+
+/* return the number of input bytes consumed, the output is 4/3 of it */
+size_t base64_encode_ssse3(const unsigned char *in, size_t len, char *out);
+
+/* return the number of input characters consumed, the output is 3/4 of it.
+ * Up to 4 (SSE4.1) or 8 (AVX2) bytes past the decoded output are written */
+size_t base64_decode_sse41(const char *in, size_t len, unsigned char *out);
+size_t base64_decode_avx2(const char *in, size_t len, unsigned char *out);
+
+#endif
+
+#endif /* BASE64_SIMD_H */
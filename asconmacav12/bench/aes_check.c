@@ -0,0 +1,200 @@
+/*
+ * Known-answer and cross checks of the AES backends
+ *
+ * Usage: ./aes_check [iterations]
+ *
+ * The FIPS-197 Appendix C vectors are checked with aes_encrypt_table() (the
+ * byte oriented code), aes_ct_encrypt_blocks(), aes_ni_encrypt_blocks() when
+ * the CPU has AES-NI, and the dispatching aes_encrypt() and
+ * aes_encrypt_blocks(). Then, for every key size, random keys and blocks are
+ * encrypted by the backends, with one key and with a key per block, and
+ * compared with aes_encrypt_table(). The block counts cover the partial
+ * groups of 8 blocks of both backends.
+ *
+ * Exits with 1 at the first mismatch.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aes.h"
+#include "aes_ct.h"
+#include "aes_ni.h"
+
+#define CHECK_ITERATIONS 200
+#define CHECK_BLOCKS_MAX 33
+
+struct check_vector {
+	uint8_t key_size;
+	const char *key;
+	const char *out;
+};
+
+/* FIPS-197 Appendix C, plaintext 00112233445566778899aabbccddeeff */
+static const struct check_vector check_vectors[] = {
+	{16, "000102030405060708090a0b0c0d0e0f", "69c4e0d86a7b0430d8cdb78070b4c55a"},
+	{24, "000102030405060708090a0b0c0d0e0f1011121314151617", "dda97ca4864cdfe06eaf70a0ec0d7191"},
+	{32, "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f",
+	 "8ea2b7ca516745bfeafc49904b496089"},
+};
+
+static const char check_plaintext[] = "00112233445566778899aabbccddeeff";
+
+static uint64_t check_state = UINT64_C(0x9E3779B97F4A7C15);
+
+/* xorshift64*, the same sequence on every run */
+static uint8_t check_random(void)
+{
+	check_state ^= check_state >> 12;
+	check_state ^= check_state << 25;
+	check_state ^= check_state >> 27;
+	return (uint8_t)((check_state * UINT64_C(0x2545F4914F6CDD1D)) >> 56);
+}
+
+static void check_fill(uint8_t *data, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		data[i] = check_random();
+	}
+}
+
+static void check_hex(const char *hex, uint8_t *data)
+{
+	for (size_t i = 0; hex[2 * i] != '\0'; i++) {
+		unsigned value;
+		sscanf(&hex[2 * i], "%2x", &value);
+		data[i] = (uint8_t)value;
+	}
+}
+
+static int check_equal(const char *what, uint8_t key_size, uint32_t n_block, const uint8_t *expected,
+		       const uint8_t *out)
+{
+	if (memcmp(expected, out, (size_t)n_block * N_BLOCK) == 0) {
+		return 0;
+	}
+	printf("FAIL %s, %u-bit key, %u blocks\n", what, key_size * 8, n_block);
+	return 1;
+}
+
+static int check_known_answers(int ni)
+{
+	uint8_t in[N_BLOCK], expected[N_BLOCK], key[32], out[N_BLOCK];
+	aes_context ctx;
+	const aes_context *keys[1] = {&ctx};
+	int failed = 0;
+
+	check_hex(check_plaintext, in);
+	for (size_t i = 0; i < sizeof(check_vectors) / sizeof(check_vectors[0]); i++) {
+		const struct check_vector *v = &check_vectors[i];
+
+		check_hex(v->key, key);
+		check_hex(v->out, expected);
+		if (aes_set_key(key, v->key_size, &ctx) != 0) {
+			printf("FAIL aes_set_key, %u-bit key\n", v->key_size * 8);
+			return 1;
+		}
+		aes_encrypt_table(in, out, &ctx);
+		failed |= check_equal("FIPS-197 aes_encrypt_table", v->key_size, 1, expected, out);
+		aes_ct_encrypt_blocks(in, out, 1, keys, 0);
+		failed |= check_equal("FIPS-197 aes_ct_encrypt_blocks", v->key_size, 1, expected, out);
+#if defined(AES_NI)
+		if (ni) {
+			aes_ni_encrypt_blocks(in, out, 1, keys, 0);
+			failed |= check_equal("FIPS-197 aes_ni_encrypt_blocks", v->key_size, 1, expected, out);
+		}
+#endif
+		aes_encrypt(in, out, &ctx);
+		failed |= check_equal("FIPS-197 aes_encrypt", v->key_size, 1, expected, out);
+		aes_encrypt_blocks(in, out, 1, &ctx);
+		failed |= check_equal("FIPS-197 aes_encrypt_blocks", v->key_size, 1, expected, out);
+	}
+	return failed;
+}
+
+static int check_random_blocks(int ni, unsigned iterations)
+{
+	static const uint8_t key_sizes[] = {16, 24, 32};
+	static aes_context ctx[CHECK_BLOCKS_MAX];
+	static uint8_t in[CHECK_BLOCKS_MAX * N_BLOCK], expected[CHECK_BLOCKS_MAX * N_BLOCK],
+		out[CHECK_BLOCKS_MAX * N_BLOCK];
+	const aes_context *keys[CHECK_BLOCKS_MAX];
+	uint8_t key[32];
+	(void)ni;
+
+	for (size_t k = 0; k < sizeof(key_sizes); k++) {
+		uint8_t key_size = key_sizes[k];
+
+		for (unsigned it = 0; it < iterations; it++) {
+			uint32_t n_block = 1 + it % CHECK_BLOCKS_MAX;
+
+			for (uint32_t i = 0; i < n_block; i++) {
+				check_fill(key, key_size);
+				aes_set_key(key, key_size, &ctx[i]);
+				keys[i] = &ctx[i];
+			}
+			check_fill(in, (size_t)n_block * N_BLOCK);
+
+			/* one key */
+			for (uint32_t i = 0; i < n_block; i++) {
+				aes_encrypt_table(&in[i * N_BLOCK], &expected[i * N_BLOCK], &ctx[0]);
+			}
+			aes_ct_encrypt_blocks(in, out, n_block, keys, 0);
+			if (check_equal("aes_ct_encrypt_blocks", key_size, n_block, expected, out)) {
+				return 1;
+			}
+#if defined(AES_NI)
+			if (ni) {
+				aes_ni_encrypt_blocks(in, out, n_block, keys, 0);
+				if (check_equal("aes_ni_encrypt_blocks", key_size, n_block, expected, out)) {
+					return 1;
+				}
+			}
+#endif
+			aes_encrypt_blocks(in, out, n_block, &ctx[0]);
+			if (check_equal("aes_encrypt_blocks", key_size, n_block, expected, out)) {
+				return 1;
+			}
+
+			/* a key per block */
+			for (uint32_t i = 0; i < n_block; i++) {
+				aes_encrypt_table(&in[i * N_BLOCK], &expected[i * N_BLOCK], &ctx[i]);
+			}
+			aes_ct_encrypt_blocks(in, out, n_block, keys, 1);
+			if (check_equal("keyed aes_ct_encrypt_blocks", key_size, n_block, expected, out)) {
+				return 1;
+			}
+#if defined(AES_NI)
+			if (ni) {
+				aes_ni_encrypt_blocks(in, out, n_block, keys, 1);
+				if (check_equal("keyed aes_ni_encrypt_blocks", key_size, n_block, expected, out)) {
+					return 1;
+				}
+			}
+#endif
+			aes_encrypt_blocks_keyed(in, out, n_block, keys);
+			if (check_equal("aes_encrypt_blocks_keyed", key_size, n_block, expected, out)) {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned iterations = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 10) : CHECK_ITERATIONS;
+	int ni = 0;
+
+#if defined(AES_NI)
+	ni = aes_ni_available();
+#endif
+	printf("AES backends: table, ct%s\n", ni ? ", aes-ni" : "");
+	if (check_known_answers(ni) != 0 || check_random_blocks(ni, iterations) != 0) {
+		return 1;
+	}
+	printf("AES check passed, FIPS-197 vectors and %u random runs per key size\n", iterations);
+	return 0;
+}
@@ -0,0 +1,495 @@
+/*
+ * Microbenchmarks of the asconmacav12 core
+ *
+ * Usage: ./core_bench [csv] [filter]
+ *
+ * Every case runs over the FRMPayload sizes of bench_sizes[] (or its own
+ * fixed size), calibrated to about BENCH_RUN_NS per run and repeated
+ * BENCH_RUNS times on one pinned CPU; the median run is reported as ns/op,
+ * ops/sec and cycles/byte. Cycles are TSC cycles (constant rate, not the
+ * core clock), 0 where there is no TSC. Only the cases whose name starts
+ * with 'filter' are run.
+ *
+ * A table goes to stdout and 'csv', when given, gets one line per case and
+ * size, to compare releases or backends:
+ * case,backend,bytes,ops,ns_op,ops_sec,cycles_op,cycles_byte
+ */
+
+#define _GNU_SOURCE /* sched_setaffinity() */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_X86
+#endif
+
+#include "aes.h"
+#include "aes_ct.h"
+#include "aes_ni.h"
+#include "api.h"
+#include "base64.h"
+#include "codec.h"
+#include "crypto_auth.h"
+#include "loramac.h"
+#include "permutations.h"
+#include "prf.h"
+#ifdef BENCH_X86
+#include "prf_x4.h"
+#include "prf_x8.h"
+#endif
+
+#define BENCH_RUN_NS 20000000u /* 20 ms */
+#define BENCH_RUNS 7
+#define BENCH_LANES_MAX 8
+
+struct bench_case {
+	const char *name;
+	const char *backend;
+	size_t bytes; /* bytes per op, 0 to sweep bench_sizes[] */
+	uint32_t ops; /* ops per iteration, e.g the MACs of one x4 call */
+	int (*available)(void);
+	void (*run)(size_t size, uint64_t iterations);
+};
+
+struct bench_result {
+	double ns_op;
+	double cycles_op;
+};
+
+/* FRMPayload sizes, the maximum of DR0-2 (51), DR3 (115) and DR4-7 (222/242) included */
+static const size_t bench_sizes[] = {1, 16, 32, 51, 64, 115, 128, 222, 242};
+
+static const uint8_t bench_key[16] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+				      0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F};
+static uint8_t bench_in[BENCH_LANES_MAX][CODEC_FRM_PAYLOAD_MAX + CODEC_FRAME_OVERHEAD];
+static char bench_b64[BASE64_ENCODED_SIZE(CODEC_FRM_PAYLOAD_MAX + CODEC_FRAME_OVERHEAD) + 1];
+static uint8_t bench_out[CODEC_BATCH_MAX][CODEC_FRM_PAYLOAD_MAX + CODEC_FRAME_OVERHEAD];
+static struct codec_session bench_session;
+static ascon_state_t bench_state;
+static uint8_t bench_frame[CODEC_BATCH_MAX][CODEC_FRM_PAYLOAD_MAX + CODEC_FRAME_OVERHEAD];
+static size_t bench_frame_size;
+static volatile uint64_t bench_sink;
+
+static uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static uint64_t bench_cycles(void)
+{
+#ifdef BENCH_X86
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static int bench_always(void)
+{
+	return 1;
+}
+
+#ifdef BENCH_X86
+static int bench_aes_ni(void)
+{
+	return aes_ni_available();
+}
+
+static int bench_avx2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+static int bench_avx512(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx512f");
+}
+#endif
+
+// Valid uplink frames of 'size' bytes FRMPayload for the decode cases
+static void bench_make_frames(size_t size)
+{
+	for (uint32_t i = 0; i < CODEC_BATCH_MAX; i++) {
+		codec_encode_frame(bench_in[0], size, &bench_session, 0x26011BDA + i, i, 1, bench_frame[i]);
+	}
+	bench_frame_size = size + CODEC_FRAME_OVERHEAD;
+	base64_encode_to(bench_frame[0], bench_frame_size, bench_b64, sizeof(bench_b64), &size);
+}
+
+static void run_p12(size_t size, uint64_t iterations)
+{
+	(void)size;
+	for (uint64_t i = 0; i < iterations; i++) {
+		P12(&bench_state);
+	}
+	bench_sink = bench_state.x[0];
+}
+
+static void run_p8(size_t size, uint64_t iterations)
+{
+	(void)size;
+	for (uint64_t i = 0; i < iterations; i++) {
+		P8(&bench_state);
+	}
+	bench_sink = bench_state.x[0];
+}
+
+/* key initialization included, as the command line program */
+static void run_crypto_auth(size_t size, uint64_t iterations)
+{
+	for (uint64_t i = 0; i < iterations; i++) {
+		crypto_auth(bench_out[0], bench_in[0], size, bench_key);
+	}
+	bench_sink = bench_out[0][0];
+}
+
+/* keyed state of the session reused, as the codec */
+static void run_crypto_prf_keyed(size_t size, uint64_t iterations)
+{
+	for (uint64_t i = 0; i < iterations; i++) {
+		crypto_prf_keyed(bench_out[0], CRYPTO_BYTES, bench_in[0], size, &bench_session.nwk_s_key);
+	}
+	bench_sink = bench_out[0][0];
+}
+
+#ifdef BENCH_X86
+static void bench_lanes(ascon_prf_msg_t msg[], const ascon_prf_msg_t *m[], const ascon_state_t *ks[],
+			unsigned char *out[], size_t size)
+{
+	for (uint32_t l = 0; l < BENCH_LANES_MAX; l++) {
+		msg[l].hdr = NULL;
+		msg[l].hdrlen = 0;
+		msg[l].in = bench_in[l];
+		msg[l].inlen = size;
+		m[l] = &msg[l];
+		ks[l] = &bench_session.nwk_s_key;
+		out[l] = bench_out[l];
+	}
+}
+
+static void run_crypto_prf_keyed_x4(size_t size, uint64_t iterations)
+{
+	ascon_prf_msg_t msg[BENCH_LANES_MAX];
+	const ascon_prf_msg_t *m[BENCH_LANES_MAX];
+	const ascon_state_t *ks[BENCH_LANES_MAX];
+	unsigned char *out[BENCH_LANES_MAX];
+
+	bench_lanes(msg, m, ks, out, size);
+	for (uint64_t i = 0; i < iterations; i++) {
+		crypto_prf_keyed_x4(out, m, ks);
+	}
+	bench_sink = bench_out[3][0];
+}
+
+static void run_crypto_prf_keyed_x8(size_t size, uint64_t iterations)
+{
+	ascon_prf_msg_t msg[BENCH_LANES_MAX];
+	const ascon_prf_msg_t *m[BENCH_LANES_MAX];
+	const ascon_state_t *ks[BENCH_LANES_MAX];
+	unsigned char *out[BENCH_LANES_MAX];
+
+	bench_lanes(msg, m, ks, out, size);
+	for (uint64_t i = 0; i < iterations; i++) {
+		crypto_prf_keyed_x8(out, m, ks);
+	}
+	bench_sink = bench_out[7][0];
+}
+#endif
+
+static void run_aes_set_key(size_t size, uint64_t iterations)
+{
+	aes_context ctx;
+
+	(void)size;
+	for (uint64_t i = 0; i < iterations; i++) {
+		aes_set_key(bench_key, 16, &ctx);
+	}
+	bench_sink = ctx.ksch[0];
+}
+
+/* chained, each block is the input of the next one */
+static void run_aes_encrypt(size_t size, uint64_t iterations)
+{
+	(void)size;
+	for (uint64_t i = 0; i < iterations; i++) {
+		aes_encrypt(bench_out[0], bench_out[0], &bench_session.app_s_key);
+	}
+	bench_sink = bench_out[0][0];
+}
+
+/* the 8 blocks pipelines, independent blocks as the A_i of a FRMPayload */
+static void run_aes_encrypt_blocks(size_t size, uint64_t iterations)
+{
+	(void)size;
+	for (uint64_t i = 0; i < iterations; i++) {
+		aes_encrypt_blocks(bench_in[0], bench_out[0], 8, &bench_session.app_s_key);
+	}
+	bench_sink = bench_out[0][0];
+}
+
+static void run_aes_ct_encrypt_blocks(size_t size, uint64_t iterations)
+{
+	const aes_context *ctx = &bench_session.app_s_key;
+
+	(void)size;
+	for (uint64_t i = 0; i < iterations; i++) {
+		aes_ct_encrypt_blocks(bench_in[0], bench_out[0], 8, &ctx, 0);
+	}
+	bench_sink = bench_out[0][0];
+}
+
+#ifdef BENCH_X86
+static void run_aes_ni_encrypt_blocks(size_t size, uint64_t iterations)
+{
+	const aes_context *ctx = &bench_session.app_s_key;
+
+	(void)size;
+	for (uint64_t i = 0; i < iterations; i++) {
+		aes_ni_encrypt_blocks(bench_in[0], bench_out[0], 8, &ctx, 0);
+	}
+	bench_sink = bench_out[0][0];
+}
+#endif
+
+static void run_base64_decode(size_t size, uint64_t iterations)
+{
+	size_t b64_size = BASE64_ENCODED_SIZE(size);
+	size_t out_size;
+
+	base64_encode_to(bench_in[0], size, bench_b64, sizeof(bench_b64), &out_size);
+	for (uint64_t i = 0; i < iterations; i++) {
+		base64_decode_to(bench_b64, b64_size, bench_out[0], sizeof(bench_out[0]), &out_size);
+	}
+	bench_sink = out_size;
+}
+
+/* the malloc() of the result included */
+static void run_base64_decode_malloc(size_t size, uint64_t iterations)
+{
+	size_t b64_size = BASE64_ENCODED_SIZE(size);
+	size_t out_size;
+
+	base64_encode_to(bench_in[0], size, bench_b64, sizeof(bench_b64), &out_size);
+	for (uint64_t i = 0; i < iterations; i++) {
+		free(base64_decode(bench_b64, b64_size, &out_size));
+	}
+	bench_sink = out_size;
+}
+
+static void run_loramac_calculate_mic(size_t size, uint64_t iterations)
+{
+	struct loramac_phys_payload phys = {0};
+	uint32_t mic = 0;
+
+	loramac_fill_fhdr(&phys, 0x26011BDA, 0, 1, NULL);
+	loramac_fill_mac_payload(&phys, 1, bench_in[0]);
+	loramac_fill_phys_payload(&phys, LORAMAC_PHYS_PAYLOAD_MHDR_UNCONFIRM_DATA_UP, 0);
+	for (uint64_t i = 0; i < iterations; i++) {
+		loramac_calculate_mic(&phys, size, &bench_session.nwk_s_key, 1, &mic);
+	}
+	bench_sink = mic;
+}
+
+static void run_loramac_frm_payload_encryption(size_t size, uint64_t iterations)
+{
+	struct loramac_phys_payload phys = {0};
+
+	loramac_fill_fhdr(&phys, 0x26011BDA, 0, 1, NULL);
+	loramac_fill_mac_payload(&phys, 1, bench_out[0]);
+	loramac_fill_phys_payload(&phys, LORAMAC_PHYS_PAYLOAD_MHDR_UNCONFIRM_DATA_UP, 0);
+	for (uint64_t i = 0; i < iterations; i++) {
+		loramac_frm_payload_encryption(&phys, size, &bench_session.app_s_key);
+	}
+	bench_sink = bench_out[0][0];
+}
+
+static void run_codec_decode_frame(size_t size, uint64_t iterations)
+{
+	struct codec_uplink uplink;
+
+	bench_make_frames(size);
+	for (uint64_t i = 0; i < iterations; i++) {
+		if (codec_decode_frame(bench_frame[0], bench_frame_size, &bench_session, &uplink, bench_out[0]) != CODEC_OK) {
+			fprintf(stderr, "codec_decode_frame failed\n");
+			exit(1);
+		}
+	}
+	bench_sink = uplink.f_cnt;
+}
+
+/* base64 string to payload, as './out <base64> <appskey> <nwkskey>' once the keys are parsed */
+static void run_decode_base64(size_t size, uint64_t iterations)
+{
+	size_t b64_size = BASE64_ENCODED_SIZE(size + CODEC_FRAME_OVERHEAD);
+	struct codec_uplink uplink;
+	size_t frame_size;
+
+	bench_make_frames(size);
+	for (uint64_t i = 0; i < iterations; i++) {
+		base64_decode_to(bench_b64, b64_size, bench_in[1], sizeof(bench_in[1]), &frame_size);
+		if (codec_decode_frame(bench_in[1], frame_size, &bench_session, &uplink, bench_out[0]) != CODEC_OK) {
+			fprintf(stderr, "codec_decode_frame failed\n");
+			exit(1);
+		}
+	}
+	bench_sink = uplink.f_cnt;
+}
+
+static void run_codec_decode_batch(size_t size, uint64_t iterations)
+{
+	static struct codec_batch batch;
+
+	bench_make_frames(size);
+	batch.count = CODEC_BATCH_MAX;
+	for (uint32_t n = 0; n < CODEC_BATCH_MAX; n++) {
+		batch.frame[n] = bench_frame[n];
+		batch.frame_size[n] = bench_frame_size;
+		batch.session[n] = &bench_session;
+		batch.payload[n] = bench_out[n];
+	}
+	for (uint64_t i = 0; i < iterations; i++) {
+		if (codec_decode_batch(&batch) != CODEC_BATCH_MAX) {
+			fprintf(stderr, "codec_decode_batch failed\n");
+			exit(1);
+		}
+	}
+	bench_sink = batch.f_cnt[0];
+}
+
+static const struct bench_case bench_cases[] = {
+	{"P12", "ref", 40, 1, bench_always, run_p12},
+	{"P8", "ref", 40, 1, bench_always, run_p8},
+	{"crypto_auth", "ref", 0, 1, bench_always, run_crypto_auth},
+	{"crypto_prf_keyed", "ref", 0, 1, bench_always, run_crypto_prf_keyed},
+#ifdef BENCH_X86
+	{"crypto_prf_keyed", "avx2-x4", 0, 4, bench_avx2, run_crypto_prf_keyed_x4},
+	{"crypto_prf_keyed", "avx512-x8", 0, 8, bench_avx512, run_crypto_prf_keyed_x8},
+#endif
+	{"aes_set_key", "default", 16, 1, bench_always, run_aes_set_key},
+	{"aes_encrypt", "default", 16, 1, bench_always, run_aes_encrypt},
+	{"aes_encrypt_blocks", "default", 16, 8, bench_always, run_aes_encrypt_blocks},
+	{"aes_encrypt_blocks", "ct", 16, 8, bench_always, run_aes_ct_encrypt_blocks},
+#ifdef BENCH_X86
+	{"aes_encrypt_blocks", "aes-ni", 16, 8, bench_aes_ni, run_aes_ni_encrypt_blocks},
+#endif
+	{"base64_decode", "to", 0, 1, bench_always, run_base64_decode},
+	{"base64_decode", "malloc", 0, 1, bench_always, run_base64_decode_malloc},
+	{"loramac_calculate_mic", "default", 0, 1, bench_always, run_loramac_calculate_mic},
+	{"loramac_frm_payload_encryption", "default", 0, 1, bench_always, run_loramac_frm_payload_encryption},
+	{"codec_decode_frame", "default", 0, 1, bench_always, run_codec_decode_frame},
+	{"decode_base64", "default", 0, 1, bench_always, run_decode_base64},
+	{"codec_decode_batch", "default", 0, CODEC_BATCH_MAX, bench_always, run_codec_decode_batch},
+};
+
+static int bench_compare(const void *a, const void *b)
+{
+	double x = ((const struct bench_result *)a)->ns_op;
+	double y = ((const struct bench_result *)b)->ns_op;
+	return (x > y) - (x < y);
+}
+
+static struct bench_result bench_measure(const struct bench_case *c, size_t size)
+{
+	struct bench_result runs[BENCH_RUNS];
+	uint64_t iterations = 1;
+
+	/* calibrate, this also warms the caches and the branch predictors up */
+	for (;;) {
+		uint64_t start = bench_now_ns();
+		c->run(size, iterations);
+		uint64_t elapsed = bench_now_ns() - start;
+		if (elapsed >= BENCH_RUN_NS / 2 || iterations >= UINT64_MAX / 4) {
+			iterations = elapsed ? iterations * BENCH_RUN_NS / elapsed : iterations;
+			break;
+		}
+		iterations *= 2;
+	}
+	if (iterations == 0) {
+		iterations = 1;
+	}
+	for (int r = 0; r < BENCH_RUNS; r++) {
+		uint64_t start = bench_now_ns();
+		uint64_t start_cycles = bench_cycles();
+		c->run(size, iterations);
+		uint64_t cycles = bench_cycles() - start_cycles;
+		uint64_t elapsed = bench_now_ns() - start;
+		runs[r].ns_op = (double)elapsed / ((double)iterations * c->ops);
+		runs[r].cycles_op = (double)cycles / ((double)iterations * c->ops);
+	}
+	qsort(runs, BENCH_RUNS, sizeof(runs[0]), bench_compare);
+	return runs[BENCH_RUNS / 2];
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *csv = NULL;
+	const char *filter = argc > 2 ? argv[2] : "";
+
+	if (argc > 1 && (csv = fopen(argv[1], "w")) == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+#ifdef __linux__
+	/* stay on one CPU, the TSC and the caches are those of the same core */
+	cpu_set_t cpus;
+	int cpu = sched_getcpu();
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu < 0 ? 0 : cpu, &cpus);
+	sched_setaffinity(0, sizeof(cpus), &cpus);
+#endif
+	for (uint32_t l = 0; l < BENCH_LANES_MAX; l++) {
+		for (size_t i = 0; i < sizeof(bench_in[l]); i++) {
+			bench_in[l][i] = (uint8_t)(i * 131 + l * 7 + 1);
+		}
+	}
+	codec_session_init(&bench_session, bench_key, bench_key);
+	bench_state = bench_session.nwk_s_key;
+
+	if (csv != NULL) {
+		fprintf(csv, "case,backend,bytes,ops,ns_op,ops_sec,cycles_op,cycles_byte\n");
+	}
+	printf("%-32s %-10s %6s %12s %14s %12s %12s\n", "case", "backend", "bytes", "ns/op", "ops/sec", "cycles/op",
+	       "cycles/byte");
+	for (size_t i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++) {
+		const struct bench_case *c = &bench_cases[i];
+		size_t n_size = c->bytes ? 1 : sizeof(bench_sizes) / sizeof(bench_sizes[0]);
+
+		if (strncmp(c->name, filter, strlen(filter)) != 0) {
+			continue;
+		}
+		if (!c->available()) {
+			printf("%-32s %-10s not supported by this CPU\n", c->name, c->backend);
+			continue;
+		}
+		for (size_t s = 0; s < n_size; s++) {
+			size_t size = c->bytes ? c->bytes : bench_sizes[s];
+			struct bench_result result = bench_measure(c, size);
+			double ops_sec = 1e9 / result.ns_op;
+			double cycles_byte = result.cycles_op / size;
+
+			printf("%-32s %-10s %6zu %12.1f %14.0f %12.1f %12.2f\n", c->name, c->backend, size, result.ns_op,
+			       ops_sec, result.cycles_op, cycles_byte);
+			if (csv != NULL) {
+				fprintf(csv, "%s,%s,%zu,%u,%.2f,%.0f,%.2f,%.3f\n", c->name, c->backend, size, c->ops,
+					result.ns_op, ops_sec, result.cycles_op, cycles_byte);
+			}
+			fflush(stdout);
+		}
+	}
+	if (csv != NULL) {
+		fclose(csv);
+	}
+	return 0;
+}
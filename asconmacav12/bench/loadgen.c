@@ -0,0 +1,795 @@
+/*
+ * Load generator: a fleet of virtual devices heard by virtual gateways
+ *
+ * Usage: ./loadgen [options]
+ *
+ * Every device has its own keys (derived from --seed and its index) and
+ * FCnt, and sends an unconfirmed data up frame built by the codec in turn
+ * with the others, so the fleet sends --rate uplinks/sec in total. Every
+ * uplink is heard by --dup of the --gateways gateways, each copy is dropped
+ * with the probability --loss (radio loss), the others go to the server as
+ * one rxpk per PUSH_DATA from the socket of their gateway. The gateways also
+ * send a PULL_DATA every --keepalive seconds.
+ *
+ * The server has to know the devices: '--provision' writes the fleet into
+ * the session table --table and exits, then start the server on that table
+ * (SESSION_TABLE_PATH) and run the load with the same --table, --devices
+ * and --seed. The table is mapped by both processes, the decodes are counted
+ * from the "last uplink FCnt accepted" of every device, polled every
+ * LG_POLL_MS (a device must not send faster than that).
+ *
+ * --rate START:STEP:MAX runs one step of --seconds per rate and stops at the
+ * first step which loses more than --max-loss % of the ACKs or decodes,
+ * or whose p99 ACK round trip is above --max-p99 ms; the last rate held is
+ * the saturation point. --csv writes one line per step.
+ *
+ *   ./loadgen --table fleet.tbl --devices 10000 --provision
+ *   SESSION_TABLE_PATH=fleet.tbl npm start
+ *   ./loadgen --table fleet.tbl --devices 10000 --gateways 4 --dup 2 --rate 500:500:10000
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "base64.h"
+#include "codec.h"
+#include "session_table.h"
+
+#define LG_GATEWAYS_MAX 256
+#define LG_THREADS_MAX 64
+#define LG_POLL_MS 10
+#define LG_LATE_NS 100000000u /* a frame sent 100 ms behind its schedule */
+#define LG_LATENCY_BUCKET_US 10
+#define LG_LATENCY_BUCKETS 100000 /* 1 s, the last one takes everything above */
+#define LG_DATAGRAM_MAX 1024
+#define LG_FRAME_MAX (CODEC_FRM_PAYLOAD_MAX + CODEC_FRAME_OVERHEAD)
+#define LG_PROTOCOL_VERSION 0x02
+
+enum lg_packet_type {
+	LG_PUSH_DATA = 0x00,
+	LG_PUSH_ACK = 0x01,
+	LG_PULL_DATA = 0x02,
+	LG_PULL_RESP = 0x03,
+	LG_PULL_ACK = 0x04,
+};
+
+struct lg_config {
+	const char *host;
+	uint16_t port;
+	uint32_t n_device;
+	uint32_t n_gateway;
+	uint32_t dup;
+	uint32_t n_thread;
+	double rate;
+	double rate_step;
+	double rate_max;
+	uint32_t seconds;
+	uint32_t grace_ms;
+	uint32_t size_min;
+	uint32_t size_max;
+	double loss;
+	uint32_t keepalive;
+	uint64_t seed;
+	const char *table;
+	const char *csv;
+	int provision;
+	double max_loss;
+	double max_p99_ms;
+};
+
+struct lg_device {
+	uint32_t dev_addr;
+	uint32_t f_cnt;
+	const struct session_entry *entry; /* in the table shared with the server */
+	uint32_t f_cnt_up; /* last value read from entry */
+	struct codec_session session;
+};
+
+struct lg_gateway {
+	int fd;
+	uint8_t eui[8];
+	uint16_t token;
+	uint64_t sent_ns[65536]; /* by token, 0 once acknowledged */
+};
+
+struct lg_worker {
+	pthread_t thread;
+	uint32_t index;
+	double rate;
+	uint64_t rng;
+	/* results */
+	uint64_t uplinks;
+	uint64_t lost;
+	uint64_t datagrams;
+	uint64_t late;
+};
+
+struct lg_receiver {
+	pthread_t thread;
+	uint64_t push_acks;
+	uint64_t pull_sent;
+	uint64_t pull_acks;
+	uint64_t downlinks;
+	uint32_t latency[LG_LATENCY_BUCKETS];
+};
+
+struct lg_result {
+	double rate;
+	double elapsed;
+	uint64_t uplinks;
+	uint64_t lost;
+	uint64_t datagrams;
+	uint64_t late;
+	uint64_t push_acks;
+	uint64_t pull_acks;
+	uint64_t pull_sent;
+	uint64_t downlinks;
+	uint64_t decoded;
+	double ack_loss;
+	double decode_loss;
+	uint32_t p50_us;
+	uint32_t p99_us;
+	uint32_t p999_us;
+	int pass;
+};
+
+static struct lg_config config = {
+	.host = "127.0.0.1",
+	.port = 1700,
+	.n_device = 1000,
+	.n_gateway = 1,
+	.dup = 1,
+	.n_thread = 2,
+	.rate = 100,
+	.seconds = 10,
+	.grace_ms = 1000,
+	.size_min = 16,
+	.size_max = 16,
+	.keepalive = 5,
+	.seed = 1,
+	.max_loss = 1.0,
+	.max_p99_ms = 100,
+};
+static struct lg_device *devices;
+static struct lg_gateway *gateways;
+static struct lg_receiver receiver;
+static volatile int workers_stop;
+static volatile int receiver_stop;
+
+static uint64_t lg_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void lg_sleep_until(uint64_t ns)
+{
+	struct timespec ts = {(time_t)(ns / 1000000000u), (long)(ns % 1000000000u)};
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+	}
+}
+
+static uint64_t lg_splitmix64(uint64_t x)
+{
+	x += UINT64_C(0x9E3779B97F4A7C15);
+	x = (x ^ (x >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+	x = (x ^ (x >> 27)) * UINT64_C(0x94D049BB133111EB);
+	return x ^ (x >> 31);
+}
+
+static uint64_t lg_random(uint64_t *state)
+{
+	*state = lg_splitmix64(*state);
+	return *state;
+}
+
+// Uniform in [0, 1)
+static double lg_random_unit(uint64_t *state)
+{
+	return (lg_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Keys of device 'index', the same for the provisioning and the load runs
+static void lg_device_keys(uint32_t index, uint8_t appskey[CODEC_KEYBYTES], uint8_t nwkskey[CODEC_KEYBYTES])
+{
+	uint64_t state = config.seed ^ ((uint64_t)index << 32);
+
+	for (uint32_t i = 0; i < CODEC_KEYBYTES; i++) {
+		appskey[i] = (uint8_t)lg_random(&state);
+		nwkskey[i] = (uint8_t)lg_random(&state);
+	}
+}
+
+static uint32_t lg_device_addr(uint32_t index)
+{
+	return 0x26000000u + index; /* NetID 0x13, experimental */
+}
+
+static int lg_provision(void)
+{
+	struct session_table table;
+	uint8_t appskey[CODEC_KEYBYTES], nwkskey[CODEC_KEYBYTES];
+	int32_t rc = session_table_open(&table, config.table, config.n_device * 2);
+
+	if (rc != SESSION_TABLE_OK) {
+		fprintf(stderr, "Cannot open the session table %s: %d\n", config.table, rc);
+		return 1;
+	}
+	for (uint32_t i = 0; i < config.n_device && rc == SESSION_TABLE_OK; i++) {
+		lg_device_keys(i, appskey, nwkskey);
+		rc = session_table_put(&table, lg_device_addr(i), appskey, nwkskey);
+	}
+	if (rc == SESSION_TABLE_OK) {
+		rc = session_table_sync(&table);
+	}
+	session_table_close(&table);
+	if (rc != SESSION_TABLE_OK) {
+		fprintf(stderr, "Cannot write the session table %s: %d\n", config.table, rc);
+		return 1;
+	}
+	printf("%u devices (%08X..%08X) written to %s, start the server with SESSION_TABLE_PATH=%s\n",
+	       config.n_device, lg_device_addr(0), lg_device_addr(config.n_device - 1), config.table, config.table);
+	return 0;
+}
+
+static int lg_setup(struct session_table *table, int *table_open)
+{
+	struct sockaddr_in addr;
+	uint8_t appskey[CODEC_KEYBYTES], nwkskey[CODEC_KEYBYTES];
+	int buffer_size = 4 << 20;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(config.port);
+	if (inet_pton(AF_INET, config.host, &addr.sin_addr) != 1) {
+		fprintf(stderr, "Invalid server address %s\n", config.host);
+		return -1;
+	}
+	*table_open = 0;
+	if (config.table != NULL) {
+		if (access(config.table, R_OK | W_OK) != 0 ||
+		    session_table_open(table, config.table, config.n_device) != SESSION_TABLE_OK) {
+			fprintf(stderr, "Cannot open the session table %s, run --provision first\n", config.table);
+			return -1;
+		}
+		*table_open = 1;
+	}
+
+	devices = calloc(config.n_device, sizeof(*devices));
+	gateways = calloc(config.n_gateway, sizeof(*gateways));
+	if (devices == NULL || gateways == NULL) {
+		fprintf(stderr, "Cannot allocate %u devices\n", config.n_device);
+		return -1;
+	}
+	uint32_t missing = 0;
+	for (uint32_t i = 0; i < config.n_device; i++) {
+		struct lg_device *device = &devices[i];
+		device->dev_addr = lg_device_addr(i);
+		lg_device_keys(i, appskey, nwkskey);
+		codec_session_init(&device->session, appskey, nwkskey);
+		if (*table_open) {
+			device->entry = session_table_find(table, device->dev_addr);
+			if (device->entry == NULL || memcmp(device->entry->appskey, appskey, CODEC_KEYBYTES) != 0 ||
+			    memcmp(device->entry->nwkskey, nwkskey, CODEC_KEYBYTES) != 0) {
+				device->entry = NULL;
+				missing++;
+			} else {
+				/* carry on after the FCnt the server has seen */
+				device->f_cnt = device->entry->f_cnt_up;
+			}
+		}
+	}
+	if (missing) {
+		fprintf(stderr, "%u devices are not in %s with these keys, run --provision with the same --devices and --seed\n",
+			missing, config.table);
+		return -1;
+	}
+	for (uint32_t g = 0; g < config.n_gateway; g++) {
+		struct lg_gateway *gateway = &gateways[g];
+		uint64_t eui = UINT64_C(0xAA555A0000000000) | g;
+		for (uint32_t i = 0; i < 8; i++) {
+			gateway->eui[i] = (uint8_t)(eui >> (56 - 8 * i));
+		}
+		gateway->fd = socket(AF_INET, SOCK_DGRAM, 0);
+		if (gateway->fd < 0 || connect(gateway->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+			perror("gateway socket");
+			return -1;
+		}
+		setsockopt(gateway->fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+		setsockopt(gateway->fd, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+	}
+	return 0;
+}
+
+static uint16_t lg_header(struct lg_gateway *gateway, uint8_t type, uint8_t *datagram)
+{
+	uint16_t token = __atomic_fetch_add(&gateway->token, 1, __ATOMIC_RELAXED);
+
+	datagram[0] = LG_PROTOCOL_VERSION;
+	datagram[1] = (uint8_t)token;
+	datagram[2] = (uint8_t)(token >> 8);
+	datagram[3] = type;
+	memcpy(&datagram[4], gateway->eui, 8);
+	return token;
+}
+
+// Build the next frame of 'device' and send its copies, returns the number of copies sent
+static uint32_t lg_send_uplink(struct lg_worker *worker, struct lg_device *device, uint32_t index)
+{
+	uint8_t payload[CODEC_FRM_PAYLOAD_MAX];
+	uint8_t frame[LG_FRAME_MAX];
+	char data[BASE64_ENCODED_SIZE(LG_FRAME_MAX) + 1];
+	uint8_t datagram[LG_DATAGRAM_MAX];
+	uint32_t size = config.size_min;
+	size_t data_size;
+	uint32_t sent = 0;
+
+	if (config.size_max > config.size_min) {
+		size += lg_random(&worker->rng) % (config.size_max - config.size_min + 1);
+	}
+	for (uint32_t i = 0; i < size; i++) {
+		payload[i] = (uint8_t)lg_random(&worker->rng);
+	}
+	device->f_cnt++;
+	codec_encode_uplink(payload, size, &device->session, device->dev_addr, device->f_cnt, 1, frame);
+	base64_encode_to(frame, size + CODEC_FRAME_OVERHEAD, data, sizeof(data) - 1, &data_size);
+	data[data_size] = '\0';
+
+	for (uint32_t copy = 0; copy < config.dup; copy++) {
+		struct lg_gateway *gateway = &gateways[(index + copy) % config.n_gateway];
+		if (config.loss > 0 && lg_random_unit(&worker->rng) < config.loss) {
+			continue;
+		}
+		uint16_t token = lg_header(gateway, LG_PUSH_DATA, datagram);
+		int json_size = snprintf((char *)&datagram[12], sizeof(datagram) - 12,
+					 "{\"rxpk\":[{\"tmst\":%u,\"chan\":%u,\"rfch\":0,\"freq\":%.1f,\"stat\":1,"
+					 "\"modu\":\"LORA\",\"datr\":\"SF7BW125\",\"codr\":\"4/5\",\"rssi\":%d,"
+					 "\"lsnr\":%.1f,\"size\":%zu,\"data\":\"%s\"}]}",
+					 (uint32_t)(lg_now_ns() / 1000), device->f_cnt % 8, 867.1 + 0.2 * (device->f_cnt % 8),
+					 -120 + (int)(lg_random(&worker->rng) % 90), -10.0 + (lg_random(&worker->rng) % 200) / 10.0,
+					 (size_t)size + CODEC_FRAME_OVERHEAD, data);
+		__atomic_store_n(&gateway->sent_ns[token], lg_now_ns(), __ATOMIC_RELAXED);
+		if (send(gateway->fd, datagram, 12 + json_size, 0) == 12 + json_size) {
+			worker->datagrams++;
+			sent++;
+		} else {
+			__atomic_store_n(&gateway->sent_ns[token], 0, __ATOMIC_RELAXED);
+		}
+	}
+	return sent;
+}
+
+/* worker i sends for the devices i, i + n_thread, ... in turn */
+static void *lg_worker_run(void *arg)
+{
+	struct lg_worker *worker = arg;
+	uint64_t interval = (uint64_t)(1e9 / worker->rate);
+	uint64_t next = lg_now_ns();
+	uint32_t index = worker->index;
+
+	if (index >= config.n_device) {
+		return NULL;
+	}
+	while (!workers_stop) {
+		uint64_t now = lg_now_ns();
+		if (now < next) {
+			lg_sleep_until(next);
+		} else if (now - next > LG_LATE_NS) {
+			worker->late++;
+		}
+		next += interval;
+
+		worker->uplinks++;
+		if (lg_send_uplink(worker, &devices[index], index) == 0) {
+			worker->lost++;
+		}
+		index += config.n_thread;
+		if (index >= config.n_device) {
+			index = worker->index;
+		}
+	}
+	return NULL;
+}
+
+static void lg_send_pull_data(void)
+{
+	uint8_t datagram[12];
+
+	for (uint32_t g = 0; g < config.n_gateway; g++) {
+		lg_header(&gateways[g], LG_PULL_DATA, datagram);
+		if (send(gateways[g].fd, datagram, sizeof(datagram), 0) == sizeof(datagram)) {
+			receiver.pull_sent++;
+		}
+	}
+}
+
+static void lg_receive(struct lg_gateway *gateway)
+{
+	uint8_t ack[LG_DATAGRAM_MAX];
+	ssize_t n;
+
+	while ((n = recv(gateway->fd, ack, sizeof(ack), MSG_DONTWAIT)) >= 0) {
+		if (n < 4 || ack[0] != LG_PROTOCOL_VERSION) {
+			continue;
+		}
+		if (ack[3] == LG_PULL_ACK) {
+			receiver.pull_acks++;
+		} else if (ack[3] == LG_PULL_RESP) {
+			receiver.downlinks++;
+		} else if (ack[3] == LG_PUSH_ACK && n == 4) {
+			uint16_t token = ack[1] | (ack[2] << 8);
+			uint64_t sent_ns = __atomic_exchange_n(&gateway->sent_ns[token], 0, __ATOMIC_RELAXED);
+			if (sent_ns == 0) {
+				/* duplicated ACK, or of a datagram from a previous step */
+				continue;
+			}
+			uint64_t bucket = (lg_now_ns() - sent_ns) / 1000 / LG_LATENCY_BUCKET_US;
+			receiver.latency[bucket < LG_LATENCY_BUCKETS ? bucket : LG_LATENCY_BUCKETS - 1]++;
+			receiver.push_acks++;
+		}
+	}
+}
+
+static void *lg_receiver_run(void *arg)
+{
+	static struct pollfd fds[LG_GATEWAYS_MAX];
+	uint64_t keepalive = 0;
+
+	(void)arg;
+	for (uint32_t g = 0; g < config.n_gateway; g++) {
+		fds[g].fd = gateways[g].fd;
+		fds[g].events = POLLIN;
+	}
+	while (!receiver_stop) {
+		if (lg_now_ns() >= keepalive) {
+			lg_send_pull_data();
+			keepalive = lg_now_ns() + (uint64_t)config.keepalive * 1000000000u;
+		}
+		if (poll(fds, config.n_gateway, LG_POLL_MS) <= 0) {
+			continue;
+		}
+		for (uint32_t g = 0; g < config.n_gateway; g++) {
+			if (fds[g].revents & POLLIN) {
+				lg_receive(&gateways[g]);
+			}
+		}
+	}
+	return NULL;
+}
+
+// Number of devices whose last accepted FCnt moved since the last poll
+static uint64_t lg_poll_decoded(void)
+{
+	uint64_t decoded = 0;
+
+	for (uint32_t i = 0; i < config.n_device; i++) {
+		struct lg_device *device = &devices[i];
+		uint32_t f_cnt_up = __atomic_load_n(&device->entry->f_cnt_up, __ATOMIC_RELAXED);
+		if (f_cnt_up != device->f_cnt_up) {
+			device->f_cnt_up = f_cnt_up;
+			decoded++;
+		}
+	}
+	return decoded;
+}
+
+static uint32_t lg_percentile(const uint32_t *latency, uint64_t total, double p)
+{
+	uint64_t rank = (uint64_t)(total * p);
+	uint64_t seen = 0;
+
+	for (uint32_t bucket = 0; bucket < LG_LATENCY_BUCKETS; bucket++) {
+		seen += latency[bucket];
+		if (seen > rank) {
+			return bucket * LG_LATENCY_BUCKET_US;
+		}
+	}
+	return LG_LATENCY_BUCKETS * LG_LATENCY_BUCKET_US;
+}
+
+static void lg_step(double rate, int watch_table, struct lg_result *result)
+{
+	static struct lg_worker workers[LG_THREADS_MAX];
+
+	memset(result, 0, sizeof(*result));
+	memset(&receiver, 0, sizeof(receiver));
+	for (uint32_t g = 0; g < config.n_gateway; g++) {
+		memset(gateways[g].sent_ns, 0, sizeof(gateways[g].sent_ns));
+	}
+	if (watch_table) {
+		for (uint32_t i = 0; i < config.n_device; i++) {
+			devices[i].f_cnt_up = devices[i].entry->f_cnt_up;
+		}
+	}
+	workers_stop = 0;
+	receiver_stop = 0;
+	pthread_create(&receiver.thread, NULL, lg_receiver_run, NULL);
+	for (uint32_t i = 0; i < config.n_thread; i++) {
+		memset(&workers[i], 0, sizeof(workers[i]));
+		workers[i].index = i;
+		workers[i].rate = rate / config.n_thread;
+		workers[i].rng = lg_splitmix64(config.seed + i + ((uint64_t)rate << 16));
+		pthread_create(&workers[i].thread, NULL, lg_worker_run, &workers[i]);
+	}
+
+	uint64_t start = lg_now_ns();
+	uint64_t end = start + (uint64_t)config.seconds * 1000000000u;
+	uint64_t grace_end = end + (uint64_t)config.grace_ms * 1000000u;
+	for (uint64_t now = start; now < grace_end; now = lg_now_ns()) {
+		if (now >= end && !workers_stop) {
+			workers_stop = 1;
+			for (uint32_t i = 0; i < config.n_thread; i++) {
+				pthread_join(workers[i].thread, NULL);
+			}
+			result->elapsed = (lg_now_ns() - start) / 1e9;
+		}
+		if (watch_table) {
+			result->decoded += lg_poll_decoded();
+		}
+		usleep(LG_POLL_MS * 1000);
+	}
+	receiver_stop = 1;
+	pthread_join(receiver.thread, NULL);
+
+	for (uint32_t i = 0; i < config.n_thread; i++) {
+		result->uplinks += workers[i].uplinks;
+		result->lost += workers[i].lost;
+		result->datagrams += workers[i].datagrams;
+		result->late += workers[i].late;
+	}
+	result->rate = rate;
+	result->push_acks = receiver.push_acks;
+	result->pull_sent = receiver.pull_sent;
+	result->pull_acks = receiver.pull_acks;
+	result->downlinks = receiver.downlinks;
+	result->p50_us = lg_percentile(receiver.latency, receiver.push_acks, 0.50);
+	result->p99_us = lg_percentile(receiver.latency, receiver.push_acks, 0.99);
+	result->p999_us = lg_percentile(receiver.latency, receiver.push_acks, 0.999);
+
+	uint64_t expected = result->uplinks - result->lost;
+	result->ack_loss = result->datagrams ? 100.0 * (result->datagrams - result->push_acks) / result->datagrams : 0;
+	result->decode_loss = watch_table && expected ? 100.0 * ((double)expected - result->decoded) / expected : 0;
+	result->pass = result->ack_loss <= config.max_loss && result->decode_loss <= config.max_loss &&
+		       result->p99_us <= config.max_p99_ms * 1000;
+}
+
+static void lg_report(const struct lg_result *r, int watch_table, FILE *csv)
+{
+	uint64_t expected = r->uplinks - r->lost;
+	char decoded[48] = "-";
+
+	if (watch_table) {
+		snprintf(decoded, sizeof(decoded), "%llu/%llu", (unsigned long long)r->decoded,
+			 (unsigned long long)expected);
+	}
+	printf("%8.0f %10.0f %10.0f %7.2f %8u %8u %8u %17s %7.2f %6llu  %s\n", r->rate, r->uplinks / r->elapsed,
+	       r->push_acks / r->elapsed, r->ack_loss, r->p50_us, r->p99_us, r->p999_us, decoded, r->decode_loss,
+	       (unsigned long long)r->late, r->pass ? "ok" : "SATURATED");
+	if (csv != NULL) {
+		fprintf(csv, "%.0f,%.1f,%llu,%llu,%llu,%.3f,%u,%u,%u,%llu,%llu,%.3f,%llu,%llu,%llu,%d\n", r->rate,
+			r->uplinks / r->elapsed, (unsigned long long)r->uplinks, (unsigned long long)r->datagrams,
+			(unsigned long long)r->push_acks, r->ack_loss, r->p50_us, r->p99_us, r->p999_us,
+			(unsigned long long)expected, (unsigned long long)(watch_table ? r->decoded : 0), r->decode_loss,
+			(unsigned long long)r->pull_sent, (unsigned long long)r->pull_acks,
+			(unsigned long long)r->late, r->pass);
+		fflush(csv);
+	}
+	if (r->late) {
+		printf("%llu uplinks sent more than %u ms late, the load generator is short of --threads\n",
+		       (unsigned long long)r->late, LG_LATE_NS / 1000000);
+	}
+}
+
+static void lg_usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  --host ADDR          server IPv4 address (%s)\n"
+		"  --port PORT          server UDP port (%u)\n"
+		"  --devices N          devices of the fleet (%u)\n"
+		"  --gateways M         gateways, 1..%d (%u)\n"
+		"  --dup D              gateways hearing every uplink, 1..M (%u)\n"
+		"  --rate R[:STEP:MAX]  uplinks/sec of the fleet, or a sweep (%.0f)\n"
+		"  --seconds S          duration of a rate step (%u)\n"
+		"  --grace MS           wait for the ACKs and decodes after a step (%u)\n"
+		"  --size MIN[-MAX]     FRMPayload bytes, uniform in [MIN, MAX] (%u)\n"
+		"  --loss PERCENT       drop probability of every copy (0)\n"
+		"  --keepalive S        PULL_DATA period of the gateways (%u)\n"
+		"  --threads T          sending threads, 1..%d (%u)\n"
+		"  --seed N             seed of the device keys (%llu)\n"
+		"  --table PATH         session table shared with the server\n"
+		"  --provision          write the fleet into --table and exit\n"
+		"  --csv PATH           write one line per step\n"
+		"  --max-loss PERCENT   ACK or decode loss of a saturated step (%.1f)\n"
+		"  --max-p99 MS         p99 ACK round trip of a saturated step (%.0f)\n",
+		name, config.host, config.port, config.n_device, LG_GATEWAYS_MAX, config.n_gateway, config.dup, config.rate,
+		config.seconds, config.grace_ms, config.size_min, config.keepalive, LG_THREADS_MAX, config.n_thread,
+		(unsigned long long)config.seed, config.max_loss, config.max_p99_ms);
+}
+
+static int lg_parse_options(int argc, char *argv[])
+{
+	static const struct option options[] = {
+		{"host", required_argument, NULL, 'h'},
+		{"port", required_argument, NULL, 'p'},
+		{"devices", required_argument, NULL, 'n'},
+		{"gateways", required_argument, NULL, 'g'},
+		{"dup", required_argument, NULL, 'd'},
+		{"rate", required_argument, NULL, 'r'},
+		{"seconds", required_argument, NULL, 's'},
+		{"grace", required_argument, NULL, 'G'},
+		{"size", required_argument, NULL, 'b'},
+		{"loss", required_argument, NULL, 'l'},
+		{"keepalive", required_argument, NULL, 'k'},
+		{"threads", required_argument, NULL, 't'},
+		{"seed", required_argument, NULL, 'S'},
+		{"table", required_argument, NULL, 'T'},
+		{"provision", no_argument, NULL, 'P'},
+		{"csv", required_argument, NULL, 'c'},
+		{"max-loss", required_argument, NULL, 'L'},
+		{"max-p99", required_argument, NULL, 'M'},
+		{"help", no_argument, NULL, 'H'},
+		{NULL, 0, NULL, 0},
+	};
+	int option;
+
+	while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+		switch (option) {
+		case 'h':
+			config.host = optarg;
+			break;
+		case 'p':
+			config.port = (uint16_t)atoi(optarg);
+			break;
+		case 'n':
+			config.n_device = (uint32_t)strtoul(optarg, NULL, 10);
+			break;
+		case 'g':
+			config.n_gateway = (uint32_t)atoi(optarg);
+			break;
+		case 'd':
+			config.dup = (uint32_t)atoi(optarg);
+			break;
+		case 'r':
+			if (sscanf(optarg, "%lf:%lf:%lf", &config.rate, &config.rate_step, &config.rate_max) == 2) {
+				return -1;
+			}
+			break;
+		case 's':
+			config.seconds = (uint32_t)atoi(optarg);
+			break;
+		case 'G':
+			config.grace_ms = (uint32_t)atoi(optarg);
+			break;
+		case 'b':
+			if (sscanf(optarg, "%u-%u", &config.size_min, &config.size_max) == 1) {
+				config.size_max = config.size_min;
+			}
+			break;
+		case 'l':
+			config.loss = atof(optarg) / 100;
+			break;
+		case 'k':
+			config.keepalive = (uint32_t)atoi(optarg);
+			break;
+		case 't':
+			config.n_thread = (uint32_t)atoi(optarg);
+			break;
+		case 'S':
+			config.seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'T':
+			config.table = optarg;
+			break;
+		case 'P':
+			config.provision = 1;
+			break;
+		case 'c':
+			config.csv = optarg;
+			break;
+		case 'L':
+			config.max_loss = atof(optarg);
+			break;
+		case 'M':
+			config.max_p99_ms = atof(optarg);
+			break;
+		default:
+			return -1;
+		}
+	}
+	if (optind != argc || config.n_device == 0 || config.n_device > 0x01000000 || config.n_gateway == 0 ||
+	    config.n_gateway > LG_GATEWAYS_MAX || config.dup == 0 || config.dup > config.n_gateway ||
+	    config.rate <= 0 || config.rate_step < 0 || config.seconds == 0 || config.size_min > config.size_max ||
+	    config.size_max > CODEC_FRM_PAYLOAD_MAX || config.loss < 0 || config.loss > 1 || config.keepalive == 0 ||
+	    config.n_thread == 0 || config.n_thread > LG_THREADS_MAX) {
+		return -1;
+	}
+	if (config.provision && config.table == NULL) {
+		return -1;
+	}
+	if (config.rate_max < config.rate) {
+		config.rate_max = config.rate;
+	}
+	if (config.rate_step == 0) {
+		config.rate_max = config.rate;
+		config.rate_step = 1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct session_table table;
+	struct lg_result result = {0};
+	int table_open = 0;
+	double saturation = 0;
+	FILE *csv = NULL;
+
+	if (lg_parse_options(argc, argv) != 0) {
+		lg_usage(argv[0]);
+		return 1;
+	}
+	if (config.provision) {
+		return lg_provision();
+	}
+	if (lg_setup(&table, &table_open) != 0) {
+		return 1;
+	}
+	if (config.csv != NULL && (csv = fopen(config.csv, "w")) == NULL) {
+		perror(config.csv);
+		return 1;
+	}
+	if (csv != NULL) {
+		fprintf(csv, "rate,uplinks_sec,uplinks,datagrams,push_acks,ack_loss_pct,p50_us,p99_us,p999_us,"
+			     "expected,decoded,decode_loss_pct,pull_sent,pull_acks,late,pass\n");
+	}
+	if (table_open && config.rate_max * LG_POLL_MS * 3 / 1000 > config.n_device) {
+		fprintf(stderr, "Above %.0f uplinks/sec a device sends more often than the table is polled, "
+				"decodes will be undercounted, use more devices\n",
+			config.n_device * 1000.0 / (LG_POLL_MS * 3));
+	}
+	printf("%s:%u, %u devices, %u gateways, %u copies, %u-%u bytes, %.1f%% loss, %u s steps\n", config.host,
+	       config.port, config.n_device, config.n_gateway, config.dup, config.size_min, config.size_max,
+	       config.loss * 100, config.seconds);
+	printf("%8s %10s %10s %7s %8s %8s %8s %17s %7s %6s\n", "rate", "uplinks/s", "acks/s", "loss%", "p50 us",
+	       "p99 us", "p999 us", "decoded", "miss%", "late");
+	for (double rate = config.rate; rate <= config.rate_max; rate += config.rate_step) {
+		lg_step(rate, table_open, &result);
+		lg_report(&result, table_open, csv);
+		if (!result.pass) {
+			break;
+		}
+		saturation = rate;
+	}
+	if (result.pass && config.rate_max > config.rate) {
+		printf("no saturation up to %.0f uplinks/sec\n", saturation);
+	} else if (!result.pass && saturation == 0) {
+		printf("saturated from the first step, start below %.0f uplinks/sec\n", config.rate);
+	} else if (!result.pass) {
+		printf("saturation point: %.0f uplinks/sec\n", saturation);
+	}
+	if (result.pull_acks == 0) {
+		printf("no PULL_ACK received, is the server running on %s:%u?\n", config.host, config.port);
+	}
+	if (csv != NULL) {
+		fclose(csv);
+	}
+	if (table_open) {
+		session_table_close(&table);
+	}
+	return 0;
+}
@@ -0,0 +1,240 @@
+/*
+ * Throughput and ACK latency of the UDP front end ('out --udpfe')
+ *
+ * Usage: ./udpfe_bench <out> [seconds] [clients] [window]
+ *
+ * Runs the front end once per receive loop (recvmmsg(), io_uring) and
+ * drives it from 'clients' gateway sockets over loopback, each keeping
+ * 'window' PUSH_DATA in flight. Prints the acknowledged packets/sec, the
+ * event frames read back from its stdout and the p50/p99 of the PUSH_DATA
+ * to PUSH_ACK round trip.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define BENCH_PORT 17100
+#define BENCH_CLIENTS_MAX 64
+#define BENCH_LATENCY_MAX_US 65536 /* 1us buckets, the last one takes everything above */
+
+static const char rxpk[] =
+	"{\"rxpk\":[{\"tmst\":3512348611,\"chan\":2,\"rfch\":0,\"freq\":866.349812,\"stat\":1,"
+	"\"modu\":\"LORA\",\"datr\":\"SF7BW125\",\"codr\":\"4/6\",\"rssi\":-35,\"lsnr\":5.1,"
+	"\"size\":32,\"data\":\"QNobASYAAQABPG+1xCcxaYT1WBnJZ5B5hvAcSJOt0ew=\"}]}";
+
+struct bench_client {
+	pthread_t thread;
+	uint16_t port;
+	uint32_t window;
+	volatile int *stop;
+	uint64_t acked;
+	uint64_t lost;
+	uint32_t latency[BENCH_LATENCY_MAX_US];
+};
+
+struct bench_drain {
+	pthread_t thread;
+	int fd;
+	uint64_t events;
+};
+
+static uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void *bench_client_run(void *arg)
+{
+	struct bench_client *client = arg;
+	static __thread uint64_t sent_ns[65536];
+	uint8_t datagram[12 + sizeof(rxpk)];
+	struct sockaddr_in addr;
+	struct timeval timeout = {0, 100000};
+	uint16_t token = 0;
+	uint32_t in_flight = 0;
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(client->port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		perror("client");
+		return NULL;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	datagram[0] = 0x02;
+	datagram[3] = 0x00; /* PUSH_DATA */
+	memset(&datagram[4], 0xAA, 8);
+	memcpy(&datagram[12], rxpk, sizeof(rxpk) - 1);
+
+	while (!*client->stop) {
+		for (; in_flight < client->window; in_flight++, token++) {
+			datagram[1] = token;
+			datagram[2] = token >> 8;
+			sent_ns[token] = bench_now_ns();
+			send(fd, datagram, 12 + sizeof(rxpk) - 1, 0);
+		}
+		uint8_t ack[16];
+		ssize_t n = recv(fd, ack, sizeof(ack), 0);
+		if (n < 0) {
+			/* whatever is still in flight is counted as lost */
+			client->lost += in_flight;
+			in_flight = 0;
+			continue;
+		}
+		if (n != 4 || ack[3] != 0x01) {
+			continue;
+		}
+		uint64_t us = (bench_now_ns() - sent_ns[ack[1] | (ack[2] << 8)]) / 1000;
+		client->latency[us < BENCH_LATENCY_MAX_US ? us : BENCH_LATENCY_MAX_US - 1]++;
+		client->acked++;
+		in_flight--;
+	}
+	close(fd);
+	return NULL;
+}
+
+static void *bench_drain_run(void *arg)
+{
+	struct bench_drain *drain = arg;
+	static uint8_t buffer[1 << 20];
+	size_t len = 0;
+
+	for (;;) {
+		ssize_t n = read(drain->fd, &buffer[len], sizeof(buffer) - len);
+		if (n <= 0) {
+			return NULL;
+		}
+		len += n;
+		size_t pos = 0;
+		while (len - pos >= 4) {
+			uint32_t size = buffer[pos] | (buffer[pos + 1] << 8) | (buffer[pos + 2] << 16) |
+					((uint32_t)buffer[pos + 3] << 24);
+			if (len - pos - 4 < size) {
+				break;
+			}
+			drain->events++;
+			pos += 4 + size;
+		}
+		memmove(buffer, &buffer[pos], len - pos);
+		len -= pos;
+	}
+}
+
+static uint32_t bench_percentile(const uint32_t *latency, uint64_t total, double p)
+{
+	uint64_t rank = (uint64_t)(total * p);
+	uint64_t seen = 0;
+
+	for (uint32_t us = 0; us < BENCH_LATENCY_MAX_US; us++) {
+		seen += latency[us];
+		if (seen > rank) {
+			return us;
+		}
+	}
+	return BENCH_LATENCY_MAX_US;
+}
+
+static int bench_run(const char *out, const char *backend, uint16_t port, uint32_t seconds,
+		     uint32_t n_client, uint32_t window)
+{
+	static struct bench_client clients[BENCH_CLIENTS_MAX];
+	static uint32_t latency[BENCH_LATENCY_MAX_US];
+	struct bench_drain drain = {0};
+	volatile int stop = 0;
+	int to_child[2], from_child[2];
+	char port_arg[8];
+
+	snprintf(port_arg, sizeof(port_arg), "%u", port);
+	if (pipe(to_child) != 0 || pipe(from_child) != 0) {
+		perror("pipe");
+		return -1;
+	}
+	pid_t pid = fork();
+	if (pid == 0) {
+		dup2(to_child[0], 0);
+		dup2(from_child[1], 1);
+		close(to_child[1]);
+		close(from_child[0]);
+		execl(out, out, "--udpfe", port_arg, "0", backend, (char *)NULL);
+		perror("execl");
+		_exit(127);
+	}
+	close(to_child[0]);
+	close(from_child[1]);
+	drain.fd = from_child[0];
+	pthread_create(&drain.thread, NULL, bench_drain_run, &drain);
+	usleep(200000);
+
+	memset(clients, 0, sizeof(clients));
+	for (uint32_t i = 0; i < n_client; i++) {
+		clients[i].port = port;
+		clients[i].window = window;
+		clients[i].stop = &stop;
+		pthread_create(&clients[i].thread, NULL, bench_client_run, &clients[i]);
+	}
+	uint64_t start = bench_now_ns();
+	sleep(seconds);
+	stop = 1;
+	uint64_t acked = 0, lost = 0;
+	memset(latency, 0, sizeof(latency));
+	for (uint32_t i = 0; i < n_client; i++) {
+		pthread_join(clients[i].thread, NULL);
+		acked += clients[i].acked;
+		lost += clients[i].lost;
+		for (uint32_t us = 0; us < BENCH_LATENCY_MAX_US; us++) {
+			latency[us] += clients[i].latency[us];
+		}
+	}
+	double elapsed = (bench_now_ns() - start) / 1e9;
+
+	/* closing stdin stops the front end */
+	usleep(100000);
+	close(to_child[1]);
+	waitpid(pid, NULL, 0);
+	pthread_join(drain.thread, NULL);
+	close(from_child[0]);
+
+	printf("%-7s %10.0f pkt/s %10.0f events/s  p50 %5u us  p99 %5u us  lost %llu\n", backend,
+	       acked / elapsed, drain.events / elapsed, bench_percentile(latency, acked, 0.50),
+	       bench_percentile(latency, acked, 0.99), (unsigned long long)lost);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <out> [seconds] [clients] [window]\n", argv[0]);
+		return 1;
+	}
+	uint32_t seconds = argc > 2 ? (uint32_t)atoi(argv[2]) : 5;
+	uint32_t n_client = argc > 3 ? (uint32_t)atoi(argv[3]) : 8;
+	uint32_t window = argc > 4 ? (uint32_t)atoi(argv[4]) : 16;
+	if (n_client == 0 || n_client > BENCH_CLIENTS_MAX || window == 0 || window > 4096) {
+		fprintf(stderr, "clients must be 1..%d and window 1..4096\n", BENCH_CLIENTS_MAX);
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+	printf("%u clients, window %u, %u s\n", n_client, window, seconds);
+	if (bench_run(argv[1], "socket", BENCH_PORT, seconds, n_client, window) != 0 ||
+	    bench_run(argv[1], "uring", BENCH_PORT + 1, seconds, n_client, window) != 0) {
+		return 1;
+	}
+	return 0;
+}
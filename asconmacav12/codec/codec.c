@@ -0,0 +1,250 @@
+#include <string.h>
+
+#include "api.h"
+#include "codec.h"
+#include "hist.h"
+#include "loramac.h"
+#include "prf.h"
+
+#define CODEC_MIC_LANES 8
+#define CODEC_BATCH_BLOCKS (CODEC_BATCH_MAX * LORAMAC_FRM_PAYLOAD_BLOCKS(CODEC_FRM_PAYLOAD_MAX))
+
+int32_t codec_session_init(struct codec_session *session, const uint8_t *appskey, const uint8_t *nwkskey)
+{
+	loramac_set_nwk_s_key(&session->nwk_s_key, nwkskey);
+	return loramac_set_app_s_key(&session->app_s_key, appskey);
+}
+
+/* Stage 1: parse the headers, the frames are only read through their view */
+static void codec_batch_parse(struct codec_batch *batch, struct loramac_frame_view *view)
+{
+	for (uint32_t n = 0; n < batch->count; n++) {
+		if (batch->frame[n] == NULL || loramac_frame_view_init(&view[n], batch->frame[n], batch->frame_size[n]) != 0) {
+			batch->dev_addr[n] = 0;
+			batch->f_cnt[n] = 0;
+			batch->f_port[n] = 0;
+			batch->m_hdr[n] = 0;
+			batch->frm_payload_size[n] = 0;
+			batch->status[n] = CODEC_ERR_INVALID_INPUT;
+			continue;
+		}
+		batch->frm_payload_size[n] = view[n].frm_payload_size;
+		batch->dev_addr[n] = loramac_frame_dev_addr(&view[n]);
+		batch->f_cnt[n] = loramac_frame_f_cnt(&view[n]);
+		batch->f_ctrl[n] = loramac_frame_f_ctrl(&view[n]);
+		batch->f_port[n] = loramac_frame_f_port(&view[n]);
+		batch->m_hdr[n] = loramac_frame_m_hdr(&view[n]);
+
+		if (batch->f_ctrl[n] & 0xF) {
+			/* currently not support FOpts */
+			batch->status[n] = CODEC_ERR_FOPTS;
+			continue;
+		}
+		batch->status[n] = CODEC_OK;
+	}
+}
+
+static void codec_batch_fill(const struct codec_batch *batch, uint32_t n, struct loramac_phys_payload *phys)
+{
+	loramac_fill_fhdr(phys, batch->dev_addr[n], batch->f_ctrl[n], batch->f_cnt[n], NULL);
+	loramac_fill_mac_payload(phys, batch->f_port[n], batch->payload[n]);
+	loramac_fill_phys_payload(phys, batch->m_hdr[n], 0);
+}
+
+/* MIC inputs of the frames verified together, one lane per frame */
+struct codec_mic_lanes {
+	uint32_t count;
+	uint32_t frame[CODEC_MIC_LANES];
+	uint8_t B0[CODEC_MIC_LANES][16];
+	ascon_prf_msg_t msg[CODEC_MIC_LANES];
+	const ascon_prf_msg_t *msg_ptr[CODEC_MIC_LANES];
+	uint8_t tag[CODEC_MIC_LANES][CRYPTO_BYTES];
+	uint8_t *tag_ptr[CODEC_MIC_LANES];
+	const ascon_state_t *nwk_s_key[CODEC_MIC_LANES];
+};
+
+static void codec_batch_verify_lanes(struct codec_batch *batch, const struct loramac_frame_view *view, struct codec_mic_lanes *lanes)
+{
+	crypto_auth_xN(lanes->tag_ptr, lanes->msg_ptr, lanes->nwk_s_key, lanes->count);
+	for (uint32_t l = 0; l < lanes->count; l++) {
+		uint32_t n = lanes->frame[l];
+
+		if (loramac_frame_le32(lanes->tag[l]) != loramac_frame_mic(&view[n])) {
+			batch->status[n] = CODEC_ERR_MIC;
+		}
+	}
+	lanes->count = 0;
+}
+
+/* Stage 2: verify the MIC of every parsed frame, up to CODEC_MIC_LANES frames per Ascon-PRF call.
+ * The MIC input is B0 followed by the frame bytes, absorbed in place */
+static void codec_batch_verify(struct codec_batch *batch, const struct loramac_frame_view *view)
+{
+	struct codec_mic_lanes lanes;
+
+	lanes.count = 0;
+	for (uint32_t l = 0; l < CODEC_MIC_LANES; l++) {
+		lanes.msg_ptr[l] = &lanes.msg[l];
+		lanes.tag_ptr[l] = lanes.tag[l];
+	}
+	for (uint32_t n = 0; n < batch->count; n++) {
+		uint32_t l = lanes.count;
+
+		if (batch->status[n] != CODEC_OK) {
+			continue;
+		}
+		loramac_frame_mic_msg(&view[n], lanes.B0[l], &lanes.msg[l]);
+		lanes.nwk_s_key[l] = &batch->session[n]->nwk_s_key;
+		lanes.frame[l] = n;
+		if (++lanes.count == CODEC_MIC_LANES) {
+			codec_batch_verify_lanes(batch, view, &lanes);
+		}
+	}
+	if (lanes.count) {
+		codec_batch_verify_lanes(batch, view, &lanes);
+	}
+}
+
+/* Stage 3: decrypt the frames with a valid MIC, same keystream as encryption (see the LoRaWAN spec).
+ * This is the first copy of the FRMPayload, reversed into the LoRaMAC API order.
+ * The A_i blocks of all the frames are encrypted in one pipelined AES call */
+static uint32_t codec_batch_decrypt(struct codec_batch *batch, const struct loramac_frame_view *view)
+{
+	uint8_t S[CODEC_BATCH_BLOCKS][16]; // A_i blocks, encrypted in place
+	const aes_context *app_s_key[CODEC_BATCH_BLOCKS];
+	uint32_t first_block[CODEC_BATCH_MAX];
+	uint32_t total_block = 0;
+	uint32_t decoded = 0;
+
+	for (uint32_t n = 0; n < batch->count; n++) {
+		struct loramac_phys_payload phys = {0};
+
+		if (batch->status[n] != CODEC_OK) {
+			continue;
+		}
+		const uint8_t *frm_payload = loramac_frame_frm_payload(&view[n]);
+		uint8_t *payload = batch->payload[n];
+		for (uint16_t i = 0, j = view[n].frm_payload_size - 1; i < view[n].frm_payload_size; i++, j--) {
+			payload[i] = frm_payload[j];
+		}
+		codec_batch_fill(batch, n, &phys);
+		first_block[n] = total_block;
+		uint8_t blocks = loramac_frm_payload_blocks(&phys, batch->frm_payload_size[n], &S[total_block]);
+		for (uint8_t i = 0; i < blocks; i++) {
+			app_s_key[total_block++] = &batch->session[n]->app_s_key;
+		}
+	}
+	if (aes_encrypt_blocks_keyed(S[0], S[0], total_block, app_s_key)) {
+		for (uint32_t n = 0; n < batch->count; n++) {
+			if (batch->status[n] == CODEC_OK) {
+				batch->status[n] = CODEC_ERR_INVALID_INPUT;
+			}
+		}
+		return 0;
+	}
+	for (uint32_t n = 0; n < batch->count; n++) {
+		struct loramac_phys_payload phys = {0};
+
+		if (batch->status[n] != CODEC_OK) {
+			continue;
+		}
+		codec_batch_fill(batch, n, &phys);
+		loramac_frm_payload_xor(&phys, batch->frm_payload_size[n], &S[first_block[n]]);
+		decoded++;
+	}
+	return decoded;
+}
+
+uint32_t codec_decode_batch(struct codec_batch *batch)
+{
+	struct loramac_frame_view view[CODEC_BATCH_MAX];
+
+	if (batch->count > CODEC_BATCH_MAX) {
+		batch->count = CODEC_BATCH_MAX;
+	}
+	uint64_t start = hist_start();
+	codec_batch_parse(batch, view);
+	hist_stage_end(HIST_STAGE_PARSE, start);
+
+	start = hist_start();
+	codec_batch_verify(batch, view);
+	hist_stage_end(HIST_STAGE_MIC, start);
+
+	start = hist_start();
+	uint32_t decoded = codec_batch_decrypt(batch, view);
+	hist_stage_end(HIST_STAGE_DECRYPT, start);
+
+	if (hist_enabled) {
+		uint64_t mic_failed = 0, bytes = 0;
+		for (uint32_t n = 0; n < batch->count; n++) {
+			mic_failed += batch->status[n] == CODEC_ERR_MIC;
+			bytes += batch->status[n] == CODEC_OK ? batch->frame_size[n] : 0;
+		}
+		hist_count(HIST_COUNTER_FRAMES, batch->count);
+		hist_count(HIST_COUNTER_DECODED, decoded);
+		hist_count(HIST_COUNTER_MIC_FAILED, mic_failed);
+		hist_count(HIST_COUNTER_BYTES, bytes);
+	}
+	return decoded;
+}
+
+int32_t codec_decode_frame(const uint8_t *frame, size_t frame_size, const struct codec_session *session,
+			   struct codec_uplink *uplink, uint8_t *payload)
+{
+	struct codec_batch batch;
+
+	batch.count = 1;
+	batch.frame[0] = frame;
+	batch.frame_size[0] = frame_size > UINT16_MAX ? UINT16_MAX : frame_size;
+	batch.session[0] = session;
+	batch.payload[0] = payload;
+	codec_decode_batch(&batch);
+
+	uplink->dev_addr = batch.dev_addr[0];
+	uplink->f_cnt = batch.f_cnt[0];
+	uplink->f_port = batch.f_port[0];
+	uplink->m_hdr = batch.m_hdr[0];
+	uplink->frm_payload_size = batch.frm_payload_size[0];
+	return batch.status[0];
+}
+
+static int32_t codec_encode(const uint8_t *data, size_t data_size, const struct codec_session *session, uint8_t m_hdr, uint32_t dev_addr, uint32_t f_cnt, uint8_t f_port, uint8_t *frame)
+{
+	struct loramac_phys_payload phys = {0};
+	uint8_t frm_payload[CODEC_FRM_PAYLOAD_MAX];
+
+	if (data_size > CODEC_FRM_PAYLOAD_MAX) {
+		return CODEC_ERR_INVALID_INPUT;
+	}
+	memcpy(frm_payload, data, data_size);
+
+	loramac_fill_fhdr(&phys, dev_addr, 0, f_cnt, NULL);
+	loramac_fill_mac_payload(&phys, f_port, frm_payload);
+	loramac_fill_phys_payload(&phys, m_hdr, 0);
+
+	loramac_frm_payload_encryption(&phys, data_size, &session->app_s_key);
+	loramac_serialize_data(&phys, frame, data_size);
+
+	/* the MIC is calculated over the serialized frame and written in place */
+	struct loramac_frame_view view;
+	uint32_t mic = 0;
+	uint8_t *frame_mic = &frame[LRMAC_BYTE_OFFSET_FRMPAYLOAD + data_size];
+	loramac_frame_view_init(&view, frame, data_size + CODEC_FRAME_OVERHEAD);
+	loramac_frame_calculate_mic(&view, &session->nwk_s_key, &mic);
+	frame_mic[0] = mic;
+	frame_mic[1] = mic >> 8;
+	frame_mic[2] = mic >> 16;
+	frame_mic[3] = mic >> 24;
+
+	return CODEC_OK;
+}
+
+int32_t codec_encode_frame(const uint8_t *data, size_t data_size, const struct codec_session *session, uint32_t dev_addr, uint32_t f_cnt, uint8_t f_port, uint8_t *frame)
+{
+	return codec_encode(data, data_size, session, LORAMAC_PHYS_PAYLOAD_MHDR_UNCONFIRM_DATA_DOWN, dev_addr, f_cnt, f_port, frame);
+}
+
+int32_t codec_encode_uplink(const uint8_t *data, size_t data_size, const struct codec_session *session, uint32_t dev_addr, uint32_t f_cnt, uint8_t f_port, uint8_t *frame)
+{
+	return codec_encode(data, data_size, session, LORAMAC_PHYS_PAYLOAD_MHDR_UNCONFIRM_DATA_UP, dev_addr, f_cnt, f_port, frame);
+}
@@ -0,0 +1,86 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aes.h"
+#include "ascon.h"
+#include "loramac.h"
+
+/*
+ * LoRaWAN frame codec with Ascon-MAC as MIC, shared by the command line
+ * program and the Node addon. Frames are the raw (base64 decoded) packages
+ * [MHDR + FHDR + FPORT + FRMPayload + MIC].
+ */
+
+#define CODEC_KEYBYTES 16
+#define CODEC_FRAME_OVERHEAD (1 + 4 + 1 + 2 + 1 + 4) /* MHDR + FHDR[DevAddr + FCtrl + FCnt] + FPORT + MIC */
+#define CODEC_FRM_PAYLOAD_MAX LORAMAC_FRM_PAYLOAD_MAX
+#define CODEC_BATCH_MAX 64
+
+enum codec_status {
+	CODEC_OK = 0,
+	CODEC_ERR_INVALID_INPUT = -2,
+	CODEC_ERR_FOPTS = -3,
+	CODEC_ERR_MIC = -4,
+};
+
+/*
+ * Per device session, expanded once when the device is provisioned or
+ * loaded and then shared by every frame of the device
+ */
+struct codec_session {
+	ascon_state_t nwk_s_key;
+	aes_context app_s_key;
+};
+
+struct codec_uplink {
+	uint32_t dev_addr;
+	uint16_t f_cnt;
+	uint8_t f_port;
+	uint8_t m_hdr;
+	uint16_t frm_payload_size;
+};
+
+/*
+ * Batch of uplink frames kept as a structure of arrays, so every stage
+ * (header parsing, MIC, keystream) runs over all frames of the batch before
+ * the next one starts. Fill the inputs and count, the outputs are written by
+ * codec_decode_batch().
+ */
+struct codec_batch {
+	uint32_t count;
+	/* inputs */
+	const uint8_t *frame[CODEC_BATCH_MAX];
+	uint16_t frame_size[CODEC_BATCH_MAX];
+	const struct codec_session *session[CODEC_BATCH_MAX];
+	uint8_t *payload[CODEC_BATCH_MAX]; // frame_size - CODEC_FRAME_OVERHEAD bytes each
+	/* outputs */
+	int32_t status[CODEC_BATCH_MAX];
+	uint32_t dev_addr[CODEC_BATCH_MAX];
+	uint16_t f_cnt[CODEC_BATCH_MAX];
+	uint8_t f_ctrl[CODEC_BATCH_MAX];
+	uint8_t f_port[CODEC_BATCH_MAX];
+	uint8_t m_hdr[CODEC_BATCH_MAX];
+	uint16_t frm_payload_size[CODEC_BATCH_MAX];
+};
+
+int32_t codec_session_init(struct codec_session *session, const uint8_t *appskey, const uint8_t *nwkskey);
+
+// Decode every frame of the batch, returns the number of frames decoded successfully
+uint32_t codec_decode_batch(struct codec_batch *batch);
+
+// Verify the MIC of 'frame' and decrypt its FRMPayload into 'payload'
+// 'payload' must hold at least frame_size - CODEC_FRAME_OVERHEAD bytes
+int32_t codec_decode_frame(const uint8_t *frame, size_t frame_size, const struct codec_session *session,
+			   struct codec_uplink *uplink, uint8_t *payload);
+
+// Build an unconfirmed data down frame carrying 'data'
+// 'frame' must hold at least data_size + CODEC_FRAME_OVERHEAD bytes
+int32_t codec_encode_frame(const uint8_t *data, size_t data_size, const struct codec_session *session, uint32_t dev_addr, uint32_t f_cnt, uint8_t f_port, uint8_t *frame);
+
+// Same as codec_encode_frame for an unconfirmed data up frame, as sent by a device
+int32_t codec_encode_uplink(const uint8_t *data, size_t data_size, const struct codec_session *session, uint32_t dev_addr, uint32_t f_cnt, uint8_t f_port, uint8_t *frame);
+
+#endif /* CODEC_H */
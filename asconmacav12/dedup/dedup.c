@@ -0,0 +1,110 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime() */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "dedup.h"
+#include "loramac.h"
+
+#define DEDUP_FNV_OFFSET UINT64_C(0xCBF29CE484222325)
+#define DEDUP_FNV_PRIME UINT64_C(0x100000001B3)
+
+static uint64_t dedup_fnv1a(uint64_t hash, const uint8_t *data, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * DEDUP_FNV_PRIME;
+	}
+	return hash;
+}
+
+int32_t dedup_init(struct dedup_set *set, uint32_t capacity, uint32_t window_ms)
+{
+	uint32_t slots = 64;
+
+	set->slots = NULL;
+	if (window_ms == 0 || window_ms >= DEDUP_WINDOW_MAX) {
+		return DEDUP_ERR_INVALID;
+	}
+	/* at most half of the slots live */
+	while (slots < (UINT32_C(1) << 30) && slots / 2 < capacity) {
+		slots *= 2;
+	}
+	set->slots = calloc(slots, sizeof(*set->slots));
+	if (set->slots == NULL) {
+		return DEDUP_ERR_NO_MEMORY;
+	}
+	set->mask = slots - 1;
+	set->window_ms = window_ms;
+	return DEDUP_OK;
+}
+
+void dedup_free(struct dedup_set *set)
+{
+	free(set->slots);
+	set->slots = NULL;
+}
+
+uint64_t dedup_frame_hash(const uint8_t *frame, size_t frame_size)
+{
+	struct loramac_frame_view view;
+	uint64_t hash = DEDUP_FNV_OFFSET;
+
+	if (loramac_frame_view_init(&view, frame, frame_size) != 0) {
+		hash = dedup_fnv1a(hash, frame, frame_size);
+	} else {
+		/* MHDR, FCtrl and FPort are covered by the MIC */
+		hash = dedup_fnv1a(hash, &frame[LRMAC_BYTE_OFFSET_DEVADDR], 4);
+		hash = dedup_fnv1a(hash, &frame[LRMAC_BYTE_OFFSET_FCNT], 2);
+		hash = dedup_fnv1a(hash, loramac_frame_frm_payload(&view), view.frm_payload_size + 4);
+	}
+	/* FNV-1a mixes the high bits poorly, finish with the splitmix64 finalizer */
+	hash = (hash ^ (hash >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+	hash = (hash ^ (hash >> 27)) * UINT64_C(0x94D049BB133111EB);
+	return hash ^ (hash >> 31);
+}
+
+uint64_t dedup_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+int32_t dedup_check(struct dedup_set *set, uint64_t hash, uint64_t now_ms)
+{
+	uint64_t tag = hash & ~DEDUP_TIME_MASK;
+	uint64_t now = now_ms & DEDUP_TIME_MASK;
+
+	if (tag == 0) {
+		/* 0 is an empty slot */
+		tag = DEDUP_TIME_MASK + 1;
+	}
+	for (;;) {
+		uint64_t *free_slot = NULL;
+		uint64_t free_value = 0;
+		uint32_t i = (uint32_t)hash & set->mask;
+
+		/* the whole probe sequence is checked, a copy can sit behind an expired slot */
+		for (uint32_t n = 0; n < DEDUP_PROBE_MAX; n++, i = (i + 1) & set->mask) {
+			uint64_t value = __atomic_load_n(&set->slots[i], __ATOMIC_ACQUIRE);
+			if (value != 0 && ((now - value) & DEDUP_TIME_MASK) < set->window_ms) {
+				if ((value & ~DEDUP_TIME_MASK) == tag) {
+					return DEDUP_DUPLICATE;
+				}
+			} else if (free_slot == NULL) {
+				free_slot = &set->slots[i];
+				free_value = value;
+			}
+		}
+		if (free_slot == NULL) {
+			/* set full, let the frame through rather than drop it */
+			return DEDUP_FIRST;
+		}
+		if (__atomic_compare_exchange_n(free_slot, &free_value, tag | now, 0,
+						__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			return DEDUP_FIRST;
+		}
+		/* another thread took the slot, maybe for a copy of this frame */
+	}
+}
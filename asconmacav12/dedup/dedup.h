@@ -0,0 +1,61 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Short-lived set of the uplinks seen recently, to collapse the copies of a
+ * frame received by several gateways before any crypto runs.
+ *
+ * A frame is identified by the hash of its DevAddr, FCnt, FRM_PAYLOAD and
+ * MIC, read from the raw frame. Every slot is a single 64-bit word
+ * [hash (40 high bits)][time in ms (24 bits)], inserted with a CAS, so the
+ * set can be shared by threads without a lock. A slot older than the window
+ * is free again, nothing has to be removed.
+ *
+ * The time wraps every 2^24 ms (~4.6 hours): a slot not reused for that
+ * long may look live again for one window, at worst a probe goes one slot
+ * further. Under contention two copies racing for a slot that has just
+ * expired can both be reported first, the set never reports a new frame as
+ * a duplicate unless their 40-bit hashes collide.
+ */
+
+#define DEDUP_TIME_BITS 24
+#define DEDUP_TIME_MASK ((UINT64_C(1) << DEDUP_TIME_BITS) - 1)
+#define DEDUP_WINDOW_MAX (1u << (DEDUP_TIME_BITS - 1))
+#define DEDUP_PROBE_MAX 16 /* slots probed before a frame is let through */
+
+enum dedup_status {
+	DEDUP_OK = 0,
+	DEDUP_ERR_INVALID = -20,
+	DEDUP_ERR_NO_MEMORY = -21,
+};
+
+enum dedup_result {
+	DEDUP_FIRST = 0,
+	DEDUP_DUPLICATE = 1,
+};
+
+struct dedup_set {
+	uint64_t *slots;
+	uint32_t mask;
+	uint32_t window_ms;
+};
+
+// 'capacity' is the number of frames expected in one window, the set is sized for twice that
+// window_ms must be below DEDUP_WINDOW_MAX
+int32_t dedup_init(struct dedup_set *set, uint32_t capacity, uint32_t window_ms);
+
+void dedup_free(struct dedup_set *set);
+
+// Hash of (DevAddr, FCnt, FRM_PAYLOAD, MIC), frames which cannot be parsed are hashed whole
+uint64_t dedup_frame_hash(const uint8_t *frame, size_t frame_size);
+
+// Monotonic clock in ms
+uint64_t dedup_now_ms(void);
+
+// Record 'hash' at 'now_ms' (e.g dedup_now_ms(), read once per batch), DEDUP_DUPLICATE if it was seen in the last window
+int32_t dedup_check(struct dedup_set *set, uint64_t hash, uint64_t now_ms);
+
+#endif
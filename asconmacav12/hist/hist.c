@@ -0,0 +1,198 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime() */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hist.h"
+
+#define HIST_CACHE_LINE 64
+
+/* cache line aligned, the sets of two threads never share a line */
+struct hist_thread {
+	uint64_t counters[HIST_COUNTER_COUNT];
+	struct hist_thread *next;
+	struct hist stage[HIST_STAGE_COUNT];
+} __attribute__((aligned(HIST_CACHE_LINE)));
+
+int hist_enabled;
+
+static struct hist_thread *hist_threads;
+static __thread struct hist_thread *hist_self;
+
+static const char *const hist_stage_names[HIST_STAGE_COUNT] = {
+	"base64", "parse", "session", "mic", "decrypt", "output", "persist",
+};
+
+void hist_enable(int enabled)
+{
+	__atomic_store_n(&hist_enabled, enabled, __ATOMIC_RELAXED);
+}
+
+const char *hist_stage_name(enum hist_stage stage)
+{
+	return stage < HIST_STAGE_COUNT ? hist_stage_names[stage] : "unknown";
+}
+
+uint64_t hist_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t hist_bucket(uint64_t value)
+{
+	if (value < HIST_SUB_COUNT) {
+		return (uint32_t)value;
+	}
+	if (value >> HIST_MAX_BITS) {
+		return HIST_BUCKETS - 1;
+	}
+	uint32_t exponent = 63 - __builtin_clzll(value); /* >= HIST_SUB_BITS */
+	uint32_t sub = (uint32_t)(value >> (exponent - HIST_SUB_BITS)) & (HIST_SUB_COUNT - 1);
+	return (exponent - HIST_SUB_BITS + 1) * HIST_SUB_COUNT + sub;
+}
+
+uint64_t hist_bucket_max(uint32_t bucket)
+{
+	if (bucket < HIST_SUB_COUNT) {
+		return bucket;
+	}
+	uint32_t exponent = bucket / HIST_SUB_COUNT + HIST_SUB_BITS - 1;
+	uint64_t sub = bucket % HIST_SUB_COUNT;
+	return ((HIST_SUB_COUNT + sub + 1) << (exponent - HIST_SUB_BITS)) - 1;
+}
+
+/* a single writer per hist, no read-modify-write needed */
+static void hist_add(uint64_t *counter, uint64_t value)
+{
+	__atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+void hist_record(struct hist *hist, uint64_t value)
+{
+	hist_add(&hist->buckets[hist_bucket(value)], 1);
+	hist_add(&hist->sum, value);
+	if (value > hist->max) {
+		__atomic_store_n(&hist->max, value, __ATOMIC_RELAXED);
+	}
+	/* last, a snapshot never sees more samples than bucket counts */
+	hist_add(&hist->count, 1);
+}
+
+static struct hist_thread *hist_thread_self(void)
+{
+	struct hist_thread *self = hist_self;
+
+	if (self != NULL) {
+		return self;
+	}
+	if (posix_memalign((void **)&self, HIST_CACHE_LINE, sizeof(*self)) != 0) {
+		return NULL;
+	}
+	memset(self, 0, sizeof(*self));
+	self->next = __atomic_load_n(&hist_threads, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&hist_threads, &self->next, self, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+	}
+	hist_self = self;
+	return self;
+}
+
+void hist_stage_record(enum hist_stage stage, uint64_t ns)
+{
+	struct hist_thread *self = hist_thread_self();
+
+	if (self != NULL && stage < HIST_STAGE_COUNT) {
+		hist_record(&self->stage[stage], ns);
+	}
+}
+
+void hist_count(enum hist_counter counter, uint64_t n)
+{
+	struct hist_thread *self;
+
+	if (hist_enabled && counter < HIST_COUNTER_COUNT && (self = hist_thread_self()) != NULL) {
+		hist_add(&self->counters[counter], n);
+	}
+}
+
+void hist_counters(uint64_t counters[HIST_COUNTER_COUNT])
+{
+	memset(counters, 0, HIST_COUNTER_COUNT * sizeof(*counters));
+	for (struct hist_thread *t = __atomic_load_n(&hist_threads, __ATOMIC_ACQUIRE); t != NULL; t = t->next) {
+		for (uint32_t i = 0; i < HIST_COUNTER_COUNT; i++) {
+			counters[i] += __atomic_load_n(&t->counters[i], __ATOMIC_RELAXED);
+		}
+	}
+}
+
+void hist_stage_end(enum hist_stage stage, uint64_t start)
+{
+	if (start != 0) {
+		hist_stage_record(stage, hist_now_ns() - start);
+	}
+}
+
+void hist_merge(struct hist *into, const struct hist *from)
+{
+	into->count += __atomic_load_n(&from->count, __ATOMIC_RELAXED);
+	into->sum += __atomic_load_n(&from->sum, __ATOMIC_RELAXED);
+	uint64_t max = __atomic_load_n(&from->max, __ATOMIC_RELAXED);
+	if (max > into->max) {
+		into->max = max;
+	}
+	for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+		into->buckets[i] += __atomic_load_n(&from->buckets[i], __ATOMIC_RELAXED);
+	}
+}
+
+void hist_snapshot(struct hist snapshot[HIST_STAGE_COUNT])
+{
+	memset(snapshot, 0, HIST_STAGE_COUNT * sizeof(*snapshot));
+	for (struct hist_thread *t = __atomic_load_n(&hist_threads, __ATOMIC_ACQUIRE); t != NULL; t = t->next) {
+		for (uint32_t stage = 0; stage < HIST_STAGE_COUNT; stage++) {
+			hist_merge(&snapshot[stage], &t->stage[stage]);
+		}
+	}
+}
+
+uint64_t hist_quantile(const struct hist *hist, double quantile)
+{
+	uint64_t total = 0;
+	uint64_t seen = 0;
+
+	for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+		total += hist->buckets[i];
+	}
+	if (total == 0) {
+		return 0;
+	}
+	uint64_t rank = (uint64_t)(quantile * (total - 1));
+	for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if (seen > rank) {
+			uint64_t value = hist_bucket_max(i);
+			return value < hist->max ? value : hist->max;
+		}
+	}
+	return hist->max;
+}
+
+void hist_report(FILE *out)
+{
+	static struct hist snapshot[HIST_STAGE_COUNT];
+
+	hist_snapshot(snapshot);
+	fprintf(out, "%-8s %10s %10s %10s %10s %10s\n", "stage", "count", "p50 us", "p99 us", "p999 us", "max us");
+	for (uint32_t stage = 0; stage < HIST_STAGE_COUNT; stage++) {
+		const struct hist *hist = &snapshot[stage];
+		if (hist->count == 0) {
+			continue;
+		}
+		fprintf(out, "%-8s %10llu %10.1f %10.1f %10.1f %10.1f\n", hist_stage_name(stage),
+			(unsigned long long)hist->count, hist_quantile(hist, 0.50) / 1e3, hist_quantile(hist, 0.99) / 1e3,
+			hist_quantile(hist, 0.999) / 1e3, hist->max / 1e3);
+	}
+}
@@ -0,0 +1,99 @@
+#ifndef HIST_H
+#define HIST_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Latency histograms and counters of the decode pipeline, one set per thread
+ *
+ * HDR-style log-linear buckets: values below HIST_SUB_COUNT ns have their
+ * own bucket, above that every power of 2 is split into HIST_SUB_COUNT
+ * buckets, so a value is known within 1/HIST_SUB_COUNT (~3%) whatever its
+ * magnitude. Values above 2^HIST_MAX_BITS ns (~18 minutes) are clamped.
+ *
+ * Every thread records into its own set, registered on its first sample
+ * and never freed (the counts of a finished thread are kept), with plain
+ * relaxed stores: nothing is shared on the hot path. A snapshot sums the
+ * sets of all threads, it can run at any time from any thread.
+ *
+ * A stage is recorded once per call, a batch stage covers all its frames.
+ * The timers cost two clock reads and, like the counters, are off until
+ * hist_enable(1).
+ */
+
+#define HIST_SUB_BITS 5
+#define HIST_SUB_COUNT (1u << HIST_SUB_BITS)
+#define HIST_MAX_BITS 40
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+enum hist_stage {
+	HIST_STAGE_BASE64 = 0,
+	HIST_STAGE_PARSE,
+	HIST_STAGE_SESSION,
+	HIST_STAGE_MIC,
+	HIST_STAGE_DECRYPT,
+	HIST_STAGE_OUTPUT,
+	HIST_STAGE_PERSIST,
+	HIST_STAGE_COUNT,
+};
+
+// Frames through codec_decode_batch()
+enum hist_counter {
+	HIST_COUNTER_FRAMES = 0,
+	HIST_COUNTER_DECODED,
+	HIST_COUNTER_MIC_FAILED,
+	HIST_COUNTER_BYTES, /* of the frames decoded */
+	HIST_COUNTER_COUNT,
+};
+
+struct hist {
+	uint64_t count;
+	uint64_t sum; /* ns */
+	uint64_t max;
+	uint64_t buckets[HIST_BUCKETS];
+};
+
+extern int hist_enabled;
+
+void hist_enable(int enabled);
+
+const char *hist_stage_name(enum hist_stage stage);
+
+// Monotonic clock in ns
+uint64_t hist_now_ns(void);
+
+// Start of a stage, 0 when the timers are off
+static inline uint64_t hist_start(void)
+{
+	return hist_enabled ? hist_now_ns() : 0;
+}
+
+// Record the time since 'start' (hist_start()) into the set of this thread
+void hist_stage_end(enum hist_stage stage, uint64_t start);
+
+// Record 'ns' measured elsewhere (e.g by JavaScript) into the set of this thread
+void hist_stage_record(enum hist_stage stage, uint64_t ns);
+
+// Add 'n' to a counter of this thread, nothing when the timers are off
+void hist_count(enum hist_counter counter, uint64_t n);
+
+// Sum of the counters of all threads
+void hist_counters(uint64_t counters[HIST_COUNTER_COUNT]);
+
+void hist_record(struct hist *hist, uint64_t value);
+void hist_merge(struct hist *into, const struct hist *from);
+
+// Sum of the sets of all threads, one hist per stage
+void hist_snapshot(struct hist snapshot[HIST_STAGE_COUNT]);
+
+// Highest value counted in 'bucket'
+uint64_t hist_bucket_max(uint32_t bucket);
+
+// Value at 'quantile' (0..1), the highest value of its bucket, 0 if empty
+uint64_t hist_quantile(const struct hist *hist, double quantile);
+
+// count, p50/p99/p999 and max of every stage sampled, in us
+void hist_report(FILE *out);
+
+#endif /* HIST_H */
@@ -2,10 +2,11 @@
 #include <string.h>
 
 #include "api.h"
+#include "constants.h"
 #include "crypto_auth.h"
+#include "prf.h"
 
 #include "loramac.h"
-#include "aes.h"
 
 struct loramac_phys_payload *loramac_init(void)
 {
@@ -42,62 +43,114 @@ int32_t loramac_fill_phys_payload(struct loramac_phys_payload *payload, uint8_t
 	return 0;
 }
 
-static int32_t loramac_aes_byte_array_xor(uint8_t *byte_a, uint8_t b[16][16], uint8_t *out, uint32_t frm_payload_size)
+// XOR with the keystream blocks S, the LoRaMAC API uses the reversed byte order of a block
+// so bytes 0..7 of a block take S[15..8] and bytes 8..15 take S[7..0]
+static void loramac_keystream_xor(uint8_t *data, const uint8_t S[][16], uint16_t size)
 {
-	int i = 0;
-	uint8_t total_block = (uint8_t)(frm_payload_size / 16) + (frm_payload_size % 16 ? 1 : 0);
-	for (uint8_t block = 0; block < total_block; block++) {
-		uint8_t *byte_b = b[block];
-		for (int j = 15; j >= 0; j--) {
-			out[i] = byte_a[i] ^ byte_b[j];
-			i++;
-			if (i >= frm_payload_size) {
-				break;
-			}
-		}
+	uint16_t block = 0;
+
+	for (; (uint32_t)(block + 1) * 16 <= size; block++) {
+		uint8_t *d = &data[block * 16];
+		uint64_t d0, d1, s0, s1;
+
+		memcpy(&d0, d, 8);
+		memcpy(&d1, d + 8, 8);
+		memcpy(&s0, S[block], 8);
+		memcpy(&s1, S[block] + 8, 8);
+		d0 ^= __builtin_bswap64(s1);
+		d1 ^= __builtin_bswap64(s0);
+		memcpy(d, &d0, 8);
+		memcpy(d + 8, &d1, 8);
+	}
+	for (uint16_t i = block * 16, j = 15; i < size; i++, j--) {
+		data[i] ^= S[block][j];
 	}
+}
+
+int32_t loramac_set_nwk_s_key(ascon_state_t *nwk_s_key, const uint8_t *key)
+{
+	ascon_prf_keyinit(nwk_s_key, key);
 	return 0;
 }
 
-// TODO: support FOpts in calculation, currently it's skipped as FCTRL will always be 0x00
-int32_t loramac_calculate_mic(struct loramac_phys_payload *payload, uint8_t frm_payload_size, uint8_t *key, uint8_t algo_option, uint32_t *mic)
+int32_t loramac_frame_view_init(struct loramac_frame_view *view, const uint8_t *frame, size_t frame_size)
 {
-	unsigned long long inlen = 9 + frm_payload_size + 16;
-	uint8_t in[inlen]; // 9 bytes = MHDR + DEV_ADDR + FCTRL + FCNT + FPORT
+	// MHDR + FHDR + FPORT + MIC
+	if (frame_size < 13 || frame_size - 13 > LORAMAC_FRM_PAYLOAD_MAX) {
+		return -1;
+	}
+	view->frame = frame;
+	view->frm_payload_size = frame_size - 13;
+	return 0;
+}
 
-	uint8_t out[16] = {0};
-	uint8_t *B_dev_addr;
-	uint8_t *B_f_cnt;
+void loramac_frame_mic_msg(const struct loramac_frame_view *view, uint8_t B0[16], ascon_prf_msg_t *msg)
+{
+	memset(B0, 0, 16);
+	B0[0] = 0x49;
+	memcpy(&B0[6], &view->frame[LRMAC_BYTE_OFFSET_DEVADDR], 4); // little endian on air too
+	memcpy(&B0[10], &view->frame[LRMAC_BYTE_OFFSET_FCNT], 2);
+	B0[15] = view->frm_payload_size + 9; // FRM_PAYLOAD + MHDR + FHDR + FPORT
+
+	msg->hdr = B0;
+	msg->hdrlen = 16;
+	msg->in = view->frame;
+	msg->inlen = view->frm_payload_size + 9;
+}
 
-	memset(in, 0, inlen);
+int32_t loramac_frame_calculate_mic(const struct loramac_frame_view *view, const ascon_state_t *nwk_s_key, uint32_t *mic)
+{
+	uint8_t B0[16];
+	uint8_t out[16];
+	ascon_prf_msg_t msg;
 
-	uint8_t B[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-	B[0] = 0x49;
+	loramac_frame_mic_msg(view, B0, &msg);
+	if (crypto_prf_keyed_msg(out, CRYPTO_BYTES, &msg, nwk_s_key) != 0) {
+		return -1;
+	}
+	*mic = loramac_frame_le32(out);
+	return 0;
+}
 
-	B_dev_addr = (uint8_t *)&payload->mac_payload.f_hdr.dev_addr;
-	memcpy(&B[6], B_dev_addr, 4);
-	B_f_cnt = (uint8_t *)&payload->mac_payload.f_hdr.f_cnt;
-	memcpy(&B[10], B_f_cnt, 2);
+// TODO: support FOpts in calculation, currently it's skipped as FCTRL will always be 0x00
+int32_t loramac_calculate_mic(struct loramac_phys_payload *payload, uint16_t frm_payload_size, const ascon_state_t *nwk_s_key, uint8_t algo_option, uint32_t *mic)
+{
+	ascon_prf_ctx_t ctx;
+	uint8_t out[16] = {0};
+	uint8_t B[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+	uint8_t block[ASCON_PRFA_IN_RATE];
 
-	B[15] = frm_payload_size + 9; // FRM_PAYLOAD + MHDR + FHDR + FPORT
-	
-	memcpy(in, B, 16);
-	in[16] = payload->m_hdr;
-	memcpy(&in[17], (uint8_t *)&payload->mac_payload.f_hdr, 7);
-	in[17 + 7] = payload->mac_payload.f_port;
-	// Little endian payload
-	for (uint16_t i = 17 + 7 + 1, j = frm_payload_size - 1; i < frm_payload_size + 17 + 7 + 1; i++, j--) {
-		in[i] = payload->mac_payload.frm_payload[j]; // FRM_PAYLOAD starts from byte offset 9
+	if (frm_payload_size > LORAMAC_FRM_PAYLOAD_MAX) {
+		return -1;
 	}
 	// ASCON MAC
-	if (algo_option) {
-		int rc = crypto_auth(out, in, inlen, key);
-		if (rc != 0) {
-			return -1;
-		}
-	} else {
+	if (!algo_option) {
 		return -2;
 	}
+	B[0] = 0x49;
+	memcpy(&B[6], (uint8_t *)&payload->mac_payload.f_hdr.dev_addr, 4); // transform to little endian
+	memcpy(&B[10], (uint8_t *)&payload->mac_payload.f_hdr.f_cnt, 2);
+	B[15] = frm_payload_size + 9; // FRM_PAYLOAD + MHDR + FHDR + FPORT
+
+	// B0 + MHDR + FHDR + FPORT + FRM_PAYLOAD, absorbed as they are read
+	ascon_prf_init(&ctx, nwk_s_key);
+	ascon_prf_update(&ctx, B, 16);
+	ascon_prf_update(&ctx, &payload->m_hdr, 1);
+	ascon_prf_update(&ctx, (uint8_t *)&payload->mac_payload.f_hdr, 7);
+	ascon_prf_update(&ctx, &payload->mac_payload.f_port, 1);
+	// Little endian payload, reversed a rate block at a time
+	for (uint16_t j = frm_payload_size; j > 0;) {
+		uint16_t n = j < ASCON_PRFA_IN_RATE ? j : ASCON_PRFA_IN_RATE;
+
+		for (uint16_t k = 0; k < n; k++) {
+			block[k] = payload->mac_payload.frm_payload[j - 1 - k];
+		}
+		ascon_prf_update(&ctx, block, n);
+		j -= n;
+	}
+	if (ascon_prf_final(&ctx, out, CRYPTO_BYTES) != 0) {
+		return -1;
+	}
 	*mic = out[0];
 	*mic |= out[1] << 8;
 	*mic |= out[2] << (8 * 2);
@@ -105,39 +158,74 @@ int32_t loramac_calculate_mic(struct loramac_phys_payload *payload, uint8_t frm_
 	return 0;
 }
 
-// TODO: support frm_payload_size greater than 16 bytes
+int32_t loramac_set_app_s_key(aes_context *app_s_key, const uint8_t *key)
+{
+	if (aes_set_key(key, 16, app_s_key) != 0) {
+		return -1;
+	}
+	return 0;
+}
+
 // TODO: support other MType other than Unconfirmed up/down
-int32_t loramac_frm_payload_encryption(struct loramac_phys_payload *payload, uint8_t frm_payload_size, uint8_t *key)
+static void loramac_fill_ai(struct loramac_phys_payload *payload, uint8_t Ai[][16], uint8_t first, uint8_t count)
 {
 	uint8_t *Ai_dev_addr;
 	uint8_t *Ai_f_cnt;
 
-	uint8_t Ai[16][16] = {0};
-	uint8_t S[16][16] = {0};
-
 	Ai_dev_addr = (uint8_t *)&payload->mac_payload.f_hdr.dev_addr; // transform to little endian
 	Ai_f_cnt = (uint8_t *)&payload->mac_payload.f_hdr.f_cnt;
 
-	for (uint8_t i = 0; i < (uint8_t)(frm_payload_size / 16) + (frm_payload_size % 16 ? 1 : 0); i++) {
+	memset(Ai, 0, count * 16);
+	for (uint8_t i = 0; i < count; i++) {
 		Ai[i][0] = 0x01;
 		Ai[i][5] = payload->m_hdr & 0x20 ? DOWNLINK : UPLINK;
 
 		memcpy(&Ai[i][6], Ai_dev_addr, 4);
 		memcpy(&Ai[i][10], Ai_f_cnt, 2);
 
-		aes_context ctx = {0};
-		aes_set_key(key, 16, &ctx);
-		Ai[i][15] = i + 1;
-		aes_encrypt(Ai[i], S[i], &ctx);
+		Ai[i][15] = first + i + 1;
 	}
+}
 
-	loramac_aes_byte_array_xor(payload->mac_payload.frm_payload, S, payload->mac_payload.frm_payload, frm_payload_size);
+uint8_t loramac_frm_payload_blocks(struct loramac_phys_payload *payload, uint16_t frm_payload_size, uint8_t Ai[][16])
+{
+	uint8_t total_block = LORAMAC_FRM_PAYLOAD_BLOCKS(frm_payload_size);
 
+	loramac_fill_ai(payload, Ai, 0, total_block);
+	return total_block;
+}
+
+int32_t loramac_frm_payload_xor(struct loramac_phys_payload *payload, uint16_t frm_payload_size, uint8_t S[][16])
+{
+	loramac_keystream_xor(payload->mac_payload.frm_payload, (const uint8_t (*)[16])S, frm_payload_size);
+	return 0;
+}
+
+int32_t loramac_frm_payload_encryption(struct loramac_phys_payload *payload, uint16_t frm_payload_size, const aes_context *app_s_key)
+{
+	// Keystream of one chunk, the A_i blocks are encrypted in place
+	uint8_t S[LORAMAC_KEYSTREAM_BLOCKS][16];
+	uint8_t total_block = LORAMAC_FRM_PAYLOAD_BLOCKS(frm_payload_size);
+
+	if (frm_payload_size > LORAMAC_FRM_PAYLOAD_MAX) {
+		return -1;
+	}
+	for (uint8_t block = 0; block < total_block; block += LORAMAC_KEYSTREAM_BLOCKS) {
+		uint8_t count = total_block - block < LORAMAC_KEYSTREAM_BLOCKS ? total_block - block : LORAMAC_KEYSTREAM_BLOCKS;
+		uint16_t offset = block * 16;
+		uint16_t size = frm_payload_size - offset < count * 16 ? frm_payload_size - offset : count * 16;
+
+		loramac_fill_ai(payload, S, block, count);
+		if (aes_encrypt_blocks(S[0], S[0], count, app_s_key)) {
+			return -1;
+		}
+		loramac_keystream_xor(&payload->mac_payload.frm_payload[offset], (const uint8_t (*)[16])S, size);
+	}
 	return 0;
 }
 
 // TODO: support FOpts unknown length, skip it for now
-int32_t loramac_serialize_data(struct loramac_phys_payload *payload, uint8_t *out_data, uint8_t frm_payload_size)
+int32_t loramac_serialize_data(struct loramac_phys_payload *payload, uint8_t *out_data, uint16_t frm_payload_size)
 {
 	memcpy(out_data, (uint8_t *)payload, 8); // MHDR -> FCNT
 	out_data[8] = payload->mac_payload.f_port; // FPORT
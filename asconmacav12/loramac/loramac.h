@@ -1,11 +1,19 @@
 #ifndef LORAMAC_H
 #define LORAMAC_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include "aes.h"
+#include "ascon.h"
+#include "prf.h"
+
 #define LORAMAC_PHYS_PAYLOAD_MHDR_UNCONFIRM_DATA_UP 0x40
 #define LORAMAC_PHYS_PAYLOAD_MHDR_UNCONFIRM_DATA_DOWN 0x60
 
+// Largest FRM_PAYLOAD of LoRaWAN, MACPayload (250) - FHDR (7) - FPORT (1)
+#define LORAMAC_FRM_PAYLOAD_MAX 242
+
 enum loramac_data_dir {UPLINK, DOWNLINK};
 enum loramac_byte_offset {LRMAC_BYTE_OFFSET_MHDR, LRMAC_BYTE_OFFSET_DEVADDR, LRMAC_BYTE_OFFSET_FCTRL = 5, LRMAC_BYTE_OFFSET_FCNT, LRMAC_BYTE_OFFSET_FPORT = 8, LRMAC_BYTE_OFFSET_FRMPAYLOAD};
 
@@ -33,6 +41,58 @@ struct loramac_phys_payload {
 
 struct loramac_phys_payload *loramac_init(void);
 
+// Read-only view of a received frame [MHDR + FHDR + FPORT + FRM_PAYLOAD + MIC], the fields
+// are read in place from the frame, which must outlive the view
+// TODO: support FOpts, the FHDR is expected to be 7 bytes
+struct loramac_frame_view {
+	const uint8_t *frame;
+	uint16_t frm_payload_size;
+};
+
+// Return -1 if the frame is too short or its FRM_PAYLOAD is longer than LORAMAC_FRM_PAYLOAD_MAX
+int32_t loramac_frame_view_init(struct loramac_frame_view *view, const uint8_t *frame, size_t frame_size);
+
+static inline uint32_t loramac_frame_le32(const uint8_t *x)
+{
+	return ((uint32_t)x[3] << 24) | ((uint32_t)x[2] << 16) | ((uint32_t)x[1] << 8) | (uint32_t)x[0];
+}
+
+static inline uint8_t loramac_frame_m_hdr(const struct loramac_frame_view *view)
+{
+	return view->frame[LRMAC_BYTE_OFFSET_MHDR];
+}
+
+static inline uint32_t loramac_frame_dev_addr(const struct loramac_frame_view *view)
+{
+	return loramac_frame_le32(&view->frame[LRMAC_BYTE_OFFSET_DEVADDR]);
+}
+
+static inline uint8_t loramac_frame_f_ctrl(const struct loramac_frame_view *view)
+{
+	return view->frame[LRMAC_BYTE_OFFSET_FCTRL];
+}
+
+static inline uint16_t loramac_frame_f_cnt(const struct loramac_frame_view *view)
+{
+	return (uint16_t)((view->frame[LRMAC_BYTE_OFFSET_FCNT + 1] << 8) | view->frame[LRMAC_BYTE_OFFSET_FCNT]);
+}
+
+static inline uint8_t loramac_frame_f_port(const struct loramac_frame_view *view)
+{
+	return view->frame[LRMAC_BYTE_OFFSET_FPORT];
+}
+
+// FRM_PAYLOAD in the on air byte order (the reverse of the loramac_phys_payload order)
+static inline const uint8_t *loramac_frame_frm_payload(const struct loramac_frame_view *view)
+{
+	return &view->frame[LRMAC_BYTE_OFFSET_FRMPAYLOAD];
+}
+
+static inline uint32_t loramac_frame_mic(const struct loramac_frame_view *view)
+{
+	return loramac_frame_le32(&view->frame[LRMAC_BYTE_OFFSET_FRMPAYLOAD + view->frm_payload_size]);
+}
+
 int32_t loramac_fill_fhdr(struct loramac_phys_payload *payload, uint32_t dev_addr, uint8_t f_ctrl, uint16_t f_cnt, uint8_t *f_opts);
 
 // Expect the user to fill the FHDR with the loramac_fill_fhdr function
@@ -41,14 +101,43 @@ int32_t loramac_fill_mac_payload(struct loramac_phys_payload *payload, uint8_t f
 // Expect the user to fill the MACPayload with the loramac_fill_mac_payload function
 int32_t loramac_fill_phys_payload(struct loramac_phys_payload *payload, uint8_t m_hdr, uint32_t mic);
 
+// Run the Ascon-MAC key initialization once per session (e.g when the device is
+// provisioned or loaded) and reuse the keyed state for every loramac_calculate_mic
+int32_t loramac_set_nwk_s_key(ascon_state_t *nwk_s_key, const uint8_t *key);
+
+// MIC input of a received frame: the B0 block, built into 'B0', followed by the
+// MHDR..FRM_PAYLOAD bytes of the frame in place
+void loramac_frame_mic_msg(const struct loramac_frame_view *view, uint8_t B0[16], ascon_prf_msg_t *msg);
+
+// Calculate the MIC of a received frame, without copying it
+int32_t loramac_frame_calculate_mic(const struct loramac_frame_view *view, const ascon_state_t *nwk_s_key, uint32_t *mic);
+
 // Calculate MIC
-int32_t loramac_calculate_mic(struct loramac_phys_payload *payload, uint8_t frm_payload_size, uint8_t *key, uint8_t algo_option, uint32_t *mic);
+int32_t loramac_calculate_mic(struct loramac_phys_payload *payload, uint16_t frm_payload_size, const ascon_state_t *nwk_s_key, uint8_t algo_option, uint32_t *mic);
+
+// Expand the AppSKey once per session (e.g when the device is provisioned or loaded)
+// and reuse the context for every loramac_frm_payload_encryption
+int32_t loramac_set_app_s_key(aes_context *app_s_key, const uint8_t *key);
 
 // Before calling this, fill all struct loramac_phys_payload and other data structures
-// Support <= 16 bytes FRM_PAYLOAD_SIZE
+// Support up to LORAMAC_FRM_PAYLOAD_MAX bytes FRM_PAYLOAD_SIZE, the keystream is generated
+// LORAMAC_KEYSTREAM_BLOCKS blocks at a time and XORed straight into frm_payload
 // After using this function, the frm_payload field is encrypted
-int32_t loramac_frm_payload_encryption(struct loramac_phys_payload *payload, uint8_t frm_payload_size, uint8_t *key);
+int32_t loramac_frm_payload_encryption(struct loramac_phys_payload *payload, uint16_t frm_payload_size, const aes_context *app_s_key);
+
+// Keystream blocks generated per AES call, matches the 8 blocks pipelines of aes_encrypt_blocks
+#define LORAMAC_KEYSTREAM_BLOCKS 8
+
+// Number of 16 bytes A_i counter blocks that encrypt FRM_PAYLOAD
+#define LORAMAC_FRM_PAYLOAD_BLOCKS(frm_payload_size) (((frm_payload_size) + 15) / 16)
+
+// The two halves of loramac_frm_payload_encryption, to encrypt the A_i blocks of many
+// frames in one aes_encrypt_blocks_keyed call:
+// build the A_i counter blocks into 'Ai', return the number of blocks
+uint8_t loramac_frm_payload_blocks(struct loramac_phys_payload *payload, uint16_t frm_payload_size, uint8_t Ai[][16]);
+// XOR FRM_PAYLOAD with the encrypted A_i blocks 'S'
+int32_t loramac_frm_payload_xor(struct loramac_phys_payload *payload, uint16_t frm_payload_size, uint8_t S[][16]);
 
-int32_t loramac_serialize_data(struct loramac_phys_payload *payload, uint8_t *out_data, uint8_t frm_payload_size);
+int32_t loramac_serialize_data(struct loramac_phys_payload *payload, uint8_t *out_data, uint16_t frm_payload_size);
 
 #endif /* LORAMAC_H */
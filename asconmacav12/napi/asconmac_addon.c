@@ -0,0 +1,1396 @@
+/*
+ * Node-API addon exposing the codec to JavaScript
+ *
+ * createSession(appskey, nwkskey)
+ *     -> session, an opaque Buffer holding the expanded keys of a device
+ * decode(frame, session)
+ *     -> { status, payload, devAddr, fCnt, fPort, mHdr }
+ * decodeAsync(frame, session)
+ *     -> Promise resolving to the same object, runs on the libuv threadpool
+ * decodeBatch(frames, sessions)
+ *     -> Array of the objects above, one per frame
+ * encode(data, session, devAddr, fCnt, fPort)
+ *     -> { status, frame }
+ *
+ * openSessionTable(path, capacity)
+ *     -> table, the sessions of session_table.h mapped from 'path'
+ * sessionPut(table, devAddr, appskey, nwkskey), sessionRemove(table, devAddr)
+ *     -> undefined, true if the device was in the table
+ * sessionSync(table)
+ *     -> undefined, flushes the table to its file
+ * decodeBatchTable(frames, table)
+ *     -> same as decodeBatch, the session is found from the DevAddr of the
+ *        frame and its FCnt recorded. status is SESSION_TABLE_ERR_NOT_FOUND
+ *        for the unknown devices
+ * encodeTable(data, table, devAddr, fPort)
+ *     -> { status, frame, fCnt }, with the next downlink FCnt of the device
+ *
+ * openDedup(windowMs, capacity)
+ *     -> set, the uplinks of the last windowMs of dedup.h
+ * dedupFrames(set, frames)
+ *     -> Array of { key, duplicate }, key is the same Number for the copies
+ *        of a frame and duplicate is true when it was seen in the window
+ *
+ * parsePushData(json, meta, frames)
+ *     -> number of rxpk in the PUSH_DATA JSON (rxpk.h). Nothing is allocated,
+ *        the fields of rxpk i are written to the Float64Array 'meta' at
+ *        i * PUSH_DATA_META_SIZE: numbers (NaN when missing), then [offset,
+ *        size] of the frame in 'frames' and of the strings in 'json' (-1
+ *        when missing). "data" is decoded into the 'frames' Buffer, which
+ *        holds at least 3/4 of the json size. Throws on invalid JSON
+ *
+ * stageEnable(enabled)
+ *     -> undefined, turns the stage timers of hist.h on or off
+ * stageRecord(stage, ns)
+ *     -> undefined, records a stage timed by JavaScript (e.g persistence)
+ * stageSnapshot()
+ *     -> Array of { stage, count, sum, max, p50, p99, p999, buckets }, one
+ *        per stage, summed over all threads. Times are in ns, buckets is a
+ *        Float64Array of the counts of the hist.h buckets
+ * stageBucketMax()
+ *     -> Float64Array, the highest value (ns) of every bucket
+ * coreCounters()
+ *     -> { frames, decoded, micFailed, bytes }, the frames through
+ *        codec_decode_batch() summed over all threads, counted while the
+ *        stage timers are on
+ *
+ * openUplinkLog(dir, { segmentMax, segmentMs, retentionMs, sync })
+ *     -> log, the append-only uplink log of ulog.h in 'dir'
+ * logAppend(log, uplinks)
+ *     -> seq of the last uplink, uplinks is an Array of { timeMs, devAddr,
+ *        fCnt, fPort, rssi, lsnr, payload, gateways }, gateways an optional
+ *        Array of { gateway (EUI hex string), rssi, lsnr } of which the first
+ *        ULOG_GATEWAY_MAX are kept. Only copied to memory
+ * logCommit(log)
+ *     -> Promise resolving to the last seq written and synced, runs on the
+ *        libuv threadpool. The appends made meanwhile go to the next commit
+ * logRead(log, fromSeq, max)
+ *     -> Array of { seq, timeMs, devAddr, fCnt, fPort, rssi, lsnr, payload,
+ *        gateways } committed, in seq order, gateways only when appended
+ * logScan(log, devAddr, fromMs, toMs)
+ *     -> same, the uplinks of a device with fromMs <= timeMs < toMs
+ * logMaintain(log, keepSeq)
+ *     -> Promise, retention and compaction on the libuv threadpool, the
+ *        segments holding seq >= keepSeq are kept
+ *
+ * All byte arguments are Buffers, keys are 16 bytes. The frame is read in
+ * place and the payload is decrypted straight into the returned Buffer.
+ */
+
+#define _POSIX_C_SOURCE 200809L /* pthread_rwlock_t of ulog.h */
+#define NAPI_VERSION 8
+#include <node_api.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "base64.h"
+#include "codec.h"
+#include "dedup.h"
+#include "hist.h"
+#include "rxpk.h"
+#include "session_table.h"
+#include "ulog.h"
+
+#define NAPI_CALL(env, call)                                      \
+	do {                                                          \
+		if ((call) != napi_ok) {                                  \
+			napi_throw_error((env), NULL, "Node-API call failed"); \
+			return NULL;                                          \
+		}                                                         \
+	} while (0)
+
+struct decode_work {
+	napi_async_work work;
+	napi_deferred deferred;
+	napi_ref refs[3]; // frame, session, payload
+	const uint8_t *frame;
+	size_t frame_size;
+	const struct codec_session *session;
+	uint8_t *payload;
+	struct codec_uplink uplink;
+	int32_t status;
+};
+
+static int get_buffer(napi_env env, napi_value value, const char *name, size_t expected_size, uint8_t **data, size_t *size)
+{
+	bool is_buffer = false;
+	char message[64];
+
+	napi_is_buffer(env, value, &is_buffer);
+	if (is_buffer && napi_get_buffer_info(env, value, (void **)data, size) == napi_ok &&
+	    (!expected_size || *size == expected_size)) {
+		return 0;
+	}
+	if (expected_size) {
+		snprintf(message, sizeof(message), "%s must be a Buffer of %u bytes", name, (unsigned)expected_size);
+	} else {
+		snprintf(message, sizeof(message), "%s must be a Buffer", name);
+	}
+	napi_throw_type_error(env, NULL, message);
+	return -1;
+}
+
+static int get_uint32(napi_env env, napi_value value, const char *name, uint32_t *out)
+{
+	char message[64];
+
+	if (napi_get_value_uint32(env, value, out) == napi_ok) {
+		return 0;
+	}
+	snprintf(message, sizeof(message), "%s must be a number", name);
+	napi_throw_type_error(env, NULL, message);
+	return -1;
+}
+
+static void set_uint32(napi_env env, napi_value object, const char *name, uint32_t value)
+{
+	napi_value v;
+	napi_create_uint32(env, value, &v);
+	napi_set_named_property(env, object, name, v);
+}
+
+static void set_int32(napi_env env, napi_value object, const char *name, int32_t value)
+{
+	napi_value v;
+	napi_create_int32(env, value, &v);
+	napi_set_named_property(env, object, name, v);
+}
+
+static napi_value decode_result(napi_env env, int32_t status, const struct codec_uplink *uplink, napi_value payload)
+{
+	napi_value result;
+	napi_value null_value;
+
+	napi_create_object(env, &result);
+	napi_get_null(env, &null_value);
+	set_int32(env, result, "status", status);
+	napi_set_named_property(env, result, "payload", status == CODEC_OK ? payload : null_value);
+	if (status != CODEC_ERR_INVALID_INPUT) {
+		set_uint32(env, result, "devAddr", uplink->dev_addr);
+		set_uint32(env, result, "fCnt", uplink->f_cnt);
+		set_uint32(env, result, "fPort", uplink->f_port);
+		set_uint32(env, result, "mHdr", uplink->m_hdr);
+	}
+	return result;
+}
+
+// Parse decode arguments and allocate the payload Buffer for the result
+static int decode_args(napi_env env, napi_callback_info info, napi_value argv[2], struct decode_work *work, napi_value *payload)
+{
+	size_t argc = 2;
+	size_t size;
+
+	if (napi_get_cb_info(env, info, &argc, argv, NULL, NULL) != napi_ok || argc < 2) {
+		napi_throw_type_error(env, NULL, "Expected (frame, session)");
+		return -1;
+	}
+	if (get_buffer(env, argv[0], "frame", 0, (uint8_t **)&work->frame, &work->frame_size) != 0 ||
+	    get_buffer(env, argv[1], "session", sizeof(struct codec_session), (uint8_t **)&work->session, &size) != 0) {
+		return -1;
+	}
+	size_t payload_size = work->frame_size > CODEC_FRAME_OVERHEAD ? work->frame_size - CODEC_FRAME_OVERHEAD : 0;
+	if (payload_size > CODEC_FRM_PAYLOAD_MAX) {
+		payload_size = 0;
+	}
+	if (napi_create_buffer(env, payload_size, (void **)&work->payload, payload) != napi_ok) {
+		napi_throw_error(env, NULL, "Cannot allocate payload");
+		return -1;
+	}
+	return 0;
+}
+
+static napi_value create_session(napi_env env, napi_callback_info info)
+{
+	size_t argc = 2;
+	napi_value argv[2];
+	uint8_t *appskey, *nwkskey;
+	size_t size;
+	struct codec_session *session;
+	napi_value result;
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	if (argc < 2) {
+		napi_throw_type_error(env, NULL, "Expected (appskey, nwkskey)");
+		return NULL;
+	}
+	if (get_buffer(env, argv[0], "appskey", CODEC_KEYBYTES, &appskey, &size) != 0 ||
+	    get_buffer(env, argv[1], "nwkskey", CODEC_KEYBYTES, &nwkskey, &size) != 0) {
+		return NULL;
+	}
+	NAPI_CALL(env, napi_create_buffer(env, sizeof(*session), (void **)&session, &result));
+	if (codec_session_init(session, appskey, nwkskey) != 0) {
+		napi_throw_error(env, NULL, "Cannot expand session keys");
+		return NULL;
+	}
+	return result;
+}
+
+static napi_value decode(napi_env env, napi_callback_info info)
+{
+	napi_value argv[2];
+	napi_value payload;
+	struct decode_work work = {0};
+
+	if (decode_args(env, info, argv, &work, &payload) != 0) {
+		return NULL;
+	}
+	work.status = codec_decode_frame(work.frame, work.frame_size, work.session, &work.uplink, work.payload);
+	return decode_result(env, work.status, &work.uplink, payload);
+}
+
+static void decode_execute(napi_env env, void *data)
+{
+	struct decode_work *work = data;
+	(void)env;
+
+	work->status = codec_decode_frame(work->frame, work->frame_size, work->session, &work->uplink, work->payload);
+}
+
+static void reject_deferred(napi_env env, napi_deferred deferred, const char *text)
+{
+	napi_value message;
+	napi_value error;
+
+	napi_create_string_utf8(env, text, NAPI_AUTO_LENGTH, &message);
+	napi_create_error(env, NULL, message, &error);
+	napi_reject_deferred(env, deferred, error);
+}
+
+// Release what was created of 'work', the refs and async work left NULL are skipped
+static void decode_work_free(napi_env env, struct decode_work *work)
+{
+	for (int i = 0; i < 3; i++) {
+		if (work->refs[i] != NULL) {
+			napi_delete_reference(env, work->refs[i]);
+		}
+	}
+	if (work->work != NULL) {
+		napi_delete_async_work(env, work->work);
+	}
+	free(work);
+}
+
+static void decode_complete(napi_env env, napi_status status, void *data)
+{
+	struct decode_work *work = data;
+	napi_value payload;
+
+	napi_get_reference_value(env, work->refs[2], &payload);
+	if (status == napi_ok) {
+		napi_resolve_deferred(env, work->deferred, decode_result(env, work->status, &work->uplink, payload));
+	} else {
+		reject_deferred(env, work->deferred, "decodeAsync cancelled");
+	}
+	decode_work_free(env, work);
+}
+
+static napi_value decode_async(napi_env env, napi_callback_info info)
+{
+	napi_value argv[2];
+	napi_value payload;
+	napi_value promise;
+	napi_value name;
+	struct decode_work *work = calloc(1, sizeof(*work));
+
+	if (work == NULL) {
+		napi_throw_error(env, NULL, "Out of memory");
+		return NULL;
+	}
+	if (decode_args(env, info, argv, work, &payload) != 0) {
+		free(work);
+		return NULL;
+	}
+	// Keep the Buffers alive (and unmoved) until the work is complete
+	if (napi_create_reference(env, argv[0], 1, &work->refs[0]) != napi_ok ||
+	    napi_create_reference(env, argv[1], 1, &work->refs[1]) != napi_ok ||
+	    napi_create_reference(env, payload, 1, &work->refs[2]) != napi_ok ||
+	    napi_create_string_utf8(env, "asconmac.decodeAsync", NAPI_AUTO_LENGTH, &name) != napi_ok ||
+	    napi_create_async_work(env, NULL, name, decode_execute, decode_complete, work, &work->work) != napi_ok ||
+	    napi_create_promise(env, &work->deferred, &promise) != napi_ok) {
+		decode_work_free(env, work);
+		napi_throw_error(env, NULL, "Node-API call failed");
+		return NULL;
+	}
+	if (napi_queue_async_work(env, work->work) != napi_ok) {
+		reject_deferred(env, work->deferred, "decodeAsync not queued");
+		decode_work_free(env, work);
+		napi_throw_error(env, NULL, "Node-API call failed");
+		return NULL;
+	}
+	return promise;
+}
+
+static int get_batch_entry(napi_env env, napi_value array, uint32_t index, const char *name, size_t expected_size,
+			   const uint8_t **data, uint16_t *size)
+{
+	napi_value value;
+	size_t value_size;
+
+	if (napi_get_element(env, array, index, &value) != napi_ok ||
+	    get_buffer(env, value, name, expected_size, (uint8_t **)data, &value_size) != 0) {
+		return -1;
+	}
+	if (size) {
+		*size = value_size > UINT16_MAX ? UINT16_MAX : value_size;
+	}
+	return 0;
+}
+
+// Decode frames[] with the sessions of sessions[] or, when it is NULL, of the table
+static napi_value decode_frames(napi_env env, napi_value frames, napi_value sessions, struct session_table *table)
+{
+	napi_value results;
+	napi_value payloads[CODEC_BATCH_MAX];
+	struct session_entry *entries[CODEC_BATCH_MAX];
+	struct loramac_frame_view views[CODEC_BATCH_MAX];
+	bool parsed[CODEC_BATCH_MAX];
+	uint32_t count = 0;
+
+	napi_get_array_length(env, frames, &count);
+	struct codec_batch *batch = malloc(sizeof(*batch));
+	if (batch == NULL) {
+		napi_throw_error(env, NULL, "Out of memory");
+		return NULL;
+	}
+	NAPI_CALL(env, napi_create_array_with_length(env, count, &results));
+	for (uint32_t first = 0; first < count; first += CODEC_BATCH_MAX) {
+		batch->count = count - first < CODEC_BATCH_MAX ? count - first : CODEC_BATCH_MAX;
+		for (uint32_t n = 0; n < batch->count; n++) {
+			if (get_batch_entry(env, frames, first + n, "frames[i]", 0, &batch->frame[n], &batch->frame_size[n]) != 0 ||
+			    (sessions != NULL &&
+			     get_batch_entry(env, sessions, first + n, "sessions[i]", sizeof(struct codec_session),
+					     (const uint8_t **)&batch->session[n], NULL) != 0)) {
+				free(batch);
+				return NULL;
+			}
+			size_t payload_size = batch->frame_size[n] > CODEC_FRAME_OVERHEAD ? batch->frame_size[n] - CODEC_FRAME_OVERHEAD : 0;
+			if (payload_size > CODEC_FRM_PAYLOAD_MAX) {
+				payload_size = 0;
+			}
+			if (napi_create_buffer(env, payload_size, (void **)&batch->payload[n], &payloads[n]) != napi_ok) {
+				free(batch);
+				napi_throw_error(env, NULL, "Cannot allocate payload");
+				return NULL;
+			}
+		}
+		uint64_t stage = hist_start();
+		for (uint32_t n = 0; n < batch->count; n++) {
+			entries[n] = NULL;
+			if (table != NULL) {
+				parsed[n] = loramac_frame_view_init(&views[n], batch->frame[n], batch->frame_size[n]) == 0;
+				if (parsed[n]) {
+					entries[n] = session_table_find(table, loramac_frame_dev_addr(&views[n]));
+				}
+				batch->session[n] = entries[n] != NULL ? &entries[n]->session : NULL;
+				if (entries[n] == NULL) {
+					/* unknown device, only parsed below */
+					batch->frame[n] = NULL;
+				}
+			}
+		}
+		if (table != NULL) {
+			hist_stage_end(HIST_STAGE_SESSION, stage);
+		}
+		codec_decode_batch(batch);
+		stage = hist_start();
+		for (uint32_t n = 0; n < batch->count; n++) {
+			struct codec_uplink uplink = {
+				.dev_addr = batch->dev_addr[n],
+				.f_cnt = batch->f_cnt[n],
+				.f_port = batch->f_port[n],
+				.m_hdr = batch->m_hdr[n],
+				.frm_payload_size = batch->frm_payload_size[n],
+			};
+			int32_t status = batch->status[n];
+			if (table != NULL && entries[n] == NULL && parsed[n]) {
+				status = SESSION_TABLE_ERR_NOT_FOUND;
+				uplink.dev_addr = loramac_frame_dev_addr(&views[n]);
+				uplink.f_cnt = loramac_frame_f_cnt(&views[n]);
+				uplink.f_port = loramac_frame_f_port(&views[n]);
+				uplink.m_hdr = loramac_frame_m_hdr(&views[n]);
+			} else if (table != NULL && status == CODEC_OK) {
+				entries[n]->f_cnt_up = uplink.f_cnt;
+			}
+			napi_set_element(env, results, first + n, decode_result(env, status, &uplink, payloads[n]));
+		}
+		hist_stage_end(HIST_STAGE_OUTPUT, stage);
+	}
+	free(batch);
+	return results;
+}
+
+static napi_value decode_batch(napi_env env, napi_callback_info info)
+{
+	size_t argc = 2;
+	napi_value argv[2];
+	uint32_t count = 0;
+	uint32_t session_count = 0;
+	bool is_array[2] = {false};
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	for (size_t i = 0; i < argc && i < 2; i++) {
+		napi_is_array(env, argv[i], &is_array[i]);
+	}
+	if (argc < 2 || !is_array[0] || !is_array[1]) {
+		napi_throw_type_error(env, NULL, "Expected (frames[], sessions[])");
+		return NULL;
+	}
+	napi_get_array_length(env, argv[0], &count);
+	napi_get_array_length(env, argv[1], &session_count);
+	if (session_count != count) {
+		napi_throw_type_error(env, NULL, "frames and sessions must have the same length");
+		return NULL;
+	}
+	return decode_frames(env, argv[0], argv[1], NULL);
+}
+
+static napi_value encode(napi_env env, napi_callback_info info)
+{
+	size_t argc = 5;
+	napi_value argv[5];
+	uint8_t *data, *frame_data;
+	struct codec_session *session;
+	size_t data_size, size;
+	uint32_t dev_addr, f_cnt, f_port;
+	napi_value frame;
+	napi_value result;
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	if (argc < 5) {
+		napi_throw_type_error(env, NULL, "Expected (data, session, devAddr, fCnt, fPort)");
+		return NULL;
+	}
+	if (get_buffer(env, argv[0], "data", 0, &data, &data_size) != 0 ||
+	    get_buffer(env, argv[1], "session", sizeof(struct codec_session), (uint8_t **)&session, &size) != 0 ||
+	    get_uint32(env, argv[2], "devAddr", &dev_addr) != 0 ||
+	    get_uint32(env, argv[3], "fCnt", &f_cnt) != 0 ||
+	    get_uint32(env, argv[4], "fPort", &f_port) != 0) {
+		return NULL;
+	}
+
+	size_t frame_size = data_size <= CODEC_FRM_PAYLOAD_MAX ? data_size + CODEC_FRAME_OVERHEAD : 0;
+	NAPI_CALL(env, napi_create_buffer(env, frame_size, (void **)&frame_data, &frame));
+	int32_t status = codec_encode_frame(data, data_size, session, dev_addr, f_cnt, (uint8_t)f_port, frame_data);
+
+	napi_create_object(env, &result);
+	set_int32(env, result, "status", status);
+	if (status != CODEC_OK) {
+		napi_get_null(env, &frame);
+	}
+	napi_set_named_property(env, result, "frame", frame);
+	return result;
+}
+
+static void session_table_finalize(napi_env env, void *data, void *hint)
+{
+	(void)env;
+	(void)hint;
+	session_table_close(data);
+	free(data);
+}
+
+static int get_table(napi_env env, napi_value value, struct session_table **table)
+{
+	napi_valuetype type;
+
+	if (napi_typeof(env, value, &type) != napi_ok || type != napi_external ||
+	    napi_get_value_external(env, value, (void **)table) != napi_ok || (*table)->header == NULL) {
+		napi_throw_type_error(env, NULL, "table must be a session table");
+		return -1;
+	}
+	return 0;
+}
+
+static napi_value throw_table_error(napi_env env, int32_t rc)
+{
+	char message[64];
+
+	snprintf(message, sizeof(message), "Session table error %d", (int)rc);
+	napi_throw_error(env, NULL, message);
+	return NULL;
+}
+
+static napi_value open_session_table(napi_env env, napi_callback_info info)
+{
+	size_t argc = 2;
+	napi_value argv[2];
+	char path[4096];
+	size_t path_size;
+	uint32_t capacity = 0;
+	napi_value result;
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	if (argc < 1 || napi_get_value_string_utf8(env, argv[0], path, sizeof(path), &path_size) != napi_ok) {
+		napi_throw_type_error(env, NULL, "Expected (path, capacity)");
+		return NULL;
+	}
+	if (argc >= 2 && get_uint32(env, argv[1], "capacity", &capacity) != 0) {
+		return NULL;
+	}
+	struct session_table *table = malloc(sizeof(*table));
+	if (table == NULL) {
+		napi_throw_error(env, NULL, "Out of memory");
+		return NULL;
+	}
+	int32_t rc = session_table_open(table, path, capacity);
+	if (rc != SESSION_TABLE_OK) {
+		free(table);
+		return throw_table_error(env, rc);
+	}
+	NAPI_CALL(env, napi_create_external(env, table, session_table_finalize, NULL, &result));
+	return result;
+}
+
+static napi_value session_put(napi_env env, napi_callback_info info)
+{
+	size_t argc = 4;
+	napi_value argv[4];
+	struct session_table *table;
+	uint32_t dev_addr;
+	uint8_t *appskey, *nwkskey;
+	size_t size;
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	if (argc < 4) {
+		napi_throw_type_error(env, NULL, "Expected (table, devAddr, appskey, nwkskey)");
+		return NULL;
+	}
+	if (get_table(env, argv[0], &table) != 0 ||
+	    get_uint32(env, argv[1], "devAddr", &dev_addr) != 0 ||
+	    get_buffer(env, argv[2], "appskey", CODEC_KEYBYTES, &appskey, &size) != 0 ||
+	    get_buffer(env, argv[3], "nwkskey", CODEC_KEYBYTES, &nwkskey, &size) != 0) {
+		return NULL;
+	}
+	int32_t rc = session_table_put(table, dev_addr, appskey, nwkskey);
+	if (rc != SESSION_TABLE_OK) {
+		return throw_table_error(env, rc);
+	}
+	return NULL;
+}
+
+static napi_value session_remove(napi_env env, napi_callback_info info)
+{
+	size_t argc = 2;
+	napi_value argv[2];
+	struct session_table *table;
+	uint32_t dev_addr;
+	napi_value result;
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	if (argc < 2) {
+		napi_throw_type_error(env, NULL, "Expected (table, devAddr)");
+		return NULL;
+	}
+	if (get_table(env, argv[0], &table) != 0 || get_uint32(env, argv[1], "devAddr", &dev_addr) != 0) {
+		return NULL;
+	}
+	NAPI_CALL(env, napi_get_boolean(env, session_table_remove(table, dev_addr) == SESSION_TABLE_OK, &result));
+	return result;
+}
+
+static napi_value session_sync(napi_env env, napi_callback_info info)
+{
+	size_t argc = 1;
+	napi_value argv[1];
+	struct session_table *table;
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	if (argc < 1 || get_table(env, argv[0], &table) != 0) {
+		return NULL;
+	}
+	int32_t rc = session_table_sync(table);
+	if (rc != SESSION_TABLE_OK) {
+		return throw_table_error(env, rc);
+	}
+	return NULL;
+}
+
+static napi_value decode_batch_table(napi_env env, napi_callback_info info)
+{
+	size_t argc = 2;
+	napi_value argv[2];
+	struct session_table *table;
+	bool is_array = false;
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	if (argc >= 1) {
+		napi_is_array(env, argv[0], &is_array);
+	}
+	if (argc < 2 || !is_array) {
+		napi_throw_type_error(env, NULL, "Expected (frames[], table)");
+		return NULL;
+	}
+	if (get_table(env, argv[1], &table) != 0) {
+		return NULL;
+	}
+	return decode_frames(env, argv[0], NULL, table);
+}
+
+static napi_value encode_table(napi_env env, napi_callback_info info)
+{
+	size_t argc = 4;
+	napi_value argv[4];
+	struct session_table *table;
+	uint8_t *data, *frame_data;
+	size_t data_size;
+	uint32_t dev_addr, f_port;
+	napi_value frame;
+	napi_value result;
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	if (argc < 4) {
+		napi_throw_type_error(env, NULL, "Expected (data, table, devAddr, fPort)");
+		return NULL;
+	}
+	if (get_buffer(env, argv[0], "data", 0, &data, &data_size) != 0 ||
+	    get_table(env, argv[1], &table) != 0 ||
+	    get_uint32(env, argv[2], "devAddr", &dev_addr) != 0 ||
+	    get_uint32(env, argv[3], "fPort", &f_port) != 0) {
+		return NULL;
+	}
+
+	struct session_entry *entry = session_table_find(table, dev_addr);
+	int32_t status = SESSION_TABLE_ERR_NOT_FOUND;
+	uint32_t f_cnt = 0;
+	size_t frame_size = entry != NULL && data_size <= CODEC_FRM_PAYLOAD_MAX ? data_size + CODEC_FRAME_OVERHEAD : 0;
+	NAPI_CALL(env, napi_create_buffer(env, frame_size, (void **)&frame_data, &frame));
+	if (entry != NULL) {
+		f_cnt = entry->f_cnt_down;
+		status = codec_encode_frame(data, data_size, &entry->session, dev_addr, f_cnt, (uint8_t)f_port, frame_data);
+		if (status == CODEC_OK) {
+			entry->f_cnt_down++;
+		}
+	}
+
+	napi_create_object(env, &result);
+	set_int32(env, result, "status", status);
+	if (status != CODEC_OK) {
+		napi_get_null(env, &frame);
+	}
+	napi_set_named_property(env, result, "frame", frame);
+	set_uint32(env, result, "fCnt", f_cnt);
+	return result;
+}
+
+static void dedup_finalize(napi_env env, void *data, void *hint)
+{
+	(void)env;
+	(void)hint;
+	dedup_free(data);
+	free(data);
+}
+
+static napi_value open_dedup(napi_env env, napi_callback_info info)
+{
+	size_t argc = 2;
+	napi_value argv[2];
+	uint32_t window_ms, capacity = 1024;
+	napi_value result;
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	if (argc < 1) {
+		napi_throw_type_error(env, NULL, "Expected (windowMs, capacity)");
+		return NULL;
+	}
+	if (get_uint32(env, argv[0], "windowMs", &window_ms) != 0 ||
+	    (argc >= 2 && get_uint32(env, argv[1], "capacity", &capacity) != 0)) {
+		return NULL;
+	}
+	struct dedup_set *set = malloc(sizeof(*set));
+	if (set == NULL) {
+		napi_throw_error(env, NULL, "Out of memory");
+		return NULL;
+	}
+	int32_t rc = dedup_init(set, capacity, window_ms);
+	if (rc != DEDUP_OK) {
+		free(set);
+		napi_throw_range_error(env, NULL, rc == DEDUP_ERR_INVALID ? "windowMs is out of range" : "Out of memory");
+		return NULL;
+	}
+	NAPI_CALL(env, napi_create_external(env, set, dedup_finalize, NULL, &result));
+	return result;
+}
+
+static napi_value dedup_frames(napi_env env, napi_callback_info info)
+{
+	size_t argc = 2;
+	napi_value argv[2];
+	struct dedup_set *set;
+	napi_valuetype type;
+	bool is_array = false;
+	uint32_t count = 0;
+	napi_value results;
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	if (argc >= 2) {
+		napi_is_array(env, argv[1], &is_array);
+	}
+	if (argc < 2 || !is_array) {
+		napi_throw_type_error(env, NULL, "Expected (set, frames[])");
+		return NULL;
+	}
+	if (napi_typeof(env, argv[0], &type) != napi_ok || type != napi_external ||
+	    napi_get_value_external(env, argv[0], (void **)&set) != napi_ok) {
+		napi_throw_type_error(env, NULL, "set must be a dedup set");
+		return NULL;
+	}
+
+	uint64_t now_ms = dedup_now_ms();
+	napi_get_array_length(env, argv[1], &count);
+	NAPI_CALL(env, napi_create_array_with_length(env, count, &results));
+	for (uint32_t i = 0; i < count; i++) {
+		const uint8_t *frame;
+		uint16_t frame_size;
+		napi_value result, key, duplicate;
+
+		if (get_batch_entry(env, argv[1], i, "frames[i]", 0, &frame, &frame_size) != 0) {
+			return NULL;
+		}
+		uint64_t hash = dedup_frame_hash(frame, frame_size);
+		/* the top 53 bits, exact in a JavaScript Number */
+		napi_create_double(env, (double)(hash >> 11), &key);
+		napi_get_boolean(env, dedup_check(set, hash, now_ms) == DEDUP_DUPLICATE, &duplicate);
+		napi_create_object(env, &result);
+		napi_set_named_property(env, result, "key", key);
+		napi_set_named_property(env, result, "duplicate", duplicate);
+		napi_set_element(env, results, i, result);
+	}
+	return results;
+}
+
+// Layout of the fields of one rxpk in the 'meta' array of parsePushData
+enum push_data_meta {
+	PUSH_DATA_TMST,
+	PUSH_DATA_FREQ,
+	PUSH_DATA_CHAN,
+	PUSH_DATA_RFCH,
+	PUSH_DATA_STAT,
+	PUSH_DATA_RSSI,
+	PUSH_DATA_LSNR,
+	PUSH_DATA_SIZE,
+	PUSH_DATA_FRAME, /* offset, size */
+	PUSH_DATA_TIME = PUSH_DATA_FRAME + 2,
+	PUSH_DATA_MODU = PUSH_DATA_TIME + 2,
+	PUSH_DATA_DATR = PUSH_DATA_MODU + 2,
+	PUSH_DATA_CODR = PUSH_DATA_DATR + 2,
+	PUSH_DATA_META_SIZE = PUSH_DATA_CODR + 2,
+};
+
+static void push_data_string(double *meta, const struct rxpk *rxpk, uint32_t field, const struct rxpk_string *s)
+{
+	meta[0] = rxpk->fields & field ? (double)s->offset : -1;
+	meta[1] = s->size;
+}
+
+static napi_value parse_push_data(napi_env env, napi_callback_info info)
+{
+	size_t argc = 3;
+	napi_value argv[3];
+	uint8_t *json, *frames;
+	size_t json_size, frames_size, meta_length, used = 0;
+	napi_typedarray_type meta_type;
+	double *meta;
+	struct rxpk rxpk[RXPK_MAX];
+	uint32_t count;
+	napi_value result;
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	if (argc < 3) {
+		napi_throw_type_error(env, NULL, "Expected (json, meta, frames)");
+		return NULL;
+	}
+	if (get_buffer(env, argv[0], "json", 0, &json, &json_size) != 0 ||
+	    get_buffer(env, argv[2], "frames", 0, &frames, &frames_size) != 0) {
+		return NULL;
+	}
+	if (napi_get_typedarray_info(env, argv[1], &meta_type, &meta_length, (void **)&meta, NULL, NULL) != napi_ok ||
+	    meta_type != napi_float64_array || meta_length < RXPK_MAX * PUSH_DATA_META_SIZE) {
+		napi_throw_type_error(env, NULL, "meta must be a Float64Array of RXPK_MAX * PUSH_DATA_META_SIZE");
+		return NULL;
+	}
+	if (frames_size < BASE64_DECODED_SIZE_MAX(json_size)) {
+		napi_throw_range_error(env, NULL, "frames must hold 3/4 of the json size");
+		return NULL;
+	}
+	int32_t rc = rxpk_parse(json, json_size, rxpk, RXPK_MAX, &count);
+	if (rc != RXPK_OK) {
+		napi_throw_error(env, NULL, rc == RXPK_ERR_TOO_MANY ? "Too many rxpk in PUSH_DATA" : "Invalid PUSH_DATA JSON");
+		return NULL;
+	}
+
+	/* no JavaScript object is created here, Node-API calls cost more than the parsing */
+	uint64_t stage = hist_start();
+	for (uint32_t i = 0; i < count; i++) {
+		const struct rxpk *r = &rxpk[i];
+		double *m = &meta[i * PUSH_DATA_META_SIZE];
+		size_t frame_size;
+
+		m[PUSH_DATA_TMST] = r->fields & RXPK_FIELD_TMST ? (double)r->tmst : NAN;
+		m[PUSH_DATA_FREQ] = r->fields & RXPK_FIELD_FREQ ? (double)r->freq : NAN;
+		m[PUSH_DATA_CHAN] = r->fields & RXPK_FIELD_CHAN ? (double)r->chan : NAN;
+		m[PUSH_DATA_RFCH] = r->fields & RXPK_FIELD_RFCH ? (double)r->rfch : NAN;
+		m[PUSH_DATA_STAT] = r->fields & RXPK_FIELD_STAT ? (double)r->stat : NAN;
+		m[PUSH_DATA_RSSI] = r->fields & RXPK_FIELD_RSSI ? (double)r->rssi : NAN;
+		m[PUSH_DATA_LSNR] = r->fields & RXPK_FIELD_LSNR ? (double)r->lsnr : NAN;
+		m[PUSH_DATA_SIZE] = r->fields & RXPK_FIELD_SIZE ? (double)r->size : NAN;
+		push_data_string(&m[PUSH_DATA_TIME], r, RXPK_FIELD_TIME, &r->time);
+		push_data_string(&m[PUSH_DATA_MODU], r, RXPK_FIELD_MODU, &r->modu);
+		push_data_string(&m[PUSH_DATA_DATR], r, RXPK_FIELD_DATR, &r->datr);
+		push_data_string(&m[PUSH_DATA_CODR], r, RXPK_FIELD_CODR, &r->codr);
+		/* decoded straight into the frames Buffer, one frame after the other */
+		m[PUSH_DATA_FRAME] = -1;
+		m[PUSH_DATA_FRAME + 1] = 0;
+		if (rxpk_data_decode(json, r, &frames[used], frames_size - used, &frame_size) == BASE64_OK) {
+			m[PUSH_DATA_FRAME] = used;
+			m[PUSH_DATA_FRAME + 1] = frame_size;
+			used += frame_size;
+		}
+	}
+	hist_stage_end(HIST_STAGE_BASE64, stage);
+	NAPI_CALL(env, napi_create_uint32(env, count, &result));
+	return result;
+}
+
+static napi_value stage_enable(napi_env env, napi_callback_info info)
+{
+	size_t argc = 1;
+	napi_value argv[1];
+	bool enabled = false;
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	if (argc < 1 || napi_get_value_bool(env, argv[0], &enabled) != napi_ok) {
+		napi_throw_type_error(env, NULL, "Expected (enabled)");
+		return NULL;
+	}
+	hist_enable(enabled);
+	return NULL;
+}
+
+static napi_value stage_record(napi_env env, napi_callback_info info)
+{
+	size_t argc = 2;
+	napi_value argv[2];
+	uint32_t stage;
+	double ns;
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	if (argc < 2 || get_uint32(env, argv[0], "stage", &stage) != 0) {
+		return NULL;
+	}
+	if (napi_get_value_double(env, argv[1], &ns) != napi_ok || stage >= HIST_STAGE_COUNT) {
+		napi_throw_type_error(env, NULL, "Expected (stage, ns)");
+		return NULL;
+	}
+	hist_stage_record(stage, ns > 0 ? (uint64_t)ns : 0);
+	return NULL;
+}
+
+static void set_double(napi_env env, napi_value object, const char *name, double value)
+{
+	napi_value v;
+	napi_create_double(env, value, &v);
+	napi_set_named_property(env, object, name, v);
+}
+
+static napi_value create_float64_array(napi_env env, size_t length, double **data)
+{
+	napi_value buffer, array;
+
+	if (napi_create_arraybuffer(env, length * sizeof(double), (void **)data, &buffer) != napi_ok ||
+	    napi_create_typedarray(env, napi_float64_array, length, buffer, 0, &array) != napi_ok) {
+		return NULL;
+	}
+	return array;
+}
+
+static napi_value stage_snapshot(napi_env env, napi_callback_info info)
+{
+	static struct hist snapshot[HIST_STAGE_COUNT];
+	napi_value results;
+	(void)info;
+
+	hist_snapshot(snapshot);
+	NAPI_CALL(env, napi_create_array_with_length(env, HIST_STAGE_COUNT, &results));
+	for (uint32_t stage = 0; stage < HIST_STAGE_COUNT; stage++) {
+		const struct hist *hist = &snapshot[stage];
+		napi_value result, name, buckets;
+		double *counts;
+
+		NAPI_CALL(env, napi_create_object(env, &result));
+		napi_create_string_utf8(env, hist_stage_name(stage), NAPI_AUTO_LENGTH, &name);
+		napi_set_named_property(env, result, "stage", name);
+		set_double(env, result, "count", (double)hist->count);
+		set_double(env, result, "sum", (double)hist->sum);
+		set_double(env, result, "max", (double)hist->max);
+		set_double(env, result, "p50", (double)hist_quantile(hist, 0.50));
+		set_double(env, result, "p99", (double)hist_quantile(hist, 0.99));
+		set_double(env, result, "p999", (double)hist_quantile(hist, 0.999));
+		buckets = create_float64_array(env, HIST_BUCKETS, &counts);
+		if (buckets == NULL) {
+			napi_throw_error(env, NULL, "Cannot allocate buckets");
+			return NULL;
+		}
+		for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+			counts[i] = (double)hist->buckets[i];
+		}
+		napi_set_named_property(env, result, "buckets", buckets);
+		napi_set_element(env, results, stage, result);
+	}
+	return results;
+}
+
+static napi_value stage_bucket_max(napi_env env, napi_callback_info info)
+{
+	napi_value result;
+	double *bounds;
+	(void)info;
+
+	result = create_float64_array(env, HIST_BUCKETS, &bounds);
+	if (result == NULL) {
+		napi_throw_error(env, NULL, "Cannot allocate buckets");
+		return NULL;
+	}
+	for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+		bounds[i] = (double)hist_bucket_max(i);
+	}
+	return result;
+}
+
+static napi_value core_counters(napi_env env, napi_callback_info info)
+{
+	uint64_t counters[HIST_COUNTER_COUNT];
+	napi_value result;
+	(void)info;
+
+	hist_counters(counters);
+	NAPI_CALL(env, napi_create_object(env, &result));
+	set_double(env, result, "frames", (double)counters[HIST_COUNTER_FRAMES]);
+	set_double(env, result, "decoded", (double)counters[HIST_COUNTER_DECODED]);
+	set_double(env, result, "micFailed", (double)counters[HIST_COUNTER_MIC_FAILED]);
+	set_double(env, result, "bytes", (double)counters[HIST_COUNTER_BYTES]);
+	return result;
+}
+
+static void uplink_log_finalize(napi_env env, void *data, void *hint)
+{
+	(void)env;
+	(void)hint;
+	ulog_close(data);
+	free(data);
+}
+
+static int get_log(napi_env env, napi_value value, struct ulog **log)
+{
+	napi_valuetype type;
+
+	if (napi_typeof(env, value, &type) != napi_ok || type != napi_external ||
+	    napi_get_value_external(env, value, (void **)log) != napi_ok) {
+		napi_throw_type_error(env, NULL, "log must be an uplink log");
+		return -1;
+	}
+	return 0;
+}
+
+static napi_value throw_log_error(napi_env env, int32_t rc)
+{
+	char message[64];
+
+	snprintf(message, sizeof(message), "Uplink log error %d", (int)rc);
+	napi_throw_error(env, NULL, message);
+	return NULL;
+}
+
+// Number property of 'object', 'fallback' when it is missing
+static double get_named_double(napi_env env, napi_value object, const char *name, double fallback)
+{
+	napi_value value;
+	napi_valuetype type;
+	double result;
+
+	if (napi_get_named_property(env, object, name, &value) != napi_ok || napi_typeof(env, value, &type) != napi_ok ||
+	    type != napi_number || napi_get_value_double(env, value, &result) != napi_ok) {
+		return fallback;
+	}
+	return result;
+}
+
+static napi_value open_uplink_log(napi_env env, napi_callback_info info)
+{
+	size_t argc = 2;
+	napi_value argv[2];
+	char dir[4096];
+	size_t dir_size;
+	struct ulog_options options = {.segment_max = 64u << 20, .sync = 1};
+	napi_value result;
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	if (argc < 1 || napi_get_value_string_utf8(env, argv[0], dir, sizeof(dir), &dir_size) != napi_ok) {
+		napi_throw_type_error(env, NULL, "Expected (dir, options)");
+		return NULL;
+	}
+	if (argc >= 2) {
+		napi_valuetype type;
+		napi_typeof(env, argv[1], &type);
+		if (type == napi_object) {
+			options.segment_max = (uint64_t)get_named_double(env, argv[1], "segmentMax", (double)options.segment_max);
+			options.segment_ms = (uint64_t)get_named_double(env, argv[1], "segmentMs", 0);
+			options.retention_ms = (uint64_t)get_named_double(env, argv[1], "retentionMs", 0);
+			options.sync = get_named_double(env, argv[1], "sync", 1) != 0;
+		}
+	}
+	struct ulog *log = malloc(sizeof(*log));
+	if (log == NULL) {
+		napi_throw_error(env, NULL, "Out of memory");
+		return NULL;
+	}
+	int32_t rc = ulog_open(log, dir, &options);
+	if (rc != ULOG_OK) {
+		free(log);
+		return throw_log_error(env, rc);
+	}
+	NAPI_CALL(env, napi_create_external(env, log, uplink_log_finalize, NULL, &result));
+	return result;
+}
+
+// The gateways of an uplink object, at most ULOG_GATEWAY_MAX, 0 without any
+static uint32_t get_gateways(napi_env env, napi_value object, struct ulog_gateway *gateways)
+{
+	napi_value array, item, value;
+	bool is_array;
+	uint32_t count;
+	char eui[17];
+	size_t size;
+
+	if (napi_get_named_property(env, object, "gateways", &array) != napi_ok ||
+	    napi_is_array(env, array, &is_array) != napi_ok || !is_array ||
+	    napi_get_array_length(env, array, &count) != napi_ok) {
+		return 0;
+	}
+	count = count < ULOG_GATEWAY_MAX ? count : ULOG_GATEWAY_MAX;
+	for (uint32_t i = 0; i < count; i++) {
+		memset(&gateways[i], 0, sizeof(gateways[i]));
+		if (napi_get_element(env, array, i, &item) != napi_ok) {
+			return i;
+		}
+		if (napi_get_named_property(env, item, "gateway", &value) == napi_ok &&
+		    napi_get_value_string_utf8(env, value, eui, sizeof(eui), &size) == napi_ok) {
+			gateways[i].eui = strtoull(eui, NULL, 16);
+		}
+		gateways[i].rssi = (int16_t)get_named_double(env, item, "rssi", 0);
+		gateways[i].lsnr = (int16_t)lround(get_named_double(env, item, "lsnr", 0) * 10);
+	}
+	return count;
+}
+
+static napi_value log_append(napi_env env, napi_callback_info info)
+{
+	size_t argc = 2;
+	napi_value argv[2];
+	struct ulog *log;
+	uint32_t count;
+	uint64_t seq = 0;
+	napi_value result;
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	if (argc < 2 || napi_get_array_length(env, argv[1], &count) != napi_ok) {
+		napi_throw_type_error(env, NULL, "Expected (log, uplinks)");
+		return NULL;
+	}
+	if (get_log(env, argv[0], &log) != 0) {
+		return NULL;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		struct ulog_uplink uplink = {0};
+		struct ulog_gateway gateways[ULOG_GATEWAY_MAX];
+		napi_value object, payload;
+		uint8_t *data;
+		size_t size;
+
+		if (napi_get_element(env, argv[1], i, &object) != napi_ok ||
+		    napi_get_named_property(env, object, "payload", &payload) != napi_ok ||
+		    get_buffer(env, payload, "uplinks[i].payload", 0, &data, &size) != 0) {
+			return NULL;
+		}
+		uplink.time_ms = (uint64_t)get_named_double(env, object, "timeMs", 0);
+		uplink.dev_addr = (uint32_t)get_named_double(env, object, "devAddr", 0);
+		uplink.f_cnt = (uint32_t)get_named_double(env, object, "fCnt", 0);
+		uplink.f_port = (uint8_t)get_named_double(env, object, "fPort", 0);
+		uplink.rssi = (int16_t)get_named_double(env, object, "rssi", 0);
+		uplink.lsnr = (int16_t)lround(get_named_double(env, object, "lsnr", 0) * 10);
+		uplink.payload = data;
+		uplink.payload_size = size > UINT16_MAX ? UINT16_MAX : (uint16_t)size;
+		uplink.gateway_count = get_gateways(env, object, gateways);
+		uplink.gateways = gateways;
+		int32_t rc = ulog_append(log, &uplink, &seq);
+		if (rc != ULOG_OK) {
+			return throw_log_error(env, rc);
+		}
+	}
+	NAPI_CALL(env, napi_create_double(env, (double)seq, &result));
+	return result;
+}
+
+struct log_work {
+	napi_async_work work;
+	napi_deferred deferred;
+	napi_ref ref; // log
+	struct ulog *log;
+	uint64_t keep_seq; // logMaintain() only
+	uint64_t seq;
+	int32_t status;
+};
+
+static void log_commit_execute(napi_env env, void *data)
+{
+	struct log_work *work = data;
+	(void)env;
+
+	work->status = ulog_commit(work->log, &work->seq);
+}
+
+static void log_maintain_execute(napi_env env, void *data)
+{
+	struct log_work *work = data;
+	(void)env;
+
+	work->status = ulog_maintain(work->log, ulog_now_ms(), work->keep_seq);
+}
+
+static void log_work_free(napi_env env, struct log_work *work)
+{
+	if (work->ref != NULL) {
+		napi_delete_reference(env, work->ref);
+	}
+	if (work->work != NULL) {
+		napi_delete_async_work(env, work->work);
+	}
+	free(work);
+}
+
+static void log_work_complete(napi_env env, napi_status status, void *data)
+{
+	struct log_work *work = data;
+	char text[64];
+
+	if (status == napi_ok && work->status == ULOG_OK) {
+		napi_value seq;
+		napi_create_double(env, (double)work->seq, &seq);
+		napi_resolve_deferred(env, work->deferred, seq);
+	} else {
+		snprintf(text, sizeof(text), "Uplink log error %d", status == napi_ok ? (int)work->status : -1);
+		reject_deferred(env, work->deferred, text);
+	}
+	log_work_free(env, work);
+}
+
+static napi_value queue_log_work(napi_env env, napi_value log_value, struct ulog *log, const char *name,
+				 napi_async_execute_callback execute, uint64_t keep_seq)
+{
+	napi_value promise;
+	napi_value resource_name;
+	struct log_work *work = calloc(1, sizeof(*work));
+
+	if (work == NULL) {
+		napi_throw_error(env, NULL, "Out of memory");
+		return NULL;
+	}
+	work->log = log;
+	work->keep_seq = keep_seq;
+	// Keep the log open until the work is complete
+	if (napi_create_reference(env, log_value, 1, &work->ref) != napi_ok ||
+	    napi_create_string_utf8(env, name, NAPI_AUTO_LENGTH, &resource_name) != napi_ok ||
+	    napi_create_async_work(env, NULL, resource_name, execute, log_work_complete, work, &work->work) != napi_ok ||
+	    napi_create_promise(env, &work->deferred, &promise) != napi_ok) {
+		log_work_free(env, work);
+		napi_throw_error(env, NULL, "Node-API call failed");
+		return NULL;
+	}
+	if (napi_queue_async_work(env, work->work) != napi_ok) {
+		reject_deferred(env, work->deferred, "Uplink log work not queued");
+		log_work_free(env, work);
+		napi_throw_error(env, NULL, "Node-API call failed");
+		return NULL;
+	}
+	return promise;
+}
+
+static napi_value log_commit(napi_env env, napi_callback_info info)
+{
+	size_t argc = 1;
+	napi_value argv[1];
+	struct ulog *log;
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	if (argc < 1 || get_log(env, argv[0], &log) != 0) {
+		return NULL;
+	}
+	return queue_log_work(env, argv[0], log, "asconmac.logCommit", log_commit_execute, 0);
+}
+
+static napi_value log_maintain(napi_env env, napi_callback_info info)
+{
+	size_t argc = 2;
+	napi_value argv[2];
+	struct ulog *log;
+	double keep_seq = (double)UINT64_MAX;
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	if (argc < 1 || get_log(env, argv[0], &log) != 0) {
+		return NULL;
+	}
+	if (argc >= 2 && napi_get_value_double(env, argv[1], &keep_seq) != napi_ok) {
+		napi_throw_type_error(env, NULL, "keepSeq must be a number");
+		return NULL;
+	}
+	return queue_log_work(env, argv[0], log, "asconmac.logMaintain", log_maintain_execute,
+			      keep_seq >= (double)UINT64_MAX ? UINT64_MAX : (uint64_t)keep_seq);
+}
+
+struct log_visit {
+	napi_env env;
+	napi_value results;
+	uint32_t count;
+	int failed;
+};
+
+// gateways property of a visited uplink, in the format of logAppend()
+static int set_gateways(napi_env env, napi_value object, const struct ulog_uplink *uplink)
+{
+	napi_value gateways, gateway, eui;
+	char hex[17];
+
+	if (napi_create_array_with_length(env, uplink->gateway_count, &gateways) != napi_ok) {
+		return -1;
+	}
+	for (uint32_t i = 0; i < uplink->gateway_count; i++) {
+		snprintf(hex, sizeof(hex), "%016llX", (unsigned long long)uplink->gateways[i].eui);
+		if (napi_create_object(env, &gateway) != napi_ok ||
+		    napi_create_string_utf8(env, hex, NAPI_AUTO_LENGTH, &eui) != napi_ok) {
+			return -1;
+		}
+		napi_set_named_property(env, gateway, "gateway", eui);
+		set_int32(env, gateway, "rssi", uplink->gateways[i].rssi);
+		set_double(env, gateway, "lsnr", uplink->gateways[i].lsnr / 10.0);
+		napi_set_element(env, gateways, i, gateway);
+	}
+	return napi_set_named_property(env, object, "gateways", gateways) == napi_ok ? 0 : -1;
+}
+
+static int log_visit(const struct ulog_uplink *uplink, void *ctx)
+{
+	struct log_visit *visit = ctx;
+	napi_env env = visit->env;
+	napi_value result, payload;
+	void *data;
+
+	if (napi_create_object(env, &result) != napi_ok ||
+	    napi_create_buffer_copy(env, uplink->payload_size, uplink->payload, &data, &payload) != napi_ok) {
+		visit->failed = 1;
+		return 1;
+	}
+	set_double(env, result, "seq", (double)uplink->seq);
+	set_double(env, result, "timeMs", (double)uplink->time_ms);
+	set_uint32(env, result, "devAddr", uplink->dev_addr);
+	set_uint32(env, result, "fCnt", uplink->f_cnt);
+	set_uint32(env, result, "fPort", uplink->f_port);
+	set_int32(env, result, "rssi", uplink->rssi);
+	set_double(env, result, "lsnr", uplink->lsnr / 10.0);
+	napi_set_named_property(env, result, "payload", payload);
+	if (uplink->gateway_count > 0 && set_gateways(env, result, uplink) != 0) {
+		visit->failed = 1;
+		return 1;
+	}
+	napi_set_element(env, visit->results, visit->count++, result);
+	return 0;
+}
+
+static napi_value log_read(napi_env env, napi_callback_info info)
+{
+	size_t argc = 3;
+	napi_value argv[3];
+	struct ulog *log;
+	double from_seq;
+	uint32_t max = UINT32_MAX;
+	struct log_visit visit = {.env = env};
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	if (argc < 2 || napi_get_value_double(env, argv[1], &from_seq) != napi_ok) {
+		napi_throw_type_error(env, NULL, "Expected (log, fromSeq, max)");
+		return NULL;
+	}
+	if (get_log(env, argv[0], &log) != 0 || (argc >= 3 && get_uint32(env, argv[2], "max", &max) != 0)) {
+		return NULL;
+	}
+	NAPI_CALL(env, napi_create_array(env, &visit.results));
+	int32_t rc = ulog_read(log, from_seq > 0 ? (uint64_t)from_seq : 0, max, log_visit, &visit);
+	if (rc != ULOG_OK || visit.failed) {
+		return throw_log_error(env, rc);
+	}
+	return visit.results;
+}
+
+static napi_value log_scan(napi_env env, napi_callback_info info)
+{
+	size_t argc = 4;
+	napi_value argv[4];
+	struct ulog *log;
+	uint32_t dev_addr;
+	double from_ms, to_ms;
+	struct log_visit visit = {.env = env};
+
+	NAPI_CALL(env, napi_get_cb_info(env, info, &argc, argv, NULL, NULL));
+	if (argc < 4 || napi_get_value_double(env, argv[2], &from_ms) != napi_ok ||
+	    napi_get_value_double(env, argv[3], &to_ms) != napi_ok) {
+		napi_throw_type_error(env, NULL, "Expected (log, devAddr, fromMs, toMs)");
+		return NULL;
+	}
+	if (get_log(env, argv[0], &log) != 0 || get_uint32(env, argv[1], "devAddr", &dev_addr) != 0) {
+		return NULL;
+	}
+	NAPI_CALL(env, napi_create_array(env, &visit.results));
+	int32_t rc = ulog_scan(log, dev_addr, from_ms > 0 ? (uint64_t)from_ms : 0,
+			       to_ms >= (double)UINT64_MAX ? UINT64_MAX : (uint64_t)to_ms, log_visit, &visit);
+	if (rc != ULOG_OK || visit.failed) {
+		return throw_log_error(env, rc);
+	}
+	return visit.results;
+}
+
+static napi_value init(napi_env env, napi_value exports)
+{
+	napi_property_descriptor properties[] = {
+		{"createSession", NULL, create_session, NULL, NULL, NULL, napi_default, NULL},
+		{"decode", NULL, decode, NULL, NULL, NULL, napi_default, NULL},
+		{"decodeAsync", NULL, decode_async, NULL, NULL, NULL, napi_default, NULL},
+		{"decodeBatch", NULL, decode_batch, NULL, NULL, NULL, napi_default, NULL},
+		{"encode", NULL, encode, NULL, NULL, NULL, napi_default, NULL},
+		{"openSessionTable", NULL, open_session_table, NULL, NULL, NULL, napi_default, NULL},
+		{"sessionPut", NULL, session_put, NULL, NULL, NULL, napi_default, NULL},
+		{"sessionRemove", NULL, session_remove, NULL, NULL, NULL, napi_default, NULL},
+		{"sessionSync", NULL, session_sync, NULL, NULL, NULL, napi_default, NULL},
+		{"decodeBatchTable", NULL, decode_batch_table, NULL, NULL, NULL, napi_default, NULL},
+		{"encodeTable", NULL, encode_table, NULL, NULL, NULL, napi_default, NULL},
+		{"openDedup", NULL, open_dedup, NULL, NULL, NULL, napi_default, NULL},
+		{"dedupFrames", NULL, dedup_frames, NULL, NULL, NULL, napi_default, NULL},
+		{"parsePushData", NULL, parse_push_data, NULL, NULL, NULL, napi_default, NULL},
+		{"stageEnable", NULL, stage_enable, NULL, NULL, NULL, napi_default, NULL},
+		{"stageRecord", NULL, stage_record, NULL, NULL, NULL, napi_default, NULL},
+		{"stageSnapshot", NULL, stage_snapshot, NULL, NULL, NULL, napi_default, NULL},
+		{"stageBucketMax", NULL, stage_bucket_max, NULL, NULL, NULL, napi_default, NULL},
+		{"coreCounters", NULL, core_counters, NULL, NULL, NULL, napi_default, NULL},
+		{"openUplinkLog", NULL, open_uplink_log, NULL, NULL, NULL, napi_default, NULL},
+		{"logAppend", NULL, log_append, NULL, NULL, NULL, napi_default, NULL},
+		{"logCommit", NULL, log_commit, NULL, NULL, NULL, napi_default, NULL},
+		{"logRead", NULL, log_read, NULL, NULL, NULL, napi_default, NULL},
+		{"logScan", NULL, log_scan, NULL, NULL, NULL, napi_default, NULL},
+		{"logMaintain", NULL, log_maintain, NULL, NULL, NULL, napi_default, NULL},
+	};
+
+	NAPI_CALL(env, napi_define_properties(env, exports, sizeof(properties) / sizeof(properties[0]), properties));
+	return exports;
+}
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
@@ -2,64 +2,125 @@
 #include "ascon.h"
 #include "crypto_auth.h"
 #include "permutations.h"
+#include "prf.h"
 #include "printstate.h"
 #include "word.h"
 
-int crypto_prf(unsigned char* out, unsigned long long outlen,
-               const unsigned char* in, unsigned long long inlen,
-               const unsigned char* k) {
-  if (CRYPTO_BYTES && outlen > CRYPTO_BYTES) return -1;
+void ascon_prf_keyinit(ascon_state_t* s, const unsigned char* k) {
   /* load key */
   const uint64_t K0 = LOADBYTES(k, 8);
   const uint64_t K1 = LOADBYTES(k + 8, 8);
-  int i;
   /* initialize */
-  ascon_state_t s;
-  s.x[0] = ASCON_MACA_IV;
-  s.x[1] = K0;
-  s.x[2] = K1;
-  s.x[3] = 0;
-  s.x[4] = 0;
-  printstate("initial value", &s);
-  P12(&s);
-  printstate("initialization", &s);
+  s->x[0] = ASCON_MACA_IV;
+  s->x[1] = K0;
+  s->x[2] = K1;
+  s->x[3] = 0;
+  s->x[4] = 0;
+  printstate("initial value", s);
+  P12(s);
+  printstate("initialization", s);
+}
 
+void ascon_prf_init(ascon_prf_ctx_t* ctx, const ascon_state_t* ks) {
+  /* start from the keyed state */
+  ctx->s = *ks;
+  ctx->word = 0;
+  ctx->len = 0;
+  ctx->i = 0;
+}
+
+static inline void ascon_prf_absorb_word(ascon_prf_ctx_t* ctx, uint64_t w) {
+  ((uint64_t*)(&ctx->s.x[0]))[ctx->i] ^= w;
+  if (++ctx->i == 5) {
+    ctx->i = 0;
+    printstate("absorb plaintext", &ctx->s);
+    P8(&ctx->s);
+  }
+}
+
+void ascon_prf_update(ascon_prf_ctx_t* ctx, const unsigned char* in,
+                      unsigned long long inlen) {
+  /* complete the partial word */
+  while (ctx->len && inlen) {
+    ctx->word |= SETBYTE(*in++, ctx->len);
+    inlen--;
+    if (++ctx->len == 8) {
+      ascon_prf_absorb_word(ctx, ctx->word);
+      ctx->word = 0;
+      ctx->len = 0;
+    }
+  }
   /* absorb full plaintext words */
-  i = 0;
   while (inlen >= 8) {
-    ((uint64_t*)(&s.x[0]))[i] ^= LOADBYTES(in, 8);
-    if (++i == 5) i = 0;
-    if (i == 0) printstate("absorb plaintext", &s);
-    if (i == 0) P8(&s);
+    ascon_prf_absorb_word(ctx, LOADBYTES(in, 8));
     in += 8;
     inlen -= 8;
   }
+  /* keep the rest for the next call */
+  if (inlen) {
+    ctx->word = LOADBYTES(in, inlen);
+    ctx->len = inlen;
+  }
+}
+
+int ascon_prf_final(ascon_prf_ctx_t* ctx, unsigned char* out,
+                    unsigned long long outlen) {
+  if (CRYPTO_BYTES && outlen > CRYPTO_BYTES) return -1;
+  ascon_state_t* s = &ctx->s;
+  int i = ctx->i;
   /* absorb final plaintext word */
-  ((uint64_t*)(&s.x[0]))[i] ^= LOADBYTES(in, inlen);
-  ((uint64_t*)(&s.x[0]))[i] ^= PAD(inlen);
-  printstate("pad plaintext", &s);
+  ((uint64_t*)(&s->x[0]))[i] ^= ctx->word;
+  ((uint64_t*)(&s->x[0]))[i] ^= PAD(ctx->len);
+  printstate("pad plaintext", s);
   /* domain separation */
-  s.x[4] ^= DSEP();
-  printstate("domain separation", &s);
+  s->x[4] ^= DSEP();
+  printstate("domain separation", s);
 
   /* squeeze */
-  P12(&s);
+  P12(s);
   /* squeeze output words */
   i = 0;
   while (outlen > 8) {
-    STOREBYTES(out, ((uint64_t*)(&s.x[0]))[i], 8);
+    STOREBYTES(out, ((uint64_t*)(&s->x[0]))[i], 8);
     if (++i == 2) i = 0;
-    if (i == 0) printstate("squeeze output", &s);
-    if (i == 0) P8(&s);
+    if (i == 0) printstate("squeeze output", s);
+    if (i == 0) P8(s);
     out += 8;
     outlen -= 8;
   }
   /* squeeze final output word */
-  STOREBYTES(out, ((uint64_t*)(&s.x[0]))[i], outlen);
-  printstate("squeeze output", &s);
+  STOREBYTES(out, ((uint64_t*)(&s->x[0]))[i], outlen);
+  printstate("squeeze output", s);
   return 0;
 }
 
+int crypto_prf_keyed_msg(unsigned char* out, unsigned long long outlen,
+                         const ascon_prf_msg_t* m, const ascon_state_t* ks) {
+  ascon_prf_ctx_t ctx;
+  if (m->hdrlen % 8) return -1;
+  ascon_prf_init(&ctx, ks);
+  ascon_prf_update(&ctx, m->hdr, m->hdrlen);
+  ascon_prf_update(&ctx, m->in, m->inlen);
+  return ascon_prf_final(&ctx, out, outlen);
+}
+
+int crypto_prf_keyed(unsigned char* out, unsigned long long outlen,
+                     const unsigned char* in, unsigned long long inlen,
+                     const ascon_state_t* ks) {
+  ascon_prf_ctx_t ctx;
+  ascon_prf_init(&ctx, ks);
+  ascon_prf_update(&ctx, in, inlen);
+  return ascon_prf_final(&ctx, out, outlen);
+}
+
+int crypto_prf(unsigned char* out, unsigned long long outlen,
+               const unsigned char* in, unsigned long long inlen,
+               const unsigned char* k) {
+  ascon_state_t ks;
+  ascon_prf_keyinit(&ks, k);
+  return crypto_prf_keyed(out, outlen, in, inlen, &ks);
+}
+
 int crypto_auth(unsigned char* out, const unsigned char* in,
                 unsigned long long len, const unsigned char* k) {
   return crypto_prf(out, CRYPTO_BYTES, in, len, k);
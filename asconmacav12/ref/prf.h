@@ -0,0 +1,58 @@
+#ifndef PRF_H_
+#define PRF_H_
+
+#include "ascon.h"
+
+/* message absorbed in place from two buffers: hdrlen bytes of hdr (a
+ * multiple of 8, e.g the 16 bytes LoRaWAN B0 block) followed by in */
+typedef struct {
+  const unsigned char* hdr;
+  unsigned long long hdrlen;
+  const unsigned char* in;
+  unsigned long long inlen;
+} ascon_prf_msg_t;
+
+/* incremental Ascon-PRFa, the message is absorbed across any number of
+ * ascon_prf_update calls, a partial word is kept until the next call */
+typedef struct {
+  ascon_state_t s;
+  uint64_t word; /* bytes of the partial word */
+  int len;       /* number of bytes in the partial word */
+  int i;         /* word of the block it goes to */
+} ascon_prf_ctx_t;
+
+/* state after the keyed initialization, it only depends on the key */
+void ascon_prf_keyinit(ascon_state_t* s, const unsigned char* k);
+
+/* start a message from the keyed state of ascon_prf_keyinit */
+void ascon_prf_init(ascon_prf_ctx_t* ctx, const ascon_state_t* ks);
+
+void ascon_prf_update(ascon_prf_ctx_t* ctx, const unsigned char* in,
+                      unsigned long long inlen);
+
+/* pad, squeeze outlen (<= CRYPTO_BYTES) bytes, ctx can not be updated after */
+int ascon_prf_final(ascon_prf_ctx_t* ctx, unsigned char* out,
+                    unsigned long long outlen);
+
+/* copy a context, e.g after a common prefix has been absorbed, to finish
+ * several messages sharing it */
+static inline void ascon_prf_clone(ascon_prf_ctx_t* dst,
+                                   const ascon_prf_ctx_t* src) {
+  *dst = *src;
+}
+
+/* same as crypto_prf but starts from a copy of the keyed state */
+int crypto_prf_keyed(unsigned char* out, unsigned long long outlen,
+                     const unsigned char* in, unsigned long long inlen,
+                     const ascon_state_t* ks);
+
+/* same as crypto_prf_keyed for the message hdr || in */
+int crypto_prf_keyed_msg(unsigned char* out, unsigned long long outlen,
+                         const ascon_prf_msg_t* m, const ascon_state_t* ks);
+
+/* MACs of n independent messages, each with its own keyed state, using the
+ * widest vector unit of the CPU (AVX-512, AVX2) and this code otherwise */
+int crypto_auth_xN(unsigned char* const* out, const ascon_prf_msg_t* const* m,
+                   const ascon_state_t* const* ks, unsigned n);
+
+#endif /* PRF_H_ */
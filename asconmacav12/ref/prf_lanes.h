@@ -0,0 +1,46 @@
+#ifndef PRF_LANES_H_
+#define PRF_LANES_H_
+
+#include <stdint.h>
+
+#include "constants.h"
+#include "prf.h"
+#include "word.h"
+
+/*
+ * Helpers for the multi-lane implementations, every lane absorbs its own
+ * message in blocks of ASCON_PRFA_IN_RATE bytes (5 words, P8 in between).
+ */
+
+/* number of full blocks, followed by P8 each, before the padded last block */
+static inline unsigned long long ascon_prf_lane_blocks(const ascon_prf_msg_t* m) {
+  return (m->hdrlen + m->inlen) / ASCON_PRFA_IN_RATE;
+}
+
+/* n bytes at word aligned position pos of the message, a word never
+ * straddles hdr and in as hdrlen is a multiple of 8 */
+static inline uint64_t ascon_prf_msg_load(const ascon_prf_msg_t* m,
+                                          unsigned long long pos, int n) {
+  if (pos < m->hdrlen) return LOADBYTES(m->hdr + pos, n);
+  return LOADBYTES(m->in + (pos - m->hdrlen), n);
+}
+
+/* word w of block b of a message, including the padding and domain
+ * separation of the last block, 0 past the end of the message */
+static inline uint64_t ascon_prf_lane_word(const ascon_prf_msg_t* m,
+                                           unsigned long long b, int w) {
+  const unsigned long long inlen = m->hdrlen + m->inlen;
+  const unsigned long long full = ascon_prf_lane_blocks(m);
+  const unsigned long long pos = b * ASCON_PRFA_IN_RATE + 8 * w;
+  uint64_t x = 0;
+  if (b < full) return ascon_prf_msg_load(m, pos, 8);
+  if (b > full) return 0;
+  if (pos + 8 <= inlen)
+    x = ascon_prf_msg_load(m, pos, 8);
+  else if (pos <= inlen)
+    x = ascon_prf_msg_load(m, pos, inlen - pos) ^ PAD(inlen - pos);
+  if (w == 4) x ^= DSEP();
+  return x;
+}
+
+#endif /* PRF_LANES_H_ */
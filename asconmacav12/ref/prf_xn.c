@@ -0,0 +1,74 @@
+#include "api.h"
+#include "ascon.h"
+#include "prf.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include "prf_x4.h"
+#include "prf_x8.h"
+#define ASCON_PRF_X86
+#endif
+
+#ifdef ASCON_PRF_X86
+
+enum { LANES_UNKNOWN, LANES_1, LANES_4, LANES_8 };
+
+static int lanes_supported(void) {
+  static int lanes = LANES_UNKNOWN;
+  if (lanes == LANES_UNKNOWN) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+      lanes = LANES_8;
+    else if (__builtin_cpu_supports("avx2"))
+      lanes = LANES_4;
+    else
+      lanes = LANES_1;
+  }
+  return lanes;
+}
+
+/* run n (<= lanes) messages, the unused lanes repeat the first message */
+static void crypto_auth_lanes(unsigned char* const* out,
+                              const ascon_prf_msg_t* const* m,
+                              const ascon_state_t* const* ks, unsigned n,
+                              unsigned lanes) {
+  unsigned char unused[8][CRYPTO_BYTES];
+  unsigned char* o[8];
+  const ascon_prf_msg_t* msg[8];
+  const ascon_state_t* k[8];
+  unsigned l;
+  for (l = 0; l < lanes; ++l) {
+    unsigned i = l < n ? l : 0;
+    o[l] = l < n ? out[l] : unused[l];
+    msg[l] = m[i];
+    k[l] = ks[i];
+  }
+  if (lanes == 8)
+    crypto_prf_keyed_x8(o, msg, k);
+  else
+    crypto_prf_keyed_x4(o, msg, k);
+}
+
+#endif
+
+int crypto_auth_xN(unsigned char* const* out, const ascon_prf_msg_t* const* m,
+                   const ascon_state_t* const* ks, unsigned n) {
+  unsigned i = 0;
+#ifdef ASCON_PRF_X86
+  const int lanes = lanes_supported();
+  while (lanes == LANES_8 && n - i > 4) {
+    unsigned count = n - i < 8 ? n - i : 8;
+    crypto_auth_lanes(out + i, m + i, ks + i, count, 8);
+    i += count;
+  }
+  while (lanes != LANES_1 && n - i > 1) {
+    unsigned count = n - i < 4 ? n - i : 4;
+    crypto_auth_lanes(out + i, m + i, ks + i, count, 4);
+    i += count;
+  }
+#endif
+  for (; i < n; ++i) {
+    if (crypto_prf_keyed_msg(out[i], CRYPTO_BYTES, m[i], ks[i]) != 0)
+      return -1;
+  }
+  return 0;
+}
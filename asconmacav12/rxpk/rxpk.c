@@ -0,0 +1,388 @@
+#include <string.h>
+
+#include "base64.h"
+#include "rxpk.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define RXPK_MANTISSA_MAX UINT64_C(100000000000000000) /* digits beyond are dropped */
+
+struct rxpk_parser {
+	const uint8_t *json;
+	const uint8_t *p;
+	const uint8_t *end;
+};
+
+static void rxpk_skip_space(struct rxpk_parser *ps)
+{
+	while (ps->p < ps->end && (*ps->p == ' ' || *ps->p == '\t' || *ps->p == '\n' || *ps->p == '\r')) {
+		ps->p++;
+	}
+}
+
+// Skip the spaces and 'c', -1 if the next character is not 'c'
+static int rxpk_expect(struct rxpk_parser *ps, uint8_t c)
+{
+	rxpk_skip_space(ps);
+	if (ps->p == ps->end || *ps->p != c) {
+		return -1;
+	}
+	ps->p++;
+	return 0;
+}
+
+// Enter an object or array, 1 if it has a first member
+static int rxpk_begin(struct rxpk_parser *ps, uint8_t open, uint8_t close)
+{
+	if (rxpk_expect(ps, open) != 0) {
+		return -1;
+	}
+	rxpk_skip_space(ps);
+	if (ps->p < ps->end && *ps->p == close) {
+		ps->p++;
+		return 0;
+	}
+	return 1;
+}
+
+// After a member, 1 if another one follows, 0 at the end of the object or array
+static int rxpk_next(struct rxpk_parser *ps, uint8_t close)
+{
+	rxpk_skip_space(ps);
+	if (ps->p == ps->end) {
+		return -1;
+	}
+	if (*ps->p == ',') {
+		ps->p++;
+		return 1;
+	}
+	if (*ps->p == close) {
+		ps->p++;
+		return 0;
+	}
+	return -1;
+}
+
+// Closing quote of the string starting at 'p', NULL if the string is not terminated
+static const uint8_t *rxpk_string_end(const uint8_t *p, const uint8_t *end)
+{
+#ifdef __SSE2__
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		uint32_t mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)));
+		if (mask == 0) {
+			p += 16;
+			continue;
+		}
+		p += __builtin_ctz(mask);
+		if (*p == '"') {
+			return p;
+		}
+		if (end - p < 2) {
+			return NULL;
+		}
+		/* skip the escaped character */
+		p += 2;
+	}
+#endif
+	while (p < end) {
+		if (*p == '"') {
+			return p;
+		}
+		if (*p == '\\') {
+			if (end - p < 2) {
+				return NULL;
+			}
+			p++;
+		}
+		p++;
+	}
+	return NULL;
+}
+
+static int rxpk_parse_string(struct rxpk_parser *ps, struct rxpk_string *s)
+{
+	if (rxpk_expect(ps, '"') != 0) {
+		return -1;
+	}
+	const uint8_t *close = rxpk_string_end(ps->p, ps->end);
+	if (close == NULL) {
+		return -1;
+	}
+	s->offset = (uint32_t)(ps->p - ps->json);
+	s->size = (uint32_t)(close - ps->p);
+	ps->p = close + 1;
+	return 0;
+}
+
+#define RXPK_IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+
+// Exact for up to 15 significant digits and a small exponent, as every rxpk
+// number, within a few ulp otherwise. strtod() would need a terminated copy
+// and depends on the locale.
+static int rxpk_parse_number(struct rxpk_parser *ps, double *value)
+{
+	static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+				       1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+	const uint8_t *p, *end = ps->end;
+	uint64_t mantissa = 0;
+	int32_t exponent = 0;
+	int negative = 0;
+
+	rxpk_skip_space(ps);
+	p = ps->p;
+	if (p < end && *p == '-') {
+		negative = 1;
+		p++;
+	}
+	if (p == end || !RXPK_IS_DIGIT(*p)) {
+		return -1;
+	}
+	for (; p < end && RXPK_IS_DIGIT(*p); p++) {
+		if (mantissa < RXPK_MANTISSA_MAX) {
+			mantissa = mantissa * 10 + (*p - '0');
+		} else {
+			exponent++;
+		}
+	}
+	if (p < end && *p == '.') {
+		if (++p == end || !RXPK_IS_DIGIT(*p)) {
+			return -1;
+		}
+		for (; p < end && RXPK_IS_DIGIT(*p); p++) {
+			if (mantissa < RXPK_MANTISSA_MAX) {
+				mantissa = mantissa * 10 + (*p - '0');
+				exponent--;
+			}
+		}
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		int32_t e = 0;
+		int e_negative = 0;
+		if (++p < end && (*p == '+' || *p == '-')) {
+			e_negative = *p++ == '-';
+		}
+		if (p == end || !RXPK_IS_DIGIT(*p)) {
+			return -1;
+		}
+		for (; p < end && RXPK_IS_DIGIT(*p); p++) {
+			if (e < 100000) {
+				e = e * 10 + (*p - '0');
+			}
+		}
+		exponent += e_negative ? -e : e;
+	}
+
+	double x = (double)mantissa;
+	for (; exponent < -22; exponent += 22) {
+		x /= 1e22;
+	}
+	for (; exponent > 22; exponent -= 22) {
+		x *= 1e22;
+	}
+	x = exponent < 0 ? x / pow10[-exponent] : x * pow10[exponent];
+	*value = negative ? -x : x;
+	ps->p = p;
+	return 0;
+}
+
+static int rxpk_parse_int(struct rxpk_parser *ps, int64_t min, int64_t max, int64_t *value)
+{
+	double x;
+
+	if (rxpk_parse_number(ps, &x) != 0 || x < (double)min || x > (double)max || x != (double)(int64_t)x) {
+		return -1;
+	}
+	*value = (int64_t)x;
+	return 0;
+}
+
+static int rxpk_skip_value(struct rxpk_parser *ps, int depth)
+{
+	struct rxpk_string s;
+	double number;
+	int more;
+
+	rxpk_skip_space(ps);
+	if (ps->p == ps->end) {
+		return -1;
+	}
+	switch (*ps->p) {
+	case '"':
+		return rxpk_parse_string(ps, &s);
+	case '{':
+	case '[': {
+		uint8_t close = *ps->p == '{' ? '}' : ']';
+		if (depth >= RXPK_DEPTH_MAX) {
+			return -1;
+		}
+		more = rxpk_begin(ps, *ps->p, close);
+		while (more > 0) {
+			if (close == '}' && (rxpk_parse_string(ps, &s) != 0 || rxpk_expect(ps, ':') != 0)) {
+				return -1;
+			}
+			if (rxpk_skip_value(ps, depth + 1) != 0) {
+				return -1;
+			}
+			more = rxpk_next(ps, close);
+		}
+		return more;
+	}
+	case 't':
+	case 'f':
+	case 'n': {
+		static const char *const literals[] = {"true", "false", "null"};
+		for (size_t i = 0; i < 3; i++) {
+			size_t size = strlen(literals[i]);
+			if ((size_t)(ps->end - ps->p) >= size && memcmp(ps->p, literals[i], size) == 0) {
+				ps->p += size;
+				return 0;
+			}
+		}
+		return -1;
+	}
+	default:
+		return rxpk_parse_number(ps, &number);
+	}
+}
+
+static int rxpk_key_is(const struct rxpk_parser *ps, const struct rxpk_string *key, const char *name)
+{
+	return key->size == strlen(name) && memcmp(&ps->json[key->offset], name, key->size) == 0;
+}
+
+static int rxpk_parse_object(struct rxpk_parser *ps, struct rxpk *rxpk)
+{
+	struct rxpk_string key;
+	int64_t value = 0;
+	int more = rxpk_begin(ps, '{', '}');
+
+	memset(rxpk, 0, sizeof(*rxpk));
+	while (more > 0) {
+		int rc = 0;
+		if (rxpk_parse_string(ps, &key) != 0 || rxpk_expect(ps, ':') != 0) {
+			return -1;
+		}
+		rxpk_skip_space(ps);
+		if (rxpk_key_is(ps, &key, "tmst")) {
+			rc = rxpk_parse_int(ps, 0, UINT32_MAX, &value);
+			rxpk->tmst = (uint32_t)value;
+			rxpk->fields |= RXPK_FIELD_TMST;
+		} else if (rxpk_key_is(ps, &key, "freq")) {
+			rc = rxpk_parse_number(ps, &rxpk->freq);
+			rxpk->fields |= RXPK_FIELD_FREQ;
+		} else if (rxpk_key_is(ps, &key, "chan")) {
+			rc = rxpk_parse_int(ps, INT32_MIN, INT32_MAX, &value);
+			rxpk->chan = (int32_t)value;
+			rxpk->fields |= RXPK_FIELD_CHAN;
+		} else if (rxpk_key_is(ps, &key, "rfch")) {
+			rc = rxpk_parse_int(ps, INT32_MIN, INT32_MAX, &value);
+			rxpk->rfch = (int32_t)value;
+			rxpk->fields |= RXPK_FIELD_RFCH;
+		} else if (rxpk_key_is(ps, &key, "stat")) {
+			rc = rxpk_parse_int(ps, INT32_MIN, INT32_MAX, &value);
+			rxpk->stat = (int32_t)value;
+			rxpk->fields |= RXPK_FIELD_STAT;
+		} else if (rxpk_key_is(ps, &key, "rssi")) {
+			rc = rxpk_parse_int(ps, INT32_MIN, INT32_MAX, &value);
+			rxpk->rssi = (int32_t)value;
+			rxpk->fields |= RXPK_FIELD_RSSI;
+		} else if (rxpk_key_is(ps, &key, "lsnr")) {
+			rc = rxpk_parse_number(ps, &rxpk->lsnr);
+			rxpk->fields |= RXPK_FIELD_LSNR;
+		} else if (rxpk_key_is(ps, &key, "size")) {
+			rc = rxpk_parse_int(ps, INT32_MIN, INT32_MAX, &value);
+			rxpk->size = (int32_t)value;
+			rxpk->fields |= RXPK_FIELD_SIZE;
+		} else if (rxpk_key_is(ps, &key, "data")) {
+			rc = rxpk_parse_string(ps, &rxpk->data);
+			rxpk->fields |= RXPK_FIELD_DATA;
+		} else if (rxpk_key_is(ps, &key, "modu")) {
+			rc = rxpk_parse_string(ps, &rxpk->modu);
+			rxpk->fields |= RXPK_FIELD_MODU;
+		} else if (rxpk_key_is(ps, &key, "datr") && ps->p < ps->end && *ps->p == '"') {
+			rc = rxpk_parse_string(ps, &rxpk->datr);
+			rxpk->fields |= RXPK_FIELD_DATR;
+		} else if (rxpk_key_is(ps, &key, "codr")) {
+			rc = rxpk_parse_string(ps, &rxpk->codr);
+			rxpk->fields |= RXPK_FIELD_CODR;
+		} else if (rxpk_key_is(ps, &key, "time")) {
+			rc = rxpk_parse_string(ps, &rxpk->time);
+			rxpk->fields |= RXPK_FIELD_TIME;
+		} else {
+			rc = rxpk_skip_value(ps, 1);
+		}
+		if (rc != 0) {
+			return -1;
+		}
+		more = rxpk_next(ps, '}');
+	}
+	return more;
+}
+
+int32_t rxpk_parse(const uint8_t *json, size_t json_size, struct rxpk *rxpk, uint32_t rxpk_max, uint32_t *count)
+{
+	struct rxpk_parser ps = {.json = json, .p = json, .end = json + json_size};
+	struct rxpk_string key;
+	int more;
+
+	*count = 0;
+	if (json_size > UINT32_MAX) {
+		return RXPK_ERR_SYNTAX;
+	}
+	more = rxpk_begin(&ps, '{', '}');
+	while (more > 0) {
+		if (rxpk_parse_string(&ps, &key) != 0 || rxpk_expect(&ps, ':') != 0) {
+			return RXPK_ERR_SYNTAX;
+		}
+		if (!rxpk_key_is(&ps, &key, "rxpk")) {
+			/* "stat", ... */
+			if (rxpk_skip_value(&ps, 0) != 0) {
+				return RXPK_ERR_SYNTAX;
+			}
+		} else {
+			int more_rxpk = rxpk_begin(&ps, '[', ']');
+			while (more_rxpk > 0) {
+				if (*count == rxpk_max) {
+					return RXPK_ERR_TOO_MANY;
+				}
+				if (rxpk_parse_object(&ps, &rxpk[*count]) != 0) {
+					return RXPK_ERR_SYNTAX;
+				}
+				(*count)++;
+				more_rxpk = rxpk_next(&ps, ']');
+			}
+			if (more_rxpk < 0) {
+				return RXPK_ERR_SYNTAX;
+			}
+		}
+		more = rxpk_next(&ps, '}');
+	}
+	return more == 0 ? RXPK_OK : RXPK_ERR_SYNTAX;
+}
+
+int32_t rxpk_data_size(const uint8_t *json, const struct rxpk *rxpk)
+{
+	const uint8_t *data = &json[rxpk->data.offset];
+	uint32_t size = rxpk->data.size;
+
+	if (!(rxpk->fields & RXPK_FIELD_DATA) || size % 4 != 0) {
+		return -1;
+	}
+	/* the '=' padding is checked by the decoding */
+	int32_t padding = size && data[size - 1] == '=' ? (size > 1 && data[size - 2] == '=' ? 2 : 1) : 0;
+	return (int32_t)BASE64_DECODED_SIZE_MAX(size) - padding;
+}
+
+int32_t rxpk_data_decode(const uint8_t *json, const struct rxpk *rxpk, uint8_t *frame, size_t frame_size, size_t *frame_len)
+{
+	if (!(rxpk->fields & RXPK_FIELD_DATA)) {
+		return BASE64_ERR_INVALID;
+	}
+	return base64_decode_to((const char *)&json[rxpk->data.offset], rxpk->data.size, frame, frame_size, frame_len);
+}
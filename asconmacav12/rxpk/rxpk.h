@@ -0,0 +1,77 @@
+#ifndef RXPK_H
+#define RXPK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Parser of the JSON object of PUSH_DATA (Semtech packet forwarder
+ * PROTOCOL.TXT), specialized for the "rxpk" array: "stat" and the unknown
+ * keys are only skipped over.
+ *
+ * One pass over the datagram, nothing is allocated or copied. The strings
+ * are returned as offsets into the JSON (escapes are left as is, none of the
+ * rxpk strings has one) and the numbers are converted in place. The strings
+ * are scanned 16 bytes at a time with SSE2.
+ */
+
+#define RXPK_MAX 64 /* rxpk per datagram, same as CODEC_BATCH_MAX */
+#define RXPK_DEPTH_MAX 16 /* nesting of the skipped values */
+
+enum rxpk_status {
+	RXPK_OK = 0,
+	RXPK_ERR_SYNTAX = -30,
+	RXPK_ERR_TOO_MANY = -31,
+};
+
+// Bits of rxpk.fields, set for the fields present in the object
+enum rxpk_field {
+	RXPK_FIELD_TMST = 1 << 0,
+	RXPK_FIELD_FREQ = 1 << 1,
+	RXPK_FIELD_CHAN = 1 << 2,
+	RXPK_FIELD_RFCH = 1 << 3,
+	RXPK_FIELD_STAT = 1 << 4,
+	RXPK_FIELD_RSSI = 1 << 5,
+	RXPK_FIELD_LSNR = 1 << 6,
+	RXPK_FIELD_SIZE = 1 << 7,
+	RXPK_FIELD_DATA = 1 << 8,
+	RXPK_FIELD_MODU = 1 << 9,
+	RXPK_FIELD_DATR = 1 << 10, /* LoRa "SF7BW125" only, the FSK bit rate is skipped */
+	RXPK_FIELD_CODR = 1 << 11,
+	RXPK_FIELD_TIME = 1 << 12,
+};
+
+// 'size' bytes at 'offset' of the JSON, without the quotes
+struct rxpk_string {
+	uint32_t offset;
+	uint32_t size;
+};
+
+struct rxpk {
+	uint32_t fields;
+	uint32_t tmst;
+	double freq;
+	double lsnr;
+	int32_t chan;
+	int32_t rfch;
+	int32_t stat;
+	int32_t rssi;
+	int32_t size;
+	struct rxpk_string data; /* base64 of the frame */
+	struct rxpk_string modu;
+	struct rxpk_string datr;
+	struct rxpk_string codr;
+	struct rxpk_string time;
+};
+
+// Parse the JSON object of a PUSH_DATA (the datagram after its 12 bytes header)
+// into rxpk[0..count), RXPK_ERR_TOO_MANY if there are more than 'rxpk_max'
+int32_t rxpk_parse(const uint8_t *json, size_t json_size, struct rxpk *rxpk, uint32_t rxpk_max, uint32_t *count);
+
+// Size of the frame of rxpk_data_decode, -1 if "data" is missing or not base64
+int32_t rxpk_data_size(const uint8_t *json, const struct rxpk *rxpk);
+
+// Decode "data" straight into 'frame', returns a base64_status
+int32_t rxpk_data_decode(const uint8_t *json, const struct rxpk *rxpk, uint8_t *frame, size_t frame_size, size_t *frame_len);
+
+#endif
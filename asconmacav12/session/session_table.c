@@ -0,0 +1,306 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L /* ftruncate(), msync() */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "session_table.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static size_t session_table_size(uint32_t capacity)
+{
+	return sizeof(struct session_table_header) + (size_t)capacity * sizeof(struct session_entry);
+}
+
+static uint32_t session_table_slot(const struct session_table *table, uint32_t dev_addr)
+{
+	/* Fibonacci hashing, DevAddr are often allocated sequentially */
+	return (uint32_t)(dev_addr * 0x9E3779B1u) >> table->shift;
+}
+
+static uint32_t session_table_shift(uint32_t capacity)
+{
+	uint32_t shift = 32;
+	while (capacity > 1) {
+		capacity >>= 1;
+		shift--;
+	}
+	return shift;
+}
+
+static int32_t session_table_map(struct session_table *table, int fd, size_t size)
+{
+	void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		return SESSION_TABLE_ERR_IO;
+	}
+	table->fd = fd;
+	table->map_size = size;
+	table->header = map;
+	table->entries = (struct session_entry *)(table->header + 1);
+	table->shift = session_table_shift(table->header->capacity);
+	return SESSION_TABLE_OK;
+}
+
+// Create an empty table file of 'capacity' slots and map it
+static int32_t session_table_create(struct session_table *table, const char *path, uint32_t capacity)
+{
+	size_t size = session_table_size(capacity);
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		return SESSION_TABLE_ERR_IO;
+	}
+	/* the new file reads as zeros, i.e. every slot SESSION_ENTRY_EMPTY */
+	if (ftruncate(fd, (off_t)size) != 0 || session_table_map(table, fd, size) != SESSION_TABLE_OK) {
+		close(fd);
+		return SESSION_TABLE_ERR_IO;
+	}
+	table->header->magic = SESSION_TABLE_MAGIC;
+	table->header->version = SESSION_TABLE_VERSION;
+	table->header->entry_size = sizeof(struct session_entry);
+	table->header->capacity = capacity;
+	table->shift = session_table_shift(capacity);
+	return SESSION_TABLE_OK;
+}
+
+static void session_table_unmap(struct session_table *table)
+{
+	if (table->header != NULL) {
+		munmap(table->header, table->map_size);
+		table->header = NULL;
+		table->entries = NULL;
+	}
+	if (table->fd >= 0) {
+		close(table->fd);
+		table->fd = -1;
+	}
+}
+
+// Slot of 'dev_addr', or the slot to insert it into when it is not in the table
+static struct session_entry *session_table_probe(const struct session_table *table, uint32_t dev_addr)
+{
+	uint32_t mask = table->header->capacity - 1;
+	struct session_entry *deleted = NULL;
+
+	for (uint32_t i = session_table_slot(table, dev_addr);; i = (i + 1) & mask) {
+		struct session_entry *entry = &table->entries[i];
+		if (entry->state == SESSION_ENTRY_EMPTY) {
+			return deleted != NULL ? deleted : entry;
+		}
+		if (entry->state == SESSION_ENTRY_DELETED) {
+			if (deleted == NULL) {
+				deleted = entry;
+			}
+		} else if (entry->dev_addr == dev_addr) {
+			return entry;
+		}
+	}
+}
+
+// Move the live entries to a file twice as large, replaced atomically by rename()
+static int32_t session_table_grow(struct session_table *table)
+{
+	struct session_table grown = {.fd = -1};
+	size_t path_size = strlen(table->path) + sizeof(".tmp");
+	char *tmp_path = malloc(path_size);
+	int32_t rc;
+
+	if (tmp_path == NULL) {
+		return SESSION_TABLE_ERR_IO;
+	}
+	snprintf(tmp_path, path_size, "%s.tmp", table->path);
+	rc = session_table_create(&grown, tmp_path, table->header->capacity * 2);
+	if (rc != SESSION_TABLE_OK) {
+		free(tmp_path);
+		return rc;
+	}
+	for (uint32_t i = 0; i < table->header->capacity; i++) {
+		const struct session_entry *entry = &table->entries[i];
+		if (entry->state == SESSION_ENTRY_USED) {
+			/* the expanded keys are position independent, copied as is */
+			*session_table_probe(&grown, entry->dev_addr) = *entry;
+		}
+	}
+	grown.header->count = table->header->count;
+	grown.header->used = table->header->count;
+	if (msync(grown.header, grown.map_size, MS_SYNC) != 0 || rename(tmp_path, table->path) != 0) {
+		session_table_unmap(&grown);
+		unlink(tmp_path);
+		free(tmp_path);
+		return SESSION_TABLE_ERR_IO;
+	}
+	free(tmp_path);
+	session_table_unmap(table);
+	table->fd = grown.fd;
+	table->header = grown.header;
+	table->entries = grown.entries;
+	table->map_size = grown.map_size;
+	table->shift = grown.shift;
+	return SESSION_TABLE_OK;
+}
+
+int32_t session_table_open(struct session_table *table, const char *path, uint32_t capacity)
+{
+	struct stat st;
+	uint32_t slots = SESSION_TABLE_CAPACITY_MIN;
+	int32_t rc;
+
+	memset(table, 0, sizeof(*table));
+	table->fd = -1;
+	table->path = malloc(strlen(path) + 1);
+	if (table->path == NULL) {
+		return SESSION_TABLE_ERR_IO;
+	}
+	strcpy(table->path, path);
+
+	int fd = open(path, O_RDWR);
+	if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		/* room for 'capacity' devices below the load factor */
+		while (slots < UINT32_MAX / 2 &&
+		       (uint64_t)slots * SESSION_TABLE_LOAD_NUM / SESSION_TABLE_LOAD_DEN < capacity) {
+			slots *= 2;
+		}
+		rc = session_table_create(table, path, slots);
+	} else if ((size_t)st.st_size < sizeof(struct session_table_header)) {
+		close(fd);
+		rc = SESSION_TABLE_ERR_FORMAT;
+	} else if ((rc = session_table_map(table, fd, (size_t)st.st_size)) != SESSION_TABLE_OK) {
+		close(fd);
+	} else {
+		const struct session_table_header *header = table->header;
+		uint32_t n = header->capacity;
+		if (header->magic != SESSION_TABLE_MAGIC || header->version != SESSION_TABLE_VERSION ||
+		    header->entry_size != sizeof(struct session_entry) || n < SESSION_TABLE_CAPACITY_MIN ||
+		    (n & (n - 1)) != 0 || (size_t)st.st_size != session_table_size(n) || header->used >= n) {
+			session_table_unmap(table);
+			rc = SESSION_TABLE_ERR_FORMAT;
+		}
+	}
+	if (rc != SESSION_TABLE_OK) {
+		free(table->path);
+		table->path = NULL;
+	}
+	return rc;
+}
+
+void session_table_close(struct session_table *table)
+{
+	session_table_unmap(table);
+	free(table->path);
+	table->path = NULL;
+}
+
+struct session_entry *session_table_find(const struct session_table *table, uint32_t dev_addr)
+{
+	struct session_entry *entry = session_table_probe(table, dev_addr);
+	return entry->state == SESSION_ENTRY_USED ? entry : NULL;
+}
+
+int32_t session_table_put(struct session_table *table, uint32_t dev_addr, const uint8_t *appskey, const uint8_t *nwkskey)
+{
+	struct session_entry *entry = session_table_probe(table, dev_addr);
+
+	if (entry->state == SESSION_ENTRY_USED) {
+		if (memcmp(entry->appskey, appskey, CODEC_KEYBYTES) == 0 &&
+		    memcmp(entry->nwkskey, nwkskey, CODEC_KEYBYTES) == 0) {
+			return SESSION_TABLE_OK;
+		}
+	} else {
+		if ((uint64_t)(table->header->used + 1) * SESSION_TABLE_LOAD_DEN >
+		    (uint64_t)table->header->capacity * SESSION_TABLE_LOAD_NUM) {
+			int32_t rc = session_table_grow(table);
+			if (rc != SESSION_TABLE_OK) {
+				return rc;
+			}
+			entry = session_table_probe(table, dev_addr);
+		}
+		if (entry->state == SESSION_ENTRY_EMPTY) {
+			table->header->used++;
+		}
+		table->header->count++;
+		entry->dev_addr = dev_addr;
+		entry->state = SESSION_ENTRY_USED;
+	}
+	entry->f_cnt_up = 0;
+	entry->f_cnt_down = 0;
+	memcpy(entry->appskey, appskey, CODEC_KEYBYTES);
+	memcpy(entry->nwkskey, nwkskey, CODEC_KEYBYTES);
+	codec_session_init(&entry->session, appskey, nwkskey);
+	return SESSION_TABLE_OK;
+}
+
+int32_t session_table_remove(struct session_table *table, uint32_t dev_addr)
+{
+	struct session_entry *entry = session_table_find(table, dev_addr);
+
+	if (entry == NULL) {
+		return SESSION_TABLE_ERR_NOT_FOUND;
+	}
+	/* keep the slot as a tombstone, later entries of the probe sequence stay reachable */
+	memset(entry, 0, sizeof(*entry));
+	entry->state = SESSION_ENTRY_DELETED;
+	table->header->count--;
+	return SESSION_TABLE_OK;
+}
+
+int32_t session_table_sync(struct session_table *table)
+{
+	return msync(table->header, table->map_size, MS_SYNC) == 0 ? SESSION_TABLE_OK : SESSION_TABLE_ERR_IO;
+}
+
+#else
+
+int32_t session_table_open(struct session_table *table, const char *path, uint32_t capacity)
+{
+	(void)path;
+	(void)capacity;
+	memset(table, 0, sizeof(*table));
+	table->fd = -1;
+	return SESSION_TABLE_ERR_IO;
+}
+
+void session_table_close(struct session_table *table)
+{
+	(void)table;
+}
+
+struct session_entry *session_table_find(const struct session_table *table, uint32_t dev_addr)
+{
+	(void)table;
+	(void)dev_addr;
+	return NULL;
+}
+
+int32_t session_table_put(struct session_table *table, uint32_t dev_addr, const uint8_t *appskey, const uint8_t *nwkskey)
+{
+	(void)table;
+	(void)dev_addr;
+	(void)appskey;
+	(void)nwkskey;
+	return SESSION_TABLE_ERR_IO;
+}
+
+int32_t session_table_remove(struct session_table *table, uint32_t dev_addr)
+{
+	(void)table;
+	(void)dev_addr;
+	return SESSION_TABLE_ERR_NOT_FOUND;
+}
+
+int32_t session_table_sync(struct session_table *table)
+{
+	(void)table;
+	return SESSION_TABLE_ERR_IO;
+}
+
+#endif
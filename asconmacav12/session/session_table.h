@@ -0,0 +1,87 @@
+#ifndef SESSION_TABLE_H
+#define SESSION_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "codec.h"
+
+/*
+ * Device sessions keyed by the raw 32-bit DevAddr, open addressing with
+ * linear probing. The table lives in a file mapped in memory, so it is
+ * ready as soon as it is opened and survives restarts: every record keeps
+ * the binary keys, the expanded keys (codec_session) and the frame
+ * counters of one device on its own cache lines.
+ *
+ * File: [header (64 bytes)][capacity x struct session_entry]
+ *
+ * The expanded keys depend on the build (AES_CT, ...), a file written by
+ * a build with another record size is refused with SESSION_TABLE_ERR_FORMAT.
+ * Not thread-safe, and a put can grow (remap) the table, so entry pointers
+ * are only valid until the next put.
+ */
+
+#define SESSION_TABLE_MAGIC 0x314C4253 /* "SBL1" */
+#define SESSION_TABLE_VERSION 1
+#define SESSION_TABLE_CACHE_LINE 64
+#define SESSION_TABLE_CAPACITY_MIN 64
+#define SESSION_TABLE_LOAD_NUM 3 /* grow above 3/4 of the slots used */
+#define SESSION_TABLE_LOAD_DEN 4
+
+enum session_table_status {
+	SESSION_TABLE_OK = 0,
+	SESSION_TABLE_ERR_IO = -10,
+	SESSION_TABLE_ERR_FORMAT = -11,
+	SESSION_TABLE_ERR_NOT_FOUND = -12, /* distinct from the codec_status values */
+};
+
+enum session_entry_state {
+	SESSION_ENTRY_EMPTY = 0,
+	SESSION_ENTRY_USED = 1,
+	SESSION_ENTRY_DELETED = 2,
+};
+
+struct session_table_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entry_size;
+	uint32_t capacity; /* power of 2 */
+	uint32_t count; /* live entries */
+	uint32_t used; /* live and deleted entries, bounds the probes */
+	uint8_t reserved[SESSION_TABLE_CACHE_LINE - 6 * sizeof(uint32_t)];
+};
+
+struct session_entry {
+	uint32_t dev_addr;
+	uint32_t state;
+	uint32_t f_cnt_up; /* last uplink FCnt accepted */
+	uint32_t f_cnt_down; /* next downlink FCnt */
+	uint8_t appskey[CODEC_KEYBYTES];
+	uint8_t nwkskey[CODEC_KEYBYTES];
+	struct codec_session session;
+} __attribute__((aligned(SESSION_TABLE_CACHE_LINE)));
+
+struct session_table {
+	int fd;
+	char *path;
+	struct session_table_header *header;
+	struct session_entry *entries;
+	size_t map_size;
+	uint32_t shift; /* 32 - log2(capacity) */
+};
+
+// Map the table file at 'path', created with room for 'capacity' devices if it does not exist
+int32_t session_table_open(struct session_table *table, const char *path, uint32_t capacity);
+void session_table_close(struct session_table *table);
+
+// NULL if the device is not in the table
+struct session_entry *session_table_find(const struct session_table *table, uint32_t dev_addr);
+
+// Add the device or change its keys, the frame counters restart when the keys change
+int32_t session_table_put(struct session_table *table, uint32_t dev_addr, const uint8_t *appskey, const uint8_t *nwkskey);
+int32_t session_table_remove(struct session_table *table, uint32_t dev_addr);
+
+// Flush the mapping to the file
+int32_t session_table_sync(struct session_table *table);
+
+#endif /* SESSION_TABLE_H */
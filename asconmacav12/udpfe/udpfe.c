@@ -0,0 +1,301 @@
+#ifdef __linux__
+#define _GNU_SOURCE /* recvmmsg(), sendmmsg() */
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "udpfe.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "udpfe_worker.h"
+
+#define UDPFE_IN_SIZE (4 * (4 + UDPFE_DOWNLINK_HEADER_SIZE + UDPFE_DATAGRAM_MAX))
+
+/* event frames of the workers are written whole, one batch at a time */
+static pthread_mutex_t udpfe_out_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int32_t udpfe_write_events(struct iovec *iov, int count)
+{
+	int32_t rc = 0;
+
+	pthread_mutex_lock(&udpfe_out_lock);
+	while (count) {
+		ssize_t n = writev(1, iov, count);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			rc = -1;
+			break;
+		}
+		for (; count && (size_t)n >= iov->iov_len; iov++, count--) {
+			n -= iov->iov_len;
+		}
+		if (count) {
+			iov->iov_base = (uint8_t *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	pthread_mutex_unlock(&udpfe_out_lock);
+	return rc;
+}
+
+int udpfe_ack(const uint8_t *datagram, uint32_t size, uint8_t ack[UDPFE_HEADER_SIZE])
+{
+	if (size < UDPFE_HEADER_SIZE) {
+		return -1;
+	}
+	uint8_t type = datagram[3];
+	if (type != UDPFE_PUSH_DATA && type != UDPFE_PULL_DATA) {
+		/* unknown packet forwarder type, not acknowledged */
+		return -1;
+	}
+	ack[0] = UDPFE_PROTOCOL_VERSION;
+	ack[1] = datagram[1];
+	ack[2] = datagram[2];
+	ack[3] = type == UDPFE_PUSH_DATA ? UDPFE_PUSH_ACK : UDPFE_PULL_ACK;
+	return type;
+}
+
+void udpfe_event_header(uint8_t header[4 + UDPFE_EVENT_HEADER_SIZE], uint8_t type,
+			const struct sockaddr_in *addr, uint32_t size)
+{
+	uint32_t frame_size = UDPFE_EVENT_HEADER_SIZE + size;
+	uint16_t port = ntohs(addr->sin_port);
+
+	header[0] = frame_size;
+	header[1] = frame_size >> 8;
+	header[2] = frame_size >> 16;
+	header[3] = frame_size >> 24;
+	header[4] = type;
+	memcpy(&header[5], &addr->sin_addr.s_addr, 4);
+	header[9] = port;
+	header[10] = port >> 8;
+}
+
+static int udpfe_socket(uint16_t port)
+{
+	struct sockaddr_in addr;
+	int one = 1;
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0 ||
+	    bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Send 'count' messages, sendmmsg() may stop before the end of the vector
+static void udpfe_send_all(int fd, struct mmsghdr *msg, uint32_t count)
+{
+	while (count) {
+		int n = sendmmsg(fd, msg, count, 0);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0) {
+			/* drop the one the kernel refuses (unreachable, ...) */
+			n = 1;
+		}
+		msg += n;
+		count -= n;
+	}
+}
+
+static void udpfe_socket_run(struct udpfe_worker *worker)
+{
+	struct mmsghdr rx_msg[UDPFE_BATCH];
+	struct iovec rx_iov[UDPFE_BATCH];
+	struct sockaddr_in rx_addr[UDPFE_BATCH];
+	struct mmsghdr ack_msg[UDPFE_BATCH];
+	struct iovec ack_iov[UDPFE_BATCH];
+	uint8_t ack[UDPFE_BATCH][UDPFE_HEADER_SIZE];
+	uint8_t header[UDPFE_BATCH][4 + UDPFE_EVENT_HEADER_SIZE];
+	struct iovec events[2 * UDPFE_BATCH];
+
+	memset(rx_msg, 0, sizeof(rx_msg));
+	memset(ack_msg, 0, sizeof(ack_msg));
+	for (uint32_t i = 0; i < UDPFE_BATCH; i++) {
+		rx_iov[i].iov_base = worker->rx[i];
+		rx_iov[i].iov_len = UDPFE_DATAGRAM_MAX;
+		rx_msg[i].msg_hdr.msg_iov = &rx_iov[i];
+		rx_msg[i].msg_hdr.msg_iovlen = 1;
+		rx_msg[i].msg_hdr.msg_name = &rx_addr[i];
+		ack_iov[i].iov_base = ack[i];
+		ack_iov[i].iov_len = UDPFE_HEADER_SIZE;
+		ack_msg[i].msg_hdr.msg_iov = &ack_iov[i];
+		ack_msg[i].msg_hdr.msg_iovlen = 1;
+		ack_msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+	}
+
+	for (;;) {
+		for (uint32_t i = 0; i < UDPFE_BATCH; i++) {
+			rx_msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		}
+		/* block for the first datagram, then take whatever is queued */
+		int n = recvmmsg(worker->fd, rx_msg, UDPFE_BATCH, MSG_WAITFORONE, NULL);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+
+		uint32_t n_ack = 0;
+		for (int i = 0; i < n; i++) {
+			uint32_t size = rx_msg[i].msg_len;
+			if (rx_msg[i].msg_hdr.msg_flags & MSG_TRUNC) {
+				continue;
+			}
+			int type = udpfe_ack(worker->rx[i], size, ack[n_ack]);
+			if (type < 0) {
+				continue;
+			}
+			ack_msg[n_ack].msg_hdr.msg_name = &rx_addr[i];
+			/* the datagrams are written from the receive buffers */
+			udpfe_event_header(header[n_ack], type, &rx_addr[i], size);
+			events[2 * n_ack].iov_base = header[n_ack];
+			events[2 * n_ack].iov_len = sizeof(header[n_ack]);
+			events[2 * n_ack + 1].iov_base = worker->rx[i];
+			events[2 * n_ack + 1].iov_len = size;
+			n_ack++;
+		}
+		udpfe_send_all(worker->fd, ack_msg, n_ack);
+
+		if (n_ack && udpfe_write_events(events, 2 * n_ack) != 0) {
+			/* parent has closed the pipe */
+			break;
+		}
+	}
+}
+
+static void *udpfe_worker_run(void *arg)
+{
+	struct udpfe_worker *worker = arg;
+
+	if (worker->backend == UDPFE_URING && udpfe_uring_run(worker) == 0) {
+		return NULL;
+	}
+	udpfe_socket_run(worker);
+	return NULL;
+}
+
+// Send the complete downlink frames of in[0..in_len), returns the bytes used
+static int32_t udpfe_downlink(int fd, const uint8_t *in, size_t in_len, size_t *used)
+{
+	struct mmsghdr msg[UDPFE_BATCH];
+	struct iovec iov[UDPFE_BATCH];
+	struct sockaddr_in addr[UDPFE_BATCH];
+	uint32_t count = 0;
+	size_t pos = 0;
+
+	memset(msg, 0, sizeof(msg));
+	memset(addr, 0, sizeof(addr));
+	while (in_len - pos >= 4) {
+		uint32_t frame_size = in[pos] | (in[pos + 1] << 8) | (in[pos + 2] << 16) | ((uint32_t)in[pos + 3] << 24);
+		if (frame_size < UDPFE_DOWNLINK_HEADER_SIZE + UDPFE_HEADER_SIZE ||
+		    frame_size > UDPFE_DOWNLINK_HEADER_SIZE + UDPFE_DATAGRAM_MAX) {
+			/* out of sync */
+			return -1;
+		}
+		if (in_len - pos - 4 < frame_size) {
+			break;
+		}
+		const uint8_t *frame = &in[pos + 4];
+		addr[count].sin_family = AF_INET;
+		memcpy(&addr[count].sin_addr.s_addr, frame, 4);
+		addr[count].sin_port = htons(frame[4] | (frame[5] << 8));
+		iov[count].iov_base = (void *)&frame[UDPFE_DOWNLINK_HEADER_SIZE];
+		iov[count].iov_len = frame_size - UDPFE_DOWNLINK_HEADER_SIZE;
+		msg[count].msg_hdr.msg_name = &addr[count];
+		msg[count].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		msg[count].msg_hdr.msg_iov = &iov[count];
+		msg[count].msg_hdr.msg_iovlen = 1;
+		pos += 4 + frame_size;
+		if (++count == UDPFE_BATCH) {
+			udpfe_send_all(fd, msg, count);
+			count = 0;
+		}
+	}
+	udpfe_send_all(fd, msg, count);
+	*used = pos;
+	return 0;
+}
+
+int32_t udpfe_run(uint16_t port, uint32_t n_thread, enum udpfe_backend backend)
+{
+	static uint8_t in[UDPFE_IN_SIZE];
+	static struct udpfe_worker workers[UDPFE_THREADS_MAX];
+	size_t in_len = 0;
+
+	if (n_thread == 0) {
+		long n_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+		n_thread = n_cpu > 0 ? (uint32_t)n_cpu : 1;
+	}
+	if (n_thread > UDPFE_THREADS_MAX) {
+		n_thread = UDPFE_THREADS_MAX;
+	}
+	for (uint32_t i = 0; i < n_thread; i++) {
+		struct udpfe_worker *worker = &workers[i];
+		worker->fd = udpfe_socket(port);
+		worker->backend = backend;
+		worker->rx = malloc(UDPFE_BATCH * sizeof(*worker->rx));
+		if (worker->fd < 0 || worker->rx == NULL ||
+		    pthread_create(&worker->thread, NULL, udpfe_worker_run, worker) != 0) {
+			perror("udpfe");
+			return -1;
+		}
+	}
+
+	/* downlinks leave through the first socket, the source port is the same for all */
+	for (;;) {
+		ssize_t n = read(0, &in[in_len], sizeof(in) - in_len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			/* EOF, parent has closed the pipe */
+			return 0;
+		}
+		in_len += n;
+
+		size_t used = 0;
+		if (udpfe_downlink(workers[0].fd, in, in_len, &used) != 0) {
+			return -1;
+		}
+		memmove(in, &in[used], in_len - used);
+		in_len -= used;
+	}
+}
+
+#else
+
+int32_t udpfe_run(uint16_t port, uint32_t n_thread, enum udpfe_backend backend)
+{
+	(void)port;
+	(void)n_thread;
+	(void)backend;
+	fprintf(stderr, "udpfe: recvmmsg()/SO_REUSEPORT are only available on Linux\n");
+	return -1;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef UDPFE_H
+#define UDPFE_H
+
+#include <stdint.h>
+
+/*
+ * Native front end of the Semtech UDP packet forwarder protocol
+ * (https://github.com/Lora-net/packet_forwarder/blob/master/PROTOCOL.TXT)
+ *
+ * Every thread owns a SO_REUSEPORT socket bound to the same port, so the
+ * kernel spreads the gateways over the threads. Datagrams are received in
+ * batches with recvmmsg(), the PUSH_ACK/PULL_ACK of a batch are sent with a
+ * single sendmmsg() and the PUSH_DATA/PULL_DATA datagrams are handed to the
+ * parent process on stdout. Downlinks (PULL_RESP) come back on stdin.
+ *
+ * Event frame (stdout):    [LEN (4 bytes, LE)][TYPE][ADDR (4 bytes)][PORT (2 bytes, LE)][DATAGRAM]
+ * Downlink frame (stdin):  [LEN (4 bytes, LE)][ADDR (4 bytes)][PORT (2 bytes, LE)][DATAGRAM]
+ *
+ * ADDR is the IPv4 address of the gateway in network order, TYPE is the
+ * packet type of the datagram (UDPFE_PUSH_DATA or UDPFE_PULL_DATA).
+ */
+
+#define UDPFE_PORT 1700
+#define UDPFE_THREADS_MAX 64
+#define UDPFE_BATCH 64
+#define UDPFE_DATAGRAM_MAX 8192 /* well above the packet forwarder TX buffer */
+#define UDPFE_HEADER_SIZE 4 /* [VERSION][TOKEN (2 bytes)][TYPE] */
+#define UDPFE_EVENT_HEADER_SIZE (1 + 4 + 2)
+#define UDPFE_DOWNLINK_HEADER_SIZE (4 + 2)
+#define UDPFE_PROTOCOL_VERSION 0x02
+
+enum udpfe_packet_type {
+	UDPFE_PUSH_DATA = 0x00,
+	UDPFE_PUSH_ACK = 0x01,
+	UDPFE_PULL_DATA = 0x02,
+	UDPFE_PULL_RESP = 0x03,
+	UDPFE_PULL_ACK = 0x04,
+	UDPFE_TX_ACK = 0x05,
+};
+
+/*
+ * Receive loop of the threads. UDPFE_URING uses a multishot recvmsg into a
+ * provided buffer ring and submits the ACKs in batches, a thread falls back
+ * to the recvmmsg() loop if the kernel does not support it.
+ */
+enum udpfe_backend {
+	UDPFE_SOCKET = 0,
+	UDPFE_URING = 1,
+};
+
+// Serve 'port' with 'n_thread' threads (0 for one per core) until stdin is closed
+// Returns -1 if the sockets cannot be set up or the platform is not supported
+int32_t udpfe_run(uint16_t port, uint32_t n_thread, enum udpfe_backend backend);
+
+#endif /* UDPFE_H */
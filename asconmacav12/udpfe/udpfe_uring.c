@@ -0,0 +1,379 @@
+#ifdef __linux__
+#define _GNU_SOURCE /* syscall() */
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "udpfe.h"
+
+#ifdef __linux__
+#include "udpfe_worker.h"
+
+#if __has_include(<linux/io_uring.h>)
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/*
+ * Raw io_uring interface, liburing is not required. The datagrams are
+ * received by one multishot recvmsg into a ring of provided buffers: the
+ * kernel picks a buffer for every datagram and writes the source address
+ * and the payload to it, the event frames are written to the parent
+ * straight from those buffers and the buffers go back to the ring after.
+ */
+
+#define UDPFE_URING_ENTRIES 256
+#define UDPFE_URING_CQ_ENTRIES 1024
+#define UDPFE_URING_BUFFERS 256 /* power of 2 */
+#define UDPFE_URING_BUFFER_SIZE (UDPFE_DATAGRAM_MAX + 64)
+#define UDPFE_URING_SENDS 128
+#define UDPFE_URING_BGID 0
+#define UDPFE_URING_RECV UINT64_MAX /* user_data of the receive, sends use their slot */
+
+struct udpfe_uring_send {
+	struct msghdr msg;
+	struct iovec iov;
+	struct sockaddr_in addr;
+	uint8_t ack[UDPFE_HEADER_SIZE];
+};
+
+struct udpfe_uring {
+	int fd;
+	/* submission queue */
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned sq_mask;
+	unsigned *sq_array;
+	struct io_uring_sqe *sqes;
+	unsigned sq_pending;
+	/* completion queue */
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned cq_mask;
+	struct io_uring_cqe *cqes;
+	/* provided buffers */
+	struct io_uring_buf_ring *buf_ring;
+	uint8_t *buffers;
+	struct msghdr recv_msg;
+	/* ACKs in flight */
+	struct udpfe_uring_send sends[UDPFE_URING_SENDS];
+	uint32_t free_sends[UDPFE_URING_SENDS];
+	uint32_t n_free_sends;
+	void *sq_ring_ptr;
+	size_t sq_ring_size;
+	void *cq_ring_ptr;
+	size_t cq_ring_size;
+	size_t sqes_size;
+};
+
+static int udpfe_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int udpfe_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int udpfe_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static int32_t udpfe_uring_init(struct udpfe_uring *u)
+{
+	struct io_uring_params params;
+	uint8_t *sq_ptr, *cq_ptr;
+
+	memset(&params, 0, sizeof(params));
+	/* only this thread submits, completions are run when it waits for them */
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+	params.cq_entries = UDPFE_URING_CQ_ENTRIES;
+	u->fd = udpfe_uring_setup(UDPFE_URING_ENTRIES, &params);
+	if (u->fd < 0 && errno == EINVAL) {
+		memset(&params, 0, sizeof(params));
+		params.flags = IORING_SETUP_CQSIZE;
+		params.cq_entries = UDPFE_URING_CQ_ENTRIES;
+		u->fd = udpfe_uring_setup(UDPFE_URING_ENTRIES, &params);
+	}
+	if (u->fd < 0) {
+		return -1;
+	}
+
+	u->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	u->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (u->cq_ring_size > u->sq_ring_size) {
+			u->sq_ring_size = u->cq_ring_size;
+		}
+		u->cq_ring_size = u->sq_ring_size;
+	}
+	u->sq_ring_ptr = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			      u->fd, IORING_OFF_SQ_RING);
+	if (u->sq_ring_ptr == MAP_FAILED) {
+		return -1;
+	}
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		u->cq_ring_ptr = u->sq_ring_ptr;
+	} else {
+		u->cq_ring_ptr = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				      u->fd, IORING_OFF_CQ_RING);
+		if (u->cq_ring_ptr == MAP_FAILED) {
+			return -1;
+		}
+	}
+	u->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		       u->fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED) {
+		return -1;
+	}
+	sq_ptr = u->sq_ring_ptr;
+	cq_ptr = u->cq_ring_ptr;
+	u->sq_head = (unsigned *)(sq_ptr + params.sq_off.head);
+	u->sq_tail = (unsigned *)(sq_ptr + params.sq_off.tail);
+	u->sq_mask = *(unsigned *)(sq_ptr + params.sq_off.ring_mask);
+	u->sq_array = (unsigned *)(sq_ptr + params.sq_off.array);
+	u->cq_head = (unsigned *)(cq_ptr + params.cq_off.head);
+	u->cq_tail = (unsigned *)(cq_ptr + params.cq_off.tail);
+	u->cq_mask = *(unsigned *)(cq_ptr + params.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)(cq_ptr + params.cq_off.cqes);
+	u->sq_pending = 0;
+
+	/* buffer ring, registered once and refilled by moving its tail */
+	struct io_uring_buf_reg reg;
+	u->buf_ring = mmap(NULL, UDPFE_URING_BUFFERS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	u->buffers = mmap(NULL, (size_t)UDPFE_URING_BUFFERS * UDPFE_URING_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+			  MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (u->buf_ring == MAP_FAILED || u->buffers == MAP_FAILED) {
+		return -1;
+	}
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)u->buf_ring;
+	reg.ring_entries = UDPFE_URING_BUFFERS;
+	reg.bgid = UDPFE_URING_BGID;
+	if (udpfe_uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+		return -1;
+	}
+	for (uint16_t bid = 0; bid < UDPFE_URING_BUFFERS; bid++) {
+		struct io_uring_buf *buf = &u->buf_ring->bufs[bid];
+		buf->addr = (uint64_t)(uintptr_t)&u->buffers[(size_t)bid * UDPFE_URING_BUFFER_SIZE];
+		buf->len = UDPFE_URING_BUFFER_SIZE;
+		buf->bid = bid;
+	}
+	__atomic_store_n(&u->buf_ring->tail, UDPFE_URING_BUFFERS, __ATOMIC_RELEASE);
+
+	/* only the sizes matter, the kernel lays the buffer out from them */
+	memset(&u->recv_msg, 0, sizeof(u->recv_msg));
+	u->recv_msg.msg_namelen = sizeof(struct sockaddr_in);
+
+	for (uint32_t i = 0; i < UDPFE_URING_SENDS; i++) {
+		struct udpfe_uring_send *send = &u->sends[i];
+		memset(&send->msg, 0, sizeof(send->msg));
+		send->iov.iov_base = send->ack;
+		send->iov.iov_len = UDPFE_HEADER_SIZE;
+		send->msg.msg_name = &send->addr;
+		send->msg.msg_namelen = sizeof(send->addr);
+		send->msg.msg_iov = &send->iov;
+		send->msg.msg_iovlen = 1;
+		u->free_sends[i] = i;
+	}
+	u->n_free_sends = UDPFE_URING_SENDS;
+	return 0;
+}
+
+static void udpfe_uring_exit(struct udpfe_uring *u)
+{
+	if (u->fd >= 0) {
+		close(u->fd);
+	}
+	if (u->sqes != NULL && u->sqes != MAP_FAILED) {
+		munmap(u->sqes, u->sqes_size);
+	}
+	if (u->cq_ring_ptr != NULL && u->cq_ring_ptr != MAP_FAILED && u->cq_ring_ptr != u->sq_ring_ptr) {
+		munmap(u->cq_ring_ptr, u->cq_ring_size);
+	}
+	if (u->sq_ring_ptr != NULL && u->sq_ring_ptr != MAP_FAILED) {
+		munmap(u->sq_ring_ptr, u->sq_ring_size);
+	}
+	if (u->buf_ring != NULL && u->buf_ring != MAP_FAILED) {
+		munmap(u->buf_ring, UDPFE_URING_BUFFERS * sizeof(struct io_uring_buf));
+	}
+	if (u->buffers != NULL && u->buffers != MAP_FAILED) {
+		munmap(u->buffers, (size_t)UDPFE_URING_BUFFERS * UDPFE_URING_BUFFER_SIZE);
+	}
+}
+
+// The SQ is never fuller than the ACK slots plus the receive, no overflow check
+static struct io_uring_sqe *udpfe_uring_sqe(struct udpfe_uring *u)
+{
+	unsigned tail = *u->sq_tail + u->sq_pending;
+	unsigned index = tail & u->sq_mask;
+	struct io_uring_sqe *sqe = &u->sqes[index];
+
+	u->sq_array[index] = index;
+	u->sq_pending++;
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+static void udpfe_uring_recv(struct udpfe_uring *u, int fd)
+{
+	struct io_uring_sqe *sqe = udpfe_uring_sqe(u);
+
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)&u->recv_msg;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = UDPFE_URING_BGID;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->user_data = UDPFE_URING_RECV;
+}
+
+static void udpfe_uring_ack(struct udpfe_uring *u, int fd, const struct sockaddr_in *addr,
+			    const uint8_t ack[UDPFE_HEADER_SIZE])
+{
+	uint32_t slot = u->free_sends[--u->n_free_sends];
+	struct udpfe_uring_send *send = &u->sends[slot];
+	struct io_uring_sqe *sqe = udpfe_uring_sqe(u);
+
+	memcpy(&send->addr, addr, sizeof(send->addr));
+	memcpy(send->ack, ack, UDPFE_HEADER_SIZE);
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)&send->msg;
+	sqe->len = 1;
+	sqe->user_data = slot;
+}
+
+// Give buffers back to the kernel
+static void udpfe_uring_recycle(struct udpfe_uring *u, const uint16_t *bids, uint32_t count)
+{
+	uint16_t tail = u->buf_ring->tail;
+
+	for (uint32_t i = 0; i < count; i++) {
+		struct io_uring_buf *buf = &u->buf_ring->bufs[(uint16_t)(tail + i) & (UDPFE_URING_BUFFERS - 1)];
+		buf->addr = (uint64_t)(uintptr_t)&u->buffers[(size_t)bids[i] * UDPFE_URING_BUFFER_SIZE];
+		buf->len = UDPFE_URING_BUFFER_SIZE;
+		buf->bid = bids[i];
+	}
+	__atomic_store_n(&u->buf_ring->tail, (uint16_t)(tail + count), __ATOMIC_RELEASE);
+}
+
+static int32_t udpfe_uring_loop(struct udpfe_uring *u, int fd)
+{
+	uint8_t header[UDPFE_BATCH][4 + UDPFE_EVENT_HEADER_SIZE];
+	struct iovec events[2 * UDPFE_BATCH];
+	uint16_t bids[UDPFE_BATCH];
+	int armed = 1;
+
+	udpfe_uring_recv(u, fd);
+	for (;;) {
+		/* one syscall submits the ACKs of the last batch and waits for the next */
+		unsigned to_submit = u->sq_pending;
+		__atomic_store_n(u->sq_tail, *u->sq_tail + to_submit, __ATOMIC_RELEASE);
+		u->sq_pending = 0;
+		if (udpfe_uring_enter(u->fd, to_submit, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+			return -1;
+		}
+
+		uint32_t n_events = 0;
+		unsigned head = *u->cq_head;
+		unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			const struct io_uring_cqe *cqe = &u->cqes[head & u->cq_mask];
+			if (cqe->user_data != UDPFE_URING_RECV) {
+				u->free_sends[u->n_free_sends++] = (uint32_t)cqe->user_data;
+				continue;
+			}
+			if (n_events == UDPFE_BATCH || !u->n_free_sends) {
+				/* out of ACK slots, the rest stays in the CQ */
+				break;
+			}
+			if (!(cqe->flags & IORING_CQE_F_MORE)) {
+				armed = 0;
+			}
+			if (cqe->res < 0) {
+				if (cqe->res == -ENOBUFS) {
+					continue;
+				}
+				/* e.g. multishot recvmsg is not supported */
+				return -1;
+			}
+			if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
+				continue;
+			}
+			uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+			uint8_t *buffer = &u->buffers[(size_t)bid * UDPFE_URING_BUFFER_SIZE];
+			const struct io_uring_recvmsg_out *out = (const struct io_uring_recvmsg_out *)buffer;
+			const struct sockaddr_in *addr = (const struct sockaddr_in *)(out + 1);
+			uint8_t *datagram = (uint8_t *)(out + 1) + u->recv_msg.msg_namelen + u->recv_msg.msg_controllen;
+			uint8_t ack[UDPFE_HEADER_SIZE];
+			int type;
+
+			bids[n_events] = bid;
+			if ((out->flags & MSG_TRUNC) || out->namelen != sizeof(struct sockaddr_in) ||
+			    (type = udpfe_ack(datagram, out->payloadlen, ack)) < 0) {
+				memset(&events[2 * n_events], 0, 2 * sizeof(events[0]));
+				n_events++;
+				continue;
+			}
+			udpfe_uring_ack(u, fd, addr, ack);
+			udpfe_event_header(header[n_events], type, addr, out->payloadlen);
+			events[2 * n_events].iov_base = header[n_events];
+			events[2 * n_events].iov_len = sizeof(header[n_events]);
+			events[2 * n_events + 1].iov_base = datagram;
+			events[2 * n_events + 1].iov_len = out->payloadlen;
+			n_events++;
+		}
+		__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+
+		if (n_events) {
+			if (udpfe_write_events(events, 2 * n_events) != 0) {
+				/* parent has closed the pipe */
+				return 0;
+			}
+			udpfe_uring_recycle(u, bids, n_events);
+		}
+		if (!armed) {
+			udpfe_uring_recv(u, fd);
+			armed = 1;
+		}
+	}
+}
+
+int32_t udpfe_uring_run(struct udpfe_worker *worker)
+{
+	struct udpfe_uring *u = calloc(1, sizeof(*u));
+	int32_t rc = -1;
+
+	if (u == NULL) {
+		return -1;
+	}
+	u->fd = -1;
+	if (udpfe_uring_init(u) == 0) {
+		rc = udpfe_uring_loop(u, worker->fd);
+	}
+	udpfe_uring_exit(u);
+	free(u);
+	return rc;
+}
+
+#else
+
+int32_t udpfe_uring_run(struct udpfe_worker *worker)
+{
+	(void)worker;
+	return -1;
+}
+
+#endif
+#endif
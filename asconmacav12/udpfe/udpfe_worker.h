@@ -0,0 +1,37 @@
+#ifndef UDPFE_WORKER_H
+#define UDPFE_WORKER_H
+
+/*
+ * Shared by the receive loops of the front end (udpfe.c, udpfe_uring.c),
+ * Linux only
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#include "udpfe.h"
+
+struct udpfe_worker {
+	pthread_t thread;
+	int fd;
+	enum udpfe_backend backend;
+	uint8_t (*rx)[UDPFE_DATAGRAM_MAX]; /* recvmmsg() loop */
+};
+
+// Fill 'ack' for a datagram, returns its packet type or -1 if it is not acknowledged
+int udpfe_ack(const uint8_t *datagram, uint32_t size, uint8_t ack[UDPFE_HEADER_SIZE]);
+
+// Header of the event frame carrying 'size' bytes of datagram
+void udpfe_event_header(uint8_t header[4 + UDPFE_EVENT_HEADER_SIZE], uint8_t type,
+			const struct sockaddr_in *addr, uint32_t size);
+
+// Write the event frames to the parent, workers never interleave their batches
+int32_t udpfe_write_events(struct iovec *iov, int count);
+
+// io_uring receive loop, returns 0 once the parent has gone and -1 if the
+// kernel cannot run it, the caller then falls back to the recvmmsg() loop
+int32_t udpfe_uring_run(struct udpfe_worker *worker);
+
+#endif /* UDPFE_WORKER_H */
@@ -0,0 +1,1161 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L /* fdatasync(), pthread_rwlock_t, clock_gettime() */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ulog.h"
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ULOG_FNV_OFFSET 0x811C9DC5u
+#define ULOG_FNV_PRIME 0x01000193u
+#define ULOG_PATH_MAX 4096
+#define ULOG_NAME_SIZE 16 /* hex digits of the first seq */
+#define ULOG_SEGMENT_DEFAULT (64u << 20)
+#define ULOG_BLOCK_NONE UINT32_MAX
+#define ULOG_BLOCK_SLOTS (sizeof(((struct ulog *)0)->block_slots) / sizeof(uint16_t))
+
+uint64_t ulog_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+// Offset of the gateways in the record
+static size_t ulog_gateways_offset(uint32_t payload_size)
+{
+	return (sizeof(struct ulog_record) + payload_size + ULOG_ALIGN - 1) & ~(size_t)(ULOG_ALIGN - 1);
+}
+
+static size_t ulog_record_size(uint32_t payload_size, uint32_t gateway_count)
+{
+	return ulog_gateways_offset(payload_size) + gateway_count * sizeof(struct ulog_gateway);
+}
+
+static uint32_t ulog_fnv(uint32_t hash, const uint8_t *data, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * ULOG_FNV_PRIME;
+	}
+	return hash;
+}
+
+static uint32_t ulog_checksum(const struct ulog_record *record)
+{
+	uint32_t hash = ulog_fnv(ULOG_FNV_OFFSET, (const uint8_t *)&record->seq,
+				 sizeof(*record) - offsetof(struct ulog_record, seq) + record->payload_size);
+
+	return ulog_fnv(hash, (const uint8_t *)record + ulog_gateways_offset(record->payload_size),
+			record->gateway_count * sizeof(struct ulog_gateway));
+}
+
+// Record at 'data' if it is whole, follows 'after_seq' and its checksum matches
+static const struct ulog_record *ulog_record_at(const uint8_t *data, size_t available, uint64_t after_seq)
+{
+	const struct ulog_record *record = (const struct ulog_record *)data;
+
+	if (available < sizeof(*record) || record->size > available || record->seq <= after_seq ||
+	    record->payload_size > ULOG_PAYLOAD_MAX || record->gateway_count > ULOG_GATEWAY_MAX ||
+	    record->size != ulog_record_size(record->payload_size, record->gateway_count) ||
+	    record->checksum != ulog_checksum(record)) {
+		return NULL;
+	}
+	return record;
+}
+
+static void ulog_uplink_of(const struct ulog_record *record, struct ulog_uplink *uplink)
+{
+	uplink->seq = record->seq;
+	uplink->time_ms = record->time_ms;
+	uplink->dev_addr = record->dev_addr;
+	uplink->f_cnt = record->f_cnt;
+	uplink->rssi = record->rssi;
+	uplink->lsnr = record->lsnr;
+	uplink->f_port = record->f_port;
+	uplink->payload_size = record->payload_size;
+	uplink->payload = (const uint8_t *)(record + 1);
+	uplink->gateway_count = record->gateway_count;
+	uplink->gateways = (const struct ulog_gateway *)((const uint8_t *)record + ulog_gateways_offset(record->payload_size));
+}
+
+static void ulog_path(const struct ulog *log, uint64_t first_seq, const char *ext, char *path)
+{
+	snprintf(path, ULOG_PATH_MAX, "%s/%016llx%s", log->dir, (unsigned long long)first_seq, ext);
+}
+
+// Make the renames and the new files of the directory durable
+static void ulog_sync_dir(const struct ulog *log)
+{
+	int fd = open(log->dir, O_RDONLY);
+	if (fd >= 0) {
+		fsync(fd);
+		close(fd);
+	}
+}
+
+static int32_t ulog_write_all(int fd, const uint8_t *data, size_t size)
+{
+	while (size > 0) {
+		ssize_t n = write(fd, data, size);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return ULOG_ERR_IO;
+		}
+		data += n;
+		size -= (size_t)n;
+	}
+	return ULOG_OK;
+}
+
+// Read-only mapping of the first 'size' bytes of a segment
+static const uint8_t *ulog_map(const struct ulog *log, const struct ulog_segment *segment)
+{
+	char path[ULOG_PATH_MAX];
+	void *map;
+	int fd;
+
+	ulog_path(log, segment->first_seq, ".seg", path);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	map = mmap(NULL, segment->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	return map == MAP_FAILED ? NULL : map;
+}
+
+static int ulog_entry_compare(const void *a, const void *b)
+{
+	const struct ulog_index_entry *x = a, *y = b;
+
+	if (x->dev_addr != y->dev_addr) {
+		return x->dev_addr < y->dev_addr ? -1 : 1;
+	}
+	return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+static int32_t ulog_entries_reserve(struct ulog_segment *segment, uint32_t count)
+{
+	uint32_t capacity = segment->capacity ? segment->capacity : 64;
+	struct ulog_index_entry *entries;
+
+	if (count <= segment->capacity) {
+		return ULOG_OK;
+	}
+	while (capacity < count) {
+		capacity *= 2;
+	}
+	entries = realloc(segment->entries, capacity * sizeof(*entries));
+	if (entries == NULL) {
+		return ULOG_ERR_NO_MEMORY;
+	}
+	segment->entries = entries;
+	segment->capacity = capacity;
+	return ULOG_OK;
+}
+
+static void ulog_block_reset(struct ulog *log, uint32_t block, uint32_t entry)
+{
+	log->block = block;
+	log->block_entry = entry;
+	memset(log->block_slots, 0, sizeof(log->block_slots));
+}
+
+// Account the record at 'offset' of the segment being written
+static int32_t ulog_index_add(struct ulog *log, struct ulog_segment *segment, const struct ulog_record *record, uint32_t offset)
+{
+	uint32_t block = offset / ULOG_BLOCK_SIZE;
+	struct ulog_index_entry *entry = NULL;
+	uint32_t slot;
+
+	if (block != log->block) {
+		ulog_block_reset(log, block, segment->count);
+	}
+	for (;;) {
+		/* Fibonacci hashing, DevAddr are often allocated sequentially */
+		slot = (uint32_t)(record->dev_addr * 0x9E3779B1u) >> 22;
+		for (uint32_t i = 0; i < ULOG_BLOCK_SLOTS; i++, slot = (slot + 1) % ULOG_BLOCK_SLOTS) {
+			if (log->block_slots[slot] == 0) {
+				break;
+			}
+			entry = &segment->entries[log->block_entry + log->block_slots[slot] - 1];
+			if (entry->dev_addr == record->dev_addr) {
+				break;
+			}
+			entry = NULL;
+		}
+		if (entry != NULL || log->block_slots[slot] == 0) {
+			break;
+		}
+		/* every slot taken, the rest of the block gets new entries */
+		ulog_block_reset(log, block, segment->count);
+	}
+	if (entry == NULL) {
+		if (ulog_entries_reserve(segment, segment->count + 1) != ULOG_OK) {
+			return ULOG_ERR_NO_MEMORY;
+		}
+		entry = &segment->entries[segment->count];
+		log->block_slots[slot] = (uint16_t)(segment->count - log->block_entry + 1);
+		segment->count++;
+		entry->dev_addr = record->dev_addr;
+		entry->count = 0;
+		entry->offset = offset;
+		entry->time_min = record->time_ms;
+		entry->time_max = record->time_ms;
+	}
+	entry->count++;
+	entry->end = offset + record->size;
+	entry->time_min = record->time_ms < entry->time_min ? record->time_ms : entry->time_min;
+	entry->time_max = record->time_ms > entry->time_max ? record->time_ms : entry->time_max;
+	if (segment->last_seq < segment->first_seq) {
+		segment->time_min = record->time_ms;
+		segment->time_max = record->time_ms;
+	}
+	segment->time_min = record->time_ms < segment->time_min ? record->time_ms : segment->time_min;
+	segment->time_max = record->time_ms > segment->time_max ? record->time_ms : segment->time_max;
+	segment->last_seq = record->seq;
+	segment->size = offset + record->size;
+	return ULOG_OK;
+}
+
+// Write the index of a sealed segment, replaced atomically by rename()
+static int32_t ulog_index_write(const struct ulog *log, const struct ulog_segment *segment)
+{
+	char path[ULOG_PATH_MAX], tmp_path[ULOG_PATH_MAX];
+	struct ulog_index_header header = {
+		.magic = ULOG_INDEX_MAGIC,
+		.version = ULOG_VERSION,
+		.first_seq = segment->first_seq,
+		.last_seq = segment->last_seq,
+		.time_min = segment->time_min,
+		.time_max = segment->time_max,
+		.size = segment->size,
+		.count = segment->count,
+	};
+	int32_t rc;
+	int fd;
+
+	ulog_path(log, segment->first_seq, ".idx", path);
+	ulog_path(log, segment->first_seq, ".idx.tmp", tmp_path);
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		return ULOG_ERR_IO;
+	}
+	rc = ulog_write_all(fd, (const uint8_t *)&header, sizeof(header));
+	if (rc == ULOG_OK) {
+		rc = ulog_write_all(fd, (const uint8_t *)segment->entries, segment->count * sizeof(*segment->entries));
+	}
+	if (rc == ULOG_OK && (fdatasync(fd) != 0 || rename(tmp_path, path) != 0)) {
+		rc = ULOG_ERR_IO;
+	}
+	close(fd);
+	if (rc != ULOG_OK) {
+		unlink(tmp_path);
+	}
+	return rc;
+}
+
+// Load the index of a segment if it matches the segment file
+static int32_t ulog_index_read(const struct ulog *log, struct ulog_segment *segment, uint64_t size)
+{
+	char path[ULOG_PATH_MAX];
+	struct ulog_index_header header;
+	size_t entries_size;
+	int32_t rc = ULOG_ERR_FORMAT;
+	FILE *file;
+
+	ulog_path(log, segment->first_seq, ".idx", path);
+	file = fopen(path, "rb");
+	if (file == NULL) {
+		return ULOG_ERR_IO;
+	}
+	if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == ULOG_INDEX_MAGIC &&
+	    header.version == ULOG_VERSION && header.first_seq == segment->first_seq && header.size == size &&
+	    ulog_entries_reserve(segment, header.count) == ULOG_OK) {
+		entries_size = header.count * sizeof(*segment->entries);
+		if (header.count == 0 || fread(segment->entries, entries_size, 1, file) == 1) {
+			segment->last_seq = header.last_seq;
+			segment->time_min = header.time_min;
+			segment->time_max = header.time_max;
+			segment->count = header.count;
+			segment->size = size;
+			rc = ULOG_OK;
+		}
+	}
+	fclose(file);
+	return rc;
+}
+
+static void ulog_segment_unlink(const struct ulog *log, uint64_t first_seq)
+{
+	char path[ULOG_PATH_MAX];
+
+	ulog_path(log, first_seq, ".seg", path);
+	unlink(path);
+	ulog_path(log, first_seq, ".idx", path);
+	unlink(path);
+}
+
+// Remove segments[at, at + n) from the array, the caller holds the write lock
+static void ulog_segments_remove(struct ulog *log, uint32_t at, uint32_t n)
+{
+	for (uint32_t i = at; i < at + n; i++) {
+		free(log->segments[i].entries);
+	}
+	memmove(&log->segments[at], &log->segments[at + n], (log->segment_count - at - n) * sizeof(*log->segments));
+	log->segment_count -= n;
+}
+
+static struct ulog_segment *ulog_segments_push(struct ulog *log, const struct ulog_segment *segment)
+{
+	if (log->segment_count == log->segment_capacity) {
+		uint32_t capacity = log->segment_capacity ? log->segment_capacity * 2 : 16;
+		struct ulog_segment *segments = realloc(log->segments, capacity * sizeof(*segments));
+		if (segments == NULL) {
+			return NULL;
+		}
+		log->segments = segments;
+		log->segment_capacity = capacity;
+	}
+	log->segments[log->segment_count] = *segment;
+	return &log->segments[log->segment_count++];
+}
+
+static struct ulog_segment *ulog_active(struct ulog *log)
+{
+	return log->fd >= 0 ? &log->segments[log->segment_count - 1] : NULL;
+}
+
+// Sort the index of the active segment and write it, the segment is read-only from then on
+static int32_t ulog_seal(struct ulog *log)
+{
+	struct ulog_segment *segment = ulog_active(log);
+
+	if (segment == NULL) {
+		return ULOG_OK;
+	}
+	if (log->options.sync && fdatasync(log->fd) != 0) {
+		return ULOG_ERR_IO;
+	}
+	close(log->fd);
+	log->fd = -1;
+	pthread_rwlock_wrlock(&log->lock);
+	if (segment->count > 1) {
+		qsort(segment->entries, segment->count, sizeof(*segment->entries), ulog_entry_compare);
+	}
+	segment->sealed = 1;
+	pthread_rwlock_unlock(&log->lock);
+	return ulog_index_write(log, segment);
+}
+
+// New active segment starting at 'first_seq'
+static int32_t ulog_create(struct ulog *log, uint64_t first_seq)
+{
+	char path[ULOG_PATH_MAX];
+	struct ulog_segment_header header = {
+		.magic = ULOG_MAGIC,
+		.version = ULOG_VERSION,
+		.first_seq = first_seq,
+		.created_ms = ulog_now_ms(),
+	};
+	struct ulog_segment segment = {
+		.first_seq = first_seq,
+		.last_seq = first_seq - 1,
+		.created_ms = header.created_ms,
+		.size = sizeof(header),
+	};
+	struct ulog_segment *pushed;
+	int fd;
+
+	ulog_path(log, first_seq, ".seg", path);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600);
+	if (fd < 0) {
+		return ULOG_ERR_IO;
+	}
+	if (ulog_write_all(fd, (const uint8_t *)&header, sizeof(header)) != ULOG_OK) {
+		close(fd);
+		unlink(path);
+		return ULOG_ERR_IO;
+	}
+	ulog_sync_dir(log);
+	pthread_rwlock_wrlock(&log->lock);
+	pushed = ulog_segments_push(log, &segment);
+	pthread_rwlock_unlock(&log->lock);
+	if (pushed == NULL) {
+		close(fd);
+		unlink(path);
+		return ULOG_ERR_NO_MEMORY;
+	}
+	log->fd = fd;
+	ulog_block_reset(log, ULOG_BLOCK_NONE, 0);
+	return ULOG_OK;
+}
+
+// Index the records of map[0..size) from scratch, segment->size ends after the last whole one
+static int32_t ulog_index_records(struct ulog *log, struct ulog_segment *segment, const uint8_t *map, size_t size)
+{
+	const struct ulog_record *record;
+	size_t offset;
+
+	segment->count = 0;
+	segment->last_seq = segment->first_seq - 1;
+	ulog_block_reset(log, ULOG_BLOCK_NONE, 0);
+	for (offset = sizeof(struct ulog_segment_header);
+	     (record = ulog_record_at(map + offset, size - offset, segment->last_seq)) != NULL; offset += record->size) {
+		if (ulog_index_add(log, segment, record, (uint32_t)offset) != ULOG_OK) {
+			return ULOG_ERR_NO_MEMORY;
+		}
+	}
+	segment->size = offset;
+	return ULOG_OK;
+}
+
+// Load the segment file starting at 'first_seq', indexing it again when its index is stale
+static int32_t ulog_load(struct ulog *log, uint64_t first_seq, int last)
+{
+	char path[ULOG_PATH_MAX];
+	struct ulog_segment segment = {.first_seq = first_seq, .last_seq = first_seq - 1};
+	const struct ulog_segment_header *header;
+	const uint8_t *map;
+	struct stat st;
+	size_t offset;
+	int fd;
+
+	ulog_path(log, first_seq, ".seg", path);
+	fd = open(path, O_RDWR);
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		return ULOG_ERR_IO;
+	}
+	if ((size_t)st.st_size < sizeof(*header)) {
+		/* created but its header never made it to the disk */
+		close(fd);
+		ulog_segment_unlink(log, first_seq);
+		return ULOG_OK;
+	}
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		close(fd);
+		return ULOG_ERR_IO;
+	}
+	header = (const struct ulog_segment_header *)map;
+	if (header->magic != ULOG_MAGIC || header->version != ULOG_VERSION || header->first_seq != first_seq) {
+		munmap((void *)map, (size_t)st.st_size);
+		close(fd);
+		return ULOG_ERR_FORMAT;
+	}
+	segment.created_ms = header->created_ms;
+	if (ulog_index_read(log, &segment, (uint64_t)st.st_size) == ULOG_OK) {
+		segment.sealed = 1;
+	} else {
+		if (ulog_index_records(log, &segment, map, (size_t)st.st_size) != ULOG_OK) {
+			munmap((void *)map, (size_t)st.st_size);
+			close(fd);
+			free(segment.entries);
+			return ULOG_ERR_NO_MEMORY;
+		}
+		offset = segment.size;
+		if (offset < (size_t)st.st_size && ftruncate(fd, (off_t)offset) != 0) {
+			munmap((void *)map, (size_t)st.st_size);
+			close(fd);
+			free(segment.entries);
+			return ULOG_ERR_IO;
+		}
+	}
+	munmap((void *)map, (size_t)st.st_size);
+	if (log->segment_count > 0 && first_seq <= log->segments[log->segment_count - 1].last_seq) {
+		/* left over by a merge interrupted before its files were deleted */
+		close(fd);
+		free(segment.entries);
+		ulog_segment_unlink(log, first_seq);
+		return ULOG_OK;
+	}
+	if (ulog_segments_push(log, &segment) == NULL) {
+		close(fd);
+		free(segment.entries);
+		return ULOG_ERR_NO_MEMORY;
+	}
+	if (segment.sealed) {
+		close(fd);
+	} else if (last) {
+		/* appended to again, the block state of the scan above goes on */
+		close(fd);
+		log->fd = open(path, O_WRONLY | O_APPEND);
+		if (log->fd < 0) {
+			return ULOG_ERR_IO;
+		}
+	} else {
+		close(fd);
+		log->segments[log->segment_count - 1].sealed = 1;
+		if (segment.count > 1) {
+			qsort(segment.entries, segment.count, sizeof(*segment.entries), ulog_entry_compare);
+		}
+		return ulog_index_write(log, &log->segments[log->segment_count - 1]);
+	}
+	return ULOG_OK;
+}
+
+static int ulog_seq_compare(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+// First seq of the segment files of the directory, sorted, left over temporary files are deleted
+static int32_t ulog_list(struct ulog *log, uint64_t **seqs, uint32_t *count)
+{
+	uint32_t capacity = 0;
+	struct dirent *dirent;
+	DIR *dir = opendir(log->dir);
+
+	*seqs = NULL;
+	*count = 0;
+	if (dir == NULL) {
+		return ULOG_ERR_IO;
+	}
+	while ((dirent = readdir(dir)) != NULL) {
+		const char *name = dirent->d_name;
+		size_t size = strlen(name);
+		char *end;
+		uint64_t seq;
+
+		if (size > 4 && strcmp(name + size - 4, ".tmp") == 0) {
+			char path[ULOG_PATH_MAX];
+			snprintf(path, sizeof(path), "%s/%s", log->dir, name);
+			unlink(path);
+			continue;
+		}
+		if (size != ULOG_NAME_SIZE + 4 || strcmp(name + ULOG_NAME_SIZE, ".seg") != 0) {
+			continue;
+		}
+		seq = strtoull(name, &end, 16);
+		if (end != name + ULOG_NAME_SIZE) {
+			continue;
+		}
+		if (*count == capacity) {
+			uint64_t *grown;
+			capacity = capacity ? capacity * 2 : 16;
+			grown = realloc(*seqs, capacity * sizeof(**seqs));
+			if (grown == NULL) {
+				closedir(dir);
+				return ULOG_ERR_NO_MEMORY;
+			}
+			*seqs = grown;
+		}
+		(*seqs)[(*count)++] = seq;
+	}
+	closedir(dir);
+	if (*count > 1) {
+		qsort(*seqs, *count, sizeof(**seqs), ulog_seq_compare);
+	}
+	return ULOG_OK;
+}
+
+int32_t ulog_open(struct ulog *log, const char *dir, const struct ulog_options *options)
+{
+	uint64_t *seqs;
+	uint32_t count;
+	int32_t rc;
+
+	memset(log, 0, sizeof(*log));
+	log->fd = -1;
+	log->next_seq = 1;
+	log->options.segment_max = ULOG_SEGMENT_DEFAULT;
+	log->options.sync = 1;
+	if (options != NULL) {
+		log->options = *options;
+	}
+	if (log->options.segment_max < ULOG_SEGMENT_MIN) {
+		log->options.segment_max = ULOG_SEGMENT_MIN;
+	} else if (log->options.segment_max > ULOG_SEGMENT_MAX) {
+		log->options.segment_max = ULOG_SEGMENT_MAX;
+	}
+	if (strlen(dir) + ULOG_NAME_SIZE + sizeof("/.idx.tmp") > ULOG_PATH_MAX) {
+		return ULOG_ERR_INVALID;
+	}
+	if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+		return ULOG_ERR_IO;
+	}
+	log->dir = malloc(strlen(dir) + 1);
+	if (log->dir == NULL) {
+		return ULOG_ERR_NO_MEMORY;
+	}
+	strcpy(log->dir, dir);
+	pthread_mutex_init(&log->append_lock, NULL);
+	pthread_mutex_init(&log->commit_lock, NULL);
+	pthread_rwlock_init(&log->lock, NULL);
+
+	rc = ulog_list(log, &seqs, &count);
+	for (uint32_t i = 0; rc == ULOG_OK && i < count; i++) {
+		rc = ulog_load(log, seqs[i], i + 1 == count);
+	}
+	free(seqs);
+	if (rc != ULOG_OK) {
+		ulog_close(log);
+		return rc;
+	}
+	if (log->segment_count > 0) {
+		log->next_seq = log->segments[log->segment_count - 1].last_seq + 1;
+	}
+	log->committed_seq = log->next_seq - 1;
+	return ULOG_OK;
+}
+
+void ulog_close(struct ulog *log)
+{
+	if (log->dir == NULL) {
+		return;
+	}
+	ulog_commit(log, NULL);
+	if (log->fd >= 0) {
+		close(log->fd);
+		log->fd = -1;
+	}
+	for (uint32_t i = 0; i < log->segment_count; i++) {
+		free(log->segments[i].entries);
+	}
+	free(log->segments);
+	free(log->pending);
+	free(log->committing);
+	free(log->dir);
+	pthread_mutex_destroy(&log->append_lock);
+	pthread_mutex_destroy(&log->commit_lock);
+	pthread_rwlock_destroy(&log->lock);
+	memset(log, 0, sizeof(*log));
+	log->fd = -1;
+}
+
+int32_t ulog_append(struct ulog *log, const struct ulog_uplink *uplink, uint64_t *seq)
+{
+	uint32_t gateway_count = uplink->gateway_count < ULOG_GATEWAY_MAX ? uplink->gateway_count : ULOG_GATEWAY_MAX;
+	size_t size = ulog_record_size(uplink->payload_size, gateway_count);
+	struct ulog_record *record;
+	struct ulog_gateway *gateways;
+
+	if (uplink->payload_size > ULOG_PAYLOAD_MAX || (uplink->payload_size > 0 && uplink->payload == NULL) ||
+	    (gateway_count > 0 && uplink->gateways == NULL)) {
+		return ULOG_ERR_INVALID;
+	}
+	pthread_mutex_lock(&log->append_lock);
+	if (log->pending_size + size > log->pending_capacity) {
+		size_t capacity = log->pending_capacity ? log->pending_capacity * 2 : ULOG_BLOCK_SIZE;
+		uint8_t *pending = realloc(log->pending, capacity);
+		if (pending == NULL) {
+			pthread_mutex_unlock(&log->append_lock);
+			return ULOG_ERR_NO_MEMORY;
+		}
+		log->pending = pending;
+		log->pending_capacity = capacity;
+	}
+	record = (struct ulog_record *)(log->pending + log->pending_size);
+	memset(record, 0, size);
+	record->size = (uint32_t)size;
+	record->seq = log->next_seq++;
+	record->time_ms = uplink->time_ms;
+	record->dev_addr = uplink->dev_addr;
+	record->f_cnt = uplink->f_cnt;
+	record->rssi = uplink->rssi;
+	record->lsnr = uplink->lsnr;
+	record->f_port = uplink->f_port;
+	record->payload_size = uplink->payload_size;
+	record->gateway_count = (uint8_t)gateway_count;
+	if (uplink->payload_size > 0) {
+		memcpy(record + 1, uplink->payload, uplink->payload_size);
+	}
+	gateways = (struct ulog_gateway *)((uint8_t *)record + ulog_gateways_offset(uplink->payload_size));
+	for (uint32_t i = 0; i < gateway_count; i++) {
+		gateways[i].eui = uplink->gateways[i].eui;
+		gateways[i].rssi = uplink->gateways[i].rssi;
+		gateways[i].lsnr = uplink->gateways[i].lsnr;
+	}
+	record->checksum = ulog_checksum(record);
+	log->pending_size += size;
+	if (seq != NULL) {
+		*seq = record->seq;
+	}
+	pthread_mutex_unlock(&log->append_lock);
+	return ULOG_OK;
+}
+
+// Drop what follows 'size' in the active segment and index it again, the segment is closed when that fails
+static int32_t ulog_rollback(struct ulog *log, uint64_t size)
+{
+	struct ulog_segment *segment = ulog_active(log);
+	uint64_t mapped = segment->size;
+	const uint8_t *map = ulog_map(log, segment);
+	int32_t rc = ULOG_ERR_IO;
+
+	/* mapped first, the index is left as it is when the file cannot be read back */
+	if (map != NULL) {
+		pthread_rwlock_wrlock(&log->lock);
+		if (ftruncate(log->fd, (off_t)size) == 0) {
+			/* the same records as before, the entries fit */
+			rc = ulog_index_records(log, segment, map, size);
+		}
+		pthread_rwlock_unlock(&log->lock);
+		munmap((void *)map, mapped);
+	}
+	if (rc != ULOG_OK) {
+		close(log->fd);
+		log->fd = -1;
+	}
+	return rc;
+}
+
+// Write and sync records[0..size) to the active segment, sealing and creating segments on the way. On an error
+// the records written since the last sync are rolled back, 'kept' gets the size of the records left in the log
+static int32_t ulog_commit_records(struct ulog *log, const uint8_t *records, size_t size, size_t *kept)
+{
+	uint64_t now_ms = ulog_now_ms();
+	struct ulog_segment *segment = ulog_active(log);
+	uint64_t synced = segment != NULL ? segment->size : 0; /* of the active segment */
+	size_t done = 0, sealed = 0;
+	int32_t rc = ULOG_OK;
+
+	while (rc == ULOG_OK && done < size) {
+		const struct ulog_record *record = (const struct ulog_record *)(records + done);
+		size_t run = 0;
+		uint64_t start;
+
+		segment = ulog_active(log);
+		if (segment != NULL && segment->last_seq >= segment->first_seq &&
+		    (segment->size + record->size > log->options.segment_max ||
+		     (log->options.segment_ms && now_ms - segment->created_ms >= log->options.segment_ms))) {
+			rc = ulog_seal(log);
+			if (log->fd < 0) {
+				/* synced and closed, a missing index is written again on open */
+				sealed = done;
+			}
+			if (rc != ULOG_OK) {
+				break;
+			}
+			segment = NULL;
+		}
+		if (segment == NULL) {
+			if ((rc = ulog_create(log, record->seq)) != ULOG_OK) {
+				break;
+			}
+			segment = ulog_active(log);
+			synced = segment->size;
+		}
+		/* the records which fit, at least one in an empty segment */
+		start = segment->size;
+		do {
+			run += ((const struct ulog_record *)(records + done + run))->size;
+		} while (done + run < size &&
+			 start + run + ((const struct ulog_record *)(records + done + run))->size <= log->options.segment_max);
+		if (ulog_write_all(log->fd, records + done, run) != ULOG_OK) {
+			rc = ULOG_ERR_IO;
+			/* drop what made it of the run, the file ends on a record */
+			if (ftruncate(log->fd, (off_t)start) != 0) {
+				close(log->fd);
+				log->fd = -1;
+			}
+			break;
+		}
+		pthread_rwlock_wrlock(&log->lock);
+		segment = ulog_active(log);
+		for (size_t offset = 0; rc == ULOG_OK && offset < run;
+		     offset += ((const struct ulog_record *)(records + done + offset))->size) {
+			rc = ulog_index_add(log, segment, (const struct ulog_record *)(records + done + offset), (uint32_t)(start + offset));
+		}
+		pthread_rwlock_unlock(&log->lock);
+		done += run;
+	}
+	if (rc == ULOG_OK && done > sealed && log->options.sync && fdatasync(log->fd) != 0) {
+		rc = ULOG_ERR_IO;
+	}
+	if (rc == ULOG_OK) {
+		*kept = size;
+	} else if (log->fd >= 0 && ulog_rollback(log, synced) == ULOG_OK) {
+		/* after a failed sync the pages may be gone, written again */
+		*kept = sealed;
+	} else {
+		*kept = done;
+	}
+	return rc;
+}
+
+// Put records[0..size) back in front of the records appended since, for the next commit
+static int32_t ulog_requeue(struct ulog *log, const uint8_t *records, size_t size)
+{
+	size_t capacity = log->pending_capacity ? log->pending_capacity : ULOG_BLOCK_SIZE;
+	uint8_t *pending;
+
+	pthread_mutex_lock(&log->append_lock);
+	while (capacity < size + log->pending_size) {
+		capacity *= 2;
+	}
+	pending = malloc(capacity);
+	if (pending == NULL) {
+		pthread_mutex_unlock(&log->append_lock);
+		return ULOG_ERR_NO_MEMORY;
+	}
+	memcpy(pending, records, size);
+	if (log->pending_size > 0) {
+		memcpy(pending + size, log->pending, log->pending_size);
+	}
+	free(log->pending);
+	log->pending = pending;
+	log->pending_size += size;
+	log->pending_capacity = capacity;
+	pthread_mutex_unlock(&log->append_lock);
+	return ULOG_OK;
+}
+
+int32_t ulog_commit(struct ulog *log, uint64_t *seq)
+{
+	uint8_t *records;
+	size_t size, capacity, kept;
+	uint64_t last;
+	int32_t rc;
+
+	pthread_mutex_lock(&log->commit_lock);
+	/* the appends go on into the other buffer meanwhile */
+	pthread_mutex_lock(&log->append_lock);
+	records = log->pending;
+	size = log->pending_size;
+	capacity = log->pending_capacity;
+	log->pending = log->committing;
+	log->pending_capacity = log->committing_capacity;
+	log->pending_size = 0;
+	last = log->next_seq - 1;
+	pthread_mutex_unlock(&log->append_lock);
+
+	rc = ulog_commit_records(log, records, size, &kept);
+	if (rc == ULOG_OK) {
+		__atomic_store_n(&log->committed_seq, last, __ATOMIC_RELEASE);
+	} else if (kept < size) {
+		/* lost only when there is no memory left for them */
+		ulog_requeue(log, records + kept, size - kept);
+	}
+	log->committing = records;
+	log->committing_capacity = capacity;
+	if (seq != NULL) {
+		*seq = __atomic_load_n(&log->committed_seq, __ATOMIC_ACQUIRE);
+	}
+	pthread_mutex_unlock(&log->commit_lock);
+	return rc;
+}
+
+// Visit the committed records of segment[offset, end) matching the filter, 1 if the visitor stopped
+static int ulog_visit(const uint8_t *map, size_t offset, size_t end, uint64_t from_seq, uint64_t committed,
+		      const uint32_t *dev_addr, uint64_t from_ms, uint64_t to_ms, uint32_t *max, ulog_visitor visit, void *ctx)
+{
+	struct ulog_uplink uplink;
+
+	while (offset < end) {
+		const struct ulog_record *record = (const struct ulog_record *)(map + offset);
+		offset += record->size;
+		if (record->seq > committed) {
+			return 1;
+		}
+		if (record->seq < from_seq || (dev_addr != NULL && (record->dev_addr != *dev_addr ||
+								    record->time_ms < from_ms || record->time_ms >= to_ms))) {
+			continue;
+		}
+		ulog_uplink_of(record, &uplink);
+		if (visit(&uplink, ctx) || --*max == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int32_t ulog_read(struct ulog *log, uint64_t from_seq, uint32_t max, ulog_visitor visit, void *ctx)
+{
+	uint64_t committed = __atomic_load_n(&log->committed_seq, __ATOMIC_ACQUIRE);
+	int32_t rc = ULOG_OK;
+	int stop = max == 0;
+
+	pthread_rwlock_rdlock(&log->lock);
+	for (uint32_t i = 0; !stop && i < log->segment_count; i++) {
+		const struct ulog_segment *segment = &log->segments[i];
+		const uint8_t *map;
+
+		if (segment->last_seq < from_seq || segment->last_seq < segment->first_seq) {
+			continue;
+		}
+		if (segment->first_seq > committed) {
+			break;
+		}
+		map = ulog_map(log, segment);
+		if (map == NULL) {
+			rc = ULOG_ERR_IO;
+			break;
+		}
+		stop = ulog_visit(map, sizeof(struct ulog_segment_header), segment->size, from_seq, committed, NULL, 0, 0,
+				  &max, visit, ctx);
+		munmap((void *)map, segment->size);
+	}
+	pthread_rwlock_unlock(&log->lock);
+	return rc;
+}
+
+int32_t ulog_scan(struct ulog *log, uint32_t dev_addr, uint64_t from_ms, uint64_t to_ms, ulog_visitor visit, void *ctx)
+{
+	uint64_t committed = __atomic_load_n(&log->committed_seq, __ATOMIC_ACQUIRE);
+	uint32_t max = UINT32_MAX;
+	int32_t rc = ULOG_OK;
+	int stop = 0;
+
+	pthread_rwlock_rdlock(&log->lock);
+	for (uint32_t i = 0; !stop && i < log->segment_count; i++) {
+		const struct ulog_segment *segment = &log->segments[i];
+		const uint8_t *map = NULL;
+		uint32_t e = 0;
+
+		if (segment->count == 0 || segment->time_max < from_ms || segment->time_min >= to_ms) {
+			continue;
+		}
+		if (segment->sealed) {
+			/* first entry of the device */
+			uint32_t high = segment->count;
+			while (e < high) {
+				uint32_t mid = e + (high - e) / 2;
+				if (segment->entries[mid].dev_addr < dev_addr) {
+					e = mid + 1;
+				} else {
+					high = mid;
+				}
+			}
+		}
+		for (; !stop && e < segment->count; e++) {
+			const struct ulog_index_entry *entry = &segment->entries[e];
+			if (entry->dev_addr != dev_addr) {
+				if (segment->sealed) {
+					break;
+				}
+				continue;
+			}
+			if (entry->time_max < from_ms || entry->time_min >= to_ms) {
+				continue;
+			}
+			if (map == NULL && (map = ulog_map(log, segment)) == NULL) {
+				rc = ULOG_ERR_IO;
+				stop = 1;
+				break;
+			}
+			stop = ulog_visit(map, entry->offset, entry->end, 0, committed, &dev_addr, from_ms, to_ms, &max, visit, ctx);
+		}
+		if (map != NULL) {
+			munmap((void *)map, segment->size);
+		}
+	}
+	pthread_rwlock_unlock(&log->lock);
+	return rc;
+}
+
+// Merge the sealed segments[at, at + n) into one segment named after the first one
+static int32_t ulog_merge(struct ulog *log, uint32_t at, uint32_t n)
+{
+	char path[ULOG_PATH_MAX], tmp_path[ULOG_PATH_MAX];
+	const struct ulog_segment *first = &log->segments[at];
+	struct ulog_segment merged = *first;
+	struct ulog_segment_header header = {
+		.magic = ULOG_MAGIC,
+		.version = ULOG_VERSION,
+		.first_seq = first->first_seq,
+		.created_ms = first->created_ms,
+	};
+	int32_t rc;
+	int fd;
+
+	merged.entries = NULL;
+	merged.count = 0;
+	merged.capacity = 0;
+	merged.size = sizeof(header);
+	ulog_path(log, first->first_seq, ".seg", path);
+	ulog_path(log, first->first_seq, ".seg.tmp", tmp_path);
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		return ULOG_ERR_IO;
+	}
+	rc = ulog_write_all(fd, (const uint8_t *)&header, sizeof(header));
+	for (uint32_t i = at; rc == ULOG_OK && i < at + n; i++) {
+		/* sealed segments do not change, read without the lock */
+		const struct ulog_segment *segment = &log->segments[i];
+		const uint8_t *map = ulog_map(log, segment);
+		uint32_t shift = (uint32_t)(merged.size - sizeof(header));
+
+		if (map == NULL) {
+			rc = ULOG_ERR_IO;
+			break;
+		}
+		rc = ulog_write_all(fd, map + sizeof(header), segment->size - sizeof(header));
+		munmap((void *)map, segment->size);
+		if (rc == ULOG_OK) {
+			rc = ulog_entries_reserve(&merged, merged.count + segment->count);
+		}
+		if (rc != ULOG_OK) {
+			break;
+		}
+		for (uint32_t e = 0; e < segment->count; e++) {
+			struct ulog_index_entry *entry = &merged.entries[merged.count++];
+			*entry = segment->entries[e];
+			entry->offset += shift;
+			entry->end += shift;
+		}
+		merged.size += segment->size - sizeof(header);
+		merged.last_seq = segment->last_seq;
+		merged.time_min = segment->time_min < merged.time_min ? segment->time_min : merged.time_min;
+		merged.time_max = segment->time_max > merged.time_max ? segment->time_max : merged.time_max;
+	}
+	if (rc == ULOG_OK && fdatasync(fd) != 0) {
+		rc = ULOG_ERR_IO;
+	}
+	close(fd);
+	if (rc != ULOG_OK) {
+		unlink(tmp_path);
+		free(merged.entries);
+		return rc;
+	}
+	if (merged.count > 1) {
+		qsort(merged.entries, merged.count, sizeof(*merged.entries), ulog_entry_compare);
+	}
+
+	/* the scans open the files by name, swap them under the lock. A crash
+	 * in between leaves a stale index, written again on open, and segments
+	 * covered by the merged one, deleted on open. */
+	pthread_rwlock_wrlock(&log->lock);
+	if (rename(tmp_path, path) != 0) {
+		pthread_rwlock_unlock(&log->lock);
+		unlink(tmp_path);
+		free(merged.entries);
+		return ULOG_ERR_IO;
+	}
+	rc = ulog_index_write(log, &merged);
+	for (uint32_t i = at + 1; i < at + n; i++) {
+		ulog_segment_unlink(log, log->segments[i].first_seq);
+	}
+	free(log->segments[at].entries);
+	log->segments[at] = merged;
+	ulog_segments_remove(log, at + 1, n - 1);
+	pthread_rwlock_unlock(&log->lock);
+	ulog_sync_dir(log);
+	return rc;
+}
+
+int32_t ulog_maintain(struct ulog *log, uint64_t now_ms, uint64_t keep_seq)
+{
+	uint64_t small = log->options.segment_max / 4;
+	uint32_t expired = 0;
+	int32_t rc = ULOG_OK;
+
+	pthread_mutex_lock(&log->commit_lock);
+	/* retention, the oldest sealed segments only so the log stays contiguous */
+	if (log->options.retention_ms) {
+		while (expired < log->segment_count && log->segments[expired].sealed &&
+		       log->segments[expired].time_max + log->options.retention_ms <= now_ms &&
+		       log->segments[expired].last_seq < keep_seq) {
+			expired++;
+		}
+	}
+	if (expired > 0) {
+		pthread_rwlock_wrlock(&log->lock);
+		for (uint32_t i = 0; i < expired; i++) {
+			ulog_segment_unlink(log, log->segments[i].first_seq);
+		}
+		ulog_segments_remove(log, 0, expired);
+		pthread_rwlock_unlock(&log->lock);
+	}
+	/* compaction, the first run of small sealed segments which fits in one */
+	for (uint32_t at = 0; at < log->segment_count; at++) {
+		uint64_t size = sizeof(struct ulog_segment_header);
+		uint32_t n = 0;
+
+		while (at + n < log->segment_count && log->segments[at + n].sealed && log->segments[at + n].size < small &&
+		       size + log->segments[at + n].size <= log->options.segment_max) {
+			size += log->segments[at + n].size - sizeof(struct ulog_segment_header);
+			n++;
+		}
+		if (n >= 2) {
+			rc = ulog_merge(log, at, n);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&log->commit_lock);
+	return rc;
+}
+
+#else
+
+uint64_t ulog_now_ms(void)
+{
+	return (uint64_t)time(NULL) * 1000u;
+}
+
+int32_t ulog_open(struct ulog *log, const char *dir, const struct ulog_options *options)
+{
+	(void)log;
+	(void)dir;
+	(void)options;
+	return ULOG_ERR_IO;
+}
+
+void ulog_close(struct ulog *log)
+{
+	(void)log;
+}
+
+int32_t ulog_append(struct ulog *log, const struct ulog_uplink *uplink, uint64_t *seq)
+{
+	(void)log;
+	(void)uplink;
+	(void)seq;
+	return ULOG_ERR_IO;
+}
+
+int32_t ulog_commit(struct ulog *log, uint64_t *seq)
+{
+	(void)log;
+	(void)seq;
+	return ULOG_ERR_IO;
+}
+
+int32_t ulog_read(struct ulog *log, uint64_t from_seq, uint32_t max, ulog_visitor visit, void *ctx)
+{
+	(void)log;
+	(void)from_seq;
+	(void)max;
+	(void)visit;
+	(void)ctx;
+	return ULOG_ERR_IO;
+}
+
+int32_t ulog_scan(struct ulog *log, uint32_t dev_addr, uint64_t from_ms, uint64_t to_ms, ulog_visitor visit, void *ctx)
+{
+	(void)log;
+	(void)dev_addr;
+	(void)from_ms;
+	(void)to_ms;
+	(void)visit;
+	(void)ctx;
+	return ULOG_ERR_IO;
+}
+
+int32_t ulog_maintain(struct ulog *log, uint64_t now_ms, uint64_t keep_seq)
+{
+	(void)log;
+	(void)now_ms;
+	(void)keep_seq;
+	return ULOG_ERR_IO;
+}
+
+#endif
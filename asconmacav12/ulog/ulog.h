@@ -0,0 +1,199 @@
+#ifndef ULOG_H
+#define ULOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+/*
+ * Append-only log of the decoded uplinks, split in segment files of a
+ * directory. Every uplink gets the next sequence number, the log is read
+ * back in sequence order (ulog_read(), e.g by a replication consumer) or
+ * per device and time range (ulog_scan()).
+ *
+ * Segment: <first seq, 16 hex digits>.seg
+ *     [header (64 bytes)][record][record]...
+ *     record = [struct ulog_record][payload, padded to 8 bytes]
+ *              [struct ulog_gateway, gateway_count times]
+ * Index: <first seq>.idx, written when the segment is sealed
+ *     [header (64 bytes)][struct ulog_index_entry, sorted by DevAddr, offset]
+ *
+ * The index is sparse: one entry per device and ULOG_BLOCK_SIZE block of the
+ * segment, with the records of the device found by scanning the block range
+ * of the entry. The segments are mapped read-only for the scans.
+ *
+ * ulog_append() only copies the record into memory, ulog_commit() writes all
+ * the records appended since the last commit and syncs them once (group
+ * commit). A commit can run on another thread than the appends, commits and
+ * ulog_maintain() are serialized. The records of a failed commit stay
+ * pending: what it wrote since the last sync is truncated and all of them are
+ * written again by the next commit. ulog_maintain() deletes the segments past
+ * the retention time and merges the small sealed segments.
+ *
+ * On open a torn record at the end of the last segment is truncated, and a
+ * segment whose index is missing or stale is indexed again.
+ */
+
+#define ULOG_MAGIC 0x31474F4C /* "LOG1" */
+#define ULOG_INDEX_MAGIC 0x31584449 /* "IDX1" */
+#define ULOG_VERSION 1
+#define ULOG_ALIGN 8
+#define ULOG_PAYLOAD_MAX 255
+#define ULOG_GATEWAY_MAX 32 /* gateways kept per uplink, the first ones */
+#define ULOG_BLOCK_SIZE (64u * 1024)
+#define ULOG_SEGMENT_MIN (1u << 20)
+#define ULOG_SEGMENT_MAX (1u << 30) /* record offsets are 32 bits */
+
+enum ulog_status {
+	ULOG_OK = 0,
+	ULOG_ERR_IO = -40,
+	ULOG_ERR_FORMAT = -41,
+	ULOG_ERR_INVALID = -42,
+	ULOG_ERR_NO_MEMORY = -43,
+};
+
+struct ulog_segment_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t first_seq;
+	uint64_t created_ms;
+	uint8_t reserved[40];
+};
+
+struct ulog_record {
+	uint32_t size; /* with the payload and padding */
+	uint32_t checksum; /* FNV-1a of the record after this field, payload included */
+	uint64_t seq;
+	uint64_t time_ms;
+	uint32_t dev_addr;
+	uint32_t f_cnt;
+	int16_t rssi; /* dBm */
+	int16_t lsnr; /* cB (0.1 dB) */
+	uint8_t f_port;
+	uint8_t gateway_count; /* 0 in the records written before the gateways */
+	uint16_t payload_size;
+};
+
+// Reception of an uplink by one of the gateways which heard it
+struct ulog_gateway {
+	uint64_t eui;
+	int16_t rssi; /* dBm */
+	int16_t lsnr; /* cB (0.1 dB) */
+	uint32_t reserved;
+};
+
+struct ulog_index_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t first_seq;
+	uint64_t last_seq;
+	uint64_t time_min;
+	uint64_t time_max;
+	uint64_t size; /* of the segment indexed */
+	uint32_t count; /* entries */
+	uint8_t reserved[12];
+};
+
+struct ulog_index_entry {
+	uint32_t dev_addr;
+	uint32_t count; /* records of the device in the range */
+	uint32_t offset; /* first record of the device */
+	uint32_t end; /* end of its last record */
+	uint64_t time_min;
+	uint64_t time_max;
+};
+
+// In memory state of a segment
+struct ulog_segment {
+	uint64_t first_seq;
+	uint64_t last_seq; /* first_seq - 1 while empty */
+	uint64_t time_min;
+	uint64_t time_max;
+	uint64_t created_ms;
+	uint64_t size; /* written, header included */
+	struct ulog_index_entry *entries;
+	uint32_t count;
+	uint32_t capacity;
+	uint32_t sealed;
+};
+
+struct ulog_options {
+	uint64_t segment_max; /* bytes, the active segment is sealed past that */
+	uint64_t segment_ms; /* age at which the active segment is sealed, 0 for none */
+	uint64_t retention_ms; /* age of the deleted segments, 0 to keep them */
+	uint32_t sync; /* fdatasync() on commit, otherwise only written */
+};
+
+// Decoded uplink given to ulog_append() and to the visitors
+struct ulog_uplink {
+	uint64_t seq;
+	uint64_t time_ms;
+	uint32_t dev_addr;
+	uint32_t f_cnt;
+	int16_t rssi;
+	int16_t lsnr;
+	uint8_t f_port;
+	uint16_t payload_size;
+	const uint8_t *payload;
+	uint32_t gateway_count;
+	const struct ulog_gateway *gateways;
+};
+
+// Return non zero to stop the visit
+typedef int (*ulog_visitor)(const struct ulog_uplink *uplink, void *ctx);
+
+#ifndef _WIN32
+struct ulog {
+	char *dir;
+	struct ulog_options options;
+	pthread_mutex_t append_lock; /* pending */
+	pthread_mutex_t commit_lock; /* commits and maintenance */
+	pthread_rwlock_t lock; /* segments and their entries */
+	struct ulog_segment *segments; /* by first_seq, the last one is active unless sealed */
+	uint32_t segment_count;
+	uint32_t segment_capacity;
+	int fd; /* of the active segment, -1 if none */
+	uint8_t *pending; /* records appended, not committed */
+	size_t pending_size;
+	size_t pending_capacity;
+	uint8_t *committing; /* the other buffer, written by ulog_commit() */
+	size_t committing_capacity;
+	uint64_t next_seq;
+	uint64_t committed_seq; /* last seq committed */
+	uint32_t block; /* of the active segment being indexed */
+	uint32_t block_entry; /* first entry of that block */
+	uint16_t block_slots[1024]; /* DevAddr hash -> entry - block_entry + 1 */
+};
+#else
+struct ulog {
+	int unused;
+};
+#endif
+
+// Open the log in 'dir', created if it does not exist, 'options' NULL for the defaults
+int32_t ulog_open(struct ulog *log, const char *dir, const struct ulog_options *options);
+void ulog_close(struct ulog *log);
+
+// Copy the uplink at the end of the log (uplink->seq is ignored), its seq is returned in 'seq'
+int32_t ulog_append(struct ulog *log, const struct ulog_uplink *uplink, uint64_t *seq);
+
+// Write and sync the records appended so far, 'seq' gets the last seq committed
+int32_t ulog_commit(struct ulog *log, uint64_t *seq);
+
+// Visit the committed uplinks from 'from_seq' on in seq order, at most 'max'
+int32_t ulog_read(struct ulog *log, uint64_t from_seq, uint32_t max, ulog_visitor visit, void *ctx);
+
+// Visit the committed uplinks of 'dev_addr' with from_ms <= time_ms < to_ms, in seq order
+int32_t ulog_scan(struct ulog *log, uint32_t dev_addr, uint64_t from_ms, uint64_t to_ms, ulog_visitor visit, void *ctx);
+
+// Delete the sealed segments older than the retention unless they hold seq >= keep_seq,
+// and merge the runs of small sealed segments
+int32_t ulog_maintain(struct ulog *log, uint64_t now_ms, uint64_t keep_seq);
+
+// Wall clock in ms, the time_ms of the uplinks
+uint64_t ulog_now_ms(void);
+
+#endif /* ULOG_H */
@@ -0,0 +1,43 @@
+{
+  "targets": [
+    {
+      "target_name": "asconmac",
+      "sources": [
+        "asconmacav12/napi/asconmac_addon.c",
+        "asconmacav12/codec/codec.c",
+        "asconmacav12/hist/hist.c",
+        "asconmacav12/loramac/loramac.c",
+        "asconmacav12/ref/prf.c",
+        "asconmacav12/ref/prf_xn.c",
+        "asconmacav12/avx2/prf_x4.c",
+        "asconmacav12/avx512/prf_x8.c",
+        "asconmacav12/ref/printstate.c",
+        "asconmacav12/aes/aes.c",
+        "asconmacav12/aes/aes_ni.c",
+        "asconmacav12/aes/aes_ct.c",
+        "asconmacav12/session/session_table.c",
+        "asconmacav12/dedup/dedup.c",
+        "asconmacav12/rxpk/rxpk.c",
+        "asconmacav12/ulog/ulog.c",
+        "asconmacav12/base64/base64.c",
+        "asconmacav12/base64/base64_simd.c"
+      ],
+      "include_dirs": [
+        "asconmacav12/codec",
+        "asconmacav12/hist",
+        "asconmacav12/loramac",
+        "asconmacav12/ref",
+        "asconmacav12/avx2",
+        "asconmacav12/avx512",
+        "asconmacav12/aes",
+        "asconmacav12/session",
+        "asconmacav12/dedup",
+        "asconmacav12/rxpk",
+        "asconmacav12/ulog",
+        "asconmacav12/base64",
+        "asconmacav12/interface"
+      ],
+      "cflags_c": ["-std=c99", "-O2"]
+    }
+  ]
+}
@@ -15,15 +15,53 @@ import { dirname } from 'path'
 import { spawn } from 'child_process'
 
 import {
+  appendLoraUplinks,
   decryptLoraRawData,
   decryptLoraRawDataAsconMac,
+  decryptLoraRawDataAsconMacBatch,
+  decryptLoraRawDataAsconMacTable,
+  dedupLoraFrames,
+  enableLoraStageTimers,
   encryptLoraDataAsconMac,
+  encryptLoraDataAsconMacTable,
+  getAsconMacCommand,
+  getLoraCoreCounters,
+  getLoraFrame,
+  getLoraStageHistograms,
+  getLoraStageSnapshot,
+  loadLoraSession,
+  LORA_STAGE,
+  loraDecodeCounters,
+  maintainLoraUplinkLog,
+  openLoraDedup,
+  openLoraSessionTable,
+  openLoraUplinkLog,
+  parseLoraPushData,
+  putLoraSession,
+  readLoraUplinkLog,
+  recordLoraStage,
 } from './lorawan.js'
+import {
+  METRICS_CONTENT_TYPE,
+  registerMetric,
+  renderMetrics,
+} from './metrics.js'
+import {
+  createFileBackend,
+  createFirestoreBackend,
+  createUplinkPersistence,
+  startLogReplication,
+} from './persistence.js'
+import {
+  createReliabilityTracker,
+  writeReliabilityReport,
+} from './reltrack.js'
 
 // Import the functions you need from the SDKs you need
 import { initializeApp } from 'firebase/app'
 import {
   getFirestore,
+  connectFirestoreEmulator,
   doc,
   collection,
   setDoc,
@@ -55,10 +93,21 @@ const firebaseConfig = {
 const firebaseApp = initializeApp(firebaseConfig)
 const firebaseAuth = getAuth(firebaseApp)
 const firebaseDb = getFirestore(firebaseApp)
+if (process.env.FIRESTORE_EMULATOR_HOST) {
+  // host:port of the local emulator (firebase emulators:start)
+  const [host, port] = process.env.FIRESTORE_EMULATOR_HOST.split(':')
+  connectFirestoreEmulator(firebaseDb, host, parseInt(port, 10))
+}
 
 const sensorDevColl = 'sensorDevCollection'
 
 const SERVER_PORT = 1700
+// 'native' to receive the packet forwarder datagrams with 'asconmacav12/out
+// --udpfe' (one socket per core) instead of the dgram socket below, 'uring'
+// for the same with the io_uring receive loop, Linux only
+const UDP_FRONTEND_NATIVE =
+  ['native', 'uring'].includes(process.env.UDP_FRONTEND) &&
+  process.platform === 'linux'
 
 const UDP_PACKET_PROTOCOL_VERSION_OFFSET = 0
 const UDP_PACKET_RANDOM_TOKEN_OFFSET = 1
@@ -92,6 +141,81 @@ const FPORT_APP = {
   TEMP_HUMI_SENSOR: 0x01,
 }
 
+// Sessions kept by the addon in a file mapped table (SESSION_TABLE_PATH), the
+// uplinks are then matched to their device natively from the raw DevAddr
+const SESSION_TABLE_ENABLED = openLoraSessionTable(
+  process.env.SESSION_TABLE_PATH || 'sessions.tbl'
+)
+
+// Copies of an uplink heard by several gateways are collapsed before any
+// crypto runs. A frame is remembered DEDUP_WINDOW_MS and its first copy is
+// held DEDUP_HOLD_MS to collect the RSSI/LSNR of the other gateways.
+const DEDUP_WINDOW_MS = parseInt(process.env.DEDUP_WINDOW_MS ?? '1000', 10)
+const DEDUP_HOLD_MS = Math.min(
+  parseInt(process.env.DEDUP_HOLD_MS ?? '200', 10),
+  DEDUP_WINDOW_MS
+)
+const DEDUP_ENABLED = openLoraDedup(DEDUP_WINDOW_MS)
+const heldUplinks = new Map() // dedup key -> { rxpk, deadline }
+let heldUplinksTimer = null
+
+// Per-stage latency histograms of the decode pipeline (base64 decode, frame
+// parse, session lookup, MIC, decrypt, output, persistence), STAGE_TIMERS=0
+// turns them off. Their p50/p99/p999 are logged every STAGE_REPORT_MS.
+const STAGE_TIMERS_ENABLED = enableLoraStageTimers(
+  process.env.STAGE_TIMERS !== '0'
+)
+const STAGE_REPORT_MS = parseInt(process.env.STAGE_REPORT_MS ?? '60000', 10)
+
+// Decoded uplinks are written in batches (persistence.js), to Firestore or,
+// with PERSIST_FILE set, to a JSON lines file standing in for it
+const uplinkPersistence = createUplinkPersistence(
+  process.env.PERSIST_FILE
+    ? createFileBackend(process.env.PERSIST_FILE)
+    : createFirestoreBackend(firebaseDb),
+  {
+    batchMax: parseInt(process.env.PERSIST_BATCH_MAX ?? '400', 10),
+    flushMs: parseInt(process.env.PERSIST_FLUSH_MS ?? '1000', 10),
+    inFlightMax: parseInt(process.env.PERSIST_IN_FLIGHT_MAX ?? '4', 10),
+    // The persistence stage is timed per batch write, unless the uplink log
+    // below is the primary sink
+    onCommit: (start) =>
+      UPLINK_LOG_ENABLED || recordLoraStage(LORA_STAGE.PERSIST, start),
+  }
+)
+
+// Decoded uplinks are first appended to a log on the local disk
+// (UPLINK_LOG_DIR, UPLINK_LOG=0 turns it off), the store above is a replica
+// fed from the log. Segments are sealed at UPLINK_LOG_SEGMENT_MB or after
+// UPLINK_LOG_SEGMENT_MS, and deleted UPLINK_LOG_RETENTION_MS after their last
+// uplink once replicated.
+const UPLINK_LOG_DIR = process.env.UPLINK_LOG_DIR || 'uplinks'
+const UPLINK_LOG_ENABLED =
+  process.env.UPLINK_LOG !== '0' &&
+  openLoraUplinkLog(UPLINK_LOG_DIR, {
+    segmentMax:
+      parseInt(process.env.UPLINK_LOG_SEGMENT_MB ?? '64', 10) * 1024 * 1024,
+    segmentMs: parseInt(process.env.UPLINK_LOG_SEGMENT_MS ?? '3600000', 10),
+    retentionMs: parseInt(
+      process.env.UPLINK_LOG_RETENTION_MS ?? `${30 * 24 * 3600 * 1000}`,
+      10
+    ),
+  })
+const UPLINK_LOG_MAINTAIN_MS = 60000
+let uplinkLogSeq = 0 // Last seq on disk
+
+// Counters of the metrics served on GET /metrics, only read when scraped
+const gatewayDatagrams = new Map() // gateway EUI -> { packet type: count }
+const acksSent = { PUSH_ACK: 0, PULL_ACK: 0 }
+const duplicatesDropped = { merged: 0, late: 0 }
+let uplinksInProgress = 0
+let udpFrontEndBacklog = 0 // Bytes of the native front end not parsed yet
+// Upper bounds (us) of the stage latency buckets
+const STAGE_METRIC_BUCKETS_US = [
+  1, 2.5, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+  100000, 250000, 1000000,
+]
+
 let udpPktFwdState = UDP_PKT_FWD_STATES.IDLE
 let PULL_DATA_RECEIVED = false
 let GW_PORT
@@ -105,6 +229,8 @@ try {
   devicesInfoQuerySnapshot.forEach((doc) => {
     const data = doc.data()
     devicesInfo.set(doc.id, [data.appskey, data.nwkskey, 0]) // Data = [appskey, nwkskey, downlink_count]
+    loadLoraSession(data.nwkskey, data.appskey)
+    putLoraSession(doc.id, data.nwkskey, data.appskey)
   })
   console.log('Available devices on startup', devicesInfo)
 } catch (error) {
@@ -175,6 +301,8 @@ app.post('/admin/create-new-device', async (req, res) => {
 
     // Add devices to local Map
     devicesInfo.set(devaddr, [appskey, nwkskey, 0]) // Data = [appskey, nwkskey, downlink_count]
+    loadLoraSession(nwkskey, appskey)
+    putLoraSession(devaddr, nwkskey, appskey)
 
     // Add document to sensorDevCollection using setDoc
     await setDoc(doc(firebaseDb, sensorDevColl, devaddr), deviceData)
@@ -232,32 +360,51 @@ app.get('/admin/list-devices', async (req, res) => {
   }
 })
 
-let mostRecentDevice = []
+// Devices under test, see reltrack.js
+const reliabilityTracker = createReliabilityTracker()
+const RELIABILITY_REPORT_DIR = process.env.RELIABILITY_REPORT_DIR || 'reports'
+
+// @retval DevAddrs of the 'devaddr' query parameter (comma separated), all
+// the devices under test without it
+const reliabilityDevAddrs = (req) =>
+  req.query.devaddr
+    ? String(req.query.devaddr).split(',').filter(Boolean)
+    : reliabilityTracker.devAddrs()
 
+// Start the test of the devices of ?devaddr=<DevAddr>,..., of every device
+// seen today with ?all=1, of the most recent one otherwise
 app.get('/admin/reliability-test-start', async (req, res) => {
   let isError = false
   try {
     if (!ADMIN_LOGGED_IN) {
       throw new Error('User has not logged in')
     }
-    const date = new Date()
-    const dateString = date.toDateString().replaceAll(' ', '')
-    const sensorDevMetaColl = 'sensorMetadataCollection' + dateString
+    let devAddrs = []
+    if (req.query.devaddr) {
+      devAddrs = reliabilityDevAddrs(req)
+    } else {
+      const date = new Date()
+      const dateString = date.toDateString().replaceAll(' ', '')
+      const sensorDevMetaColl = 'sensorMetadataCollection' + dateString
 
-    const devicesMetadataQuerySnapshot = await getDocs(
-      collection(firebaseDb, sensorDevMetaColl)
-    )
-    console.log('Run reliability test, finding most recent device...')
-    let mostRecentDeviceTimestamp = 0
-    devicesMetadataQuerySnapshot.forEach((doc) => {
-      const data = doc.data()
-      if (mostRecentDeviceTimestamp < data.time_ms) {
-        mostRecentDeviceTimestamp = data.time_ms
-        mostRecentDevice = [doc.id, data, [], [], [], [], []]
-      }
-    })
-    if (mostRecentDevice.length > 0) {
-      console.log('Found:', mostRecentDevice[0])
+      const devicesMetadataQuerySnapshot = await getDocs(
+        collection(firebaseDb, sensorDevMetaColl)
+      )
+      console.log('Run reliability test, finding most recent device...')
+      let mostRecentDeviceTimestamp = 0
+      devicesMetadataQuerySnapshot.forEach((doc) => {
+        const data = doc.data()
+        if (req.query.all) {
+          devAddrs.push(doc.id)
+        } else if (mostRecentDeviceTimestamp < data.time_ms) {
+          mostRecentDeviceTimestamp = data.time_ms
+          devAddrs = [doc.id]
+        }
+      })
+    }
+    if (devAddrs.length > 0) {
+      devAddrs.forEach((devAddr) => reliabilityTracker.start(devAddr))
+      console.log('Found:', devAddrs.join(', '))
     } else {
       throw new Error('Cannot found a running device')
     }
@@ -278,36 +425,45 @@ app.get('/admin/reliability-test-start', async (req, res) => {
                           </html>`)
 })
 
-const findMissingPackages = (arr) => {
-  // Check if array is empty or undefined
-  if (!arr || arr.length === 0) {
-    return []
-  }
-
-  let offset = arr[0]
-  for (let i = 0; i < arr.length; i++) {
-    arr[i] += 1 - offset
+// Stats of the devices under test so far, with their missing FCnt runs when
+// a single device is asked for
+app.get('/admin/reliability-test-status', (req, res) => {
+  if (!ADMIN_LOGGED_IN) {
+    res.status(401).send('Unauthorized access')
+    return
   }
-
-  // Get the maximum number to know the full range
-  const maxNum = Math.max(...arr)
-
-  // Create a Set for O(1) lookup
-  const numSet = new Set(arr)
-
-  // Array to store missing numbers
-  const missing = []
-
-  // Check each number from 1 to maxNum
-  for (let i = 1; i <= maxNum; i++) {
-    if (!numSet.has(i)) {
-      missing.push(i)
-    }
+  const devAddrs = reliabilityDevAddrs(req)
+  const devices = devAddrs
+    .map((devAddr) => reliabilityTracker.stats(devAddr))
+    .filter(Boolean)
+  if (devices.length === 1) {
+    devices[0].gapRuns = reliabilityTracker.gaps(devices[0].devAddr)
   }
+  res.status(200).json(devices)
+})
 
-  return missing
+const logReliabilitySummary = (stats) => {
+  console.log('====================== TEST SUMMARY ======================')
+  console.log('Device:', stats.devAddr)
+  console.log('Total package sent:', stats.received)
+  console.log('Total failed package:', stats.failures)
+  console.log('Total missing package:', stats.missing)
+  console.log('Loss:', `${(stats.loss * 100).toFixed(3)}%`)
+  console.log('Missing runs:', stats.gaps, 'longest:', stats.longestGap)
+  console.log('Average LSNR:', stats.lsnr.mean, 'std:', stats.lsnr.std)
+  console.log('Average RSSI:', stats.rssi.mean, 'std:', stats.rssi.std)
+  console.log(
+    'Average encryption time (us):',
+    stats.encUs.mean,
+    'std:',
+    stats.encUs.std
+  )
 }
 
+// End the test of the devices of ?devaddr=<DevAddr>,..., of all of them
+// otherwise. reltest.py --report renders the plots and the summary table of
+// the devices to RELIABILITY_REPORT_DIR/<time>, ?plot=1 opens the former
+// interactive plot instead when a single device ends
 app.get('/admin/reliability-test-end', async (req, res) => {
   let isError = false
   try {
@@ -315,45 +471,66 @@ app.get('/admin/reliability-test-end', async (req, res) => {
       throw new Error('User has not logged in')
     }
     console.log('End reliability test, find device under test...')
-    const missedPackage = findMissingPackages(mostRecentDevice[4])
-    if (mostRecentDevice.length >= 1) {
-      console.log('====================== TEST SUMMARY ======================')
-      console.log('Total package sent:', mostRecentDevice[3].length)
-      console.log('Total failed package:', mostRecentDevice[2].length)
-      console.log('Total missing package:', missedPackage.length)
-      console.log(
-        'Average LSNR:',
-        mostRecentDevice[5].reduce((a, b) => a + b, 0) /
-          mostRecentDevice[5].length
-      )
-      console.log(
-        'Average RSSI:',
-        mostRecentDevice[6].reduce((a, b) => a + b, 0) /
-          mostRecentDevice[6].length
-      )
-    } else {
+    const devAddrs = reliabilityDevAddrs(req).filter((devAddr) =>
+      reliabilityTracker.has(devAddr)
+    )
+    if (devAddrs.length === 0) {
       throw new Error('Cannot found device under test')
     }
-    // Start python plot
-    const py = spawn('python', ['reltest.py'])
-    py.stdin.write(
-      JSON.stringify([
-        mostRecentDevice[3],
-        mostRecentDevice[2],
-        missedPackage,
-        mostRecentDevice[5],
-        mostRecentDevice[6],
-      ])
+    // Read before stop(), the device is dropped with its samples
+    const reports = devAddrs.map((devAddr) =>
+      reliabilityTracker.report(devAddr)
     )
-    py.stdout.on('data', (data) => {
-      console.log(data.toString())
-    })
-    py.stdin.end()
+    devAddrs.forEach((devAddr) =>
+      logReliabilitySummary(reliabilityTracker.stop(devAddr))
+    )
+    if (req.query.plot && reports.length === 1 && reports[0].samples) {
+      const { gaps, samples } = reports[0]
+      const missedPackage = []
+      for (let i = 0; i < gaps.length; i += 2) {
+        for (let j = 0; j < gaps[i + 1]; j++) {
+          missedPackage.push(gaps[i] + j)
+        }
+      }
+      // Start python plot
+      const py = spawn('python', ['reltest.py'])
+      py.stdin.write(
+        JSON.stringify([
+          Array.from(samples.encUs),
+          Array.from(samples.failures),
+          missedPackage,
+          Array.from(samples.lsnr),
+          Array.from(samples.rssi),
+        ])
+      )
+      py.stdout.on('data', (data) => {
+        console.log(data.toString())
+      })
+      py.stdin.end()
+    } else {
+      const out = path.join(
+        RELIABILITY_REPORT_DIR,
+        new Date().toISOString().replaceAll(':', '-')
+      )
+      const py = spawn('python', ['reltest.py', '--report', '-', '--out', out])
+      py.stdout.on('data', (data) => {
+        console.log(data.toString())
+      })
+      py.stderr.on('data', (data) => {
+        console.error('[ERROR] reltest.py:', data.toString())
+      })
+      py.on('error', (error) => {
+        console.error('[ERROR] reltest.py:', error.message)
+      })
+      py.stdin.on('error', () => {}) // Reported by 'error' or on stderr
+      await writeReliabilityReport(py.stdin, reports)
+      py.stdin.end()
+      console.log('Reliability report:', out)
+    }
   } catch (error) {
     console.error('[ERROR] Reliability end :', error.message)
     isError = true
   }
-  mostRecentDevice = []
   // Return result
   res.status(200).send(`<!DOCTYPE html>
                           <html>
@@ -380,15 +557,26 @@ app.post('/client/downlink', async (req, res) => {
     if (!devicesInfo.has(devaddr)) {
       throw new Error('Undefined device address')
     }
-    const [appskey, nwkskey, downLinkCounter] = devicesInfo.get(devaddr)
-    const dataString = await encryptLoraDataAsconMac(
-      data,
-      nwkskey,
-      appskey,
-      devaddr,
-      downLinkCounter,
-      200
-    )
+    const [appskey, nwkskey] = devicesInfo.get(devaddr)
+    let downLinkCounter = devicesInfo.get(devaddr)[2]
+    let dataString
+    if (SESSION_TABLE_ENABLED) {
+      // The table keeps the downlink counter across restarts
+      ;[dataString, downLinkCounter] = encryptLoraDataAsconMacTable(
+        data,
+        devaddr,
+        200
+      )
+    } else {
+      dataString = await encryptLoraDataAsconMac(
+        data,
+        nwkskey,
+        appskey,
+        devaddr,
+        downLinkCounter,
+        200
+      )
+    }
     const dataBuffer = Buffer.from(dataString, 'hex')
     const dataBase64 = dataBuffer.toString('base64')
     // Generate random token
@@ -405,7 +593,7 @@ app.post('/client/downlink', async (req, res) => {
     // Update F_CNT for downlink
     devicesInfo.set(devaddr, [appskey, nwkskey, downLinkCounter + 1])
     // Send data to gateway
-    server.send(msg, GW_PORT, GW_ADDR)
+    sendToGateway(msg, GW_PORT, GW_ADDR)
     console.log('Downlink device', devaddr)
     console.log('Downlink random token:', randomToken)
     console.log('Downlink f_cnt:', downLinkCounter + 1)
@@ -417,6 +605,11 @@ app.post('/client/downlink', async (req, res) => {
   }
 })
 
+// Prometheus scrape endpoint
+app.get('/metrics', (req, res) => {
+  res.type(METRICS_CONTENT_TYPE).send(renderMetrics())
+})
+
 // Start express server
 app.listen(appPort, () => {
   console.log(`Example app listening on port ${appPort}`)
@@ -424,6 +617,32 @@ app.listen(appPort, () => {
 
 const server = dgram.createSocket('udp4')
 
+// @param type Byte of the packet type
+// @retval Name of the UDP_PACKET_TYPE member, UNKNOWN if none
+const udpPacketTypeName = (type) =>
+  Object.keys(UDP_PACKET_TYPE).find(
+    (name) => UDP_PACKET_TYPE[name] === type
+  ) ?? 'UNKNOWN'
+
+// Count a datagram of a gateway for the metrics
+// @param msg The datagram Buffer
+const countDatagram = (msg) => {
+  const gateway =
+    msg.length >= UDP_PACKET_JSON_OBJ_OFFSET
+      ? msg
+          .subarray(UDP_PACKET_GATEWAY_UID_OFFSET, UDP_PACKET_JSON_OBJ_OFFSET)
+          .toString('hex')
+          .toUpperCase()
+      : 'unknown'
+  const type = udpPacketTypeName(msg[UDP_PACKET_TYPE_OFFSET])
+  let counts = gatewayDatagrams.get(gateway)
+  if (!counts) {
+    counts = {}
+    gatewayDatagrams.set(gateway, counts)
+  }
+  counts[type] = (counts[type] ?? 0) + 1
+}
+
 // @param packetType UDP_PACKET_TYPE object member
 // @param randomToken The token received from client (2 bytes)
 // @param port The client UDP opened port
@@ -432,13 +651,101 @@ const sendServerAck = (packetType, randomToken, port, address) => {
   // 0x02 protocol version
   const msg = Buffer.from([0x02, ...randomToken, packetType])
   server.send(msg, port, address)
+  acksSent[udpPacketTypeName(packetType)]++
   console.log('Sending ACK:')
   console.log(msg)
 }
 
+// Native front end process, it acknowledges PUSH_DATA/PULL_DATA by itself
+// and forwards the datagrams on stdout
+let udpFrontEnd = null
+
+// @param msg The datagram Buffer
+// @param port The gateway UDP opened port
+// @param address The gateway IPv4 address
+const sendToGateway = (msg, port, address) => {
+  if (!udpFrontEnd) {
+    server.send(msg, port, address)
+    return
+  }
+  // Downlink = [LEN (4 bytes, LE)][ADDR (4 bytes)][PORT (2 bytes, LE)][DATAGRAM]
+  const header = Buffer.alloc(10)
+  header.writeUInt32LE(6 + msg.length, 0)
+  Buffer.from(address.split('.').map(Number)).copy(header, 4)
+  header.writeUInt16LE(port, 8)
+  udpFrontEnd.stdin.write(Buffer.concat([header, msg]))
+}
+
+// The front end is spawned again when it dies, after UDP_FRONTEND_RESPAWN_MS
+// doubled on every crash up to UDP_FRONTEND_RESPAWN_MAX_MS, and from
+// UDP_FRONTEND_RESPAWN_MS again once it ran UDP_FRONTEND_RESPAWN_MAX_MS
+const UDP_FRONTEND_RESPAWN_MS = 1000
+const UDP_FRONTEND_RESPAWN_MAX_MS = 30000
+let udpFrontEndRespawnMs = UDP_FRONTEND_RESPAWN_MS
+
+const startUdpFrontEnd = () => {
+  const startMs = Date.now()
+  const args = ['--udpfe', `${SERVER_PORT}`]
+  if (process.env.UDP_FRONTEND === 'uring') {
+    args.push('0', 'uring')
+  }
+  udpFrontEnd = spawn(getAsconMacCommand(), args)
+  let rx = Buffer.alloc(0)
+  udpFrontEnd.stdout.on('data', (chunk) => {
+    rx = rx.length ? Buffer.concat([rx, chunk]) : chunk
+    // Event = [LEN (4 bytes, LE)][TYPE][ADDR (4 bytes)][PORT (2 bytes, LE)][DATAGRAM]
+    while (rx.length >= 4) {
+      const size = rx.readUInt32LE(0)
+      if (rx.length < 4 + size) {
+        break
+      }
+      const type = rx[4]
+      const address = `${rx[5]}.${rx[6]}.${rx[7]}.${rx[8]}`
+      const port = rx.readUInt16LE(9)
+      const msg = rx.subarray(11, 4 + size)
+      rx = rx.subarray(4 + size)
+      countDatagram(msg)
+      // Both have already been acknowledged by the front end
+      if (type == UDP_PACKET_TYPE.PUSH_DATA) {
+        acksSent.PUSH_ACK++
+        networkServerProcessData(UDP_PKT_FWD_STATES.UPSTREAM, msg)
+      } else if (type == UDP_PACKET_TYPE.PULL_DATA) {
+        acksSent.PULL_ACK++
+        PULL_DATA_RECEIVED = true
+        GW_ADDR = address
+        GW_PORT = port
+        networkServerProcessData(UDP_PKT_FWD_STATES.DOWNSTREAM, msg)
+      }
+    }
+    udpFrontEndBacklog = rx.length
+  })
+  udpFrontEnd.stdin.on('error', () => {})
+  udpFrontEnd.on('error', (error) => {
+    console.error('[ERROR] UDP front end:', error.message)
+  })
+  // After an exit or a failed spawn, nothing is received until it is back
+  udpFrontEnd.on('close', (code) => {
+    if (Date.now() - startMs >= UDP_FRONTEND_RESPAWN_MAX_MS) {
+      udpFrontEndRespawnMs = UDP_FRONTEND_RESPAWN_MS
+    }
+    console.error(
+      `[ERROR] UDP front end exited with code ${code}, restarted in`,
+      udpFrontEndRespawnMs,
+      'ms'
+    )
+    setTimeout(startUdpFrontEnd, udpFrontEndRespawnMs)
+    udpFrontEndRespawnMs = Math.min(
+      udpFrontEndRespawnMs * 2,
+      UDP_FRONTEND_RESPAWN_MAX_MS
+    )
+  })
+  console.log(`Native UDP front end listening on port ${SERVER_PORT}`)
+}
+
 // Main entry of UDP package
 server.on('message', (msg, rinfo) => {
   console.log('\nUDP package received')
+  countDatagram(msg)
 
   if (udpPktFwdState == UDP_PKT_FWD_STATES.IDLE) {
     // If current state is IDLE and receive new packet, we check if it's upstream or downstream
@@ -496,23 +803,52 @@ const networkServerProcessData = async (state, buff) => {
   console.log('Process LoRa package..')
   try {
     if (state == UDP_PKT_FWD_STATES.UPSTREAM) {
-      const jsonObject = pushDataBuffToJsonObject(buff)
-      console.log(jsonObject)
-      if (!jsonObject.rxpk) {
+      const rxpks = parseLoraPushData(buff.subarray(UDP_PACKET_JSON_OBJ_OFFSET))
+      console.log(rxpks)
+      if (!rxpks) {
+        return
+      }
+      if (DEDUP_ENABLED) {
+        const gateway = buff
+          .subarray(UDP_PACKET_GATEWAY_UID_OFFSET, UDP_PACKET_JSON_OBJ_OFFSET)
+          .toString('hex')
+          .toUpperCase()
+        holdUplinks(rxpks, gateway)
         return
       }
-      // rxpk may contain multiple RF package
-      // so we loop through to check
-      for (let i = 0; i < jsonObject.rxpk.length; i++) {
-        const startTimer = Date.now()
-        console.log('###### Decrypt package, start time in ms:', startTimer)
-        // Create a buffer from the string
-        const loraPktBase64 = jsonObject.rxpk[i].data
-        const loraPktBuf = Buffer.from(loraPktBase64, 'base64')
+      await processUplinks(rxpks)
+    } else if ((state = UDP_PKT_FWD_STATES.DOWNSTREAM)) {
+      console.log('No support for downstream data processing yet')
+    } else {
+      console.log('Unknown packet forwarder state for data processing')
+    }
+  } catch (error) {
+    console.error('[ERROR] Process data:', error.message)
+  }
+}
+
+// @param rxpks Array of rxpk objects of PUSH_DATA, decrypted in a single batch
+const processUplinks = async (rxpks) => {
+  uplinksInProgress += rxpks.length
+  try {
+    // rxpk may contain multiple RF package, find the device of every
+    // package first and then decrypt all of them in a single batch
+    let packages = []
+    if (SESSION_TABLE_ENABLED) {
+      // The device is found by the addon from the DevAddr of the frame
+      rxpks.forEach((rxpk) =>
+        packages.push({ rxpk, frame: getLoraFrame(rxpk) })
+      )
+    } else {
+      for (let i = 0; i < rxpks.length; i++) {
+        // Raw frame, decoded from the Base64 string unless the parser did
+        const loraPktBuf = getLoraFrame(rxpks[i])
         // Turn to hex string
         const loraPktHex = loraPktBuf.toString('hex')
         // Get LoRa node address
-        let loraNodeAddressLittleEndian = loraPktHex.slice(2, 10).toUpperCase()
+        let loraNodeAddressLittleEndian = loraPktHex
+          .slice(2, 10)
+          .toUpperCase()
         if (loraNodeAddressLittleEndian.length % 2 !== 0) {
           throw new Error('Hex string must have an even length')
         }
@@ -524,155 +860,432 @@ const networkServerProcessData = async (state, buff) => {
         // Reverse the bytes to convert from little-endian to big-endian
         const loraNodeAddress = bytes.reverse().join('')
         if (!devicesInfo.has(loraNodeAddress)) {
-          throw new Error(`Unknown device address ${loraNodeAddress}`)
-        }
-        const [appskey, nwkskey, downLinkCounter] =
-          devicesInfo.get(loraNodeAddress)
-        const [data, packet] = await decryptLoraRawDataAsconMac(
-          jsonObject.rxpk[i].data,
-          nwkskey,
-          appskey
-        )
-        const endTimer = Date.now()
-        console.log('###### Finish, end time in ms:', endTimer)
-        console.log('Time elapsed in ms:', endTimer - startTimer)
-        const date = new Date()
-        const dateString = date.toDateString().replaceAll(' ', '')
-        const sensorDevMetaColl = 'sensorMetadataCollection' + dateString
-        if (data == null) {
-          console.log(`Failed to decrypt package inst ${i}`)
-          // If test enabled, save failed package count
-          if (
-            mostRecentDevice.length >= 1 &&
-            mostRecentDevice[0] === loraNodeAddress
-          ) {
-            mostRecentDevice[2].push(mostRecentDevice[3].length + 1)
-          }
-          // Check next package
+          console.error(`[ERROR] Unknown device address ${loraNodeAddress}`)
+          // Counted here, the decoders only see the known devices
+          loraDecodeCounters.unknownDevices++
           continue
         }
+        const [appskey, nwkskey] = devicesInfo.get(loraNodeAddress)
+        packages.push({
+          rxpk: rxpks[i],
+          loraNodeAddress,
+          data: rxpks[i].data,
+          frame: loraPktBuf,
+          nwkskey,
+          appskey,
+        })
+      }
+    }
+    const startTimer = Date.now()
+    console.log('###### Decrypt packages, start time in ms:', startTimer)
+    let decrypted
+    if (SESSION_TABLE_ENABLED) {
+      decrypted = await decryptLoraRawDataAsconMacTable(packages)
+      decrypted.forEach((result, i) => {
+        packages[i].loraNodeAddress = result[2]
+      })
+      // Unknown devices are skipped like above
+      packages = packages.filter((pkg, i) => decrypted[i][2] !== null)
+      decrypted = decrypted.filter((result) => result[2] !== null)
+    } else {
+      decrypted = await decryptLoraRawDataAsconMacBatch(packages)
+    }
+    const endTimer = Date.now()
+    console.log('###### Finish, end time in ms:', endTimer)
+    console.log('Time elapsed in ms:', endTimer - startTimer)
+    const logUplinks = []
+    for (let i = 0; i < packages.length; i++) {
+      const { rxpk, loraNodeAddress } = packages[i]
+      const [data, packet] = decrypted[i]
+      const date = new Date()
+      const dateString = date.toDateString().replaceAll(' ', '')
+      const sensorDevMetaColl = 'sensorMetadataCollection' + dateString
+      if (data == null) {
+        console.log(`Failed to decrypt package inst ${i}`)
+        // If test enabled, save failed package count
+        reliabilityTracker.recordFailure(loraNodeAddress)
+        // Check next package
+        continue
+      }
 
-        console.log(`RF captured data inst ${i}:`)
-        console.log(
-          'Actual time elapsed in microsec:',
-          data[ASCON_MAC_DATA_OFFSET.TIME_ELAPSED].readUInt32BE(0)
-        )
-        console.log('DevAddress:', data[ASCON_MAC_DATA_OFFSET.DEV_ADDR])
-        console.log('FPort:', data[ASCON_MAC_DATA_OFFSET.FPORT])
-        console.log('MHDR:', data[ASCON_MAC_DATA_OFFSET.MHDR])
-        console.log('FCnt:', data[ASCON_MAC_DATA_OFFSET.FCNT])
-        const data_packet = []
-        const fport = data[ASCON_MAC_DATA_OFFSET.FPORT].readInt8()
-        data_packet.push(...data[ASCON_MAC_DATA_OFFSET.PAYLOAD])
-        const sensorDoc = {
-          time_ms: Date.now(),
-          fport: fport,
-          dev_addr: loraNodeAddress,
-          data: data_packet,
-          data_size: data_packet.length,
-        }
-        // If test enabled, don't write to db
-        if (
-          mostRecentDevice.length >= 1 &&
-          mostRecentDevice[0] === loraNodeAddress
-        ) {
-          if (data_packet.length < 5) {
-            throw new Error(
-              `[Test] Message size of ${data_packet.length} is invalid, the correct size is 5`
-            )
-          }
-          // The upper two bytes are zero, format to test
-          if (data_packet[4] == 0) {
-            // Write time_elapsed of encryption process on MCU to local storage
-            mostRecentDevice[3].push(
-              (data_packet[2] << 16) | (data_packet[1] << 8) | data_packet[0]
-            )
-            const fcntByte = data[ASCON_MAC_DATA_OFFSET.FCNT]
-            mostRecentDevice[4].push((fcntByte[0] << 8) | fcntByte[1])
-            mostRecentDevice[5].push(jsonObject.rxpk[i].lsnr)
-            mostRecentDevice[6].push(jsonObject.rxpk[i].rssi)
-          } else {
-            // Received invalid format, alert the user
-            console.log(
-              '[Test] Received incorrect test format or different device address',
-              data_packet,
-              loraNodeAddress
-            )
-          }
-          console.log(
-            '[Test] Store info to local storage success, encrypted data size tested:',
-            data_packet[3]
+      console.log(`RF captured data inst ${i}:`)
+      console.log(
+        'Actual time elapsed in microsec:',
+        data[ASCON_MAC_DATA_OFFSET.TIME_ELAPSED].readUInt32BE(0)
+      )
+      console.log('DevAddress:', data[ASCON_MAC_DATA_OFFSET.DEV_ADDR])
+      console.log('FPort:', data[ASCON_MAC_DATA_OFFSET.FPORT])
+      console.log('MHDR:', data[ASCON_MAC_DATA_OFFSET.MHDR])
+      console.log('FCnt:', data[ASCON_MAC_DATA_OFFSET.FCNT])
+      const data_packet = []
+      const fport = data[ASCON_MAC_DATA_OFFSET.FPORT].readInt8()
+      data_packet.push(...data[ASCON_MAC_DATA_OFFSET.PAYLOAD])
+      const sensorDoc = {
+        time_ms: Date.now(),
+        fport: fport,
+        dev_addr: loraNodeAddress,
+        data: data_packet,
+        data_size: data_packet.length,
+      }
+      if (rxpk.gateways) {
+        // Gateways which heard the uplink, { gateway, rssi, lsnr }
+        sensorDoc.gateways = rxpk.gateways
+      }
+      // If test enabled, don't write to db
+      if (reliabilityTracker.has(loraNodeAddress)) {
+        if (data_packet.length < 5) {
+          // Not a test frame, only this one is dropped: the uplinks of the
+          // batch before and after it still go to the log
+          console.error(
+            `[Test] Message size of ${data_packet.length} is invalid, the correct size is 5`
           )
-          console.log('[Test] Package count:', mostRecentDevice[3].length)
-          // Check next package
+          reliabilityTracker.recordFailure(loraNodeAddress)
           continue
         }
-        // Write to firebase
-        const id = crypto.randomBytes(16).toString('hex')
-        const coll = 'sensorDataCollection' + fport + dateString
-        const docRef = doc(firebaseDb, coll, id)
-        await setDoc(docRef, sensorDoc)
-        console.log('Document written with id and col:', id, coll)
-        // Update device metadata
-        const sensorDevMetadataDoc = {
-          package_count: 1,
-          time_ms: sensorDoc.time_ms,
-        }
-        const devicesMetadataQuerySnapshot = await getDocs(
-          collection(firebaseDb, sensorDevMetaColl)
-        )
-        let pkt_count = 0
-        devicesMetadataQuerySnapshot.forEach((doc) => {
-          const data = doc.data()
-          if (doc.id === loraNodeAddress) {
-            pkt_count = data.package_count
-            console.log('Found matching device metadata')
-          }
-        })
-        // No device
-        if (pkt_count <= 0) {
-          const sensorDevMetadataRef = doc(
-            firebaseDb,
-            sensorDevMetaColl,
-            loraNodeAddress
-          )
-          await setDoc(sensorDevMetadataRef, sensorDevMetadataDoc)
-          console.log(
-            'Create new device metadata with id and col:',
+        // The upper two bytes are zero, format to test
+        if (data_packet[4] == 0) {
+          // Record time_elapsed of encryption process on MCU
+          const fcntByte = data[ASCON_MAC_DATA_OFFSET.FCNT]
+          reliabilityTracker.recordUplink(
             loraNodeAddress,
-            sensorDevMetaColl
+            (fcntByte[0] << 8) | fcntByte[1],
+            (data_packet[2] << 16) | (data_packet[1] << 8) | data_packet[0],
+            rxpk.rssi,
+            rxpk.lsnr
           )
         } else {
-          // Found a device
-          await updateDoc(doc(firebaseDb, sensorDevMetaColl, loraNodeAddress), {
-            package_count: pkt_count + 1,
-            time_ms: sensorDoc.time_ms, // Update timestamp to check most recent active device
-          })
+          // Received invalid format, alert the user
           console.log(
-            'Updated device metadata for doc id and col:',
-            loraNodeAddress,
-            sensorDevMetaColl
+            '[Test] Received incorrect test format or different device address',
+            data_packet,
+            loraNodeAddress
           )
         }
+        console.log(
+          '[Test] Store info to local storage success, encrypted data size tested:',
+          data_packet[3]
+        )
+        console.log(
+          '[Test] Package count:',
+          reliabilityTracker.received(loraNodeAddress)
+        )
+        // Check next package
+        continue
       }
-    } else if ((state = UDP_PKT_FWD_STATES.DOWNSTREAM)) {
-      console.log('No support for downstream data processing yet')
-    } else {
-      console.log('Unknown packet forwarder state for data processing')
+      if (UPLINK_LOG_ENABLED) {
+        logUplinks.push({
+          timeMs: sensorDoc.time_ms,
+          devAddr: parseInt(loraNodeAddress, 16),
+          fCnt: data[ASCON_MAC_DATA_OFFSET.FCNT].readUInt16BE(0),
+          fPort: fport,
+          rssi: rxpk.rssi,
+          lsnr: rxpk.lsnr,
+          payload: data[ASCON_MAC_DATA_OFFSET.PAYLOAD],
+          gateways: rxpk.gateways,
+        })
+        continue
+      }
+      // Queue for the next batched write, the package count of the device
+      // metadata is incremented by the store
+      const id = crypto.randomBytes(16).toString('hex')
+      const coll = 'sensorDataCollection' + fport + dateString
+      await uplinkPersistence.add(coll, id, sensorDoc, {
+        collection: sensorDevMetaColl,
+        id: loraNodeAddress,
+        timeMs: sensorDoc.time_ms,
+      })
+    }
+    if (logUplinks.length) {
+      // One sync for the whole batch and the batches appended meanwhile
+      const persistStart = process.hrtime.bigint()
+      uplinkLogSeq = await appendLoraUplinks(logUplinks)
+      recordLoraStage(LORA_STAGE.PERSIST, persistStart)
     }
   } catch (error) {
-    console.error('[ERROR] Process data:', error.message)
+    console.error('[ERROR] Process uplinks:', error.message)
+  } finally {
+    uplinksInProgress -= rxpks.length
   }
 }
 
-// @param buff The msg Buffer type
-const pushDataBuffToJsonObject = (buff) => {
-  const jsonObjectSize = buff.length - 12 // Ignore the first 12 bytes of upstream PUSH_DATA
-  const jsonObjectBuff = Buffer.alloc(jsonObjectSize)
-  buff.copy(jsonObjectBuff, 0, 12, 12 + jsonObjectSize) // json contents of buff starts at index 12 of PUSH_DATA
-  const jsonObject = JSON.parse(jsonObjectBuff.toString())
+// Keep the first copy of every frame until its hold time is over, the
+// copies of the other gateways only add their metadata to it
+// @param rxpks Array of rxpk objects of PUSH_DATA
+// @param gateway EUI of the gateway which sent them (hex string)
+const holdUplinks = (rxpks, gateway) => {
+  const results = dedupLoraFrames(rxpks.map(getLoraFrame))
+  const now = Date.now()
+  rxpks.forEach((rxpk, i) => {
+    const { key, duplicate } = results[i]
+    const copy = { gateway, rssi: rxpk.rssi, lsnr: rxpk.lsnr }
+    const held = heldUplinks.get(key)
+    if (held) {
+      held.rxpk.gateways.push(copy)
+      duplicatesDropped.merged++
+      return
+    }
+    if (duplicate) {
+      // The surviving copy has already been processed
+      duplicatesDropped.late++
+      console.log('Drop late copy of an uplink from gateway', gateway)
+      return
+    }
+    rxpk.gateways = [copy]
+    heldUplinks.set(key, { rxpk, deadline: now + DEDUP_HOLD_MS })
+  })
+  if (heldUplinks.size && !heldUplinksTimer) {
+    heldUplinksTimer = setTimeout(releaseUplinks, DEDUP_HOLD_MS)
+  }
+}
+
+// Process the held uplinks whose hold time is over, in a single batch
+const releaseUplinks = () => {
+  const now = Date.now()
+  const rxpks = []
+  // Insertion order is the deadline order
+  for (const [key, held] of heldUplinks) {
+    if (held.deadline > now) {
+      break
+    }
+    heldUplinks.delete(key)
+    // Report the best reception, all copies stay in rxpk.gateways
+    const best = held.rxpk.gateways.reduce((a, b) => (b.rssi > a.rssi ? b : a))
+    held.rxpk.rssi = best.rssi
+    held.rxpk.lsnr = best.lsnr
+    rxpks.push(held.rxpk)
+  }
+  heldUplinksTimer = null
+  if (heldUplinks.size) {
+    const { deadline } = heldUplinks.values().next().value
+    heldUplinksTimer = setTimeout(releaseUplinks, Math.max(deadline - now, 0))
+  }
+  if (rxpks.length) {
+    console.log(`Release ${rxpks.length} uplinks after deduplication`)
+    processUplinks(rxpks)
+  }
+}
+
+// Log the latency of every stage timed so far
+const reportStages = () => {
+  const stages = getLoraStageSnapshot().filter(({ count }) => count > 0)
+  if (stages.length === 0) {
+    return
+  }
+  const us = (ns) => (ns / 1000).toFixed(1)
+  console.log('Stage latency (us): stage count p50 p99 p999 max')
+  stages.forEach(({ stage, count, p50, p99, p999, max }) =>
+    console.log(stage, count, us(p50), us(p99), us(p999), us(max))
+  )
+}
+
+if (STAGE_TIMERS_ENABLED && STAGE_REPORT_MS > 0) {
+  setInterval(reportStages, STAGE_REPORT_MS).unref()
+}
+
+registerMetric(
+  'lora_datagrams_received_total',
+  'counter',
+  'Packet forwarder datagrams received per gateway',
+  () =>
+    [...gatewayDatagrams].flatMap(([gateway, counts]) =>
+      Object.entries(counts).map(([type, count]) => [{ gateway, type }, count])
+    )
+)
+registerMetric(
+  'lora_acks_sent_total',
+  'counter',
+  'PUSH_ACK/PULL_ACK sent to the gateways',
+  () => Object.entries(acksSent).map(([type, count]) => [{ type }, count])
+)
+registerMetric(
+  'lora_frames_decoded_total',
+  'counter',
+  'Uplink frames decoded',
+  () => [[{}, loraDecodeCounters.decoded]]
+)
+registerMetric(
+  'lora_mic_failures_total',
+  'counter',
+  'Uplink frames with an invalid MIC',
+  () => [[{}, loraDecodeCounters.micFailures]]
+)
+registerMetric(
+  'lora_unknown_devaddr_total',
+  'counter',
+  'Uplink frames of a DevAddr without session',
+  () => [[{}, loraDecodeCounters.unknownDevices]]
+)
+registerMetric(
+  'lora_frames_failed_total',
+  'counter',
+  'Uplink frames not decoded for another reason',
+  () => [[{}, loraDecodeCounters.failed]]
+)
+registerMetric(
+  'lora_duplicates_dropped_total',
+  'counter',
+  'Copies of an uplink from other gateways, merged while held or late',
+  () =>
+    Object.entries(duplicatesDropped).map(([reason, count]) => [
+      { reason },
+      count,
+    ])
+)
+registerMetric(
+  'lora_uplinks_held',
+  'gauge',
+  'Uplinks held to collect the copies of other gateways',
+  () => [[{}, heldUplinks.size]]
+)
+registerMetric(
+  'lora_uplinks_in_progress',
+  'gauge',
+  'Uplinks being decoded or persisted',
+  () => [[{}, uplinksInProgress]]
+)
+registerMetric(
+  'lora_udp_frontend_backlog_bytes',
+  'gauge',
+  'Bytes of the native UDP front end not parsed yet',
+  () => [[{}, udpFrontEndBacklog]]
+)
+registerMetric(
+  'lora_persist_pending',
+  'gauge',
+  'Uplinks waiting for the next batched write',
+  () => [[{}, uplinkPersistence.stats().pending]]
+)
+registerMetric(
+  'lora_persist_in_flight',
+  'gauge',
+  'Batched writes in flight',
+  () => [[{}, uplinkPersistence.stats().inFlight]]
+)
+registerMetric(
+  'lora_persist_written_total',
+  'counter',
+  'Uplinks written to the store',
+  () => [[{}, uplinkPersistence.stats().written]]
+)
+registerMetric(
+  'lora_persist_failed_total',
+  'counter',
+  'Uplinks of failed writes, retried',
+  () => [[{}, uplinkPersistence.stats().failed]]
+)
+registerMetric(
+  'lora_uplink_log_seq',
+  'gauge',
+  'Last uplink synced to the local log and last one replicated',
+  () =>
+    UPLINK_LOG_ENABLED
+      ? [
+          [{ state: 'synced' }, uplinkLogSeq],
+          [{ state: 'replicated' }, uplinkLogReplication.seq()],
+        ]
+      : []
+)
+registerMetric(
+  'asconmac_stage_duration_seconds',
+  'histogram',
+  'Latency of the stages of the decode pipeline',
+  () =>
+    getLoraStageHistograms(STAGE_METRIC_BUCKETS_US.map((us) => us * 1000)).map(
+      ({ stage, count, sum, cumulative }) => [
+        { stage },
+        {
+          buckets: cumulative.map((n, i) => [
+            STAGE_METRIC_BUCKETS_US[i] / 1e6,
+            n,
+          ]),
+          sum: sum / 1e9,
+          count,
+        },
+      ]
+    )
+)
+// Counted by the native core while the stages are timed
+const CORE_METRICS = {
+  frames: ['asconmac_core_frames_total', 'Frames given to the native decoder'],
+  decoded: ['asconmac_core_decoded_total', 'Frames decoded natively'],
+  micFailed: ['asconmac_core_mic_failures_total', 'Frames with an invalid MIC'],
+  bytes: ['asconmac_core_bytes_total', 'Bytes of the frames decoded natively'],
+}
+Object.entries(CORE_METRICS).forEach(([counter, [name, help]]) =>
+  registerMetric(name, 'counter', help, () => {
+    const counters = getLoraCoreCounters()
+    return counters ? [[{}, counters[counter]]] : []
+  })
+)
+
+if (UDP_FRONTEND_NATIVE) {
+  startUdpFrontEnd()
+} else {
+  server.bind(SERVER_PORT)
+}
 
-  return jsonObject
+// Replica of the uplink log in the store, the document id is derived from
+// the uplink so an uplink replayed after a restart overwrites its document,
+// and startLogReplication sets the package count from the log
+const logEntryToUplink = ({
+  seq,
+  timeMs,
+  devAddr,
+  fCnt,
+  fPort,
+  rssi,
+  lsnr,
+  payload,
+  gateways,
+}) => {
+  const address = devAddr.toString(16).toUpperCase().padStart(8, '0')
+  const dateString = new Date(timeMs).toDateString().replaceAll(' ', '')
+  return [
+    'sensorDataCollection' + fPort + dateString,
+    `${address}-${fCnt}-${timeMs}`,
+    {
+      time_ms: timeMs,
+      fport: fPort,
+      dev_addr: address,
+      data: [...payload],
+      data_size: payload.length,
+      f_cnt: fCnt,
+      rssi,
+      lsnr,
+      log_seq: seq,
+      // Gateways which heard the uplink, as without the log
+      ...(gateways && { gateways }),
+    },
+    {
+      collection: 'sensorMetadataCollection' + dateString,
+      id: address,
+      timeMs,
+    },
+  ]
 }
+const uplinkLogReplication = UPLINK_LOG_ENABLED
+  ? startLogReplication({
+      read: readLoraUplinkLog,
+      toUplink: logEntryToUplink,
+      persistence: uplinkPersistence,
+      cursorPath: path.join(UPLINK_LOG_DIR, 'replica.cursor'),
+    })
+  : null
 
-server.bind(SERVER_PORT)
+if (UPLINK_LOG_ENABLED) {
+  // Only the replicated segments can be deleted
+  setInterval(() => {
+    maintainLoraUplinkLog(uplinkLogReplication.seq() + 1).catch((error) =>
+      console.error('[ERROR] Uplink log maintenance:', error.message)
+    )
+  }, UPLINK_LOG_MAINTAIN_MS).unref()
+}
+
+// Write the uplinks still queued before exiting
+const shutdown = async () => {
+  await uplinkLogReplication?.stop()
+  await uplinkPersistence.drain()
+  process.exit(0)
+}
+process.on('SIGINT', shutdown)
+process.on('SIGTERM', shutdown)
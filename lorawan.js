@@ -1,6 +1,16 @@
 import lora from 'lora-packet'
-import { exec } from 'child_process'
+import { spawn } from 'child_process'
 import fs from 'fs'
+import os from 'os'
+import { createRequire } from 'module'
+
+// In-process codec (binding.gyp), fall back to asconmacav12 workers without it
+let asconMacAddon = null
+try {
+  asconMacAddon = createRequire(import.meta.url)('./build/Release/asconmac.node')
+} catch (error) {
+  console.log('asconmac addon is not built, use asconmacav12 workers')
+}
 
 const hexStringToByteArray = (string) => {
   if (string.length % 2 !== 0) {
@@ -36,6 +46,471 @@ export const decryptLoraRawData = (data, nwkskeyHexString, appkeyHexString) => {
   return [null, null]
 }
 
+// Expanded keys of every device, created once when the device is provisioned
+// or loaded and reused for every frame. The asconmacav12 workers keep their
+// own cache, so this is only needed by the addon.
+const asconMacSessions = new Map()
+
+// @param nwkskeyHexString, appkeyHexString Session keys of the device
+// @retval The addon session, null when the addon is not built
+export const loadLoraSession = (nwkskeyHexString, appkeyHexString) => {
+  if (!asconMacAddon) {
+    return null
+  }
+  const sessionKey = appkeyHexString + nwkskeyHexString
+  let session = asconMacSessions.get(sessionKey)
+  if (!session) {
+    session = asconMacAddon.createSession(
+      Buffer.from(appkeyHexString, 'hex'),
+      Buffer.from(nwkskeyHexString, 'hex')
+    )
+    asconMacSessions.set(sessionKey, session)
+  }
+  return session
+}
+
+// Native session table of the addon (session_table.h): binary and expanded
+// keys and frame counters keyed by the numeric DevAddr, mapped from a file
+let loraSessionTable = null
+const SESSION_TABLE_ERR_NOT_FOUND = -12
+const CODEC_ERR_MIC = -4
+
+// Result of every frame decoded, read by the metrics on scrape
+export const loraDecodeCounters = {
+  decoded: 0,
+  micFailures: 0,
+  unknownDevices: 0,
+  failed: 0, // Any other error
+}
+
+const countLoraDecode = (status) => {
+  if (status === 0) {
+    loraDecodeCounters.decoded++
+  } else if (status === CODEC_ERR_MIC) {
+    loraDecodeCounters.micFailures++
+  } else if (status === SESSION_TABLE_ERR_NOT_FOUND) {
+    loraDecodeCounters.unknownDevices++
+  } else {
+    loraDecodeCounters.failed++
+  }
+}
+
+// @param path File of the table, created when it does not exist
+// @retval true when the table is used, it needs the addon
+export const openLoraSessionTable = (path) => {
+  if (!asconMacAddon) {
+    return false
+  }
+  try {
+    loraSessionTable = asconMacAddon.openSessionTable(path, 1024)
+  } catch (error) {
+    console.error('[ERROR] Cannot open session table:', error.message)
+    return false
+  }
+  return true
+}
+
+// @param devAddressHexString DevAddr as written in the device list (big-endian hex)
+export const putLoraSession = (
+  devAddressHexString,
+  nwkskeyHexString,
+  appkeyHexString
+) => {
+  if (!loraSessionTable) {
+    return
+  }
+  asconMacAddon.sessionPut(
+    loraSessionTable,
+    parseInt(devAddressHexString, 16),
+    Buffer.from(appkeyHexString, 'hex'),
+    Buffer.from(nwkskeyHexString, 'hex')
+  )
+}
+
+// Uplinks seen in the last window, to collapse the copies of a frame heard
+// by several gateways (dedup.h). Without the addon the frames are kept in a
+// Map, keyed by the whole frame.
+let loraDedup = null
+let loraDedupWindowMs = 0
+const loraDedupSeen = new Map()
+
+// @param windowMs How long a frame is remembered, 0 disables deduplication
+// @retval true when deduplication is enabled
+export const openLoraDedup = (windowMs) => {
+  loraDedupWindowMs = windowMs
+  if (windowMs <= 0) {
+    return false
+  }
+  if (asconMacAddon) {
+    try {
+      loraDedup = asconMacAddon.openDedup(windowMs, 4096)
+    } catch (error) {
+      console.error('[ERROR] Cannot open dedup set:', error.message)
+      return false
+    }
+  }
+  return true
+}
+
+// @param frames Array of raw frame Buffers
+// @retval Array of { key, duplicate } in the same order, key is the same for
+// every copy of a frame and duplicate true when it was seen in the window
+export const dedupLoraFrames = (frames) => {
+  if (loraDedup) {
+    return asconMacAddon.dedupFrames(loraDedup, frames)
+  }
+  const now = Date.now()
+  for (const [key, seen] of loraDedupSeen) {
+    // Insertion order is the time order
+    if (now - seen < loraDedupWindowMs) {
+      break
+    }
+    loraDedupSeen.delete(key)
+  }
+  return frames.map((frame) => {
+    const key = frame.toString('base64')
+    const duplicate = loraDedupSeen.has(key)
+    if (!duplicate) {
+      loraDedupSeen.set(key, now)
+    }
+    return { key, duplicate }
+  })
+}
+
+// Layout of the fields of one rxpk written by the addon parsePushData:
+// numbers, then [offset, size] of the frame and of the strings
+const PUSH_DATA_FRAME = 8
+const PUSH_DATA_TIME = 10
+const PUSH_DATA_MODU = 12
+const PUSH_DATA_DATR = 14
+const PUSH_DATA_CODR = 16
+const PUSH_DATA_META_SIZE = 18
+const PUSH_DATA_RXPK_MAX = 64 // RXPK_MAX
+const pushDataMeta = new Float64Array(PUSH_DATA_RXPK_MAX * PUSH_DATA_META_SIZE)
+
+// rxpk parsed by the addon. The hot path only reads the numbers and the
+// frame, the strings stay offsets into the datagram until they are read.
+class LoraRxpk {
+  #json
+  #strings
+
+  constructor(json, frames, meta) {
+    const number = (i) =>
+      Number.isNaN(pushDataMeta[meta + i]) ? undefined : pushDataMeta[meta + i]
+    this.tmst = number(0)
+    this.freq = number(1)
+    this.chan = number(2)
+    this.rfch = number(3)
+    this.stat = number(4)
+    this.rssi = number(5)
+    this.lsnr = number(6)
+    this.size = number(7)
+    const offset = pushDataMeta[meta + PUSH_DATA_FRAME]
+    const size = pushDataMeta[meta + PUSH_DATA_FRAME + 1]
+    // null when "data" is missing or not base64
+    this.frame = offset < 0 ? null : frames.subarray(offset, offset + size)
+    this.#json = json
+    this.#strings = pushDataMeta.slice(
+      meta + PUSH_DATA_TIME,
+      meta + PUSH_DATA_META_SIZE
+    )
+  }
+
+  string(field) {
+    const offset = this.#strings[field - PUSH_DATA_TIME]
+    const size = this.#strings[field - PUSH_DATA_TIME + 1]
+    return offset < 0
+      ? undefined
+      : this.#json.toString('latin1', offset, offset + size)
+  }
+
+  get time() {
+    return this.string(PUSH_DATA_TIME)
+  }
+
+  get modu() {
+    return this.string(PUSH_DATA_MODU)
+  }
+
+  get datr() {
+    return this.string(PUSH_DATA_DATR)
+  }
+
+  get codr() {
+    return this.string(PUSH_DATA_CODR)
+  }
+}
+
+// @param json The JSON object of PUSH_DATA, the datagram after its header
+// @retval Array of rxpk, or undefined when there is none. With the addon the
+// JSON is parsed natively and "data" is replaced by the decoded frame Buffer
+// 'frame', without the addon it is JSON.parse
+export const parseLoraPushData = (json) => {
+  if (!asconMacAddon) {
+    return JSON.parse(json.toString()).rxpk
+  }
+  // The frames are subarrays of one Buffer, decoded into by the addon
+  const frames = Buffer.allocUnsafe(json.length)
+  const count = asconMacAddon.parsePushData(json, pushDataMeta, frames)
+  if (count === 0) {
+    return undefined
+  }
+  const rxpks = new Array(count)
+  for (let i = 0; i < count; i++) {
+    rxpks[i] = new LoraRxpk(json, frames, i * PUSH_DATA_META_SIZE)
+  }
+  return rxpks
+}
+
+// @param rxpk rxpk of parseLoraPushData or a package of the decrypt functions
+// @retval The raw frame Buffer, empty when "data" is not base64
+export const getLoraFrame = (rxpk) => {
+  if (rxpk.frame !== undefined) {
+    return rxpk.frame ?? Buffer.alloc(0)
+  }
+  return Buffer.from(rxpk.data, 'base64')
+}
+
+// Append-only log of the decoded uplinks on the local disk (ulog.h), the
+// primary sink of the uplinks. Appends made while a commit is in flight are
+// synced together by the next commit (group commit). The uplinks of a failed
+// commit stay pending, committed again after LORA_UPLINK_LOG_RETRY_MS unless
+// another append commits them first.
+const LORA_UPLINK_LOG_RETRY_MS = 1000
+let loraUplinkLog = null
+let loraUplinkLogCommit = null // Commit in flight
+let loraUplinkLogNextCommit = null // Commit queued behind it
+
+// @param dir Directory of the segments, created when it does not exist
+// @param options { segmentMax, segmentMs, retentionMs, sync }
+// @retval true when the log is used, it needs the addon
+export const openLoraUplinkLog = (dir, options) => {
+  if (!asconMacAddon) {
+    return false
+  }
+  try {
+    loraUplinkLog = asconMacAddon.openUplinkLog(dir, options)
+  } catch (error) {
+    console.error('[ERROR] Cannot open uplink log:', error.message)
+    return false
+  }
+  return true
+}
+
+const commitLoraUplinkLog = () => {
+  if (!loraUplinkLogCommit) {
+    loraUplinkLogCommit = asconMacAddon
+      .logCommit(loraUplinkLog)
+      .catch((error) => {
+        setTimeout(
+          () => commitLoraUplinkLog().catch(() => {}),
+          LORA_UPLINK_LOG_RETRY_MS
+        )
+        throw error
+      })
+      .finally(() => {
+        loraUplinkLogCommit = null
+      })
+    return loraUplinkLogCommit
+  }
+  loraUplinkLogNextCommit ??= loraUplinkLogCommit
+    .catch(() => {})
+    .then(() => {
+      loraUplinkLogNextCommit = null
+      return commitLoraUplinkLog()
+    })
+  return loraUplinkLogNextCommit
+}
+
+// @param uplinks Array of { timeMs, devAddr, fCnt, fPort, rssi, lsnr,
+// payload, gateways }, devAddr and fCnt numbers, payload a Buffer, gateways
+// the optional rxpk.gateways ({ gateway, rssi, lsnr }, the first 32 kept)
+// @retval Promise resolved to the last seq on disk once they are synced
+export const appendLoraUplinks = (uplinks) => {
+  asconMacAddon.logAppend(loraUplinkLog, uplinks)
+  return commitLoraUplinkLog()
+}
+
+// @retval Array of the uplinks above with their seq, from fromSeq on
+export const readLoraUplinkLog = (fromSeq, max) =>
+  asconMacAddon.logRead(loraUplinkLog, fromSeq, max)
+
+// @param devAddressHexString DevAddr (big-endian hex)
+// @retval Array of the uplinks of the device with fromMs <= timeMs < toMs
+export const scanLoraUplinkLog = (devAddressHexString, fromMs, toMs) =>
+  asconMacAddon.logScan(
+    loraUplinkLog,
+    parseInt(devAddressHexString, 16),
+    fromMs,
+    toMs
+  )
+
+// Retention and compaction, off the event loop
+// @param keepSeq The segments holding this seq or later are kept
+export const maintainLoraUplinkLog = (keepSeq) =>
+  asconMacAddon.logMaintain(loraUplinkLog, keepSeq)
+
+// Latency of every stage of the decode pipeline, kept by the addon in
+// per-thread histograms (asconmacav12/hist/hist.h) summed on snapshot
+export const LORA_STAGE = {
+  BASE64: 0,
+  PARSE: 1,
+  SESSION: 2,
+  MIC: 3,
+  DECRYPT: 4,
+  OUTPUT: 5,
+  PERSIST: 6,
+}
+let loraStageTimers = false
+
+// @retval true when the stages are timed, never without the addon
+export const enableLoraStageTimers = (enabled) => {
+  if (!asconMacAddon) {
+    return false
+  }
+  asconMacAddon.stageEnable(enabled)
+  loraStageTimers = enabled
+  return enabled
+}
+
+// Record a stage timed in JavaScript
+// @param stage LORA_STAGE member
+// @param start process.hrtime.bigint() at the start of the stage
+export const recordLoraStage = (stage, start) => {
+  if (loraStageTimers) {
+    asconMacAddon.stageRecord(stage, Number(process.hrtime.bigint() - start))
+  }
+}
+
+// @retval Array of { stage, count, sum, max, p50, p99, p999, buckets } per
+// stage, times in ns, empty when the stages are not timed
+export const getLoraStageSnapshot = () =>
+  loraStageTimers ? asconMacAddon.stageSnapshot() : []
+
+let loraStageBucketMax = null
+
+// Stage histograms cut at fixed bounds, e.g for the Prometheus le buckets
+// @param bounds Ascending upper bounds in ns
+// @retval Array of { stage, count, sum, cumulative }, cumulative[i] being the
+// samples up to bounds[i], empty when the stages are not timed
+export const getLoraStageHistograms = (bounds) => {
+  const snapshot = getLoraStageSnapshot()
+  if (snapshot.length === 0) {
+    return []
+  }
+  loraStageBucketMax ??= asconMacAddon.stageBucketMax()
+  return snapshot.map(({ stage, sum, buckets }) => {
+    const cumulative = []
+    let count = 0
+    let bucket = 0
+    for (const bound of bounds) {
+      for (; bucket < buckets.length; bucket++) {
+        if (loraStageBucketMax[bucket] > bound) {
+          break
+        }
+        count += buckets[bucket]
+      }
+      cumulative.push(count)
+    }
+    // Counted from the buckets, the total of a snapshot taken while threads
+    // record may lag behind them
+    for (; bucket < buckets.length; bucket++) {
+      count += buckets[bucket]
+    }
+    return { stage, count, sum, cumulative }
+  })
+}
+
+// @retval { frames, decoded, micFailed, bytes } decoded by the native core,
+// null when the stages are not timed
+export const getLoraCoreCounters = () =>
+  loraStageTimers ? asconMacAddon.coreCounters() : null
+
+// Path of the asconmacav12 program for the current OS
+export const getAsconMacCommand = () => {
+  if (process.platform === 'win32') {
+    console.log('OS is Window')
+    if (fs.existsSync('.\\asconmacav12\\out.exe')) {
+      console.log('Found .exe, use it')
+      return '.\\asconmacav12\\out.exe'
+    }
+    console.log('Cannot find .exe, use the default one')
+    return '.\\asconmacav12\\out'
+  }
+  /* Assuming this is Linux */
+  console.log('OS IS NOT Window, use the default one')
+  return './asconmacav12/out'
+}
+
+// Warm asconmacav12 processes running in server mode ('out --serve'), one per
+// core. Each request is a length-prefixed list of the command line arguments
+// and the responses come back in the same order, so every worker only needs
+// a FIFO of pending callbacks.
+const ASCON_MAC_WORKERS = os.cpus().length
+const ASCON_MAC_BATCH_MAX = 64 // CODEC_BATCH_MAX
+const asconMacWorkers = []
+
+const spawnAsconMacWorker = () => {
+  const worker = {
+    proc: spawn(getAsconMacCommand(), ['--serve']),
+    pending: [],
+    rx: Buffer.alloc(0),
+  }
+  worker.proc.stdout.on('data', (chunk) => {
+    worker.rx = worker.rx.length ? Buffer.concat([worker.rx, chunk]) : chunk
+    // Response = [LEN (4 bytes, LE)][STATUS (int8)][TEXT]
+    while (worker.rx.length >= 4) {
+      const size = worker.rx.readUInt32LE(0)
+      if (worker.rx.length < 4 + size) {
+        break
+      }
+      const status = worker.rx.readInt8(4)
+      const text = worker.rx.toString('latin1', 5, 4 + size)
+      worker.rx = worker.rx.subarray(4 + size)
+      worker.pending.shift()(status, text)
+    }
+  })
+  const onExit = () => {
+    const index = asconMacWorkers.indexOf(worker)
+    if (index >= 0) {
+      asconMacWorkers.splice(index, 1)
+    }
+    // Fail everything in flight, a new worker is spawned on the next request
+    worker.pending.splice(0).forEach((callback) =>
+      callback(-1, 'asconmacav12 worker exited')
+    )
+  }
+  worker.proc.on('error', (error) => {
+    console.error('[ERROR] asconmacav12 worker:', error.message)
+    onExit()
+  })
+  worker.proc.on('exit', onExit)
+  worker.proc.stdin.on('error', () => {})
+  asconMacWorkers.push(worker)
+  return worker
+}
+
+// @param args The same arguments as the one-shot command line
+// @retval [status, text] The program return code and its stdout
+const asconMacRequest = (args) => {
+  return new Promise((resolve) => {
+    let worker
+    if (asconMacWorkers.length < ASCON_MAC_WORKERS) {
+      worker = spawnAsconMacWorker()
+    } else {
+      // Least loaded worker
+      worker = asconMacWorkers.reduce((a, b) =>
+        b.pending.length < a.pending.length ? b : a
+      )
+    }
+    const body = Buffer.from(args.map((arg) => `${arg}\0`).join(''), 'latin1')
+    const header = Buffer.alloc(4)
+    header.writeUInt32LE(body.length, 0)
+    worker.pending.push((status, text) => resolve([status, text]))
+    worker.proc.stdin.write(Buffer.concat([header, body]))
+  })
+}
+
 export const encryptLoraDataAsconMac = async (
   data,
   nwkskeyHexString,
@@ -44,34 +519,71 @@ export const encryptLoraDataAsconMac = async (
   downlinkCount,
   fport
 ) => {
-  return new Promise((resolve, reject) => {
-    // Pass Base64 package to C program
-    let command
-    if (process.platform === 'win32') {
-      console.log('OS is Window')
-      if (fs.existsSync('.\\asconmacav12\\out.exe')) {
-        console.log('Found .exe, use it')
-        command = '.\\asconmacav12\\out.exe'
-      } else {
-        console.log('Cannot find .exe, use the default one')
-        command = '.\\asconmacav12\\out'
-      }
-    } else {
-      /* Assuming this is Linux */
-      console.log('OS IS NOT Window, use the default one')
-      command = './asconmacav12/out'
+  if (asconMacAddon) {
+    const { status, frame } = asconMacAddon.encode(
+      Buffer.from(data),
+      loadLoraSession(nwkskeyHexString, appkeyHexString),
+      parseInt(devAddress, 16),
+      Number(downlinkCount),
+      Number(fport)
+    )
+    if (status !== 0) {
+      console.error(`Error: asconmac addon returned ${status}`)
+      return null
     }
-    const inBase64 = Buffer.from(data).toString('base64')
-    command += ` "${inBase64}" "${appkeyHexString}" "${nwkskeyHexString}" "${devAddress}" "${downlinkCount}" "${fport}"`
-    exec(command, (error, stdout) => {
-      if (error) {
-        console.error(`Error: ${error.message}`, stdout.trim())
-        resolve(null)
-      }
-      const dataBase64 = stdout.trim()
-      resolve(dataBase64)
-    })
-  })
+    return frame.toString('hex')
+  }
+  // Pass Base64 package to C program
+  const inBase64 = Buffer.from(data).toString('base64')
+  const [status, stdout] = await asconMacRequest([
+    inBase64,
+    appkeyHexString,
+    nwkskeyHexString,
+    devAddress,
+    downlinkCount,
+    fport,
+  ])
+  if (status !== 0) {
+    console.error(`Error: asconmacav12 returned ${status}`, stdout.trim())
+    return null
+  }
+  const dataBase64 = stdout.trim()
+  return dataBase64
+}
+
+// Same layout as the lines printed by asconmacav12:
+// [payload, time elapsed (us), DevAddr, FCnt, FPort, MHDR]
+const asconMacInfo = (result, elapsedUs) => {
+  const timeElapsed = Buffer.alloc(4)
+  timeElapsed.writeUInt32BE(Math.min(elapsedUs, 0xffffffff))
+  const devAddr = Buffer.alloc(4)
+  devAddr.writeUInt32BE(result.devAddr)
+  const fCnt = Buffer.alloc(2)
+  fCnt.writeUInt16BE(result.fCnt)
+  return [
+    result.payload,
+    timeElapsed,
+    devAddr,
+    fCnt,
+    Buffer.from([result.fPort]),
+    Buffer.from([result.mHdr]),
+  ]
+}
+
+const decryptWithAddon = async (decode, data, nwkskeyHexString, appkeyHexString) => {
+  const start = process.hrtime.bigint()
+  const result = await decode(
+    Buffer.from(data, 'base64'),
+    loadLoraSession(nwkskeyHexString, appkeyHexString)
+  )
+  countLoraDecode(result.status)
+  if (result.status !== 0) {
+    console.error(`Error: asconmac addon returned ${result.status}`)
+    return [null, null]
+  }
+  const elapsedUs = Number((process.hrtime.bigint() - start) / 1000n)
+  const info = asconMacInfo(result, elapsedUs)
+  return [info, info[0]]
 }
 
 // @param msg raw string data received from gateway usually in Base64 format
@@ -80,36 +592,161 @@ export const decryptLoraRawDataAsconMac = async (
   nwkskeyHexString,
   appkeyHexString
 ) => {
-  return new Promise((resolve, reject) => {
-    // Pass Base64 package to C program
-    let command
-    if (process.platform === 'win32') {
-      console.log('OS is Window')
-      if (fs.existsSync('.\\asconmacav12\\out.exe')) {
-        console.log('Found .exe, use it')
-        command = '.\\asconmacav12\\out.exe'
-      } else {
-        console.log('Cannot find .exe, use the default one')
-        command = '.\\asconmacav12\\out'
-      }
-    } else {
-      /* Assuming this is Linux */
-      console.log('OS IS NOT Window, use the default one')
-      command = './asconmacav12/out'
-    }
-    command += ` "${data}" "${appkeyHexString}" "${nwkskeyHexString}"`
-    const info = []
-    exec(command, (error, stdout) => {
-      if (error) {
-        console.error(`Error: ${error.message}`, stdout.trim())
-        resolve([null, null])
+  if (asconMacAddon) {
+    return decryptWithAddon(
+      asconMacAddon.decode,
+      data,
+      nwkskeyHexString,
+      appkeyHexString
+    )
+  }
+  // Pass Base64 package to C program
+  const [status, stdout] = await asconMacRequest([
+    data,
+    appkeyHexString,
+    nwkskeyHexString,
+  ])
+  if (status !== 0) {
+    console.error(`Error: asconmacav12 returned ${status}`, stdout.trim())
+    return [null, null]
+  }
+  const info = []
+  const lines = stdout.trim().split('\n')
+  for (let i = 0; i < lines.length; i++) {
+    lines[i] = lines[i].replace(/[\n\r]+/g, '')
+    info.push(hexStringToByteArray(lines[i]))
+  }
+  return [info, info[0]]
+}
+
+// Same as decryptLoraRawDataAsconMac but the addon runs the decoding on the
+// libuv threadpool instead of the event loop
+export const decryptLoraRawDataAsconMacAsync = async (
+  data,
+  nwkskeyHexString,
+  appkeyHexString
+) => {
+  if (asconMacAddon) {
+    return decryptWithAddon(
+      asconMacAddon.decodeAsync,
+      data,
+      nwkskeyHexString,
+      appkeyHexString
+    )
+  }
+  return decryptLoraRawDataAsconMac(data, nwkskeyHexString, appkeyHexString)
+}
+
+// @param packages Array of { data, frame, nwkskey, appskey }, data is the raw
+// Base64 string received from the gateway, or frame the decoded Buffer, and
+// the keys are hex strings
+// @retval Array of [info, payload] in the same order, [null, null] for the
+// packages which cannot be decrypted
+export const decryptLoraRawDataAsconMacBatch = async (packages) => {
+  if (packages.length === 0) {
+    return []
+  }
+  const start = process.hrtime.bigint()
+  let results
+  if (asconMacAddon) {
+    results = asconMacAddon.decodeBatch(
+      packages.map(getLoraFrame),
+      packages.map((pkg) => loadLoraSession(pkg.nwkskey, pkg.appskey))
+    )
+  } else {
+    // Line per package: <status> <payload> <DevAddr> <FCnt> <FPort> <MHDR>
+    results = []
+    for (let i = 0; i < packages.length; i += ASCON_MAC_BATCH_MAX) {
+      const args = ['--batch']
+      packages
+        .slice(i, i + ASCON_MAC_BATCH_MAX)
+        .forEach((pkg) => args.push(pkg.data, pkg.appskey, pkg.nwkskey))
+      const [status, stdout] = await asconMacRequest(args)
+      if (status !== 0) {
+        console.error(`Error: asconmacav12 returned ${status}`, stdout.trim())
+        return packages.map(() => [null, null])
       }
-      const lines = stdout.trim().split('\n')
-      for (let i = 0; i < lines.length; i++) {
-        lines[i] = lines[i].replace(/[\n\r]+/g, '')
-        info.push(hexStringToByteArray(lines[i]))
+      for (const line of stdout.trim().split('\n')) {
+        const [lineStatus, payload, devAddr, fCnt, fPort, mHdr] = line.split(' ')
+        results.push({
+          status: parseInt(lineStatus, 10),
+          payload: Buffer.from(payload, 'hex'),
+          devAddr: parseInt(devAddr, 16),
+          fCnt: parseInt(fCnt, 16),
+          fPort: parseInt(fPort, 16),
+          mHdr: parseInt(mHdr, 16),
+        })
       }
-      resolve([info, info[0]])
-    })
+    }
+  }
+  // Decoding time is shared by the whole batch
+  const elapsedUs = Number(
+    (process.hrtime.bigint() - start) / 1000n / BigInt(packages.length)
+  )
+  return results.map((result) => {
+    countLoraDecode(result.status)
+    if (result.status !== 0) {
+      console.error(`Error: decrypt package returned ${result.status}`)
+      return [null, null]
+    }
+    const info = asconMacInfo(result, elapsedUs)
+    return [info, info[0]]
+  })
+}
+
+// Same as decryptLoraRawDataAsconMacBatch with the sessions of the session
+// table, the device is found from the DevAddr of every frame so no key is
+// passed around
+// @param packages Array of { data } or { frame }, see above
+// @retval Array of [info, payload, loraNodeAddress], loraNodeAddress is null
+// for the packages of unknown devices and info null if decryption failed
+export const decryptLoraRawDataAsconMacTable = async (packages) => {
+  if (packages.length === 0) {
+    return []
+  }
+  const start = process.hrtime.bigint()
+  const results = asconMacAddon.decodeBatchTable(
+    packages.map(getLoraFrame),
+    loraSessionTable
+  )
+  const elapsedUs = Number(
+    (process.hrtime.bigint() - start) / 1000n / BigInt(packages.length)
+  )
+  return results.map((result) => {
+    countLoraDecode(result.status)
+    // Undefined when the frame cannot even be parsed
+    const address =
+      result.devAddr === undefined
+        ? undefined
+        : result.devAddr.toString(16).toUpperCase().padStart(8, '0')
+    if (result.status === SESSION_TABLE_ERR_NOT_FOUND) {
+      console.error(`[ERROR] Unknown device address ${address}`)
+      return [null, null, null]
+    }
+    if (result.status !== 0) {
+      console.error(`Error: decrypt package returned ${result.status}`)
+      return [null, null, address]
+    }
+    const info = asconMacInfo(result, elapsedUs)
+    return [info, info[0], address]
   })
 }
+
+// @retval [frame hex string, FCnt used] with the downlink counter kept by the
+// session table, [null, null] when the table is not open or encoding failed
+export const encryptLoraDataAsconMacTable = (data, devAddress, fport) => {
+  if (!loraSessionTable) {
+    return [null, null]
+  }
+  const { status, frame, fCnt } = asconMacAddon.encodeTable(
+    Buffer.from(data),
+    loraSessionTable,
+    parseInt(devAddress, 16),
+    Number(fport)
+  )
+  if (status !== 0) {
+    console.error(`Error: asconmac addon returned ${status}`)
+    return [null, null]
+  }
+  return [frame.toString('hex'), fCnt]
+}
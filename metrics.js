@@ -0,0 +1,57 @@
+// Reference
+// https://prometheus.io/docs/instrumenting/exposition_formats/
+//
+// Metrics of the network server in the Prometheus text format. Nothing is
+// aggregated on the hot path: every metric reads the counters of its owner
+// (plain numbers here, per-thread counters of the addon) when scraped.
+
+export const METRICS_CONTENT_TYPE = 'text/plain; version=0.0.4; charset=utf-8'
+
+const metrics = []
+
+// @param name Metric name, counters end with _total
+// @param type 'counter', 'gauge' or 'histogram'
+// @param help One line description
+// @param collect Called on scrape, returns an Array of [labels, value]. The
+// value of a histogram is { buckets, sum, count }, buckets being an Array of
+// [le, cumulative count]
+export const registerMetric = (name, type, help, collect) => {
+  metrics.push({ name, type, help, collect })
+}
+
+const escapeLabel = (value) =>
+  String(value)
+    .replaceAll('\\', '\\\\')
+    .replaceAll('\n', '\\n')
+    .replaceAll('"', '\\"')
+
+const formatLabels = (labels) => {
+  const pairs = Object.entries(labels).map(
+    ([name, value]) => `${name}="${escapeLabel(value)}"`
+  )
+  return pairs.length ? `{${pairs.join(',')}}` : ''
+}
+
+// @retval The text of a scrape, every registered metric collected once
+export const renderMetrics = () => {
+  const lines = []
+  for (const { name, type, help, collect } of metrics) {
+    lines.push(`# HELP ${name} ${help}`, `# TYPE ${name} ${type}`)
+    for (const [labels, value] of collect()) {
+      if (type !== 'histogram') {
+        lines.push(`${name}${formatLabels(labels)} ${value}`)
+        continue
+      }
+      for (const [le, count] of value.buckets) {
+        lines.push(`${name}_bucket${formatLabels({ ...labels, le })} ${count}`)
+      }
+      const inf = formatLabels({ ...labels, le: '+Inf' })
+      lines.push(
+        `${name}_bucket${inf} ${value.count}`,
+        `${name}_sum${formatLabels(labels)} ${value.sum}`,
+        `${name}_count${formatLabels(labels)} ${value.count}`
+      )
+    }
+  }
+  return lines.join('\n') + '\n'
+}
@@ -0,0 +1,407 @@
+// Persistence of the decoded uplinks, batched instead of a round trip per
+// frame. Uplink documents are queued, the metadata of every device (package
+// count, last seen time) is merged in memory, and both are flushed together
+// when PERSIST_BATCH_MAX uplinks are pending or every PERSIST_FLUSH_MS, with
+// at most PERSIST_IN_FLIGHT_MAX writes in flight.
+//
+// The store is a backend with a single method, write(uplinks, metadata)
+// -> Promise, where uplinks is an Array of { collection, id, doc } and
+// metadata an Array of { collection, id, count, timeMs } increments, or of
+// { collection, id, total, timeMs } absolute counts. Uplink writes are
+// idempotent, increments are not: a failed write rejects with
+// error.committedMetadata, the metadata entries it did commit, so they are
+// not applied twice.
+// - createFirestoreBackend, Firestore batched writes (the emulator when
+//   FIRESTORE_EMULATOR_HOST is set, see index.js)
+// - createFileBackend, a JSON lines file standing in for Firestore in tests
+//
+// startLogReplication feeds it from the local uplink log instead, the log
+// being the primary sink and the store a replica.
+
+import fs from 'fs'
+import { doc, increment, writeBatch } from 'firebase/firestore'
+
+// Writes of a Firestore batch are limited to 500
+const FIRESTORE_BATCH_MAX = 500
+
+// Increment the count, or set it when it is absolute
+const metadataCount = ({ count, total }) =>
+  total === undefined ? increment(count) : total
+
+// @param db Firestore instance
+export const createFirestoreBackend = (db) => ({
+  write: async (uplinks, metadata) => {
+    // Every batch commits atomically, the metadata goes in batches of its
+    // own so that the committed ones are known when another one fails
+    const batches = []
+    for (let i = 0; i < uplinks.length; i += FIRESTORE_BATCH_MAX) {
+      const batch = writeBatch(db)
+      uplinks
+        .slice(i, i + FIRESTORE_BATCH_MAX)
+        .forEach(({ collection, id, doc: data }) =>
+          batch.set(doc(db, collection, id), data)
+        )
+      batches.push({ batch, metadata: [] })
+    }
+    for (let i = 0; i < metadata.length; i += FIRESTORE_BATCH_MAX) {
+      const batch = writeBatch(db)
+      const entries = metadata.slice(i, i + FIRESTORE_BATCH_MAX)
+      // No read, the count is incremented by Firestore
+      entries.forEach((m) =>
+        batch.set(
+          doc(db, m.collection, m.id),
+          { package_count: metadataCount(m), time_ms: m.timeMs },
+          { merge: true }
+        )
+      )
+      batches.push({ batch, metadata: entries })
+    }
+    const results = await Promise.allSettled(
+      batches.map(({ batch }) => batch.commit())
+    )
+    const failed = results.find(({ status }) => status === 'rejected')
+    if (failed) {
+      const error =
+        failed.reason instanceof Error
+          ? failed.reason
+          : new Error(String(failed.reason))
+      error.committedMetadata = batches
+        .filter((_, i) => results[i].status === 'fulfilled')
+        .flatMap(({ metadata: entries }) => entries)
+      throw error
+    }
+  },
+})
+
+// Line per write: { op: 'set', collection, id, doc }, { op: 'increment',
+// collection, id, package_count, time_ms } or { op: 'count', ... } for the
+// absolute counts. Appended at once, a failed write commits nothing
+// @param path File appended to, created when it does not exist
+export const createFileBackend = (path) => ({
+  write: async (uplinks, metadata) => {
+    const lines = [
+      ...uplinks.map(({ collection, id, doc: data }) =>
+        JSON.stringify({ op: 'set', collection, id, doc: data })
+      ),
+      ...metadata.map(({ collection, id, count, total, timeMs }) =>
+        JSON.stringify({
+          op: total === undefined ? 'increment' : 'count',
+          collection,
+          id,
+          package_count: total ?? count,
+          time_ms: timeMs,
+        })
+      ),
+    ]
+    await fs.promises.appendFile(path, lines.join('\n') + '\n')
+  },
+})
+
+// Replay a createFileBackend file like Firestore would have applied it
+// @retval Map of 'collection/id' -> document
+export const readFileBackend = (path) => {
+  const store = new Map()
+  if (!fs.existsSync(path)) {
+    return store
+  }
+  for (const line of fs.readFileSync(path, 'utf8').split('\n')) {
+    if (!line) {
+      continue
+    }
+    const { op, collection, id, doc: data, package_count, time_ms } =
+      JSON.parse(line)
+    const key = `${collection}/${id}`
+    if (op === 'set') {
+      store.set(key, data)
+    } else if (op === 'count') {
+      store.set(key, { ...store.get(key), package_count, time_ms })
+    } else {
+      const current = store.get(key) ?? { package_count: 0 }
+      store.set(key, {
+        ...current,
+        package_count: current.package_count + package_count,
+        time_ms,
+      })
+    }
+  }
+  return store
+}
+
+// Longest wait before writing again after failed writes
+const PERSIST_BACKOFF_MAX_MS = 30000
+
+// @param backend See above
+// @param options { batchMax, flushMs, inFlightMax, onCommit }, onCommit(start,
+// uplinks) is called after every successful write, start being its
+// process.hrtime.bigint(). After a failed write the next one waits flushMs,
+// doubled on every failure up to PERSIST_BACKOFF_MAX_MS
+export const createUplinkPersistence = (
+  backend,
+  { batchMax = 400, flushMs = 1000, inFlightMax = 4, onCommit } = {}
+) => {
+  let uplinks = []
+  // 'collection/id' -> { collection, id, count, total, timeMs }
+  let metadata = new Map()
+  let inFlight = 0
+  let timer = null
+  let waiting = [] // add() callers held back until the queue drains
+  let backoffMs = 0
+  let backoffUntil = 0 // Date.now() before which nothing is written
+  const stats = { written: 0, failed: 0 }
+
+  const mergeMetadata = (into, { collection, id, count, total, timeMs }) => {
+    const key = `${collection}/${id}`
+    const current = into.get(key)
+    if (!current) {
+      into.set(key, { collection, id, count, total, timeMs })
+      return
+    }
+    current.count += count
+    // Absolute counts only grow, the latest one wins
+    if (total !== undefined) {
+      current.total = Math.max(current.total ?? 0, total)
+    }
+    current.timeMs = Math.max(current.timeMs, timeMs)
+  }
+
+  const schedule = () => {
+    if (!timer && (uplinks.length || metadata.size)) {
+      const now = Date.now()
+      timer = setTimeout(
+        () => {
+          timer = null
+          flush()
+        },
+        backoffUntil > now ? backoffUntil - now : flushMs
+      )
+    }
+  }
+
+  // Start as many writes as the in-flight limit allows
+  const flush = () => {
+    if (backoffUntil > Date.now()) {
+      schedule()
+      return
+    }
+    while (inFlight < inFlightMax && (uplinks.length || metadata.size)) {
+      const batchUplinks = uplinks.slice(0, batchMax)
+      uplinks = uplinks.slice(batchMax)
+      // The metadata goes with the first write, it is small
+      const batchMetadata = [...metadata.values()]
+      metadata = new Map()
+      write(batchUplinks, batchMetadata)
+    }
+    schedule()
+  }
+
+  const write = async (batchUplinks, batchMetadata) => {
+    inFlight++
+    const start = process.hrtime.bigint()
+    try {
+      await backend.write(batchUplinks, batchMetadata)
+      stats.written += batchUplinks.length
+      backoffMs = 0
+      backoffUntil = 0
+      onCommit?.(start, batchUplinks.length)
+    } catch (error) {
+      // Queued again in front, retried once the backoff is over. The
+      // increments which did commit are not retried
+      console.error('[ERROR] Persist uplinks:', error.message)
+      stats.failed += batchUplinks.length
+      backoffMs = Math.min(
+        backoffMs ? backoffMs * 2 : flushMs,
+        PERSIST_BACKOFF_MAX_MS
+      )
+      backoffUntil = Date.now() + backoffMs
+      uplinks = batchUplinks.concat(uplinks)
+      const committed = new Set(error.committedMetadata ?? [])
+      const retried = metadata
+      metadata = new Map()
+      batchMetadata
+        .filter((m) => !committed.has(m))
+        .forEach((m) => mergeMetadata(metadata, m))
+      retried.forEach((m) => mergeMetadata(metadata, m))
+    } finally {
+      inFlight--
+    }
+    if (uplinks.length < batchMax * inFlightMax) {
+      waiting.forEach((resolve) => resolve())
+      waiting = []
+    }
+    if (uplinks.length >= batchMax) {
+      flush()
+    } else {
+      schedule()
+    }
+  }
+
+  return {
+    // Queue an uplink document and count it in the metadata of its device
+    // @retval Promise resolved at once, or once the queue has drained when
+    // batchMax * inFlightMax uplinks are already pending
+    add: (collection, id, data, meta) => {
+      uplinks.push({ collection, id, doc: data })
+      mergeMetadata(metadata, { ...meta, count: 1 })
+      if (uplinks.length >= batchMax) {
+        flush()
+      } else {
+        schedule()
+      }
+      if (uplinks.length < batchMax * inFlightMax) {
+        return Promise.resolve()
+      }
+      return new Promise((resolve) => waiting.push(resolve))
+    },
+    // Write everything pending and wait for all the writes in flight, gives
+    // up at the first failed write
+    // @retval true when everything was written
+    drain: async () => {
+      const failed = stats.failed
+      while (
+        stats.failed === failed &&
+        (uplinks.length || metadata.size || inFlight)
+      ) {
+        flush()
+        clearTimeout(timer)
+        timer = null
+        await new Promise((resolve) => setTimeout(resolve, 10))
+      }
+      return stats.failed === failed
+    },
+    // @retval { pending, inFlight, written, failed } for the metrics
+    stats: () => ({ pending: uplinks.length, inFlight, ...stats }),
+  }
+}
+
+// Copy a local log to the persistence, at least once: the last seq copied is
+// saved to cursorPath once the store has it, a restart goes on from there.
+// The entries replayed after a restart would count twice as increments, so
+// the metadata counts are derived from the log instead: the count of every
+// metadata document is kept here, saved with the seq, and written as an
+// absolute total. The counts of the documents older than countsMs are
+// forgotten; a document counted before the log was replicated is restarted
+// from the log.
+//
+// cursorPath holds JSON lines of { seq, counts }: a save appends the seq
+// with the counts changed since the previous one, a line torn by a crash is
+// ignored. Every compactSaves saves, and on the first one after a start, the
+// file is written again whole with the old counts dropped.
+// @param read (fromSeq, max) => Array of the log entries, with their seq
+// @param toUplink (entry) => [collection, id, doc, meta] as given to add(),
+// the id should be derived from the entry so a replay overwrites it
+// @param persistence createUplinkPersistence() result
+// @retval { stop, seq }, stop() waits for the copy in progress and seq() is
+// the last seq saved
+export const startLogReplication = ({
+  read,
+  toUplink,
+  persistence,
+  cursorPath,
+  intervalMs = 1000,
+  batchMax = 1000,
+  countsMs = 2 * 24 * 3600 * 1000,
+  compactSaves = 1000,
+}) => {
+  let seq = 0
+  // 'collection/id' -> [count, timeMs] as of seq
+  const counts = new Map()
+  const changed = new Set() // keys of counts since the last save
+  let newest = 0 // timeMs of the newest entry counted
+  if (fs.existsSync(cursorPath)) {
+    // Or the bare seq of the cursors saved before the counts
+    const text = fs.readFileSync(cursorPath, 'utf8')
+    if (!text.trimStart().startsWith('{')) {
+      seq = parseInt(text, 10) || 0
+    }
+    for (const line of text.split('\n')) {
+      let state
+      try {
+        state = JSON.parse(line)
+      } catch {
+        continue
+      }
+      seq = state.seq ?? seq
+      for (const [key, value] of Object.entries(state.counts ?? {})) {
+        counts.set(key, value)
+        newest = Math.max(newest, value[1])
+      }
+    }
+  }
+  let saved = seq
+  let saves = compactSaves // lines since the file was written whole
+
+  // The metadata of an entry with the count of its document
+  const count = (meta) => {
+    const key = `${meta.collection}/${meta.id}`
+    const [total, timeMs] = counts.get(key) ?? [0, 0]
+    counts.set(key, [total + 1, Math.max(timeMs, meta.timeMs)])
+    changed.add(key)
+    newest = Math.max(newest, meta.timeMs)
+    return { ...meta, total: total + 1 }
+  }
+  const save = async () => {
+    const lines = saves
+    // A failed save may leave a torn line, the next one writes the file whole
+    saves = compactSaves
+    if (lines >= compactSaves) {
+      for (const [key, [, timeMs]] of counts) {
+        if (timeMs < newest - countsMs) {
+          counts.delete(key)
+        }
+      }
+      const state = { seq, counts: Object.fromEntries(counts) }
+      await fs.promises.writeFile(
+        cursorPath + '.tmp',
+        JSON.stringify(state) + '\n'
+      )
+      await fs.promises.rename(cursorPath + '.tmp', cursorPath)
+      saves = 1
+    } else {
+      const state = { seq, counts: {} }
+      changed.forEach((key) => (state.counts[key] = counts.get(key)))
+      await fs.promises.appendFile(cursorPath, JSON.stringify(state) + '\n')
+      saves = lines + 1
+    }
+    changed.clear()
+    saved = seq
+  }
+  let running = true
+  let timer = null
+  let replicating = null
+
+  const replicate = async () => {
+    try {
+      let entries
+      do {
+        entries = read(seq + 1, batchMax)
+        for (const entry of entries) {
+          const [collection, id, data, meta] = toUplink(entry)
+          await persistence.add(collection, id, data, meta && count(meta))
+          seq = entry.seq
+        }
+      } while (running && entries.length === batchMax)
+      if (seq !== saved && (await persistence.drain())) {
+        await save()
+      }
+    } catch (error) {
+      console.error('[ERROR] Replicate uplink log:', error.message)
+    }
+  }
+  const schedule = () => {
+    replicating = replicate().then(() => {
+      if (running) {
+        timer = setTimeout(schedule, intervalMs)
+      }
+    })
+  }
+  schedule()
+
+  return {
+    stop: async () => {
+      running = false
+      clearTimeout(timer)
+      await replicating
+    },
+    seq: () => saved,
+  }
+}
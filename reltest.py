@@ -1,26 +1,44 @@
-import sys
+import argparse
+import csv
+import heapq
 import json
+import os
+import struct
+import sys
+
 import numpy as np
-import matplotlib.pyplot as plt
+
+# Interactive plot of a single device (default): reads one JSON line from
+# stdin, [time elapsed, failed, missed, lsnr, rssi] arrays.
+#
+# Report mode (--report <file or ->): reads the devices written by
+# writeReliabilityReport (reltrack.js), one at a time, and renders without a
+# display to --out:
+#     summary.csv           one row per device
+#     overview.<format>     loss of all the devices
+#     <DevAddr>.<format>    series of the --plots devices with the most loss
+# The series are downsampled to --points bins (mean, min and max of every
+# bin), nothing is computed per packet in Python.
+
+REPORT_MAGIC = b'RELR'
+REPORT_VERSION = 1
+REPORT_TYPES = {'u4': '<u4', 'f4': '<f4'}
+
+SUMMARY_FIELDS = [
+    'devAddr', 'received', 'expected', 'missing', 'loss', 'gaps',
+    'longestGap', 'gapP99', 'failures', 'duplicates', 'late', 'rssiMean',
+    'rssiStd', 'lsnrMean', 'lsnrStd', 'encUsMean', 'encUsStd', 'startMs',
+    'lastMs',
+]
 
 
 def find_missing_packages(arr):
     if not arr:  # Check if array is empty
         return []
 
-    # Get the maximum number to know the full range
-    max_num = max(arr)
-    # Create a set for O(1) lookup
-    num_set = set(arr)
-    # List to store missing numbers
-    missing = []
-
-    # Check each number from 1 to max_num
-    for i in range(1, max_num + 1):
-        if i not in num_set:
-            missing.append(i)
-
-    return missing
+    # Every number from 1 to the maximum which is not in the array
+    numbers = np.arange(1, max(arr) + 1)
+    return numbers[~np.isin(numbers, arr)].tolist()
 
 
 def read_in():
@@ -29,6 +47,247 @@ def read_in():
     return json.loads(lines[0])
 
 
+def read_exact(stream, size):
+    data = stream.read(size)
+    if len(data) != size:
+        raise ValueError('Truncated report')
+    return data
+
+
+def skip_padding(stream, size):
+    read_exact(stream, -size % 8)
+
+
+def read_report(stream):
+    # Yield { 'stats': ..., <column name>: numpy array } per device
+    magic, version, count, _ = struct.unpack(
+        '<4sIII', read_exact(stream, 16))
+    if magic != REPORT_MAGIC or version != REPORT_VERSION:
+        raise ValueError('Not a reliability report')
+    for _ in range(count):
+        meta_size, _ = struct.unpack('<II', read_exact(stream, 8))
+        meta = json.loads(read_exact(stream, meta_size))
+        skip_padding(stream, meta_size)
+        device = {'stats': meta['stats']}
+        for column in meta['columns']:
+            dtype = np.dtype(REPORT_TYPES[column['type']])
+            size = column['length'] * dtype.itemsize
+            device[column['name']] = np.frombuffer(
+                read_exact(stream, size), dtype=dtype)
+            skip_padding(stream, size)
+        yield device
+
+
+def gap_runs(device):
+    # Missing FCnt runs as (starts, lengths), from the FCnts received when
+    # the samples were kept, otherwise from the runs of the tracker
+    fcnt = device.get('fCnt')
+    if fcnt is not None and fcnt.size:
+        # Unique already, only reordered within the window of the tracker
+        fcnt = np.sort(fcnt).astype(np.int64)
+        step = np.diff(fcnt)
+        at = np.flatnonzero(step > 1)
+        return fcnt[at] + 1, step[at] - 1
+    pairs = device['gaps'].astype(np.int64).reshape(-1, 2)
+    return pairs[:, 0], pairs[:, 1]
+
+
+def bin_edges(size, points):
+    # Edges of at most 'points' bins of about the same size over [0, size)
+    return np.unique(np.linspace(0, size, min(points, size) + 1).astype(
+        np.int64))
+
+
+def downsample(values, points):
+    # (x, mean, min, max) of the bins of 'values', x being the bin center
+    if values.size == 0:
+        empty = np.empty(0)
+        return empty, empty, empty, empty
+    edges = bin_edges(values.size, points)
+    starts = edges[:-1]
+    values = values.astype(np.float64)
+    mean = np.add.reduceat(values, starts) / np.diff(edges)
+    return ((starts + edges[1:] + 1) / 2, mean,
+            np.minimum.reduceat(values, starts),
+            np.maximum.reduceat(values, starts))
+
+
+def loss_series(starts, lengths, expected, points):
+    # (x, loss rate) of the FCnt bins, from the runs: the FCnts missing
+    # before an edge are the runs starting before it, the last one cut there
+    if expected == 0:
+        return np.empty(0), np.empty(0)
+    edges = bin_edges(expected, points) + 1  # FCnts are 1 based
+    missing = np.zeros(edges.size)
+    if starts.size:
+        order = np.argsort(starts)
+        starts, lengths = starts[order], lengths[order]
+        before = np.concatenate(([0], np.cumsum(lengths)))
+        run = np.searchsorted(starts, edges, side='right') - 1
+        last = np.maximum(run, 0)
+        missing = np.where(
+            run >= 0,
+            before[last] + np.clip(edges - starts[last], 0, lengths[last]),
+            0)
+    return (edges[:-1] + edges[1:]) / 2, np.diff(missing) / np.diff(edges)
+
+
+def summarize(device, starts, lengths):
+    stats = device['stats']
+
+    def stat(name, field):
+        value = stats[name][field]
+        return '' if value is None else value
+
+    return {
+        'devAddr': stats['devAddr'],
+        'received': stats['received'],
+        'expected': stats['expected'],
+        'missing': stats['missing'],
+        'loss': stats['loss'],
+        'gaps': int(lengths.size),
+        'longestGap': int(lengths.max()) if lengths.size else 0,
+        'gapP99': float(np.percentile(lengths, 99)) if lengths.size else 0,
+        'failures': stats['failures'],
+        'duplicates': stats['duplicates'],
+        'late': stats['late'],
+        'rssiMean': stat('rssi', 'mean'),
+        'rssiStd': stat('rssi', 'std'),
+        'lsnrMean': stat('lsnr', 'mean'),
+        'lsnrStd': stat('lsnr', 'std'),
+        'encUsMean': stat('encUs', 'mean'),
+        'encUsStd': stat('encUs', 'std'),
+        'startMs': stats['startMs'],
+        'lastMs': stats['lastMs'],
+    }
+
+
+def plot_series(axes, series, title, ylabel):
+    x, mean, low, high = series
+    axes.fill_between(x, low, high, alpha=0.3, linewidth=0)
+    axes.plot(x, mean, linewidth=0.8)
+    axes.set_title(title)
+    axes.set_xlabel('Package number')
+    axes.set_ylabel(ylabel)
+
+
+def plot_device(plt, row, plot, path):
+    figure, axes = plt.subplots(5, 1, figsize=(10, 14))
+    plot_series(axes[0], plot['encUs'], 'MCU time encryption interval',
+                'Time (us)')
+    plot_series(axes[1], plot['lsnr'], 'LSNR', 'SNR')
+    plot_series(axes[2], plot['rssi'], 'RSSI', 'RSSI (dBm)')
+    x, counts = plot['failures']
+    axes[3].step(x, counts, where='mid', linewidth=0.8)
+    axes[3].set_title('Network server failed to decrypt package')
+    axes[3].set_xlabel('Package number')
+    axes[3].set_ylabel('Failures per bin')
+    x, loss = plot['loss']
+    axes[4].step(x, loss * 100, where='mid', linewidth=0.8)
+    axes[4].set_ylim(-1, 101)
+    axes[4].set_title('Network server failed to get package')
+    axes[4].set_xlabel('FCnt (from the first received)')
+    axes[4].set_ylabel('Loss (%)')
+    figure.suptitle('{} - loss {:.3f}%, {} runs, longest {}'.format(
+        row['devAddr'], row['loss'] * 100, row['gaps'], row['longestGap']))
+    figure.subplots_adjust(top=0.94, bottom=0.04, hspace=0.6)
+    figure.savefig(path)
+    plt.close(figure)
+
+
+def plot_overview(plt, rows, path):
+    loss = np.array([row['loss'] * 100 for row in rows])
+    rssi = np.array([np.nan if row['rssiMean'] == '' else row['rssiMean']
+                     for row in rows], dtype=np.float64)
+    figure, axes = plt.subplots(2, 1, figsize=(10, 8))
+    axes[0].hist(loss, bins=50)
+    axes[0].set_title('Loss of the {} devices'.format(len(rows)))
+    axes[0].set_xlabel('Loss (%)')
+    axes[0].set_ylabel('Devices')
+    axes[1].scatter(rssi, loss, s=4)
+    axes[1].set_title('Loss against mean RSSI')
+    axes[1].set_xlabel('RSSI (dBm)')
+    axes[1].set_ylabel('Loss (%)')
+    figure.subplots_adjust(hspace=0.4)
+    figure.savefig(path)
+    plt.close(figure)
+
+
+def print_summary(rows, limit):
+    # Devices with the most loss first
+    columns = ['devAddr', 'received', 'missing', 'loss', 'gaps',
+               'longestGap', 'failures', 'rssiMean', 'lsnrMean', 'encUsMean']
+    table = [columns]
+    for row in sorted(rows, key=lambda row: -row['loss'])[:limit]:
+        cells = []
+        for column in columns:
+            value = row[column]
+            if column == 'loss':
+                value = '{:.3f}%'.format(value * 100)
+            elif isinstance(value, float):
+                value = '{:.2f}'.format(value)
+            cells.append(str(value))
+        table.append(cells)
+    widths = [max(len(cells[i]) for cells in table)
+              for i in range(len(columns))]
+    for cells in table:
+        print('  '.join(cell.rjust(width)
+                        for cell, width in zip(cells, widths)))
+    if len(rows) > limit:
+        print('... {} more devices in summary.csv'.format(len(rows) - limit))
+
+
+def report(args):
+    import matplotlib
+    matplotlib.use('Agg')  # No display
+    import matplotlib.pyplot as plt
+
+    os.makedirs(args.out, exist_ok=True)
+    stream = sys.stdin.buffer if args.report == '-' else open(
+        args.report, 'rb')
+    rows = []
+    worst = []  # Heap of (loss, index, row, plot) of the devices to plot
+    with stream:
+        for index, device in enumerate(read_report(stream)):
+            starts, lengths = gap_runs(device)
+            row = summarize(device, starts, lengths)
+            rows.append(row)
+            if args.plots <= 0 or 'encUs' not in device:
+                continue
+            received = device['encUs'].size
+            failures = device['failures']
+            if received + failures.size == 0 or (
+                    len(worst) == args.plots and row['loss'] <= worst[0][0]):
+                continue
+            edges = bin_edges(received + failures.size, args.points) + 1
+            plot = {
+                'encUs': downsample(device['encUs'], args.points),
+                'lsnr': downsample(device['lsnr'], args.points),
+                'rssi': downsample(device['rssi'], args.points),
+                'failures': ((edges[:-1] + edges[1:]) / 2,
+                             np.histogram(failures, edges)[0]),
+                'loss': loss_series(starts, lengths, row['expected'],
+                                    args.points),
+            }
+            item = (row['loss'], index, row, plot)
+            if len(worst) < args.plots:
+                heapq.heappush(worst, item)
+            else:
+                heapq.heappushpop(worst, item)
+
+    with open(os.path.join(args.out, 'summary.csv'), 'w', newline='') as f:
+        writer = csv.DictWriter(f, fieldnames=SUMMARY_FIELDS)
+        writer.writeheader()
+        writer.writerows(rows)
+    if rows:
+        plot_overview(plt, rows, os.path.join(
+            args.out, 'overview.' + args.format))
+    for _, _, row, plot in worst:
+        plot_device(plt, row, plot, os.path.join(
+            args.out, '{}.{}'.format(row['devAddr'], args.format)))
+    print_summary(rows, args.table)
+
+
 def main():
     # get our data as an array from read_in()
     inputs = read_in()
@@ -48,6 +307,8 @@ def main():
     # get package rssi
     package_rssi = inputs[4]
 
+    import matplotlib.pyplot as plt
+
     # create array for package time elapsed
     np_package_time_elapsed = np.array(package_time_elapsed)
     np_x_package = np.arange(1, np_package_time_elapsed.size + 1, 1)
@@ -65,8 +326,8 @@ def main():
     np_package_failure = np.array(package_failure)
     if np_package_failure.size > 0:
         np_x_package_failure = np.arange(1, np_package_failure[-1] + 1, 1)
-        np_y_package_failure = np.array(
-            [0 if i in np_package_failure else 1 for i in np_x_package_failure])
+        np_y_package_failure = (~np.isin(
+            np_x_package_failure, np_package_failure)).astype(int)
         number_of_plot_row = number_of_plot_row + 1
 
     # create array for gateway missed package
@@ -74,17 +335,23 @@ def main():
     if np_package_gateway_missed.size > 0:
         np_x_package_gateway_missed = np.arange(
             1, np_package_gateway_missed[-1] + 1, 1)
-        np_y_package_gateway_missed = np.array(
-            [0 if i in np_package_gateway_missed else 1 for i in np_x_package_gateway_missed])
+        np_y_package_gateway_missed = (~np.isin(
+            np_x_package_gateway_missed, np_package_gateway_missed)).astype(
+                int)
         number_of_plot_row = number_of_plot_row + 1
 
+    def xticks(x):
+        # Every x-tick of the short runs only
+        if x.size <= 50:
+            plt.xticks(x)
+
     # plot
     plt.figure()
     idx = 1
     if number_of_plot_row >= 1:
         plt.subplot(number_of_plot_row, number_of_plot_col, idx)
         plt.plot(np_x_package, np_package_time_elapsed)
-        plt.xticks(np_x_package)  # Show all x-ticks
+        xticks(np_x_package)
         plt.title("MCU time encryption interval")
         plt.xlabel("Package number")
         plt.ylabel("Time (us)")
@@ -94,7 +361,7 @@ def main():
         idx = idx + 1
         plt.subplot(number_of_plot_row, number_of_plot_col, idx)
         plt.plot(np_x_package, np_package_lsnr)
-        plt.xticks(np_x_package)  # Show all x-ticks
+        xticks(np_x_package)
         plt.title("LSNR")
         plt.xlabel("Package number")
         plt.ylabel("SNR")
@@ -104,7 +371,7 @@ def main():
         idx = idx + 1
         plt.subplot(number_of_plot_row, number_of_plot_col, idx)
         plt.plot(np_x_package, np_package_rssi)
-        plt.xticks(np_x_package)  # Show all x-ticks
+        xticks(np_x_package)
         plt.title("RSSI")
         plt.xlabel("Package number")
         plt.ylabel("RSSI (dBm)")
@@ -116,7 +383,7 @@ def main():
         plt.ylim(-0.1, 1.1)
         plt.plot(np_x_package_failure, np_y_package_failure)
         plt.yticks([0, 1])  # Show only 0 and 1 on y-axis
-        plt.xticks(np_x_package_failure)  # Show all x-ticks
+        xticks(np_x_package_failure)
         plt.title("Network server decrypt package")
         plt.xlabel("Package number")
         plt.ylabel("Success rate")
@@ -128,7 +395,7 @@ def main():
         plt.ylim(-0.1, 1.1)
         plt.plot(np_x_package_gateway_missed, np_y_package_gateway_missed)
         plt.yticks([0, 1])  # Show only 0 and 1 on y-axis
-        plt.xticks(np_x_package_gateway_missed)  # Show all x-ticks
+        xticks(np_x_package_gateway_missed)
         plt.title("Network server failed to get package")
         plt.xlabel("Package number")
         plt.ylabel("Success rate")
@@ -138,6 +405,27 @@ def main():
     plt.show()
 
 
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description='Plot a reliability test, or report on many devices')
+    parser.add_argument('--report', metavar='PATH',
+                        help='report of reltrack.js, - for stdin')
+    parser.add_argument('--out', default='reports',
+                        help='directory of the report files')
+    parser.add_argument('--format', choices=['png', 'svg'], default='png')
+    parser.add_argument('--points', type=int, default=2000,
+                        help='bins of the plotted series')
+    parser.add_argument('--plots', type=int, default=16,
+                        help='devices plotted, the ones with the most loss')
+    parser.add_argument('--table', type=int, default=50,
+                        help='devices printed in the summary table')
+    return parser.parse_args()
+
+
 # start process
 if __name__ == '__main__':
-    main()
+    args = parse_args()
+    if args.report:
+        report(args)
+    else:
+        main()
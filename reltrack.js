@@ -0,0 +1,410 @@
+// Reliability test of the devices: every uplink of a device under test is
+// recorded in O(1), any number of devices can be under test at once and the
+// loss and gaps are known at any time without going over the uplinks again.
+//
+// Per device:
+// - the FCnt (16 bits on air, extended past the wrap) of the last
+//   RELIABILITY_WINDOW uplinks in a bitmap ring, so uplinks arriving out of
+//   order within the window are still counted. FCnts leaving the window are
+//   final, their missing runs are counted and kept as [start, length]
+// - running mean and variance (Welford) of the RSSI, LSNR and encryption
+//   time on the MCU
+// - the uplinks which failed to decode
+// - optionally the samples of every uplink in typed arrays, for the plots
+//
+// writeReliabilityReport streams the devices to reltest.py --report in a
+// columnar binary format, little-endian:
+//     [magic "RELR"][version u32][device count u32][reserved u32]
+//     per device: [meta size u32][reserved u32][meta JSON], then the columns
+//     listed in meta.columns as { name, type, length }, every part padded to
+//     8 bytes
+// meta is { stats, columns }, stats as returned by stats() and the columns
+// being the samples plus 'gaps', the [start, length] pairs of the runs.
+
+import { once } from 'events'
+
+const RELIABILITY_WINDOW = 1024 // FCnts, power of 2
+const WINDOW_WORDS = RELIABILITY_WINDOW / 32
+const FCNT_WRAP = 0x10000
+
+const createRunningStats = () => ({
+  count: 0,
+  mean: 0,
+  m2: 0,
+  min: Infinity,
+  max: -Infinity,
+})
+
+// Welford's online algorithm
+const addRunningStats = (s, x) => {
+  s.count++
+  const delta = x - s.mean
+  s.mean += delta / s.count
+  s.m2 += delta * (x - s.mean)
+  s.min = Math.min(s.min, x)
+  s.max = Math.max(s.max, x)
+}
+
+const summarizeRunningStats = (s) => ({
+  count: s.count,
+  mean: s.count ? s.mean : NaN,
+  std: s.count > 1 ? Math.sqrt(s.m2 / (s.count - 1)) : 0,
+  min: s.count ? s.min : NaN,
+  max: s.count ? s.max : NaN,
+})
+
+// Typed array growing by doubling, push is amortized O(1)
+const createColumn = (Type) => {
+  let data = new Type(1024)
+  let length = 0
+  return {
+    push: (value) => {
+      if (length === data.length) {
+        const grown = new Type(data.length * 2)
+        grown.set(data)
+        data = grown
+      }
+      data[length++] = value
+    },
+    get length() {
+      return length
+    },
+    // @retval View of the values pushed, valid until the next push
+    values: () => data.subarray(0, length),
+  }
+}
+
+const createDevice = (devAddr, timeMs, keepSamples) => ({
+  devAddr,
+  startMs: timeMs,
+  lastMs: timeMs,
+  first: -1, // Extended FCnt of the first uplink, -1 before it
+  high: -1, // Highest extended FCnt received
+  window: new Uint32Array(WINDOW_WORDS),
+  received: 0,
+  duplicates: 0,
+  late: 0, // Older than the window, not counted
+  failures: 0,
+  // Final part, the FCnts below the window
+  missing: 0,
+  openGap: 0, // Missing run reaching the window
+  gaps: createColumn(Uint32Array), // start, length pairs
+  longestGap: 0,
+  rssi: createRunningStats(),
+  lsnr: createRunningStats(),
+  encUs: createRunningStats(),
+  samples: keepSamples
+    ? {
+        fCnt: createColumn(Uint32Array),
+        encUs: createColumn(Uint32Array),
+        rssi: createColumn(Float32Array),
+        lsnr: createColumn(Float32Array),
+        failures: createColumn(Uint32Array),
+      }
+    : null,
+})
+
+const closeGap = (device, end) => {
+  if (device.openGap) {
+    device.gaps.push(end - device.openGap - device.first + 1)
+    device.gaps.push(device.openGap)
+    device.longestGap = Math.max(device.longestGap, device.openGap)
+    device.openGap = 0
+  }
+}
+
+// Move the window up to end at 'high', the FCnts leaving it are final
+const advanceWindow = (device, high) => {
+  const from = Math.max(device.first, device.high - RELIABILITY_WINDOW + 1)
+  const to = high - RELIABILITY_WINDOW // Last FCnt leaving the window
+  let fCnt = from
+  for (; fCnt <= to && fCnt <= device.high; fCnt++) {
+    const bit = fCnt & (RELIABILITY_WINDOW - 1)
+    const word = bit >>> 5
+    const mask = 1 << (bit & 31)
+    if (device.window[word] & mask) {
+      closeGap(device, fCnt)
+      device.window[word] &= ~mask
+    } else {
+      device.missing++
+      device.openGap++
+    }
+  }
+  // Jumped past the whole window, none of these were received
+  if (fCnt <= to) {
+    device.missing += to - fCnt + 1
+    device.openGap += to - fCnt + 1
+  }
+  device.high = high
+}
+
+// Runs of the window, [start, length] relative to the first FCnt (1 based)
+// @param visit (start, length) for every missing run, the open one included
+const visitWindowGaps = (device, visit) => {
+  if (device.high < 0) {
+    return
+  }
+  let run = device.openGap
+  const from = Math.max(device.first, device.high - RELIABILITY_WINDOW + 1)
+  for (let fCnt = from; fCnt <= device.high; fCnt++) {
+    const bit = fCnt & (RELIABILITY_WINDOW - 1)
+    if (device.window[bit >>> 5] & (1 << (bit & 31))) {
+      if (run) {
+        visit(fCnt - run - device.first + 1, run)
+        run = 0
+      }
+    } else {
+      run++
+    }
+  }
+}
+
+// @param options { keepSamples }, keepSamples false keeps only the counters
+// and statistics, not the samples of every uplink
+export const createReliabilityTracker = ({ keepSamples = true } = {}) => {
+  const devices = new Map() // DevAddr -> device
+
+  // Extend the 16-bit FCnt from the highest one received
+  const extendFCnt = (device, fCnt) => {
+    if (device.high < 0) {
+      return fCnt
+    }
+    const delta = (fCnt - (device.high % FCNT_WRAP) + FCNT_WRAP) % FCNT_WRAP
+    return delta < FCNT_WRAP / 2
+      ? device.high + delta
+      : device.high - (FCNT_WRAP - delta)
+  }
+
+  const tracker = {
+    // @retval false if the device is already under test
+    start: (devAddr, timeMs = Date.now()) => {
+      if (devices.has(devAddr)) {
+        return false
+      }
+      devices.set(devAddr, createDevice(devAddr, timeMs, keepSamples))
+      return true
+    },
+    // @retval The stats of the device, null if it was not under test
+    stop: (devAddr) => {
+      const device = devices.get(devAddr)
+      if (!device) {
+        return null
+      }
+      devices.delete(devAddr)
+      return summarize(device)
+    },
+    has: (devAddr) => devices.has(devAddr),
+    // @retval Uplinks of the device counted so far, without going over its
+    // window as stats() does
+    received: (devAddr) => devices.get(devAddr)?.received ?? 0,
+    devAddrs: () => [...devices.keys()],
+    get size() {
+      return devices.size
+    },
+    // @param fCnt FCnt of the uplink, 16 or 32 bits
+    // @param encUs Time the MCU took to encrypt it, in us
+    // @retval false if the device is not under test
+    recordUplink: (devAddr, fCnt, encUs, rssi, lsnr, timeMs = Date.now()) => {
+      const device = devices.get(devAddr)
+      if (!device) {
+        return false
+      }
+      device.lastMs = timeMs
+      const extended = extendFCnt(device, fCnt)
+      if (device.high < 0) {
+        device.first = extended
+        device.high = extended
+      } else if (extended > device.high) {
+        advanceWindow(device, extended)
+      } else if (
+        extended < device.first ||
+        extended <= device.high - RELIABILITY_WINDOW
+      ) {
+        device.late++
+        return true
+      }
+      const bit = extended & (RELIABILITY_WINDOW - 1)
+      const mask = 1 << (bit & 31)
+      if (device.window[bit >>> 5] & mask) {
+        device.duplicates++
+        return true
+      }
+      device.window[bit >>> 5] |= mask
+      device.received++
+      addRunningStats(device.rssi, rssi)
+      addRunningStats(device.lsnr, lsnr)
+      addRunningStats(device.encUs, encUs)
+      if (device.samples) {
+        device.samples.fCnt.push(extended - device.first + 1)
+        device.samples.encUs.push(encUs)
+        device.samples.rssi.push(rssi)
+        device.samples.lsnr.push(lsnr)
+      }
+      return true
+    },
+    // An uplink of the device which failed to decode
+    // @retval false if the device is not under test
+    recordFailure: (devAddr, timeMs = Date.now()) => {
+      const device = devices.get(devAddr)
+      if (!device) {
+        return false
+      }
+      device.lastMs = timeMs
+      device.failures++
+      // Position among the uplinks received, as the plots number them
+      device.samples?.failures.push(device.received + device.failures)
+      return true
+    },
+    // @retval See summarize(), null if the device is not under test
+    stats: (devAddr) => {
+      const device = devices.get(devAddr)
+      return device ? summarize(device) : null
+    },
+    // @retval Array of [start, length] of the missing FCnt runs, start
+    // relative to the first FCnt received (1 based)
+    gaps: (devAddr) => {
+      const device = devices.get(devAddr)
+      if (!device) {
+        return null
+      }
+      const pairs = device.gaps.values()
+      const gaps = []
+      for (let i = 0; i < pairs.length; i += 2) {
+        gaps.push([pairs[i], pairs[i + 1]])
+      }
+      visitWindowGaps(device, (start, length) => gaps.push([start, length]))
+      return gaps
+    },
+    // @retval { stats, gaps, samples } for writeReliabilityReport, gaps being
+    // the [start, length] pairs flattened in a Uint32Array
+    report: (devAddr) => {
+      const device = devices.get(devAddr)
+      if (!device) {
+        return null
+      }
+      const gaps = createColumn(Uint32Array)
+      const pairs = device.gaps.values()
+      pairs.forEach((value) => gaps.push(value))
+      visitWindowGaps(device, (start, length) => {
+        gaps.push(start)
+        gaps.push(length)
+      })
+      return {
+        stats: summarize(device),
+        gaps: gaps.values(),
+        samples: device.samples && tracker.samples(devAddr),
+      }
+    },
+    // @retval { fCnt, encUs, rssi, lsnr, failures } typed arrays, one
+    // element per uplink received (fCnt relative to the first, 1 based),
+    // failures their position as in recordFailure(). null without samples
+    samples: (devAddr) => {
+      const samples = devices.get(devAddr)?.samples
+      if (!samples) {
+        return null
+      }
+      return Object.fromEntries(
+        Object.entries(samples).map(([name, column]) => [
+          name,
+          column.values(),
+        ])
+      )
+    },
+  }
+  return tracker
+}
+
+// @retval { devAddr, startMs, lastMs, received, expected, missing, loss,
+// gaps, longestGap, duplicates, late, failures, rssi, lsnr, encUs }, the
+// last three being { count, mean, std, min, max }
+const summarize = (device) => {
+  let missing = device.missing
+  let gaps = device.gaps.length / 2
+  let longestGap = device.longestGap
+  visitWindowGaps(device, (start, length) => {
+    gaps++
+    longestGap = Math.max(longestGap, length)
+  })
+  // Plus the FCnts of the window not received yet
+  const from = Math.max(device.first, device.high - RELIABILITY_WINDOW + 1)
+  for (let fCnt = from; device.high >= 0 && fCnt <= device.high; fCnt++) {
+    const bit = fCnt & (RELIABILITY_WINDOW - 1)
+    if (!(device.window[bit >>> 5] & (1 << (bit & 31)))) {
+      missing++
+    }
+  }
+  const expected = device.high < 0 ? 0 : device.high - device.first + 1
+  return {
+    devAddr: device.devAddr,
+    startMs: device.startMs,
+    lastMs: device.lastMs,
+    received: device.received,
+    expected,
+    missing,
+    loss: expected ? missing / expected : 0,
+    gaps,
+    longestGap,
+    duplicates: device.duplicates,
+    late: device.late,
+    failures: device.failures,
+    rssi: summarizeRunningStats(device.rssi),
+    lsnr: summarizeRunningStats(device.lsnr),
+    encUs: summarizeRunningStats(device.encUs),
+  }
+}
+
+const REPORT_MAGIC = 'RELR'
+const REPORT_VERSION = 1
+const REPORT_TYPES = new Map([
+  [Uint32Array, 'u4'],
+  [Float32Array, 'f4'],
+])
+
+const padReport = (size) => Buffer.alloc((8 - (size % 8)) % 8)
+
+// @param stream Writable, e.g the stdin of reltest.py --report -
+// @param reports Array of report() results, of devices stopped since (their
+// columns must not grow until written)
+// @retval Promise resolved once everything is written, the stream is left
+// open
+export const writeReliabilityReport = async (stream, reports) => {
+  const write = async (buffer) => {
+    if (buffer.length && !stream.write(buffer)) {
+      await once(stream, 'drain')
+    }
+  }
+  const header = Buffer.alloc(16)
+  header.write(REPORT_MAGIC, 0, 'latin1')
+  header.writeUInt32LE(REPORT_VERSION, 4)
+  header.writeUInt32LE(reports.length, 8)
+  await write(header)
+  for (const { stats, gaps, samples } of reports) {
+    const columns = Object.entries({ ...samples, gaps })
+    const meta = Buffer.from(
+      JSON.stringify({
+        stats,
+        columns: columns.map(([name, values]) => ({
+          name,
+          type: REPORT_TYPES.get(values.constructor),
+          length: values.length,
+        })),
+      })
+    )
+    const metaHeader = Buffer.alloc(8)
+    metaHeader.writeUInt32LE(meta.length, 0)
+    await write(metaHeader)
+    await write(meta)
+    await write(padReport(meta.length))
+    for (const [, values] of columns) {
+      // Typed arrays are in the byte order of the host, little-endian on
+      // the targets of the addon. Not copied, see reports above
+      const data = Buffer.from(
+        values.buffer,
+        values.byteOffset,
+        values.byteLength
+      )
+      await write(data)
+      await write(padReport(data.length))
+    }
+  }
+}